@@ -325,6 +325,23 @@ typedef struct __ST_LHDC_AR_GYRO
 } ST_LHDC_AR_GYRO, *PST_LHDC_AR_GYRO;
 #pragma pack(pop)
 
+//
+// Staged extended functions: set without the packed config, changes are
+// staged, then lhdcBT_ext_commit () hands them all to the encoder, which
+// applies them together before its next frame
+//
+#define LHDCBT_AR_POS_NUM           6
+#define LHDCBT_AR_GAIN_NUM          32
+#define LHDCBT_META_LEN_MAX         255     // meta_metadata_length of ST_LHDC_SET_META
+#define LHDCBT_META_LOOP_CNT_MAX    255     // meta_set of ST_LHDC_SET_META
+
+// same values as ST_LHDC_AR
+typedef struct _lhdcBT_ar_cfg_t {
+    bool    enabled;                        // app_ar_enabled
+    int     pos[LHDCBT_AR_POS_NUM];         // Ch1_Pos ~ Ch6_Pos
+    float   gain[LHDCBT_AR_GAIN_NUM];       // Ch1_L_PreGain ~ ThreeD_gain, in ST_LHDC_AR order
+} lhdcBT_ar_cfg_t;
+
 #ifdef NEW_API_SET
 //for NEW API used!!!!
 typedef struct {
@@ -385,6 +402,18 @@ void lhdcBT_set_user_exdata(HANDLE_LHDC_BT handle, char* userConfig, int clen);
 // 4. API -- Get Version 
 int lhdcBT_get_user_exApiver(HANDLE_LHDC_BT handle, char *version, int clen);
 
+//
+// Staged extended functions, see lhdcBT_ar_cfg_t; return EXTEND_FUNC_RET_*.
+// A commit that the encoder has not taken yet is merged with the next one,
+// later changes win. The packed lhdcBT_set_user_exconfig () still applies
+// right away.
+//
+int lhdcBT_ext_stage_state(HANDLE_LHDC_BT handle, lhdcBT_ext_func_field_t field, bool enabled);
+int lhdcBT_ext_stage_meta(HANDLE_LHDC_BT handle, bool enabled, const unsigned char *data, int data_len, int loop_cnt);
+int lhdcBT_ext_stage_ar(HANDLE_LHDC_BT handle, const lhdcBT_ar_cfg_t *cfg);
+int lhdcBT_ext_commit(HANDLE_LHDC_BT handle);
+int lhdcBT_ext_discard(HANDLE_LHDC_BT handle);
+
 #endif
 #ifdef __cplusplus
 }
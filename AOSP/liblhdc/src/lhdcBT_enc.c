@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "lhdcBT.h"
 #include "lhdc_process.h"
 #include "lhdc_cfg.h"
@@ -31,6 +32,41 @@ static uint32_t gABR_table_index = 0;
 
 #define AR_ALWAYS_ONx  1
 
+// Staged extended functions: lhdcBT_ext_set_t.mask bits
+#define LHDCBT_EXT_STATE(field)   (1u << (field))   // lhdcBT_ext_func_field_t on/off
+#define LHDCBT_EXT_META           (1u << 8)         // META state with its data
+#define LHDCBT_EXT_AR_CFG         (1u << 9)         // AR positions and gains, with AR on/off
+// frames the encoder skips a busy ext_lock for before it waits on it
+#define LHDCBT_EXT_TRY_FRAMES     4
+
+typedef struct _lhdcBT_ext_set_t {
+    uint32_t mask;                      // LHDCBT_EXT_* items held
+    bool state[LHDCBT_EXT_FUNC_MAX];
+    bool meta_enabled;
+    int meta_len;
+    int meta_loop_cnt;
+    unsigned char meta[LHDCBT_META_LEN_MAX];
+    lhdcBT_ar_cfg_t ar;
+} lhdcBT_ext_set_t;
+
+// What a handle points to. The library only sees the lhdc_cb_t in front,
+// the staged extended functions behind it are the wrapper's own.
+typedef struct _lhdcBT_enc_cb_t {
+    lhdc_cb_t cb;
+
+    // lhdcBT_ext_stage_* () fill ext_staged, lhdcBT_ext_commit () merges it
+    // into ext_pending and raises ext_committed; the encoder only tries
+    // ext_lock, so a commit in progress delays the apply by a frame or more
+    pthread_mutex_t ext_lock;
+    lhdcBT_ext_set_t ext_staged;
+    lhdcBT_ext_set_t ext_pending;
+    int ext_committed;                  // read without the lock
+    lhdcBT_ext_set_t ext_taken;         // encoder thread only
+    uint32_t ext_busy_frames;           // frames ext_lock was found busy in a row
+} lhdcBT_enc_cb_t;
+
+static void lhdcBT_ext_apply(HANDLE_LHDC_BT handle);
+
 
 static const char * rate_to_string(LHDCBT_QUALITY_T q){
     switch (q) {
@@ -387,6 +423,7 @@ void lhdcBT_free_handle(HANDLE_LHDC_BT handle) {
 
     ar_process_free(lhdcBT->ar_filter);
 
+    pthread_mutex_destroy(&((lhdcBT_enc_cb_t *)lhdcBT)->ext_lock);
     free(lhdcBT);
 }
 
@@ -399,8 +436,15 @@ HANDLE_LHDC_BT lhdcBT_get_handle(int version){
       return NULL;
     }
 
-    lhdc_cb_t * lhdcBT = (lhdc_cb_t *)malloc(sizeof(lhdc_cb_t));
-    memset(lhdcBT, 0 , sizeof(lhdc_cb_t));
+    lhdcBT_enc_cb_t * encCb = (lhdcBT_enc_cb_t *)malloc(sizeof(lhdcBT_enc_cb_t));
+    if (!encCb)
+    {
+        ALOGE("%s: Out of memory!!!", __func__);
+        return NULL;
+    }
+    memset(encCb, 0 , sizeof(lhdcBT_enc_cb_t));
+    pthread_mutex_init(&encCb->ext_lock, NULL);
+    lhdc_cb_t * lhdcBT = &encCb->cb;
 
 #ifdef AR_ALWAYS_ON
     lhdcBT->ar_filter = ar_process_new();
@@ -420,7 +464,8 @@ HANDLE_LHDC_BT lhdcBT_get_handle(int version){
         lhdcBT->enc_type = ENC_TYPE_LLAC;
     }else{
         lhdcBT->enc_type = ENC_TYPE_UNKNOWN;
-        free(lhdcBT);
+        pthread_mutex_destroy(&encCb->ext_lock);
+        free(encCb);
         lhdcBT = NULL;
     }
 
@@ -561,6 +606,8 @@ int lhdcBT_encode(HANDLE_LHDC_BT handle, void* p_pcm, unsigned char* p_stream){
     }
     enc_t * enc = &lhdcBT->enc;
 
+    lhdcBT_ext_apply(handle);
+
     switch(lhdcBT->enc_type){
         case ENC_TYPE_LHDC:
             return lhdc_encoder_encode(enc->lhdc, p_pcm, p_stream);
@@ -606,6 +653,8 @@ int lhdcBT_encodeV3(HANDLE_LHDC_BT handle, void* p_pcm, unsigned char* out_put,
         return -1;
     }
 
+    lhdcBT_ext_apply(handle);
+
     return lhdc_util_encv4_process( handle, p_pcm, out_put, written, out_frames);
 }
 
@@ -1585,3 +1634,246 @@ int lhdcBT_get_user_exApiver(HANDLE_LHDC_BT handle, char *version, int clen) {
     return result;
 }
 
+
+/*
+******************************************************************
+ Staged extended functions group
+******************************************************************
+*/
+
+static bool lhdcBT_ext_state_supported(lhdc_enc_type_t type, lhdcBT_ext_func_field_t field) {
+    switch(type){
+        case ENC_TYPE_LHDC:
+            return field == LHDCBT_EXT_FUNC_AR || field == LHDCBT_EXT_FUNC_JAS;
+        case ENC_TYPE_LLAC:
+            return field == LHDCBT_EXT_FUNC_AR || field == LHDCBT_EXT_FUNC_LARC;
+        default:
+            return false;
+    }
+}
+
+// Copy the items of a newer set of changes over an older one. The AR on/off
+// travels with a staged AR config, so that the later of the two wins.
+static void lhdcBT_ext_merge(lhdcBT_ext_set_t * dst, const lhdcBT_ext_set_t * src) {
+    int i;
+
+    if (src->mask & LHDCBT_EXT_AR_CFG) {
+        dst->ar = src->ar;
+        dst->mask = (dst->mask & ~LHDCBT_EXT_STATE(LHDCBT_EXT_FUNC_AR)) | LHDCBT_EXT_AR_CFG;
+    }
+
+    for (i = 0; i < LHDCBT_EXT_FUNC_MAX; i++) {
+        if (!(src->mask & LHDCBT_EXT_STATE(i))) {
+            continue;
+        }
+        if (i == LHDCBT_EXT_FUNC_AR && (dst->mask & LHDCBT_EXT_AR_CFG)) {
+            dst->ar.enabled = src->state[i];
+            continue;
+        }
+        dst->state[i] = src->state[i];
+        dst->mask |= LHDCBT_EXT_STATE(i);
+    }
+
+    if (src->mask & LHDCBT_EXT_META) {
+        dst->meta_enabled = src->meta_enabled;
+        dst->meta_len = src->meta_len;
+        dst->meta_loop_cnt = src->meta_loop_cnt;
+        memcpy(dst->meta, src->meta, src->meta_len);
+        dst->mask |= LHDCBT_EXT_META;
+    }
+}
+
+// Hand committed changes to the encoder, all of them between two frames;
+// called once per encoded frame on the encode thread.
+static void lhdcBT_ext_apply(HANDLE_LHDC_BT handle) {
+    lhdcBT_enc_cb_t * encCb = (lhdcBT_enc_cb_t *)handle;
+    lhdc_cb_t * lhdcBT = &encCb->cb;
+    lhdcBT_ext_set_t * set = &encCb->ext_taken;
+    int i;
+
+    if (!__atomic_load_n(&encCb->ext_committed, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    // a commit is in progress, take it with a later frame; the lock is only
+    // held for copies, so wait once steady commits kept it busy for a few frames
+    if (encCb->ext_busy_frames < LHDCBT_EXT_TRY_FRAMES) {
+        if (pthread_mutex_trylock(&encCb->ext_lock) != 0) {
+            encCb->ext_busy_frames++;
+            return;
+        }
+    } else {
+        pthread_mutex_lock(&encCb->ext_lock);
+    }
+    encCb->ext_busy_frames = 0;
+    set->mask = 0;
+    lhdcBT_ext_merge(set, &encCb->ext_pending);
+    encCb->ext_pending.mask = 0;
+    __atomic_store_n(&encCb->ext_committed, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&encCb->ext_lock);
+
+    for (i = 0; i < LHDCBT_EXT_FUNC_MAX; i++) {
+        if ((set->mask & LHDCBT_EXT_STATE(i)) &&
+            lhdcBT_set_ext_func_state(handle, (lhdcBT_ext_func_field_t)i, set->state[i], NULL, 0) != 0) {
+            ALOGW("%s: failed to set ext. function %d state!", __func__, i);
+        }
+    }
+
+    if ((set->mask & LHDCBT_EXT_META) && lhdcBT->enc_type == ENC_TYPE_LHDC) {
+        LhdcExtFuncMetaEnable(lhdcBT->enc.lhdc->fft_blk, set->meta_enabled ? 1 : 0,
+                              set->meta, set->meta_len, set->meta_loop_cnt);
+    }
+
+    if (set->mask & LHDCBT_EXT_AR_CFG) {
+        Ar_set_ext_func_state(handle, set->ar.enabled);
+        if (lhdc_util_get_ext_func_state(lhdcBT->enc_type, &lhdcBT->enc, EXT_FUNC_AR) &&
+            ar_set_cfg(lhdcBT->ar_filter, set->ar.pos, set->ar.gain, set->ar.enabled ? 1 : 0) != 0) {
+            ALOGW("%s: failed to set AR config!", __func__);
+        }
+    }
+
+    ALOGD("%s: ext. function changes 0x%X applied", __func__, set->mask);
+}
+
+// 1. Stage the on/off state of an ext. function that takes no data
+int lhdcBT_ext_stage_state(HANDLE_LHDC_BT handle, lhdcBT_ext_func_field_t field, bool enabled) {
+    lhdcBT_enc_cb_t * encCb = (lhdcBT_enc_cb_t *)handle;
+    lhdcBT_ext_set_t * staged;
+
+    if (handle == NULL) {
+        ALOGE("(LHDC-exAPI) %s: Handle error!(%p)",  __func__, handle);
+        return EXTEND_FUNC_RET_INVALID_HANDLE;
+    }
+
+    if (field < LHDCBT_EXT_FUNC_AR || field >= LHDCBT_EXT_FUNC_MAX)
+    {
+        ALOGE("(LHDC-exAPI) %s: invalid field (%d) !!!", __func__, field);
+        return EXTEND_FUNC_RET_INVALID_PARAMETER;
+    }
+
+    if (!lhdcBT_ext_state_supported(encCb->cb.enc_type, field))
+    {
+        ALOGE("(LHDC-exAPI) %s: field (%d) not supported by encoder (%d)", __func__, field, encCb->cb.enc_type);
+        return EXTEND_FUNC_RET_FUNC_NOT_SUPPORT;
+    }
+
+    pthread_mutex_lock(&encCb->ext_lock);
+    staged = &encCb->ext_staged;
+    if (field == LHDCBT_EXT_FUNC_AR && (staged->mask & LHDCBT_EXT_AR_CFG)) {
+        staged->ar.enabled = enabled;
+    } else {
+        staged->state[field] = enabled;
+        staged->mask |= LHDCBT_EXT_STATE(field);
+    }
+    pthread_mutex_unlock(&encCb->ext_lock);
+
+    return EXTEND_FUNC_RET_OK;
+}
+
+// 2. Stage the META state and data, the same values as ST_LHDC_SET_META
+int lhdcBT_ext_stage_meta(HANDLE_LHDC_BT handle, bool enabled, const unsigned char * data,
+    int data_len, int loop_cnt) {
+    lhdcBT_enc_cb_t * encCb = (lhdcBT_enc_cb_t *)handle;
+    lhdcBT_ext_set_t * staged;
+
+    if (handle == NULL) {
+        ALOGE("(LHDC-exAPI) %s: Handle error!(%p)",  __func__, handle);
+        return EXTEND_FUNC_RET_INVALID_HANDLE;
+    }
+
+    if ((data == NULL && data_len > 0) ||
+        data_len < 0 || data_len > LHDCBT_META_LEN_MAX ||
+        loop_cnt < 0 || loop_cnt > LHDCBT_META_LOOP_CNT_MAX)
+    {
+        ALOGE("(LHDC-exAPI) %s: invalid META data (%p, %d bytes, loop %d)", __func__, data, data_len, loop_cnt);
+        return EXTEND_FUNC_RET_INVALID_PARAMETER;
+    }
+
+    if (encCb->cb.enc_type != ENC_TYPE_LHDC)
+    {
+        ALOGE("(LHDC-exAPI) %s: META not supported by encoder (%d)", __func__, encCb->cb.enc_type);
+        return EXTEND_FUNC_RET_FUNC_NOT_SUPPORT;
+    }
+
+    pthread_mutex_lock(&encCb->ext_lock);
+    staged = &encCb->ext_staged;
+    staged->meta_enabled = enabled;
+    staged->meta_len = data_len;
+    staged->meta_loop_cnt = loop_cnt;
+    if (data_len > 0) {
+        memcpy(staged->meta, data, data_len);
+    }
+    staged->mask |= LHDCBT_EXT_META;
+    pthread_mutex_unlock(&encCb->ext_lock);
+
+    return EXTEND_FUNC_RET_OK;
+}
+
+// 3. Stage the AR config, positions and gains always change together
+int lhdcBT_ext_stage_ar(HANDLE_LHDC_BT handle, const lhdcBT_ar_cfg_t * cfg) {
+    lhdcBT_enc_cb_t * encCb = (lhdcBT_enc_cb_t *)handle;
+    lhdcBT_ext_set_t * staged;
+
+    if (handle == NULL) {
+        ALOGE("(LHDC-exAPI) %s: Handle error!(%p)",  __func__, handle);
+        return EXTEND_FUNC_RET_INVALID_HANDLE;
+    }
+
+    if (cfg == NULL)
+    {
+        ALOGE("(LHDC-exAPI) %s: AR config error!(%p)",  __func__, cfg);
+        return EXTEND_FUNC_RET_INVALID_PARAMETER;
+    }
+
+    if (encCb->cb.ar_filter == NULL)
+    {
+        ALOGE("(LHDC-exAPI) %s: AR not supported by this handle", __func__);
+        return EXTEND_FUNC_RET_FUNC_NOT_SUPPORT;
+    }
+
+    pthread_mutex_lock(&encCb->ext_lock);
+    staged = &encCb->ext_staged;
+    staged->ar = *cfg;
+    staged->mask = (staged->mask & ~LHDCBT_EXT_STATE(LHDCBT_EXT_FUNC_AR)) | LHDCBT_EXT_AR_CFG;
+    pthread_mutex_unlock(&encCb->ext_lock);
+
+    return EXTEND_FUNC_RET_OK;
+}
+
+// 4. Hand the staged changes to the encoder, which applies all of them
+//    before its next frame; merged with an earlier commit it has not taken yet
+int lhdcBT_ext_commit(HANDLE_LHDC_BT handle) {
+    lhdcBT_enc_cb_t * encCb = (lhdcBT_enc_cb_t *)handle;
+
+    if (handle == NULL) {
+        ALOGE("(LHDC-exAPI) %s: Handle error!(%p)",  __func__, handle);
+        return EXTEND_FUNC_RET_INVALID_HANDLE;
+    }
+
+    pthread_mutex_lock(&encCb->ext_lock);
+    if (encCb->ext_staged.mask != 0) {
+        lhdcBT_ext_merge(&encCb->ext_pending, &encCb->ext_staged);
+        __atomic_store_n(&encCb->ext_committed, 1, __ATOMIC_RELAXED);
+        ALOGD("(LHDC-exAPI) %s: ext. function changes 0x%X committed", __func__, encCb->ext_staged.mask);
+        encCb->ext_staged.mask = 0;
+    }
+    pthread_mutex_unlock(&encCb->ext_lock);
+
+    return EXTEND_FUNC_RET_OK;
+}
+
+// 5. Drop the changes staged since the last commit
+int lhdcBT_ext_discard(HANDLE_LHDC_BT handle) {
+    lhdcBT_enc_cb_t * encCb = (lhdcBT_enc_cb_t *)handle;
+
+    if (handle == NULL) {
+        ALOGE("(LHDC-exAPI) %s: Handle error!(%p)",  __func__, handle);
+        return EXTEND_FUNC_RET_INVALID_HANDLE;
+    }
+
+    pthread_mutex_lock(&encCb->ext_lock);
+    encCb->ext_staged.mask = 0;
+    pthread_mutex_unlock(&encCb->ext_lock);
+
+    return EXTEND_FUNC_RET_OK;
+}
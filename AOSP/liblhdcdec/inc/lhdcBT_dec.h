@@ -7,6 +7,7 @@ extern "C" {
 #endif
 
 #include "lhdcUtil.h"
+#include "lhdc_dec_trace.h"
 
 
 
@@ -15,14 +16,30 @@ typedef struct
   lhdc_ver_t version;
   uint32_t   sample_rate;
   uint8_t    bits_depth;
+  uint8_t    channel;       // lhdc_channel_t, LEFT/RIGHT decode one half of split (TWS) frames as mono
 } tLHDCV3_DEC_CONFIG;
 
+// decoder instance, state of one stream
+typedef void * HANDLE_LHDCV3_BT;
+
 
 
 int lhdcBT_dec_init_decoder(tLHDCV3_DEC_CONFIG *config);
 int lhdcBT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t frameBytes, uint32_t *packetBytes);
 int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pcmData, uint32_t* pcmBytes, uint32_t bits_depth);
 int lhdcBT_dec_deinit_decoder(void);
+int lhdcBT_dec_dump_trace(lhdc_dec_trace_rec_t *recs, uint32_t maxNum, uint32_t *recNum);
+
+// handle-based API. The util decoder below the wrapper is a single global
+// instance, so only one instance (a handle, or the one set up by the legacy
+// init) can be live at a time; another init returns LHDCBT_DEC_FUNC_DECODER_BUSY
+// until it is deinitialized. The legacy check/decode/trace APIs operate on the
+// live instance.
+int lhdcBT_dec_init_decoder_r(HANDLE_LHDCV3_BT *handle, tLHDCV3_DEC_CONFIG *config);
+int lhdcBT_dec_check_frame_data_enough_r(HANDLE_LHDCV3_BT handle, const uint8_t *frameData, uint32_t frameBytes, uint32_t *packetBytes);
+int lhdcBT_dec_decode_r(HANDLE_LHDCV3_BT handle, const uint8_t *frameData, uint32_t frameBytes, uint8_t* pcmData, uint32_t* pcmBytes);
+int lhdcBT_dec_deinit_decoder_r(HANDLE_LHDCV3_BT handle);
+int lhdcBT_dec_dump_trace_r(HANDLE_LHDCV3_BT handle, lhdc_dec_trace_rec_t *recs, uint32_t maxNum, uint32_t *recNum);
 
 
 #define LHDCBT_DEC_NOT_UPD_SEQ_NO			0
@@ -34,6 +51,7 @@ int lhdcBT_dec_deinit_decoder(void);
 #define LHDCBT_DEC_FUNC_INPUT_NOT_ENOUGH    -2
 #define LHDCBT_DEC_FUNC_OUTPUT_NOT_ENOUGH   -3
 #define LHDCBT_DEC_FUNC_INVALID_SEQ_NO		-4
+#define LHDCBT_DEC_FUNC_DECODER_BUSY		-5
 
 #ifdef __cplusplus
 }
@@ -4,16 +4,70 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "lhdcBT_dec.h"
+#include "lhdc_dec_trace.h"
 
 
 #define LOG_NDEBUG 0
 #define LOG_TAG "lhdcBT_dec"
 #include <cutils/log.h>
 
-static uint8_t serial_no = 0xff;
+// Per-stream decoder state. HANDLE_LHDCV3_BT returned by lhdcBT_dec_init_decoder_r
+// points to one of these.
+typedef struct _lhdcBT_dec_ctx
+{
+	tLHDCV3_DEC_CONFIG config;
+	uint8_t serial_no;
+	uint32_t frame_samples;
+	lhdc_dec_trace_ring_t trace;
+} lhdcBT_dec_ctx_t;
+
+// instance set up by the legacy (handle-less) init API
+static lhdcBT_dec_ctx_t default_ctx = { .serial_no = 0xff };
+
+// The util decoder is one global instance (its APIs take no handle), so it
+// belongs to one wrapper instance at a time. The owner is also the instance
+// used by the legacy check/decode/trace APIs.
+static pthread_mutex_t owner_lock = PTHREAD_MUTEX_INITIALIZER;
+static lhdcBT_dec_ctx_t *owner_ctx = NULL;
+
+static int assemble_lhdc_packet(lhdcBT_dec_ctx_t *ctx, uint8_t *input, uint32_t input_len, uint8_t **pLout, uint32_t *pLlen, int upd_seq_no);
+
+// description
+//   pin the instance used by the legacy (handle-less) APIs, owner_lock is held
+//   until unlock_lhdc_owner so a concurrent deinit cannot free it meanwhile
+// return:
+//   owner of the util decoder, NULL when none is live
+static lhdcBT_dec_ctx_t *lock_lhdc_owner(void)
+{
+	pthread_mutex_lock(&owner_lock);
 
-static int assemble_lhdc_packet(uint8_t *input, uint32_t input_len, uint8_t **pLout, uint32_t *pLlen, int upd_seq_no);
+	return owner_ctx;
+}
+
+// description
+//   unpin the instance returned by lock_lhdc_owner
+static void unlock_lhdc_owner(void)
+{
+	pthread_mutex_unlock(&owner_lock);
+}
+
+// description
+//   destroy the util decoder if an instance owns it, the instance memory is
+//   left to the caller
+// Parameter
+//   ctx: decoder instance
+static void destroy_lhdc_decoder(lhdcBT_dec_ctx_t *ctx)
+{
+	pthread_mutex_lock(&owner_lock);
+	if (owner_ctx == ctx)
+	{
+		lhdcDestroy();
+		owner_ctx = NULL;
+	}
+	pthread_mutex_unlock(&owner_lock);
+}
 
 // description
 //   a function to log information in LHDC decoder library
@@ -33,13 +87,15 @@ static void print_log_cb(char*  msg)
 }
 
 // description
-//   init. LHDC v4 decoder 
+//   init. LHDC v4 decoder state of one instance
 // Parameter
+//   ctx: decoder instance
 //   config: configuration data for LHDC v4 decoder
 // return:
 //   == 0: succeed
+//   LHDCBT_DEC_FUNC_DECODER_BUSY: another instance is live
 //   < 0: error
-int lhdcBT_dec_init_decoder(tLHDCV3_DEC_CONFIG *config)
+static int init_lhdc_decoder(lhdcBT_dec_ctx_t *ctx, tLHDCV3_DEC_CONFIG *config)
 {
 	//ALOGD("[WL50] %s: enter", __func__);
     if (config == NULL)
@@ -66,30 +122,107 @@ int lhdcBT_dec_init_decoder(tLHDCV3_DEC_CONFIG *config)
 		return LHDCBT_DEC_FUNC_FAIL;
 	}
 
+	if ((config->channel != LHDC_OUTPUT_STEREO) &&
+		(config->channel != LHDC_OUTPUT_LEFT_CAHNNEL) &&
+		(config->channel != LHDC_OUTPUT_RIGHT_CAHNNEL))
+	{
+		return LHDCBT_DEC_FUNC_FAIL;
+	}
+
+	// the owner may init again; the lock is kept until setup is done so
+	// legacy calls never see a partial instance
+	pthread_mutex_lock(&owner_lock);
+	if ((owner_ctx != NULL) && (owner_ctx != ctx))
+	{
+		pthread_mutex_unlock(&owner_lock);
+		ALOGW("%s: another decoder instance is live!", __func__);
+		return LHDCBT_DEC_FUNC_DECODER_BUSY;
+	}
+
 	lhdc_register_log_cb(&print_log_cb);
 
     //ALOGD("[WL50] %s: start lhdcInit..", __func__);
     lhdcInit(config->bits_depth, config->sample_rate, 400000, config->version);
 
-    lhdcChannelSelsect(LHDC_OUTPUT_STEREO);
+    lhdcChannelSelsect((lhdc_channel_t)config->channel);
 
-    serial_no = 0xff;
+	ctx->config = *config;
+    ctx->serial_no = 0xff;
+	ctx->frame_samples = lhdcGetSampleSize();
+    lhdc_dec_trace_reset(&ctx->trace);
+	owner_ctx = ctx;
+	pthread_mutex_unlock(&owner_lock);
     //ALOGD("[WL50] %s: end", __func__);
 	return LHDCBT_DEC_FUNC_SUCCEED;
 }
 
 
+// description
+//   create and init. one LHDC v3/v4/LLAC decoder instance
+// Parameter
+//   handle: return decoder instance
+//   config: configuration data for LHDC v4 decoder
+// return:
+//   == 0: succeed
+//   < 0: error
+int lhdcBT_dec_init_decoder_r(HANDLE_LHDCV3_BT *handle, tLHDCV3_DEC_CONFIG *config)
+{
+	lhdcBT_dec_ctx_t *ctx;
+	int ret;
+
+	if (handle == NULL)
+	{
+		return LHDCBT_DEC_FUNC_FAIL;
+	}
+
+	ctx = (lhdcBT_dec_ctx_t *)malloc(sizeof(lhdcBT_dec_ctx_t));
+	if (ctx == NULL)
+	{
+		ALOGW("%s: Fail to allocate memory!", __func__);
+		return LHDCBT_DEC_FUNC_FAIL;
+	}
+
+	memset(ctx, 0, sizeof(lhdcBT_dec_ctx_t));
+
+	ret = init_lhdc_decoder(ctx, config);
+	if (ret != LHDCBT_DEC_FUNC_SUCCEED)
+	{
+		free(ctx);
+		return ret;
+	}
+
+	*handle = (HANDLE_LHDCV3_BT)ctx;
+
+	return LHDCBT_DEC_FUNC_SUCCEED;
+}
+
+
+// description
+//   init. LHDC v4 decoder (legacy API, default instance)
+// Parameter
+//   config: configuration data for LHDC v4 decoder
+// return:
+//   == 0: succeed
+//   < 0: error
+int lhdcBT_dec_init_decoder(tLHDCV3_DEC_CONFIG *config)
+{
+	return init_lhdc_decoder(&default_ctx, config);
+}
+
+
 
 // description
 //   check whether all frames of one packet are in buffer?
 // Parameter
+//   handle: decoder instance from lhdcBT_dec_init_decoder_r
 //   frameData: pointer to input buffer
 //   frameBytes: length (bytes) of input buffer pointed by frameData
 // return:
 //   == 0: succeed
 //   < 0: error
-int lhdcBT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t frameBytes, uint32_t *packetBytes)
+int lhdcBT_dec_check_frame_data_enough_r(HANDLE_LHDCV3_BT handle, const uint8_t *frameData, uint32_t frameBytes, uint32_t *packetBytes)
 {
+	lhdcBT_dec_ctx_t *ctx = (lhdcBT_dec_ctx_t *)handle;
 	uint8_t *frameDataStart = (uint8_t *)frameData;
     uint8_t *in_buf = NULL;
     uint32_t in_len = 0;
@@ -99,19 +232,16 @@ int lhdcBT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t frameB
 	bool fn_ret;
 
 
-    ALOGD("[WL50] %s: enter, frameBytes (%d)", __func__, (int)frameBytes);
-
-	if ((frameData == NULL) || (packetBytes == NULL))
+	if ((ctx == NULL) || (frameData == NULL) || (packetBytes == NULL))
 	{
 		return LHDCBT_DEC_FUNC_FAIL;
 	}
 	
 	*packetBytes = 0;
 
-    frame_num = assemble_lhdc_packet(frameDataStart, frameBytes, &in_buf, &in_len, LHDCBT_DEC_NOT_UPD_SEQ_NO);
+    frame_num = assemble_lhdc_packet(ctx, frameDataStart, frameBytes, &in_buf, &in_len, LHDCBT_DEC_NOT_UPD_SEQ_NO);
     if (frame_num == 0)
 	{
-        ALOGD("%s: assemble_lhdc_packet (%d)", __func__, (int)frame_num);
 		return LHDCBT_DEC_FUNC_SUCCEED;
 	}
 	//else if (frame_num < 0)
@@ -120,8 +250,6 @@ int lhdcBT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t frameB
 	//	return frame_num;
 	//}
 	
-	ALOGD("[WL50] %s: in_buf (%p), frameData (%p), in_len (%d), frame_num (%d)", __func__, in_buf, frameData, (int)in_len, (int) frame_num);
-	
 	ptr_offset = 0;
 
 	while ((frame_num > 0) && (ptr_offset < in_len))
@@ -129,15 +257,13 @@ int lhdcBT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t frameB
 		fn_ret = lhdcFetchFrameInfo (in_buf + ptr_offset, &lhdc_frame_Info);
 		if (fn_ret == false)
 		{
-			ALOGD("[WL50] %s: lhdcFetchFrameInfo(%d) fail..", __func__, (int)frame_num);
+			LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_ERROR, LHDC_DEC_TRACE_EVT_FRAME_INFO_FAIL, frame_num, ptr_offset);
 			return LHDCBT_DEC_FUNC_FAIL;
 		}
-		
-		ALOGD("[WL50] %s: lhdcFetchFrameInfo  frame_num (%d), ptr_offset (%d), lhdc_frame_Info.frame_len (%d), in_len (%d)", __func__, (int)frame_num, (int)ptr_offset, (int)lhdc_frame_Info.frame_len, (int)in_len);
-		
+
 		if ((ptr_offset + lhdc_frame_Info.frame_len) > in_len)
 		{
-			ALOGD("[WL50] %s: Not Enough... frame_num(%d), ptr_offset(%d), frame_len(%d), in_len (%d)", __func__, (int)frame_num, (int)ptr_offset, (int)lhdc_frame_Info.frame_len, (int)in_len);
+			LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_INFO, LHDC_DEC_TRACE_EVT_INPUT_NOT_ENOUGH, ptr_offset, lhdc_frame_Info.frame_len);
 			return LHDCBT_DEC_FUNC_INPUT_NOT_ENOUGH;
 		}
 
@@ -149,12 +275,30 @@ int lhdcBT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t frameB
 
 	*packetBytes = ptr_offset;
 
-    ALOGD("[WL50] %s: end ", __func__);
     return LHDCBT_DEC_FUNC_SUCCEED;
 
 }
 
 
+// description
+//   check whether all frames of one packet are in buffer? (legacy API, default instance)
+// Parameter
+//   frameData: pointer to input buffer
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+// return:
+//   == 0: succeed
+//   < 0: error
+int lhdcBT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t frameBytes, uint32_t *packetBytes)
+{
+	int ret;
+
+	ret = lhdcBT_dec_check_frame_data_enough_r((HANDLE_LHDCV3_BT)lock_lhdc_owner(), frameData, frameBytes, packetBytes);
+	unlock_lhdc_owner();
+
+	return ret;
+}
+
+
 /*
 	uint8_t llac_test_ptn[0x100] = {
 		0x90, 0x01, 0x04, 0xF7, 0x7C, 0x65, 0xEA, 0x83, 
@@ -195,14 +339,16 @@ int lhdcBT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t frameB
 // description
 //   decode all frames in one packet
 // Parameter
+//   ctx: decoder instance
 //   frameData: pointer to input buffer
 //   frameBytes: length (bytes) of input buffer pointed by frameData
 //   pcmData: pointer to output buffer
 //   pcmBytes: length (bytes) of pcm samples in output buffer
+//   bits_depth: bit per sample of pcm output
 // return:
 //   == 0: succeed
 //   < 0: error
-int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pcmData, uint32_t* pcmBytes, uint32_t bits_depth)
+static int decode_lhdc_packet(lhdcBT_dec_ctx_t *ctx, const uint8_t *frameData, uint32_t frameBytes, uint8_t* pcmData, uint32_t* pcmBytes, uint32_t bits_depth)
 {
 	uint8_t *frameDataStart = (uint8_t *)frameData;
     uint32_t dec_sum = 0;
@@ -213,7 +359,6 @@ int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pc
 	lhdc_frame_Info_t lhdc_frame_Info;
 	uint32_t ptr_offset = 0;
 	bool fn_ret;
-    uint32_t frame_samples;
 	uint32_t frame_bytes;
 	uint32_t pcmSpaceBytes;
 
@@ -246,7 +391,7 @@ int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pc
     }
 */
 
-    frame_num = assemble_lhdc_packet(frameDataStart, frameBytes, &in_buf, &in_len, LHDCBT_DEC_UPD_SEQ_NO);
+    frame_num = assemble_lhdc_packet(ctx, frameDataStart, frameBytes, &in_buf, &in_len, LHDCBT_DEC_UPD_SEQ_NO);
     if (frame_num == 0)
 	{
 		return LHDCBT_DEC_FUNC_SUCCEED;
@@ -254,16 +399,19 @@ int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pc
 	//ALOGD("[WL50] %s: frameData=0x%p, in_buf=0x%p, in_len=%d", __func__, frameData, in_buf, in_len);
     //ALOGD("[WL50] %s: get frame_num=%d", __func__, (int)frame_num);
 
-    frame_samples = lhdcGetSampleSize ();
 	if (bits_depth == 16)
 	{
-		frame_bytes = frame_samples * 2 * 2;
+		frame_bytes = ctx->frame_samples * 2;
 	}
 	else
 	{
-		frame_bytes = frame_samples * 4 * 2;
+		frame_bytes = ctx->frame_samples * 4;
+	}
+
+	if (ctx->config.channel == LHDC_OUTPUT_STEREO)
+	{
+		frame_bytes *= 2;
 	}
-    ALOGD("[WL50] %s: frame_samples=%d", __func__, (int)frame_samples);
 
     ptr_offset = 0;
     dec_sum = 0;
@@ -284,12 +432,13 @@ int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pc
 
 		if ((dec_sum + frame_bytes) > pcmSpaceBytes)
 		{
+			LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_WARN, LHDC_DEC_TRACE_EVT_OUTPUT_NOT_ENOUGH, dec_sum, pcmSpaceBytes);
 			return LHDCBT_DEC_FUNC_OUTPUT_NOT_ENOUGH;
 		}
 
  		//ALOGD("[WL50] %s: get ptr_offset=%d, dec_sum=%d", __func__, ptr_offset, dec_sum);
         lhdc_out_len = lhdcDecodeProcess(((uint8_t *)pcmData) + dec_sum, in_buf + ptr_offset, lhdc_frame_Info.frame_len);
-        //ALOGD("[WL50] %s: lhdcDecodeProcess(frm=%d, frame_len=%d out_len=%d)..", __func__, (int)frame_num, (int)lhdc_frame_Info.frame_len, (int)lhdc_out_len);
+        LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_FRAME, lhdc_frame_Info.frame_len, lhdc_out_len);
 
         //if (lhdc_out_len % frame_samples)
         //{
@@ -311,7 +460,80 @@ int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pc
 
 
 // description
-//   de-initialize (free) all resources allocated by LHDC v4 decoder
+//   decode all frames in one packet, pcm layout follows the configured bits_depth
+// Parameter
+//   handle: decoder instance from lhdcBT_dec_init_decoder_r
+//   frameData: pointer to input buffer
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+//   pcmData: pointer to output buffer
+//   pcmBytes: length (bytes) of pcm samples in output buffer
+// return:
+//   == 0: succeed
+//   < 0: error
+int lhdcBT_dec_decode_r(HANDLE_LHDCV3_BT handle, const uint8_t *frameData, uint32_t frameBytes, uint8_t* pcmData, uint32_t* pcmBytes)
+{
+	lhdcBT_dec_ctx_t *ctx = (lhdcBT_dec_ctx_t *)handle;
+
+	if (ctx == NULL)
+	{
+		return LHDCBT_DEC_FUNC_FAIL;
+	}
+
+	return decode_lhdc_packet(ctx, frameData, frameBytes, pcmData, pcmBytes, ctx->config.bits_depth);
+}
+
+
+// description
+//   decode all frames in one packet (legacy API, default instance)
+// Parameter
+//   frameData: pointer to input buffer
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+//   pcmData: pointer to output buffer
+//   pcmBytes: length (bytes) of pcm samples in output buffer
+//   bits_depth: bit per sample of pcm output
+// return:
+//   == 0: succeed
+//   < 0: error
+int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pcmData, uint32_t* pcmBytes, uint32_t bits_depth)
+{
+	lhdcBT_dec_ctx_t *ctx = lock_lhdc_owner();
+	int ret = LHDCBT_DEC_FUNC_FAIL;
+
+	if (ctx != NULL)
+	{
+		ret = decode_lhdc_packet(ctx, frameData, frameBytes, pcmData, pcmBytes, bits_depth);
+	}
+	unlock_lhdc_owner();
+
+	return ret;
+}
+
+
+// description
+//   de-initialize (free) all resources of one decoder instance
+// Parameter
+//   handle: decoder instance from lhdcBT_dec_init_decoder_r
+// return:
+//   == 0: succceed
+int lhdcBT_dec_deinit_decoder_r(HANDLE_LHDCV3_BT handle)
+{
+	lhdcBT_dec_ctx_t *ctx = (lhdcBT_dec_ctx_t *)handle;
+
+	ALOGD("[WL50] %s: enter", __func__);
+	if (ctx == NULL)
+	{
+		return LHDCBT_DEC_FUNC_SUCCEED;
+	}
+
+	destroy_lhdc_decoder(ctx);
+	free(ctx);
+
+    return LHDCBT_DEC_FUNC_SUCCEED;
+}
+
+
+// description
+//   de-initialize (free) all resources allocated by LHDC v4 decoder (legacy API, default instance)
 // Parameter
 //   none
 // return:
@@ -319,14 +541,78 @@ int lhdcBT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pc
 int lhdcBT_dec_deinit_decoder(void)
 {
 	ALOGD("[WL50] %s: enter", __func__);
-    lhdcDestroy();
+	destroy_lhdc_decoder(&default_ctx);
 
-    return LHDCBT_DEC_FUNC_SUCCEED;
+	return LHDCBT_DEC_FUNC_SUCCEED;
+}
+
+// description
+//   drain trace records collected by one decoder instance
+// Parameter
+//   handle: decoder instance from lhdcBT_dec_init_decoder_r
+//   recs: output records, NULL to print all pending records to the log instead
+//   maxNum: capacity of recs
+//   recNum: return number of records drained
+// return:
+//   == 0: succceed
+//   < 0: error
+int lhdcBT_dec_dump_trace_r(HANDLE_LHDCV3_BT handle, lhdc_dec_trace_rec_t *recs, uint32_t maxNum, uint32_t *recNum)
+{
+	lhdcBT_dec_ctx_t *ctx = (lhdcBT_dec_ctx_t *)handle;
+	uint32_t num;
+
+	if (ctx == NULL)
+	{
+		return LHDCBT_DEC_FUNC_FAIL;
+	}
+
+	if (recs == NULL)
+	{
+		num = lhdc_dec_trace_dump_log(&ctx->trace, LOG_TAG);
+	}
+	else
+	{
+		num = lhdc_dec_trace_drain(&ctx->trace, recs, maxNum);
+	}
+
+	if (recNum != NULL)
+	{
+		*recNum = num;
+	}
+
+	return LHDCBT_DEC_FUNC_SUCCEED;
+}
+
+
+// description
+//   drain trace records collected by the decoder (legacy API, default instance)
+// Parameter
+//   recs: output records, NULL to print all pending records to the log instead
+//   maxNum: capacity of recs
+//   recNum: return number of records drained
+// return:
+//   == 0: succceed
+int lhdcBT_dec_dump_trace(lhdc_dec_trace_rec_t *recs, uint32_t maxNum, uint32_t *recNum)
+{
+	lhdcBT_dec_ctx_t *ctx = lock_lhdc_owner();
+	int ret;
+
+	// records of the legacy instance stay readable after its deinit
+	if (ctx == NULL)
+	{
+		ctx = &default_ctx;
+	}
+
+	ret = lhdcBT_dec_dump_trace_r((HANDLE_LHDCV3_BT)ctx, recs, maxNum, recNum);
+	unlock_lhdc_owner();
+
+	return ret;
 }
 
 // description
 //   check number of frames in one packet and return pointer to first byte of 1st frame in current packet
 // Parameter
+//   ctx: decoder instance owning the sequence number
 //   input: pointer to input buffer
 //   input_len: length (bytes) of input buffer pointed by input
 //   pLout: pointer to pointer to output buffer
@@ -335,7 +621,7 @@ int lhdcBT_dec_deinit_decoder(void)
 //   > 0: number of frames in current packet
 //   == 0: No frames in current packet
 //   < 0: error
-static int assemble_lhdc_packet(uint8_t *input, uint32_t input_len, uint8_t **pLout, uint32_t *pLlen, int upd_seq_no)
+static int assemble_lhdc_packet(lhdcBT_dec_ctx_t *ctx, uint8_t *input, uint32_t input_len, uint8_t **pLout, uint32_t *pLlen, int upd_seq_no)
 {
     uint8_t hdr = 0, seqno = 0xff;
     int ret = LHDCBT_DEC_FUNC_FAIL;
@@ -368,27 +654,25 @@ static int assemble_lhdc_packet(uint8_t *input, uint32_t input_len, uint8_t **pL
     //Get number of frame in packet.
     status = (hdr & A2DP_LHDC_HDR_FRAME_NO_MASK) >> 2;
 
-    ALOGD("[WL50] %s: enter", __func__);
-
     if (status <= 0)
     {
-        ALOGD("%s: No any frame in packet.", __func__);
+        LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_NO_FRAME, hdr, input_len + 2);
         return 0;
     }
 
 
     lhdc_total_frame_nb = status;
 
-    if (seqno != serial_no)
+    if (seqno != ctx->serial_no)
     {
-        ALOGD("%s: Packet lost! now(%d), expect(%d)", __func__, seqno, serial_no);
+        LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_WARN, LHDC_DEC_TRACE_EVT_PACKET_LOST, seqno, ctx->serial_no);
         //serial_no = seqno;
 		//return LHDCBT_DEC_FUNC_INVALID_SEQ_NO;
     }
 	
 	if (upd_seq_no == LHDCBT_DEC_UPD_SEQ_NO)
 	{
-        serial_no = seqno + 1;
+        ctx->serial_no = seqno + 1;
 	}
 
     // log average bit rate
@@ -399,7 +683,7 @@ static int assemble_lhdc_packet(uint8_t *input, uint32_t input_len, uint8_t **pL
 
     ret = (int) lhdc_total_frame_nb;
 
-    ALOGD("[WL50] %s: end frame number (%d)", __func__, ret);
+    LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_PACKET, seqno | (ret << 8), input_len + 2);
     return ret;
 }
 
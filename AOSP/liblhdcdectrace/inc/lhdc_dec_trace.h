@@ -0,0 +1,83 @@
+/*
+ * lhdc_dec_trace.h
+ *
+ * Binary trace ring shared by the LHDC decoder wrappers. Hot paths write
+ * fixed-size records into a per-instance ring instead of calling ALOGD; the
+ * ring is drained on demand. Records above LHDC_DEC_TRACE_LEVEL are removed
+ * at compile time.
+ */
+
+#ifndef LHDC_DEC_TRACE_H
+#define LHDC_DEC_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LHDC_DEC_TRACE_LVL_NONE     0
+#define LHDC_DEC_TRACE_LVL_ERROR    1
+#define LHDC_DEC_TRACE_LVL_WARN     2
+#define LHDC_DEC_TRACE_LVL_INFO     3
+#define LHDC_DEC_TRACE_LVL_DEBUG    4
+
+// highest level compiled in, override with -DLHDC_DEC_TRACE_LEVEL=...
+#ifndef LHDC_DEC_TRACE_LEVEL
+#define LHDC_DEC_TRACE_LEVEL        LHDC_DEC_TRACE_LVL_INFO
+#endif
+
+// number of records per ring, must be a power of 2
+#define LHDC_DEC_TRACE_RING_SIZE    256
+
+typedef enum {
+  LHDC_DEC_TRACE_EVT_PACKET = 1,        // arg0: seqno | (frame_num << 8), arg1: packet bytes
+  LHDC_DEC_TRACE_EVT_PACKET_LOST,       // arg0: received seqno, arg1: expected seqno
+  LHDC_DEC_TRACE_EVT_NO_FRAME,          // arg0: header byte, arg1: packet bytes
+  LHDC_DEC_TRACE_EVT_FRAME,             // arg0: input frame bytes, arg1: output pcm bytes
+  LHDC_DEC_TRACE_EVT_INPUT_NOT_ENOUGH,  // arg0: frame offset, arg1: frame bytes
+  LHDC_DEC_TRACE_EVT_OUTPUT_NOT_ENOUGH, // arg0: pcm bytes used, arg1: pcm buffer bytes
+  LHDC_DEC_TRACE_EVT_FRAME_INFO_FAIL,   // arg0: error code, arg1: frame offset
+  LHDC_DEC_TRACE_EVT_DECODE_FAIL,       // arg0: error code, arg1: input frame bytes
+  LHDC_DEC_TRACE_EVT_CONCEAL,           // arg0: frames concealed, arg1: frames lost
+} lhdc_dec_trace_evt_t;
+
+typedef struct
+{
+  uint32_t time_us;     // CLOCK_MONOTONIC, truncated to 32 bits
+  uint16_t event;       // lhdc_dec_trace_evt_t
+  uint8_t  level;       // LHDC_DEC_TRACE_LVL_xxx
+  uint8_t  reserved;
+  uint32_t arg0;
+  uint32_t arg1;
+} lhdc_dec_trace_rec_t;
+
+// Single-producer / single-consumer ring: the decode thread writes, any one
+// thread drains. Indexes are free running and only accessed atomically.
+typedef struct
+{
+  uint32_t head;        // next record to write, owned by producer
+  uint32_t tail;        // next record to read, owned by consumer
+  uint32_t dropped;     // records lost because the ring was full
+  lhdc_dec_trace_rec_t rec[LHDC_DEC_TRACE_RING_SIZE];
+} lhdc_dec_trace_ring_t;
+
+void lhdc_dec_trace_reset(lhdc_dec_trace_ring_t *ring);
+void lhdc_dec_trace_write(lhdc_dec_trace_ring_t *ring, uint8_t level, uint16_t event,
+    uint32_t arg0, uint32_t arg1);
+uint32_t lhdc_dec_trace_drain(lhdc_dec_trace_ring_t *ring, lhdc_dec_trace_rec_t *recs,
+    uint32_t max_num);
+uint32_t lhdc_dec_trace_dump_log(lhdc_dec_trace_ring_t *ring, const char *name);
+const char *lhdc_dec_trace_evt_str(uint16_t event);
+
+#define LHDC_DEC_TRACE(ring, lvl, evt, a0, a1)                                \
+  do {                                                                        \
+    if ((lvl) <= LHDC_DEC_TRACE_LEVEL) {                                      \
+      lhdc_dec_trace_write((ring), (lvl), (evt), (uint32_t)(a0), (uint32_t)(a1)); \
+    }                                                                         \
+  } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* End of LHDC_DEC_TRACE_H */
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "lhdc_dec_trace.h"
+
+#define LOG_TAG "lhdc_dec_trace"
+#include <cutils/log.h>
+
+#define LHDC_DEC_TRACE_RING_MASK    (LHDC_DEC_TRACE_RING_SIZE - 1)
+#define LHDC_DEC_TRACE_DUMP_CHUNK   32
+
+#if (LHDC_DEC_TRACE_RING_SIZE & LHDC_DEC_TRACE_RING_MASK) != 0
+#error "LHDC_DEC_TRACE_RING_SIZE must be a power of 2"
+#endif
+
+static uint32_t trace_time_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+
+// description
+//   clear all records of a ring, must not race with write or drain
+// Parameter
+//   ring: trace ring
+void lhdc_dec_trace_reset(lhdc_dec_trace_ring_t *ring)
+{
+  if (ring == NULL) {
+    return;
+  }
+
+  memset(ring, 0, sizeof(lhdc_dec_trace_ring_t));
+}
+
+
+// description
+//   append one record, called by the (single) decode thread only
+// Parameter
+//   ring: trace ring
+//   level: LHDC_DEC_TRACE_LVL_xxx
+//   event: lhdc_dec_trace_evt_t
+//   arg0, arg1: event specific values
+void lhdc_dec_trace_write(lhdc_dec_trace_ring_t *ring, uint8_t level, uint16_t event,
+    uint32_t arg0, uint32_t arg1)
+{
+  uint32_t head, tail;
+  lhdc_dec_trace_rec_t *rec;
+
+  if (ring == NULL) {
+    return;
+  }
+
+  head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  if ((head - tail) >= LHDC_DEC_TRACE_RING_SIZE) {
+    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  rec = &ring->rec[head & LHDC_DEC_TRACE_RING_MASK];
+  rec->time_us = trace_time_us();
+  rec->event = event;
+  rec->level = level;
+  rec->reserved = 0;
+  rec->arg0 = arg0;
+  rec->arg1 = arg1;
+
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+// description
+//   move up to max_num oldest records out of the ring
+// Parameter
+//   ring: trace ring
+//   recs: output records
+//   max_num: capacity of recs
+// return:
+//   number of records copied to recs
+uint32_t lhdc_dec_trace_drain(lhdc_dec_trace_ring_t *ring, lhdc_dec_trace_rec_t *recs,
+    uint32_t max_num)
+{
+  uint32_t head, tail;
+  uint32_t num, i;
+
+  if ((ring == NULL) || (recs == NULL)) {
+    return 0;
+  }
+
+  tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+  num = head - tail;
+  if (num > max_num) {
+    num = max_num;
+  }
+
+  for (i = 0; i < num; i++) {
+    recs[i] = ring->rec[(tail + i) & LHDC_DEC_TRACE_RING_MASK];
+  }
+
+  __atomic_store_n(&ring->tail, tail + num, __ATOMIC_RELEASE);
+
+  return num;
+}
+
+
+// description
+//   drain the whole ring into the android log
+// Parameter
+//   ring: trace ring
+//   name: prefix printed with every record
+// return:
+//   number of records printed
+uint32_t lhdc_dec_trace_dump_log(lhdc_dec_trace_ring_t *ring, const char *name)
+{
+  lhdc_dec_trace_rec_t recs[LHDC_DEC_TRACE_DUMP_CHUNK];
+  uint32_t num, i, total = 0;
+  uint32_t dropped;
+
+  if (ring == NULL) {
+    return 0;
+  }
+
+  if (name == NULL) {
+    name = "";
+  }
+
+  while ((num = lhdc_dec_trace_drain(ring, recs, LHDC_DEC_TRACE_DUMP_CHUNK)) > 0) {
+    for (i = 0; i < num; i++) {
+      ALOGI("[%s] %10u L%u %s %u %u", name, recs[i].time_us, recs[i].level,
+          lhdc_dec_trace_evt_str(recs[i].event), recs[i].arg0, recs[i].arg1);
+    }
+    total += num;
+  }
+
+  dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+  if (dropped > 0) {
+    ALOGI("[%s] %u records dropped", name, dropped);
+  }
+
+  return total;
+}
+
+
+const char *lhdc_dec_trace_evt_str(uint16_t event)
+{
+  switch (event) {
+    case LHDC_DEC_TRACE_EVT_PACKET:
+      return "PACKET";
+    case LHDC_DEC_TRACE_EVT_PACKET_LOST:
+      return "PACKET_LOST";
+    case LHDC_DEC_TRACE_EVT_NO_FRAME:
+      return "NO_FRAME";
+    case LHDC_DEC_TRACE_EVT_FRAME:
+      return "FRAME";
+    case LHDC_DEC_TRACE_EVT_INPUT_NOT_ENOUGH:
+      return "INPUT_NOT_ENOUGH";
+    case LHDC_DEC_TRACE_EVT_OUTPUT_NOT_ENOUGH:
+      return "OUTPUT_NOT_ENOUGH";
+    case LHDC_DEC_TRACE_EVT_FRAME_INFO_FAIL:
+      return "FRAME_INFO_FAIL";
+    case LHDC_DEC_TRACE_EVT_DECODE_FAIL:
+      return "DECODE_FAIL";
+    case LHDC_DEC_TRACE_EVT_CONCEAL:
+      return "CONCEAL";
+    default:
+      return "UNKNOWN";
+  }
+}
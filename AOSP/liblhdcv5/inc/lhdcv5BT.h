@@ -7,6 +7,193 @@ extern "C" {
 
 #include "lhdcv5_api.h"
 
+//
+// Auto bit rate (ABR) and lossless variable bit rate (VBR) policy
+//
+#define LHDCV5BT_ABR_MAX_STAGES    (8)
+
+typedef struct _lhdcv5_bitrate_ladder_t
+{
+  uint32_t  stage_num;                          // number of stages used in bitrate[]
+  uint32_t  bitrate[LHDCV5BT_ABR_MAX_STAGES];   // bit rate (kbps) of each stage, ascending
+} lhdcv5_bitrate_ladder_t;
+
+// ABR (lossy) policy of one sample rate
+typedef struct _lhdcv5_abr_rate_policy_t
+{
+  lhdcv5_bitrate_ladder_t ladder;   // bit rates below LHDCV5_VBR_MIN_BITRATE
+  uint32_t  up_time_cnt;            // bit rate upgrade checking interval (by tick count)
+  uint32_t  down_time_cnt;          // bit rate downgrade checking interval (by tick count)
+  uint32_t  up_queue_th;            // upgrade when the queue length sum of an interval is below it
+  uint32_t  down_queue_th;          // downgrade when the mean queue length of an interval is above it
+  uint32_t  down_target_stage;      // ladder stage a downgrade goes to
+} lhdcv5_abr_rate_policy_t;
+
+// VBR (lossless) policy of one lossless stream type
+typedef struct _lhdcv5_vbr_policy_t
+{
+  lhdcv5_bitrate_ladder_t ladder;   // bit rates in [LHDCV5_VBR_MIN_BITRATE, LHDCV5_VBR_MAX_BITRATE]
+  uint32_t  promote_target_stage;   // ladder stage entered when promoting from the top ABR stage
+  uint32_t  up_time_cnt;            // bit rate upgrade checking interval (by tick count)
+  uint32_t  down_time_cnt;          // bit rate downgrade checking interval (by tick count)
+  uint32_t  up_lossy_ratio_th;      // lossy frame ratio (percentage: 0~100) to upgrade
+  uint32_t  down_lossless_ratio_th; // lossless frame ratio (percentage: 0~100) to downgrade
+  uint32_t  demote_time_cnt;        // demoting to ABR checking interval (by tick count)
+  uint32_t  demote_queue_th;        // demote when the mean queue length of an interval is above it
+  uint32_t  demote_target_stage;    // ABR ladder stage a demotion goes to
+} lhdcv5_vbr_policy_t;
+
+// lossless stream types with a VBR policy of their own; the encoder library
+// tunes all of them as LHDCV5_VBR_48K_RES
+typedef enum __LHDCV5BT_VBR_TYPE__
+{
+  LHDCV5BT_VBR_48K_RES = 0,         // 48KHz 16-bit
+  LHDCV5BT_VBR_48K_24BIT_RES,       // 48KHz 24-bit
+  LHDCV5BT_VBR_96K_RES,             // 96KHz
+  LHDCV5BT_VBR_INVALID
+} LHDCV5BT_VBR_TYPE_T;
+
+// bit rate controller run by lhdcv5BT_adjust_bitrate ()
+typedef enum __LHDCV5BT_ABR_MODE__
+{
+  LHDCV5BT_ABR_MODE_QUEUE = 0,      // mean queue length against fixed thresholds
+  LHDCV5BT_ABR_MODE_PREDICTIVE,     // queue trend, send latency and link hint through a PI model
+  LHDCV5BT_ABR_MODE_INVALID
+} LHDCV5BT_ABR_MODE_T;
+
+// LHDCV5BT_ABR_MODE_PREDICTIVE tuning, all gains and thresholds in Q8 (256 = 1.0)
+// of "packets in queue"
+typedef struct _lhdcv5_abr_pred_policy_t
+{
+  uint32_t  ewma_shift;             // weight of a new sample is 1/2^ewma_shift
+  uint32_t  horizon_ticks;          // look-ahead of the queue trend (by tick count)
+  uint32_t  target_queue;           // queue length the controller steers to (packets)
+  uint32_t  target_latency_us;      // send latency regarded as healthy
+  uint32_t  latency_per_packet_us;  // send latency counted as one queued packet
+  uint32_t  link_quality_th;        // link hint (0~100) below which each 10 points count as one packet
+  uint32_t  kp_q8;                  // proportional gain
+  uint32_t  ki_q8;                  // integral gain
+  uint32_t  down_th_q8;             // controller output stepping down one stage per multiple
+  uint32_t  up_th_q8;               // controller output below -up_th_q8 counts toward a step up
+  uint32_t  down_hold_ticks;        // ticks after a step down before the next one
+  uint32_t  up_hold_ticks;          // consecutive ticks below -up_th_q8 to step up one stage
+} lhdcv5_abr_pred_policy_t;
+
+typedef struct _lhdcv5_abr_policy_t
+{
+  uint32_t                  mode;   // LHDCV5BT_ABR_MODE_T
+  lhdcv5_abr_rate_policy_t  abr[LHDCV5_ABR_INVALID];  // indexed by LHDCV5_ABR_TYPE_T
+  lhdcv5_vbr_policy_t       vbr[LHDCV5BT_VBR_INVALID];  // indexed by LHDCV5BT_VBR_TYPE_T
+  lhdcv5_abr_pred_policy_t  pred;   // used in LHDCV5BT_ABR_MODE_PREDICTIVE
+} lhdcv5_abr_policy_t;
+
+#define LHDCV5BT_LINK_QUALITY_UNKNOWN  (0xFFFFFFFF)
+
+// transmit feedback of one tick for lhdcv5BT_adjust_bitrate_ex ()
+typedef struct _lhdcv5_abr_feedback_t
+{
+  uint32_t  queue_len;          // number of packets in the A2DP transmit queue
+  uint32_t  send_latency_us;    // latest packet send-completion latency, 0 if not measured
+  uint32_t  link_quality;       // link quality hint (0~100), LHDCV5BT_LINK_QUALITY_UNKNOWN if none
+} lhdcv5_abr_feedback_t;
+
+//
+// Encoder statistics, counted since lhdcv5BT_init_encoder ()
+//
+#define LHDCV5BT_STATS_RATE_NUM     (LHDCV5_QUALITY_MAX_BITRATE + 1)
+#define LHDCV5BT_STATS_QUEUE_BINS   (32)    // queue length 0 ~ 30, the last bin counts 31 and longer
+
+typedef struct _lhdcv5_enc_stats_t
+{
+  // per bit rate index (LHDCV5_QUALITY_LOW0 ~ LHDCV5_QUALITY_MAX_BITRATE)
+  uint32_t  rate_kbps[LHDCV5BT_STATS_RATE_NUM];       // bit rate (kbps) of the index
+  uint32_t  rate_frames[LHDCV5BT_STATS_RATE_NUM];     // frames encoded at the bit rate
+  uint32_t  rate_dwell_ms[LHDCV5BT_STATS_RATE_NUM];   // auto bit rate time spent at the bit rate
+
+  // auto bit rate decisions
+  uint32_t  adjust_ticks;           // lhdcv5BT_adjust_bitrate () calls in LHDCV5_QUALITY_AUTO
+  uint32_t  up_switches;            // bit rate raised
+  uint32_t  down_switches;          // bit rate lowered
+
+  // frames by coding mode
+  uint32_t  lossless_frames;
+  uint32_t  lossy_frames;
+
+  // transmit queue length seen by the bit rate controller
+  uint32_t  queue_hist[LHDCV5BT_STATS_QUEUE_BINS];
+  uint32_t  queue_p50;
+  uint32_t  queue_p90;
+  uint32_t  queue_p99;
+
+  // lhdcv5BT_encode () timing
+  uint32_t  encode_calls;
+  uint32_t  encode_avg_us;
+  uint32_t  encode_max_us;
+  uint64_t  encode_total_us;
+} lhdcv5_enc_stats_t;
+
+//
+// PCM accumulator and A2DP packetizer around lhdcv5BT_encode ()
+//
+#define LHDCV5BT_PKT_HDR_BYTES          (2)     // frame number + latency, sequence number
+#define LHDCV5BT_PKT_HDR_FRAME_NO_MASK  (0xFC)
+#define LHDCV5BT_PKT_MAX_FRAMES         (LHDCV5BT_PKT_HDR_FRAME_NO_MASK >> 2)
+#define LHDCV5BT_PKT_LATENCY_LOW        (0x00)
+#define LHDCV5BT_PKT_LATENCY_MID        (0x01)
+#define LHDCV5BT_PKT_LATENCY_HIGH       (0x02)
+#define LHDCV5BT_PKT_LATENCY_MASK       (LHDCV5BT_PKT_LATENCY_MID | LHDCV5BT_PKT_LATENCY_HIGH)
+#define LHDCV5BT_PKT_DEF_RING_BLOCKS    (8)     // PCM ring of lhdcv5BT_pkt_init () by default (blocks)
+#define LHDCV5BT_PKT_MAX_RING_BLOCKS    (64)
+
+//
+// PCM input format of lhdcv5BT_encode () and the packetizer/pipeline
+// around it, converted to the encoder sample format on the way in
+//
+typedef enum __LHDCV5BT_INPUT_FMT__
+{
+  LHDCV5BT_INPUT_FMT_NATIVE = 0,    // as bits_per_sample of lhdcv5BT_init_encoder (): s16, packed s24, s32
+  LHDCV5BT_INPUT_FMT_S16,           // int16
+  LHDCV5BT_INPUT_FMT_S24_PACKED,    // 3 bytes little endian
+  LHDCV5BT_INPUT_FMT_S24_IN32,      // 24 bit sign extended in int32
+  LHDCV5BT_INPUT_FMT_S32,           // int32 left-justified, any depth in the upper bits
+  LHDCV5BT_INPUT_FMT_FLOAT,         // float32, full scale 1.0, clipped
+  LHDCV5BT_INPUT_FMT_INVALID
+} LHDCV5BT_INPUT_FMT_T;
+
+//
+// Sample rate converter ahead of the encoder, e.g. 44.1 kHz sources into
+// the 48 kHz encoder; its group delay is about taps / 2 input frames
+//
+typedef enum __LHDCV5BT_SRC_QUALITY__
+{
+  LHDCV5BT_SRC_QUALITY_LOW = 0,     // 16 taps, ~50 dB stop band, 0.18 ms at 44.1 kHz
+  LHDCV5BT_SRC_QUALITY_MID,         // 32 taps, ~70 dB stop band, 0.36 ms at 44.1 kHz
+  LHDCV5BT_SRC_QUALITY_HIGH,        // 64 taps, ~90 dB stop band, 0.73 ms at 44.1 kHz
+  LHDCV5BT_SRC_QUALITY_INVALID
+} LHDCV5BT_SRC_QUALITY_T;
+
+//
+// Extended functions (AR, LARC, JAS, META) set without the packed byte
+// protocol: changes are staged, then lhdcv5BT_ext_commit () hands them all
+// to the encoder, which applies them together before its next block
+//
+#define LHDCV5BT_AR_POS_NUM       (6)
+#define LHDCV5BT_AR_GAIN_NUM      (32)
+
+// same values as ST_LHDC_AR
+typedef struct _lhdcv5_ar_cfg_t
+{
+  bool      enabled;                        // app_ar_enabled
+  int32_t   pos[LHDCV5BT_AR_POS_NUM];       // Ch1_Pos ~ Ch6_Pos
+  float     gain[LHDCV5BT_AR_GAIN_NUM];     // Ch1_L_PreGain ~ ThreeD_gain, in ST_LHDC_AR order
+} lhdcv5_ar_cfg_t;
+
+//
+// Encode pipeline: PCM blocks handed to an encode thread
+//
+#define LHDCV5BT_PIPE_DEF_DEPTH         (4)     // depth of lhdcv5BT_pipe_start (), one block is in flight at any depth
+#define LHDCV5BT_PIPE_MAX_DEPTH         (16)
+
 int32_t lhdcv5BT_free_handle 
 (
     HANDLE_LHDCV5_BT	handle
@@ -48,6 +235,70 @@ int32_t lhdcv5BT_adjust_bitrate
     uint32_t			queueLen
 );
 
+// lhdcv5BT_adjust_bitrate () with full transmit feedback, the queue mode
+// controller uses queue_len only
+int32_t lhdcv5BT_adjust_bitrate_ex
+(
+    HANDLE_LHDCV5_BT	handle,
+    const lhdcv5_abr_feedback_t	* feedback
+);
+
+// built-in policy, used by every handle until lhdcv5BT_set_abr_policy ()
+int32_t lhdcv5BT_get_default_abr_policy
+(
+    lhdcv5_abr_policy_t	* policy
+);
+
+int32_t lhdcv5BT_get_abr_policy
+(
+    HANDLE_LHDCV5_BT	handle,
+    lhdcv5_abr_policy_t	* policy
+);
+
+int32_t lhdcv5BT_set_abr_policy
+(
+    HANDLE_LHDCV5_BT	handle,
+    const lhdcv5_abr_policy_t	* policy
+);
+
+// snapshot of the encoder statistics, safe to call from any thread at any time
+int32_t lhdcv5BT_get_stats
+(
+    HANDLE_LHDCV5_BT	handle,
+    lhdcv5_enc_stats_t	* stats
+);
+
+// packetizer: lhdcv5BT_pkt_write_pcm () takes PCM of any size, then
+// lhdcv5BT_pkt_get_packet () is called until it returns no packet
+int32_t lhdcv5BT_pkt_init
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			latency,
+    uint32_t			ring_blocks
+);
+
+int32_t lhdcv5BT_pkt_reset
+(
+    HANDLE_LHDCV5_BT	handle
+);
+
+int32_t lhdcv5BT_pkt_write_pcm
+(
+    HANDLE_LHDCV5_BT	handle,
+    const void			* p_in_pcm,
+    uint32_t			pcm_bytes,
+    uint32_t			* p_used_bytes
+);
+
+int32_t lhdcv5BT_pkt_get_packet
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint8_t				* p_out_buf,
+    uint32_t			out_buf_bytes,
+    uint32_t			* p_out_bytes,
+    uint32_t			* p_out_frames
+);
+
 int32_t lhdcv5BT_set_ext_func_state
 (
     HANDLE_LHDCV5_BT 	handle,
@@ -57,6 +308,40 @@ int32_t lhdcv5BT_set_ext_func_state
     uint32_t 			priv_data_len
 );
 
+// staged extended functions, see lhdcv5_ar_cfg_t; a commit that the encoder
+// has not taken yet is merged with the next one, later changes win
+int32_t lhdcv5BT_ext_stage_state
+(
+    HANDLE_LHDCV5_BT	handle,
+    LHDCV5_EXT_FUNC_T	field,
+    bool				enabled
+);
+
+int32_t lhdcv5BT_ext_stage_meta
+(
+    HANDLE_LHDCV5_BT	handle,
+    bool				enabled,
+    const uint8_t		* data,
+    uint32_t			data_len,
+    uint32_t			loop_cnt
+);
+
+int32_t lhdcv5BT_ext_stage_ar
+(
+    HANDLE_LHDCV5_BT	handle,
+    const lhdcv5_ar_cfg_t	* cfg
+);
+
+int32_t lhdcv5BT_ext_commit
+(
+    HANDLE_LHDCV5_BT	handle
+);
+
+int32_t lhdcv5BT_ext_discard
+(
+    HANDLE_LHDCV5_BT	handle
+);
+
 int32_t lhdcv5BT_init_encoder
 (
     HANDLE_LHDCV5_BT 	handle,
@@ -68,6 +353,30 @@ int32_t lhdcv5BT_init_encoder
     uint32_t      is_lossless_enable
 ) ;
 
+// input format: interleaved, or planar (the right channel plane follows the
+// left one); applied from the next lhdcv5BT_init_encoder () when called before
+int32_t lhdcv5BT_set_input_format
+(
+    HANDLE_LHDCV5_BT	handle,
+    LHDCV5BT_INPUT_FMT_T	input_fmt,
+    bool				planar
+);
+
+// resampler: input_freq (0: off) is converted to the sampling_freq of the
+// next lhdcv5BT_init_encoder (); resampled input goes through the packetizer
+int32_t lhdcv5BT_set_resampler
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			input_freq,
+    LHDCV5BT_SRC_QUALITY_T	quality
+);
+
+int32_t lhdcv5BT_get_resampler_delay
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			* delay_us
+);
+
 int32_t lhdcv5BT_get_block_Size
 (
     HANDLE_LHDCV5_BT	handle,
@@ -85,6 +394,49 @@ int32_t lhdcv5BT_encode
     uint32_t 			* p_out_frames
 );
 
+// pipeline: lhdcv5BT_pipe_encode () is called like lhdcv5BT_encode () and
+// returns the encoded stream of its own block, encoded by the encode thread,
+// so lhdcv5BT_pipe_stop () and lhdcv5BT_init_encoder () never drop a block
+// and there is nothing to drain before them; while it runs,
+// lhdcv5BT_encode (), lhdcv5BT_encode_packet () and lhdcv5BT_pkt_get_packet ()
+// return LHDCV5_FRET_CODEC_NOT_READY
+int32_t lhdcv5BT_pipe_start
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			depth
+);
+
+int32_t lhdcv5BT_pipe_stop
+(
+    HANDLE_LHDCV5_BT	handle
+);
+
+int32_t lhdcv5BT_pipe_encode
+(
+    HANDLE_LHDCV5_BT 	handle,
+    void				* p_in_pcm,
+    uint32_t			pcm_bytes,
+    uint8_t				* p_out_buf,
+    uint32_t			out_buf_bytes,
+    uint32_t 			* p_out_bytes,
+    uint32_t 			* p_out_frames
+);
+
+// lhdcv5BT_encode () into a caller owned packet buffer, the LHDC header is
+// filled in place at hdr_offset and the frames follow it
+int32_t lhdcv5BT_encode_packet
+(
+    HANDLE_LHDCV5_BT 	handle,
+    void				* p_in_pcm,
+    uint32_t			pcm_bytes,
+    uint32_t			latency,
+    uint8_t				* p_pkt_buf,
+    uint32_t			pkt_buf_bytes,
+    uint32_t			hdr_offset,
+    uint32_t 			* p_payload_bytes,
+    uint32_t 			* p_out_frames
+);
+
 //
 // LHDCV5 Extended APIs
 //
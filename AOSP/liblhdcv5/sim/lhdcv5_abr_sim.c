@@ -0,0 +1,702 @@
+//----------------------------------------------------------------
+// lhdcv5_abr_sim
+//
+// Offline replay of the LHDC 5.0 ABR/VBR bit rate controller.
+//
+// lhdcv5BT_enc.c is linked against the host stand-in of the encoder
+// (lhdcv5_util_sim.c), and a queue length or link capacity trace is fed
+// through lhdcv5BT_adjust_bitrate_ex () one tick at a time. The output is
+// the timeline of bit rate changes and summary metrics, so ABR/VBR policy
+// changes can be compared without a headset.
+//
+// Trace lines (whitespace separated, '#' starts a comment):
+//   replay mode:  queue_len [lossless_pct [send_latency_us [link_quality]]]
+//   link mode:    capacity_kbps [lossless_pct [link_quality]]
+// In replay mode the recorded queue is used as is. In link mode the queue
+// is simulated from the encoder bit rate and the link capacity, so the
+// trace reacts to the controller. Synthetic traces always run in link mode.
+//----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include "lhdcv5BT.h"
+#include "lhdcv5_util_sim.h"
+
+#define SIM_FRAME_MS            (5)
+#define SIM_MAX_RUNGS           (32)
+#define SIM_DEF_TICK_MS         (20)
+#define SIM_DEF_TICKS           (3000)
+#define SIM_DEF_MTU             (LHDCV5_MTU_3MBPS)
+#define SIM_DEF_LOSSLESS_PCT    (50)
+#define SIM_DEF_OVERFLOW_QUEUE  (10)
+#define SIM_DEF_SEED            (1)
+
+typedef enum
+{
+  SIM_SYNTH_NONE = 0,
+  SIM_SYNTH_CLEAN,      // steady link
+  SIM_SYNTH_FADE,       // capacity fades out and back in over the middle third
+  SIM_SYNTH_BURST,      // short deep dips every 20 seconds
+  SIM_SYNTH_WALK,       // random walk of the capacity
+} SIM_SYNTH_T;
+
+typedef struct
+{
+  uint32_t value;               // queue length (replay) or capacity kbps (link)
+  uint32_t lossless_pct;
+  uint32_t send_latency_us;
+  uint32_t link_quality;
+} sim_sample_t;
+
+typedef struct
+{
+  uint32_t bitrate;
+  uint64_t ticks;
+} sim_rung_t;
+
+typedef struct
+{
+  // setup
+  uint32_t sample_rate;
+  uint32_t bits_per_sample;
+  uint32_t lossless;
+  uint32_t tick_ms;
+  uint32_t mtu;
+  uint32_t overflow_queue;
+  uint32_t lossless_pct;
+  bool link_mode;
+  bool quiet;
+
+  // trace source
+  FILE *trace;
+  SIM_SYNTH_T synth;
+  uint32_t synth_ticks;
+  uint32_t seed;
+
+  // link model state
+  uint64_t queue_bits;
+  int32_t walk_kbps;
+
+  // metrics
+  uint64_t ticks;
+  uint64_t switches;
+  uint64_t overflows;
+  uint64_t encoded_bits;
+  uint64_t delivered_bits;
+  uint32_t rung_num;
+  sim_rung_t rungs[SIM_MAX_RUNGS];
+} sim_t;
+
+// policy fields that can be overridden from the command line
+typedef enum
+{
+  SIM_KNOB_ABR = 0,     // applied to the ladder of every sample rate
+  SIM_KNOB_VBR,         // applied to every VBR table
+  SIM_KNOB_PRED,
+} SIM_KNOB_GROUP_T;
+
+typedef struct
+{
+  const char *name;
+  SIM_KNOB_GROUP_T group;
+  size_t offset;
+} sim_knob_t;
+
+static const sim_knob_t sim_knobs[] =
+{
+  {"abr.up_time_cnt",           SIM_KNOB_ABR,  offsetof(lhdcv5_abr_rate_policy_t, up_time_cnt)},
+  {"abr.down_time_cnt",         SIM_KNOB_ABR,  offsetof(lhdcv5_abr_rate_policy_t, down_time_cnt)},
+  {"abr.up_queue_th",           SIM_KNOB_ABR,  offsetof(lhdcv5_abr_rate_policy_t, up_queue_th)},
+  {"abr.down_queue_th",         SIM_KNOB_ABR,  offsetof(lhdcv5_abr_rate_policy_t, down_queue_th)},
+  {"abr.down_target_stage",     SIM_KNOB_ABR,  offsetof(lhdcv5_abr_rate_policy_t, down_target_stage)},
+  {"vbr.promote_target_stage",  SIM_KNOB_VBR,  offsetof(lhdcv5_vbr_policy_t, promote_target_stage)},
+  {"vbr.up_time_cnt",           SIM_KNOB_VBR,  offsetof(lhdcv5_vbr_policy_t, up_time_cnt)},
+  {"vbr.down_time_cnt",         SIM_KNOB_VBR,  offsetof(lhdcv5_vbr_policy_t, down_time_cnt)},
+  {"vbr.up_lossy_ratio_th",     SIM_KNOB_VBR,  offsetof(lhdcv5_vbr_policy_t, up_lossy_ratio_th)},
+  {"vbr.down_lossless_ratio_th",SIM_KNOB_VBR,  offsetof(lhdcv5_vbr_policy_t, down_lossless_ratio_th)},
+  {"vbr.demote_time_cnt",       SIM_KNOB_VBR,  offsetof(lhdcv5_vbr_policy_t, demote_time_cnt)},
+  {"vbr.demote_queue_th",       SIM_KNOB_VBR,  offsetof(lhdcv5_vbr_policy_t, demote_queue_th)},
+  {"vbr.demote_target_stage",   SIM_KNOB_VBR,  offsetof(lhdcv5_vbr_policy_t, demote_target_stage)},
+  {"pred.ewma_shift",           SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, ewma_shift)},
+  {"pred.horizon_ticks",        SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, horizon_ticks)},
+  {"pred.target_queue",         SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, target_queue)},
+  {"pred.target_latency_us",    SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, target_latency_us)},
+  {"pred.latency_per_packet_us",SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, latency_per_packet_us)},
+  {"pred.link_quality_th",      SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, link_quality_th)},
+  {"pred.kp_q8",                SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, kp_q8)},
+  {"pred.ki_q8",                SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, ki_q8)},
+  {"pred.down_th_q8",           SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, down_th_q8)},
+  {"pred.up_th_q8",             SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, up_th_q8)},
+  {"pred.down_hold_ticks",      SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, down_hold_ticks)},
+  {"pred.up_hold_ticks",        SIM_KNOB_PRED, offsetof(lhdcv5_abr_pred_policy_t, up_hold_ticks)},
+};
+#define SIM_KNOB_NUM  (sizeof(sim_knobs) / sizeof(sim_knobs[0]))
+
+
+static void sim_usage
+(
+    const char *prog
+)
+{
+  fprintf (stderr,
+      "usage: %s [options] [trace | -s synth]\n"
+      "  -r rate        sample rate (Hz), default 48000\n"
+      "  -b bits        bits per sample, default 16\n"
+      "  -l             lossless enabled (ABR+VBR hybrid)\n"
+      "  -t ms          tick interval, default %u\n"
+      "  -u mtu         packet size (bytes), default %u\n"
+      "  -o queue       queue length counted as an overflow, default %u\n"
+      "  -p pct         lossless frame share when the trace has none, default %u\n"
+      "  -m mode        controller: queue | pred, default queue\n"
+      "  -k name=value  override a policy field (-k list shows them)\n"
+      "  -L             trace values are link capacity (kbps), not queue length\n"
+      "  -s synth       synthetic link trace: clean | fade | burst | walk\n"
+      "  -n ticks       length of a synthetic trace, default %u\n"
+      "  -S seed        seed of the walk trace, default %u\n"
+      "  -q             summary only, no timeline\n",
+      prog, SIM_DEF_TICK_MS, SIM_DEF_MTU, SIM_DEF_OVERFLOW_QUEUE, SIM_DEF_LOSSLESS_PCT,
+      SIM_DEF_TICKS, SIM_DEF_SEED);
+}
+
+static int sim_set_knob
+(
+    lhdcv5_abr_policy_t *policy,
+    const char *arg
+)
+{
+  const char *eq = strchr (arg, '=');
+  size_t name_len = 0;
+  uint32_t value = 0;
+
+  if (strcmp (arg, "list") == 0)
+  {
+    for (uint32_t i = 0; i < SIM_KNOB_NUM; i++)
+    {
+      fprintf (stderr, "  %s\n", sim_knobs[i].name);
+    }
+    return -1;
+  }
+
+  if (eq == NULL)
+  {
+    fprintf (stderr, "policy override needs name=value: %s\n", arg);
+    return -1;
+  }
+  name_len = (size_t) (eq - arg);
+  value = (uint32_t) strtoul (eq + 1, NULL, 0);
+
+  for (uint32_t i = 0; i < SIM_KNOB_NUM; i++)
+  {
+    const sim_knob_t *knob = &sim_knobs[i];
+
+    if ((strlen (knob->name) != name_len) || (strncmp (knob->name, arg, name_len) != 0))
+    {
+      continue;
+    }
+
+    switch (knob->group)
+    {
+    case SIM_KNOB_ABR:
+      for (uint32_t t = 0; t < LHDCV5_ABR_INVALID; t++)
+      {
+        *(uint32_t *) ((uint8_t *) &policy->abr[t] + knob->offset) = value;
+      }
+      break;
+    case SIM_KNOB_VBR:
+      for (uint32_t t = 0; t < LHDCV5BT_VBR_INVALID; t++)
+      {
+        *(uint32_t *) ((uint8_t *) &policy->vbr[t] + knob->offset) = value;
+      }
+      break;
+    case SIM_KNOB_PRED:
+      *(uint32_t *) ((uint8_t *) &policy->pred + knob->offset) = value;
+      break;
+    }
+    return 0;
+  }
+
+  fprintf (stderr, "unknown policy field: %.*s\n", (int) name_len, arg);
+  return -1;
+}
+
+// deterministic pseudo random numbers for the walk trace
+static uint32_t sim_rand
+(
+    sim_t *sim
+)
+{
+  sim->seed = sim->seed * 1103515245u + 12345u;
+  return (sim->seed >> 16) & 0x7FFF;
+}
+
+static bool sim_synth_sample
+(
+    sim_t *sim,
+    sim_sample_t *sample
+)
+{
+  uint32_t tick = (uint32_t) sim->ticks;
+  uint32_t ticks_per_sec = 1000 / sim->tick_ms;
+  uint32_t third = sim->synth_ticks / 3;
+
+  if (tick >= sim->synth_ticks)
+  {
+    return false;
+  }
+
+  sample->lossless_pct = sim->lossless_pct;
+  sample->send_latency_us = 0;
+  sample->link_quality = LHDCV5BT_LINK_QUALITY_UNKNOWN;
+
+  switch (sim->synth)
+  {
+  case SIM_SYNTH_CLEAN:
+    sample->value = 1600;
+    break;
+  case SIM_SYNTH_FADE:
+    // 1600 kbps, down to 250 kbps at mid trace, back to 1600 kbps
+    if ((tick < third) || (tick >= 2 * third))
+    {
+      sample->value = 1600;
+    }
+    else if (tick < third + third / 2)
+    {
+      sample->value = 1600 - (1350 * (tick - third)) / (third / 2);
+    }
+    else
+    {
+      sample->value = 250 + (1350 * (tick - third - third / 2)) / (third - third / 2);
+    }
+    break;
+  case SIM_SYNTH_BURST:
+    // 2 seconds at 200 kbps every 20 seconds
+    sample->value = ((tick % (20 * ticks_per_sec)) >= (18 * ticks_per_sec)) ? 200 : 1600;
+    break;
+  case SIM_SYNTH_WALK:
+    sim->walk_kbps += (int32_t) (sim_rand (sim) % 101) - 50;
+    if (sim->walk_kbps < 150)
+    {
+      sim->walk_kbps = 150;
+    }
+    else if (sim->walk_kbps > 2000)
+    {
+      sim->walk_kbps = 2000;
+    }
+    sample->value = (uint32_t) sim->walk_kbps;
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+static bool sim_read_sample
+(
+    sim_t *sim,
+    sim_sample_t *sample
+)
+{
+  char line[256];
+  unsigned long v[4];
+  int n = 0;
+
+  if (sim->synth != SIM_SYNTH_NONE)
+  {
+    return sim_synth_sample (sim, sample);
+  }
+
+  while (fgets (line, sizeof(line), sim->trace) != NULL)
+  {
+    char *hash = strchr (line, '#');
+
+    if (hash != NULL)
+    {
+      *hash = '\0';
+    }
+    n = sscanf (line, "%lu %lu %lu %lu", &v[0], &v[1], &v[2], &v[3]);
+    if (n <= 0)
+    {
+      continue;
+    }
+
+    sample->value = (uint32_t) v[0];
+    sample->lossless_pct = (n > 1) ? (uint32_t) v[1] : sim->lossless_pct;
+    sample->send_latency_us = 0;
+    sample->link_quality = LHDCV5BT_LINK_QUALITY_UNKNOWN;
+    if (sim->link_mode)
+    {
+      if (n > 2)
+      {
+        sample->link_quality = (uint32_t) v[2];
+      }
+    }
+    else
+    {
+      if (n > 2)
+      {
+        sample->send_latency_us = (uint32_t) v[2];
+      }
+      if (n > 3)
+      {
+        sample->link_quality = (uint32_t) v[3];
+      }
+    }
+    if (sample->lossless_pct > 100)
+    {
+      sample->lossless_pct = 100;
+    }
+    return true;
+  }
+  return false;
+}
+
+static uint32_t sim_get_bitrate
+(
+    HANDLE_LHDCV5_BT  handle
+)
+{
+  uint32_t bitrate = 0;
+
+  // read from the encoder directly: lhdcv5BT_get_bitrate () rejects the VBR range
+  lhdcv5_util_get_target_bitrate (handle, &bitrate);
+  return bitrate / 1000;
+}
+
+static void sim_count_rung
+(
+    sim_t *sim,
+    uint32_t  bitrate
+)
+{
+  uint32_t i = 0;
+
+  for (i = 0; i < sim->rung_num; i++)
+  {
+    if (sim->rungs[i].bitrate == bitrate)
+    {
+      sim->rungs[i].ticks++;
+      return;
+    }
+  }
+  if (sim->rung_num < SIM_MAX_RUNGS)
+  {
+    // keep the list sorted by bit rate
+    for (i = sim->rung_num; (i > 0) && (sim->rungs[i - 1].bitrate > bitrate); i--)
+    {
+      sim->rungs[i] = sim->rungs[i - 1];
+    }
+    sim->rungs[i].bitrate = bitrate;
+    sim->rungs[i].ticks = 1;
+    sim->rung_num++;
+  }
+}
+
+static int sim_run
+(
+    sim_t *sim,
+    HANDLE_LHDCV5_BT  handle
+)
+{
+  const uint64_t packet_bits = (uint64_t) sim->mtu * 8;
+  const uint32_t frames_per_tick = (sim->tick_ms + SIM_FRAME_MS - 1) / SIM_FRAME_MS;
+  lhdcv5_abr_feedback_t feedback;
+  sim_sample_t sample;
+  uint32_t lossless_acc = 0;
+  uint32_t lossless_frames = 0;
+  uint32_t bitrate = 0;
+  uint32_t new_bitrate = 0;
+  uint32_t queue_len = 0;
+  bool overflowing = false;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  bitrate = sim_get_bitrate (handle);
+  if (!sim->quiet)
+  {
+    printf ("%10s  %s\n", "time(s)", "bit rate change");
+    printf ("%10.3f  start at %u kbps\n", 0.0, bitrate);
+  }
+
+  while (sim_read_sample (sim, &sample))
+  {
+    // encode one tick worth of frames, spreading the lossless share evenly
+    lossless_acc += frames_per_tick * sample.lossless_pct;
+    lossless_frames = lossless_acc / 100;
+    lossless_acc -= lossless_frames * 100;
+    lhdcv5_util_sim_feed_frames (handle, frames_per_tick, lossless_frames);
+    sim->encoded_bits += (uint64_t) bitrate * sim->tick_ms;
+
+    if (sim->link_mode)
+    {
+      uint64_t produced = (uint64_t) bitrate * sim->tick_ms;
+      uint64_t capacity = (uint64_t) sample.value * sim->tick_ms;
+      uint64_t sent = 0;
+      uint64_t limit = (uint64_t) sim->overflow_queue * packet_bits;
+
+      sim->queue_bits += produced;
+      sent = (sim->queue_bits < capacity) ? sim->queue_bits : capacity;
+      sim->queue_bits -= sent;
+      sim->delivered_bits += sent;
+
+      // a full transmit queue drops the excess
+      if (sim->queue_bits > limit)
+      {
+        sim->queue_bits = limit;
+        if (!overflowing)
+        {
+          sim->overflows++;
+        }
+        overflowing = true;
+      }
+      else
+      {
+        overflowing = false;
+      }
+
+      queue_len = (uint32_t) (sim->queue_bits / packet_bits);
+      if (sample.value > 0)
+      {
+        // time to drain what is queued
+        sample.send_latency_us = (uint32_t) ((sim->queue_bits * 1000) / sample.value);
+      }
+    }
+    else
+    {
+      queue_len = sample.value;
+      if (queue_len > sim->overflow_queue)
+      {
+        if (!overflowing)
+        {
+          sim->overflows++;
+        }
+        overflowing = true;
+      }
+      else
+      {
+        overflowing = false;
+      }
+    }
+
+    sim_count_rung (sim, bitrate);
+    sim->ticks++;
+
+    feedback.queue_len = queue_len;
+    feedback.send_latency_us = sample.send_latency_us;
+    feedback.link_quality = sample.link_quality;
+    func_ret = lhdcv5BT_adjust_bitrate_ex (handle, &feedback);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      fprintf (stderr, "lhdcv5BT_adjust_bitrate_ex failed (%d) at tick %llu\n",
+          func_ret, (unsigned long long) sim->ticks);
+      return -1;
+    }
+
+    new_bitrate = sim_get_bitrate (handle);
+    if (new_bitrate != bitrate)
+    {
+      sim->switches++;
+      if (!sim->quiet)
+      {
+        printf ("%10.3f  %4u -> %4u kbps  queue %u\n",
+            (double) sim->ticks * sim->tick_ms / 1000.0, bitrate, new_bitrate, queue_len);
+      }
+      bitrate = new_bitrate;
+    }
+  }
+
+  return 0;
+}
+
+static void sim_report
+(
+    const sim_t *sim
+)
+{
+  double seconds = (double) sim->ticks * sim->tick_ms / 1000.0;
+
+  printf ("\n");
+  printf ("duration         %.3f s (%llu ticks)\n", seconds, (unsigned long long) sim->ticks);
+  printf ("switches         %llu\n", (unsigned long long) sim->switches);
+  printf ("overflow events  %llu (queue > %u)\n", (unsigned long long) sim->overflows,
+      sim->overflow_queue);
+  if (sim->ticks == 0)
+  {
+    return;
+  }
+
+  printf ("mean bit rate    %.1f kbps\n", (double) sim->encoded_bits / (sim->ticks * sim->tick_ms));
+  if (sim->link_mode)
+  {
+    printf ("mean throughput  %.1f kbps\n", (double) sim->delivered_bits / (sim->ticks * sim->tick_ms));
+  }
+
+  printf ("time at each rung:\n");
+  for (uint32_t i = 0; i < sim->rung_num; i++)
+  {
+    printf ("  %4u kbps  %10.3f s  %5.1f%%\n", sim->rungs[i].bitrate,
+        (double) sim->rungs[i].ticks * sim->tick_ms / 1000.0,
+        100.0 * sim->rungs[i].ticks / sim->ticks);
+  }
+}
+
+int main
+(
+    int argc,
+    char *argv[]
+)
+{
+  HANDLE_LHDCV5_BT handle = NULL;
+  lhdcv5_abr_policy_t policy;
+  sim_t sim;
+  int opt = 0;
+  int ret = 0;
+
+  memset (&sim, 0, sizeof(sim));
+  sim.sample_rate = LHDCV5_SR_48000HZ;
+  sim.bits_per_sample = LHDCV5BT_SMPL_FMT_S16;
+  sim.tick_ms = SIM_DEF_TICK_MS;
+  sim.mtu = SIM_DEF_MTU;
+  sim.overflow_queue = SIM_DEF_OVERFLOW_QUEUE;
+  sim.lossless_pct = SIM_DEF_LOSSLESS_PCT;
+  sim.synth_ticks = SIM_DEF_TICKS;
+  sim.seed = SIM_DEF_SEED;
+  sim.walk_kbps = 1200;
+  sim.trace = stdin;
+
+  lhdcv5BT_get_default_abr_policy (&policy);
+
+  while ((opt = getopt (argc, argv, "r:b:lt:u:o:p:m:k:Ls:n:S:qh")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      sim.sample_rate = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'b':
+      sim.bits_per_sample = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'l':
+      sim.lossless = 1;
+      break;
+    case 't':
+      sim.tick_ms = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'u':
+      sim.mtu = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'o':
+      sim.overflow_queue = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'p':
+      sim.lossless_pct = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'm':
+      if (strcmp (optarg, "queue") == 0)
+      {
+        policy.mode = LHDCV5BT_ABR_MODE_QUEUE;
+      }
+      else if (strcmp (optarg, "pred") == 0)
+      {
+        policy.mode = LHDCV5BT_ABR_MODE_PREDICTIVE;
+      }
+      else
+      {
+        sim_usage (argv[0]);
+        return 1;
+      }
+      break;
+    case 'k':
+      if (sim_set_knob (&policy, optarg) != 0)
+      {
+        return 1;
+      }
+      break;
+    case 'L':
+      sim.link_mode = true;
+      break;
+    case 's':
+      if (strcmp (optarg, "clean") == 0)
+      {
+        sim.synth = SIM_SYNTH_CLEAN;
+      }
+      else if (strcmp (optarg, "fade") == 0)
+      {
+        sim.synth = SIM_SYNTH_FADE;
+      }
+      else if (strcmp (optarg, "burst") == 0)
+      {
+        sim.synth = SIM_SYNTH_BURST;
+      }
+      else if (strcmp (optarg, "walk") == 0)
+      {
+        sim.synth = SIM_SYNTH_WALK;
+      }
+      else
+      {
+        sim_usage (argv[0]);
+        return 1;
+      }
+      sim.link_mode = true;
+      break;
+    case 'n':
+      sim.synth_ticks = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'S':
+      sim.seed = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'q':
+      sim.quiet = true;
+      break;
+    default:
+      sim_usage (argv[0]);
+      return 1;
+    }
+  }
+
+  if ((sim.tick_ms == 0) || (sim.tick_ms > 1000) || (sim.mtu == 0) || (sim.lossless_pct > 100))
+  {
+    sim_usage (argv[0]);
+    return 1;
+  }
+
+  if ((sim.synth == SIM_SYNTH_NONE) && (optind < argc) && (strcmp (argv[optind], "-") != 0))
+  {
+    sim.trace = fopen (argv[optind], "r");
+    if (sim.trace == NULL)
+    {
+      perror (argv[optind]);
+      return 1;
+    }
+  }
+
+  if ((lhdcv5BT_get_handle (LHDCV5_VERSION_1, &handle) != LHDCV5_FRET_SUCCESS) ||
+      (lhdcv5BT_set_abr_policy (handle, &policy) != LHDCV5_FRET_SUCCESS) ||
+      (lhdcv5BT_init_encoder (handle, sim.sample_rate, sim.bits_per_sample,
+          LHDCV5_QUALITY_AUTO, sim.mtu, sim.tick_ms, sim.lossless) != LHDCV5_FRET_SUCCESS))
+  {
+    fprintf (stderr, "failed to set up the encoder (rate %u, bits %u, policy)\n",
+        sim.sample_rate, sim.bits_per_sample);
+    ret = 1;
+    goto end;
+  }
+
+  if (sim_run (&sim, handle) != 0)
+  {
+    ret = 1;
+  }
+  sim_report (&sim);
+
+end:
+  if (handle != NULL)
+  {
+    lhdcv5BT_free_handle (handle);
+  }
+  if ((sim.trace != NULL) && (sim.trace != stdin))
+  {
+    fclose (sim.trace);
+  }
+  return ret;
+}
@@ -0,0 +1,226 @@
+/*
+ * lhdcv5_enc_pcm_bench.c
+ *
+ * Host benchmark of the V5 encoder input conversion (lhdcv5BT_enc_pcm.c).
+ *
+ * Every input layout is converted to every encoder layout, interleaved and
+ * planar, by each kernel set this cpu supports. The output of each kernel set
+ * is compared with the scalar reference on the same input, which includes
+ * full scale samples and, for float input, out of range, infinite and NaN
+ * samples. The run fails when any kernel set differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "lhdcv5BT_enc_pcm.h"
+
+// 240 stereo frames, one 5 ms encoder block at 48 kHz
+#define BENCH_DEF_BLOCK_FRAMES    240
+#define BENCH_DEF_BLOCKS          256
+#define BENCH_DEF_RUNS            20
+
+typedef struct
+{
+  lhdcv5_enc_pcm_layout_t layout;
+  const char *name;
+} bench_layout_t;
+
+static const bench_layout_t bench_in[] = {
+  { LHDCV5_ENC_PCM_S16, "s16" },
+  { LHDCV5_ENC_PCM_S24_IN32, "s24in32" },
+  { LHDCV5_ENC_PCM_S32, "s32" },
+  { LHDCV5_ENC_PCM_S24_PACKED, "s24p" },
+  { LHDCV5_ENC_PCM_FLOAT, "float" },
+};
+
+static const bench_layout_t bench_out[] = {
+  { LHDCV5_ENC_PCM_S16, "s16" },
+  { LHDCV5_ENC_PCM_S24_PACKED, "s24p" },
+  { LHDCV5_ENC_PCM_S32, "s32" },
+};
+
+#define BENCH_NUM(a)  (sizeof(a) / sizeof((a)[0]))
+
+static uint32_t bench_rng = 1;
+
+static uint32_t bench_rand(void)
+{
+  bench_rng = bench_rng * 1664525u + 1013904223u;
+  return bench_rng;
+}
+
+static uint64_t bench_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// random samples of an input layout, the first ones at the range limits
+static void bench_fill(uint8_t *buf, lhdcv5_enc_pcm_layout_t layout, uint32_t samples)
+{
+  static const int32_t edge32[] = { INT32_MIN, INT32_MAX, 0, -1, 1 };
+  static const int32_t edge24[] = { -8388608, 8388607, 0, -1, 1 };
+  static const int16_t edge16[] = { INT16_MIN, INT16_MAX, 0, -1, 1 };
+  const float edgef[] = { NAN, -NAN, INFINITY, -INFINITY, 1.0f, -1.0f, 1.5f, -1.5f,
+      0.0f, -0.0f, 1e-30f };
+  uint32_t i;
+
+  for (i = 0; i < samples; i++) {
+    uint32_t r = bench_rand();
+
+    if (layout == LHDCV5_ENC_PCM_S16) {
+      int16_t v = (i < BENCH_NUM(edge16)) ? edge16[i] : (int16_t)(r >> 16);
+      memcpy(buf + 2 * i, &v, 2);
+    } else if (layout == LHDCV5_ENC_PCM_S24_IN32) {
+      int32_t v = (i < BENCH_NUM(edge24)) ? edge24[i] : ((int32_t)r >> 8);
+      memcpy(buf + 4 * i, &v, 4);
+    } else if (layout == LHDCV5_ENC_PCM_S24_PACKED) {
+      int32_t v = (i < BENCH_NUM(edge24)) ? edge24[i] : ((int32_t)r >> 8);
+      buf[3 * i + 0] = (uint8_t)v;
+      buf[3 * i + 1] = (uint8_t)(v >> 8);
+      buf[3 * i + 2] = (uint8_t)(v >> 16);
+    } else if (layout == LHDCV5_ENC_PCM_FLOAT) {
+      // up to 1.25 full scale, so that the clamp is exercised
+      float v = (i < BENCH_NUM(edgef)) ? edgef[i] : ((float)(int32_t)r * (1.25f / 2147483648.0f));
+      memcpy(buf + 4 * i, &v, 4);
+    } else {
+      int32_t v = (i < BENCH_NUM(edge32)) ? edge32[i] : (int32_t)r;
+      memcpy(buf + 4 * i, &v, 4);
+    }
+  }
+}
+
+static void bench_usage(const char *name)
+{
+  fprintf(stderr,
+      "usage: %s [-f block_frames] [-n blocks] [-r runs]\n"
+      "  -f  stereo frames of one converted block, default %u\n"
+      "  -n  blocks converted per timed run, default %u\n"
+      "  -r  timed runs, the fastest is reported, default %u\n",
+      name, BENCH_DEF_BLOCK_FRAMES, BENCH_DEF_BLOCKS, BENCH_DEF_RUNS);
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t block_frames = BENCH_DEF_BLOCK_FRAMES;
+  uint32_t blocks = BENCH_DEF_BLOCKS;
+  uint32_t runs = BENCH_DEF_RUNS;
+  uint32_t isa_num = lhdcv5_enc_pcm_isa_num();
+  uint32_t block_samples, samples, buf_bytes;
+  uint32_t fails = 0;
+  uint8_t *src, *ref, *buf;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:n:r:h")) != -1) {
+    switch (opt) {
+      case 'f':
+        block_frames = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'n':
+        blocks = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'r':
+        runs = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      default:
+        bench_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if ((block_frames == 0) || (blocks == 0) || (runs == 0)) {
+    bench_usage(argv[0]);
+    return 1;
+  }
+
+  block_samples = block_frames * LHDCV5_ENC_PCM_CHANNELS;
+  samples = block_samples * blocks;
+  buf_bytes = samples * 4;
+  src = malloc(buf_bytes);
+  ref = malloc(buf_bytes);
+  buf = malloc(buf_bytes);
+  if ((src == NULL) || (ref == NULL) || (buf == NULL)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  printf("kernel sets:");
+  for (uint32_t k = 0; k < isa_num; k++) {
+    printf(" %s", lhdcv5_enc_pcm_isa_name(k));
+  }
+  printf("\n%u stereo frames per block, %u blocks per run, best of %u runs\n\n",
+      block_frames, blocks, runs);
+  printf("%-8s %-5s %-7s %-5s %10s %9s  %s\n",
+      "in", "out", "order", "isa", "Msmpl/s", "ns/block", "vs c");
+
+  for (uint32_t i = 0; i < BENCH_NUM(bench_in); i++) {
+    uint32_t in_bytes = lhdcv5_enc_pcm_layout_bytes(bench_in[i].layout);
+
+    bench_fill(src, bench_in[i].layout, samples);
+
+    for (uint32_t o = 0; o < BENCH_NUM(bench_out); o++) {
+      uint32_t out_bytes = lhdcv5_enc_pcm_layout_bytes(bench_out[o].layout);
+
+      for (uint32_t p = 0; p < 2; p++) {
+        bool planar = (p != 0);
+
+        for (uint32_t k = 0; k < isa_num; k++) {
+          lhdcv5_enc_pcm_conv_t conv;
+          uint64_t best = UINT64_MAX;
+          const char *check = "ref";
+
+          lhdcv5_enc_pcm_conv_init_isa(&conv, bench_in[i].layout, bench_out[o].layout,
+              planar, k);
+          if (!conv.active) {
+            break;
+          }
+
+          for (uint32_t r = 0; r < runs; r++) {
+            uint64_t t0, t1;
+
+            t0 = bench_now_ns();
+            // planar blocks are a left plane followed by a right plane
+            for (uint32_t b = 0; b < blocks; b++) {
+              lhdcv5_enc_pcm_convert(&conv, src + b * block_samples * in_bytes,
+                  block_frames * in_bytes, buf + b * block_samples * out_bytes, block_frames);
+            }
+            t1 = bench_now_ns();
+            if ((t1 - t0) < best) {
+              best = t1 - t0;
+            }
+          }
+
+          if (k == 0) {
+            memcpy(ref, buf, samples * out_bytes);
+          } else if (memcmp(ref, buf, samples * out_bytes) == 0) {
+            check = "same";
+          } else {
+            check = "DIFF";
+            fails++;
+          }
+
+          printf("%-8s %-5s %-7s %-5s %10.1f %9.0f  %s\n",
+              bench_in[i].name, bench_out[o].name, planar ? "planar" : "inter", conv.isa,
+              (double)samples * 1000.0 / (double)best,
+              (double)best / (double)blocks, check);
+        }
+      }
+    }
+  }
+
+  printf("\n%u kernel mismatches\n", fails);
+
+  free(src);
+  free(ref);
+  free(buf);
+
+  return (fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+/*
+ * lhdcv5_enc_src_bench.c
+ *
+ * Host benchmark of the V5 encoder sample rate converter
+ * (lhdcv5BT_enc_src.c), run standalone without the encoder.
+ *
+ * A stereo sine tone is converted by every quality preset in 10 ms pieces,
+ * as the packetizer feeds it. For each preset the cpu time per channel
+ * second of input is reported, together with the SNR of the output against
+ * a sine fitted at the tone frequency and the delay of that sine against
+ * the one put in. The run fails when a measured delay is off the one the
+ * converter reports, or an SNR is below the floor.
+ *
+ * The SNR includes the quantization of the output layout, so at 16 bit and
+ * low tone levels it shows the word length rather than the filter; run 24 or
+ * 32 bit to see the filter alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "lhdcv5BT_enc_src.h"
+
+#define BENCH_DEF_IN_RATE         44100
+#define BENCH_DEF_OUT_RATE        48000
+#define BENCH_DEF_BITS            16
+#define BENCH_DEF_TONE_HZ         1000.0
+#define BENCH_DEF_LEVEL_DB        (-1.0)
+#define BENCH_DEF_SECONDS         10
+#define BENCH_DEF_RUNS            5
+#define BENCH_DEF_MIN_SNR_DB      50.0
+
+// output skipped by the fit while the history fills from silence
+#define BENCH_SETTLE_FRAMES       1024
+// measured delay allowed off the reported one
+#define BENCH_DELAY_TOL_US        2.0
+
+static const char *const bench_quality[] = { "low", "mid", "high" };
+
+static uint64_t bench_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_put(uint8_t *p, lhdcv5_enc_pcm_layout_t layout, double x)
+{
+  int32_t v;
+
+  if (layout == LHDCV5_ENC_PCM_S16) {
+    int16_t s = (int16_t)lrint(x * 32767.0);
+    memcpy(p, &s, 2);
+  } else if (layout == LHDCV5_ENC_PCM_S24_PACKED) {
+    v = (int32_t)lrint(x * 8388607.0);
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+  } else {
+    v = (int32_t)lrint(x * 2147483647.0);
+    memcpy(p, &v, 4);
+  }
+}
+
+static double bench_get(const uint8_t *p, lhdcv5_enc_pcm_layout_t layout)
+{
+  int16_t s;
+  int32_t v;
+
+  if (layout == LHDCV5_ENC_PCM_S16) {
+    memcpy(&s, p, 2);
+    return (double)s / 32768.0;
+  }
+  if (layout == LHDCV5_ENC_PCM_S24_PACKED) {
+    v = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+    return (double)v / 8388608.0;
+  }
+  memcpy(&v, p, 4);
+  return (double)v / 2147483648.0;
+}
+
+// least squares fit of a sine at the tone frequency to one channel of the
+// output; returns the SNR in dB and the delay of the fitted sine in us
+static void bench_fit(const uint8_t *out, uint32_t frames, uint32_t ch, uint32_t sample_bytes,
+    lhdcv5_enc_pcm_layout_t layout, double tone_hz, uint32_t rate, double phase0,
+    double *snr_db, double *delay_us)
+{
+  const double w = 2.0 * M_PI * tone_hz / (double)rate;
+  double ss = 0.0, cc = 0.0, sc = 0.0, ys = 0.0, yc = 0.0;
+  double det, a, b, m, y, err = 0.0, sig = 0.0, ph;
+  uint32_t n;
+
+  for (n = BENCH_SETTLE_FRAMES; n < frames; n++) {
+    y = bench_get(out + (2 * n + ch) * sample_bytes, layout);
+    ss += sin(w * n) * sin(w * n);
+    cc += cos(w * n) * cos(w * n);
+    sc += sin(w * n) * cos(w * n);
+    ys += y * sin(w * n);
+    yc += y * cos(w * n);
+  }
+  det = ss * cc - sc * sc;
+  a = (ys * cc - yc * sc) / det;
+  b = (yc * ss - ys * sc) / det;
+
+  for (n = BENCH_SETTLE_FRAMES; n < frames; n++) {
+    y = bench_get(out + (2 * n + ch) * sample_bytes, layout);
+    m = a * sin(w * n) + b * cos(w * n);
+    err += (y - m) * (y - m);
+    sig += m * m;
+  }
+  *snr_db = 10.0 * log10(sig / err);
+
+  // the output is sin(w * n + phase0 - delay phase)
+  ph = phase0 - atan2(b, a);
+  ph = fmod(ph, 2.0 * M_PI);
+  if (ph < 0.0) {
+    ph += 2.0 * M_PI;
+  }
+  *delay_us = ph / (2.0 * M_PI * tone_hz) * 1000000.0;
+}
+
+static void bench_usage(const char *name)
+{
+  fprintf(stderr,
+      "usage: %s [-i in_rate] [-o out_rate] [-b bits] [-f tone_hz] [-l level_db]\n"
+      "          [-s seconds] [-r runs] [-m min_snr_db]\n"
+      "  -i  input sample rate, default %u\n"
+      "  -o  output (encoder) sample rate, default %u\n"
+      "  -b  encoder bits per sample: 16, 24 or 32, default %u\n"
+      "  -f  tone frequency, default %.0f Hz\n"
+      "  -l  tone level, default %.1f dBFS\n"
+      "  -s  seconds of input per run, default %u\n"
+      "  -r  timed runs, the fastest is reported, default %u\n"
+      "  -m  SNR floor of every preset, default %.0f dB\n",
+      name, BENCH_DEF_IN_RATE, BENCH_DEF_OUT_RATE, BENCH_DEF_BITS, BENCH_DEF_TONE_HZ,
+      BENCH_DEF_LEVEL_DB, BENCH_DEF_SECONDS, BENCH_DEF_RUNS, BENCH_DEF_MIN_SNR_DB);
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t in_rate = BENCH_DEF_IN_RATE;
+  uint32_t out_rate = BENCH_DEF_OUT_RATE;
+  uint32_t bits = BENCH_DEF_BITS;
+  double tone_hz = BENCH_DEF_TONE_HZ;
+  double level_db = BENCH_DEF_LEVEL_DB;
+  uint32_t seconds = BENCH_DEF_SECONDS;
+  uint32_t runs = BENCH_DEF_RUNS;
+  double min_snr = BENCH_DEF_MIN_SNR_DB;
+  lhdcv5_enc_pcm_layout_t layout;
+  uint32_t sample_bytes, in_frames, out_room, piece;
+  uint32_t fails = 0;
+  uint8_t *in, *out;
+  double amp;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:o:b:f:l:s:r:m:h")) != -1) {
+    switch (opt) {
+      case 'i':
+        in_rate = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        out_rate = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'b':
+        bits = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'f':
+        tone_hz = strtod(optarg, NULL);
+        break;
+      case 'l':
+        level_db = strtod(optarg, NULL);
+        break;
+      case 's':
+        seconds = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'r':
+        runs = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'm':
+        min_snr = strtod(optarg, NULL);
+        break;
+      default:
+        bench_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (bits == 16) {
+    layout = LHDCV5_ENC_PCM_S16;
+  } else if (bits == 24) {
+    layout = LHDCV5_ENC_PCM_S24_PACKED;
+  } else if (bits == 32) {
+    layout = LHDCV5_ENC_PCM_S32;
+  } else {
+    bench_usage(argv[0]);
+    return 1;
+  }
+  if ((in_rate < 100) || (out_rate == 0) || (seconds == 0) || (runs == 0) ||
+      (tone_hz <= 0.0) || (level_db > 0.0)) {
+    bench_usage(argv[0]);
+    return 1;
+  }
+
+  sample_bytes = lhdcv5_enc_pcm_layout_bytes(layout);
+  amp = pow(10.0, level_db / 20.0);
+  in_frames = in_rate * seconds;
+  out_room = (uint32_t)((uint64_t)in_frames * out_rate / in_rate) + 2 * LHDCV5_ENC_SRC_CHUNK_FRAMES;
+  piece = in_rate / 100;
+  in = malloc((size_t)in_frames * LHDCV5_ENC_PCM_CHANNELS * sample_bytes);
+  out = malloc((size_t)out_room * LHDCV5_ENC_PCM_CHANNELS * sample_bytes);
+  if ((in == NULL) || (out == NULL)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  // the right channel is a quarter period ahead
+  for (uint32_t n = 0; n < in_frames; n++) {
+    double t = 2.0 * M_PI * tone_hz * (double)n / (double)in_rate;
+
+    bench_put(in + 2 * n * sample_bytes, layout, amp * sin(t));
+    bench_put(in + (2 * n + 1) * sample_bytes, layout, amp * sin(t + M_PI / 2.0));
+  }
+
+  printf("%u -> %u Hz, %u bit, %.0f Hz tone at %.1f dBFS, %u s per run, best of %u runs\n\n",
+      in_rate, out_rate, bits, tone_hz, level_db, seconds, runs);
+  printf("%-5s %4s %-5s %9s %7s %8s %8s %9s %9s  %s\n",
+      "q", "taps", "isa", "us/ch-s", "%core", "snr L", "snr R", "delay", "measured", "check");
+
+  for (uint32_t q = LHDCV5_ENC_SRC_LOW; q <= LHDCV5_ENC_SRC_HIGH; q++) {
+    lhdcv5_enc_src_t *src = lhdcv5_enc_src_create(in_rate, out_rate,
+        (lhdcv5_enc_src_quality_t)q, layout);
+    uint64_t best = UINT64_MAX;
+    uint32_t produced = 0;
+    double snr[LHDCV5_ENC_PCM_CHANNELS], delay[LHDCV5_ENC_PCM_CHANNELS];
+    double ch_s = (double)seconds * LHDCV5_ENC_PCM_CHANNELS;
+    bool ok;
+
+    if (src == NULL) {
+      fprintf(stderr, "%u -> %u Hz not supported\n", in_rate, out_rate);
+      free(in);
+      free(out);
+      return 1;
+    }
+
+    for (uint32_t r = 0; r < runs; r++) {
+      uint64_t t0, t1;
+      uint32_t done, n;
+
+      lhdcv5_enc_src_reset(src);
+      produced = 0;
+      t0 = bench_now_ns();
+      for (done = 0; done < in_frames; done += n) {
+        n = ((in_frames - done) < piece) ? (in_frames - done) : piece;
+        produced += lhdcv5_enc_src_process(src,
+            in + done * LHDCV5_ENC_PCM_CHANNELS * sample_bytes, n,
+            out + produced * LHDCV5_ENC_PCM_CHANNELS * sample_bytes);
+      }
+      t1 = bench_now_ns();
+      if ((t1 - t0) < best) {
+        best = t1 - t0;
+      }
+    }
+
+    bench_fit(out, produced, 0, sample_bytes, layout, tone_hz, out_rate, 0.0,
+        &snr[0], &delay[0]);
+    bench_fit(out, produced, 1, sample_bytes, layout, tone_hz, out_rate, M_PI / 2.0,
+        &snr[1], &delay[1]);
+
+    ok = (fabs(delay[0] - (double)src->delay_us) <= BENCH_DELAY_TOL_US) &&
+        (fabs(delay[1] - (double)src->delay_us) <= BENCH_DELAY_TOL_US) &&
+        (snr[0] >= min_snr) && (snr[1] >= min_snr);
+    if (!ok) {
+      fails++;
+    }
+
+    printf("%-5s %4u %-5s %9.0f %7.3f %8.1f %8.1f %9u %9.1f  %s\n",
+        bench_quality[q], src->taps, src->isa, (double)best / 1000.0 / ch_s,
+        (double)best / 1e7 / (double)seconds, snr[0], snr[1], src->delay_us,
+        (delay[0] + delay[1]) / 2.0, ok ? "ok" : "FAIL");
+
+    lhdcv5_enc_src_destroy(src);
+  }
+
+  printf("\n%u presets failed\n", fails);
+
+  free(in);
+  free(out);
+
+  return (fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,440 @@
+//----------------------------------------------------------------
+// lhdcv5_pkt_bench
+//
+// Host benchmark of the per-packet overhead of the V5 encoder wrapper.
+//
+// lhdcv5BT_enc.c is linked against the host stand-in of the encoder
+// (lhdcv5_util_sim.c), which sizes frames from the bit rate but does no
+// audio coding, so the time measured is the wrapper's own: input checks,
+// locking, statistics, the PCM ring and the packet assembly. The same
+// stream of blocks is encoded by
+//   encode      lhdcv5BT_encode (), one block per call, no packet built
+//   enc_packet  lhdcv5BT_encode_packet (), one frame per packet, in place
+//   pkt/N       lhdcv5BT_pkt_write_pcm () in writes of N samples per
+//               channel, lhdcv5BT_pkt_get_packet () drained after each
+// Every packet of the packetizer is checked: it fits the MTU (or holds a
+// single frame larger than it), its header carries the frame number
+// returned and the next sequence number, and all frames written come out
+// of it.
+//----------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include "lhdcv5BT.h"
+
+#define BENCH_DEF_BLOCKS        (20000)
+#define BENCH_DEF_RUNS          (5)
+#define BENCH_DEF_MTU           (LHDCV5_MTU_3MBPS)
+#define BENCH_DEF_QUALITY       (LHDCV5_QUALITY_LOW)
+#define BENCH_MAX_WRITES        (8)
+#define BENCH_OUT_BYTES         (LHDCV5_MTU_MAX)
+
+typedef enum
+{
+  BENCH_PATH_ENCODE = 0,
+  BENCH_PATH_ENC_PACKET,
+  BENCH_PATH_PKT,
+} BENCH_PATH_T;
+
+typedef struct
+{
+  // setup
+  uint32_t sample_rate;
+  uint32_t bits_per_sample;
+  uint32_t quality;
+  uint32_t mtu;
+  uint32_t blocks;
+  uint32_t runs;
+  uint32_t write_num;
+  uint32_t write_samples[BENCH_MAX_WRITES];   // 0: one block
+
+  // stream
+  uint32_t block_samples;       // per channel
+  uint32_t frame_bytes;         // one sample of all channels
+  uint8_t *pcm;
+  uint8_t *out;
+} bench_t;
+
+typedef struct
+{
+  uint64_t ns;
+  uint32_t packets;
+  uint32_t frames;
+  uint64_t bytes;
+  uint32_t errors;
+} bench_result_t;
+
+static uint64_t bench_now_ns
+(
+    void
+)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static int32_t bench_open
+(
+    const bench_t *bench,
+    HANDLE_LHDCV5_BT *handle
+)
+{
+  if (lhdcv5BT_get_handle (LHDCV5_VERSION_1, handle) != LHDCV5_FRET_SUCCESS)
+  {
+    return -1;
+  }
+
+  if (lhdcv5BT_init_encoder (*handle, bench->sample_rate, bench->bits_per_sample,
+      bench->quality, bench->mtu, 0, 0) != LHDCV5_FRET_SUCCESS)
+  {
+    lhdcv5BT_free_handle (*handle);
+    *handle = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+// one timed pass over the stream
+static int32_t bench_run
+(
+    const bench_t *bench,
+    BENCH_PATH_T path,
+    uint32_t write_samples,
+    bench_result_t *res
+)
+{
+  HANDLE_LHDCV5_BT handle = NULL;
+  uint32_t block_bytes = bench->block_samples * bench->frame_bytes;
+  uint32_t write_bytes = write_samples * bench->frame_bytes;
+  uint32_t total_bytes = bench->blocks * block_bytes;
+  uint32_t out_bytes = 0;
+  uint32_t out_frames = 0;
+  uint32_t used = 0;
+  uint32_t pos = 0;
+  uint32_t len = 0;
+  uint8_t seqno = 0;
+  uint64_t t0 = 0;
+
+  memset (res, 0, sizeof(bench_result_t));
+
+  if (bench_open (bench, &handle) != 0)
+  {
+    return -1;
+  }
+
+  if ((path == BENCH_PATH_PKT) &&
+      (lhdcv5BT_pkt_init (handle, LHDCV5BT_PKT_LATENCY_MID, 0) != LHDCV5_FRET_SUCCESS))
+  {
+    lhdcv5BT_free_handle (handle);
+    return -1;
+  }
+
+  t0 = bench_now_ns ();
+
+  switch (path)
+  {
+  case BENCH_PATH_ENCODE:
+    for (uint32_t b = 0; b < bench->blocks; b++)
+    {
+      if (lhdcv5BT_encode (handle, bench->pcm + b * block_bytes, block_bytes,
+          bench->out, BENCH_OUT_BYTES, &out_bytes, &out_frames) != LHDCV5_FRET_SUCCESS)
+      {
+        res->errors++;
+        break;
+      }
+      res->frames += out_frames;
+      res->bytes += out_bytes;
+    }
+    break;
+
+  case BENCH_PATH_ENC_PACKET:
+    for (uint32_t b = 0; b < bench->blocks; b++)
+    {
+      if (lhdcv5BT_encode_packet (handle, bench->pcm + b * block_bytes, block_bytes,
+          LHDCV5BT_PKT_LATENCY_MID, bench->out, BENCH_OUT_BYTES, 0,
+          &out_bytes, &out_frames) != LHDCV5_FRET_SUCCESS)
+      {
+        res->errors++;
+        break;
+      }
+      res->packets += (out_bytes > 0) ? 1 : 0;
+      res->frames += out_frames;
+      res->bytes += out_bytes;
+    }
+    break;
+
+  case BENCH_PATH_PKT:
+    while (pos < total_bytes)
+    {
+      len = total_bytes - pos;
+      if (len > write_bytes)
+      {
+        len = write_bytes;
+      }
+      if ((lhdcv5BT_pkt_write_pcm (handle, bench->pcm + pos, len, &used) != LHDCV5_FRET_SUCCESS) ||
+          (used == 0))
+      {
+        res->errors++;
+        break;
+      }
+      pos += used;
+
+      for (;;)
+      {
+        if (lhdcv5BT_pkt_get_packet (handle, bench->out, BENCH_OUT_BYTES,
+            &out_bytes, &out_frames) != LHDCV5_FRET_SUCCESS)
+        {
+          res->errors++;
+          break;
+        }
+        if (out_bytes == 0)
+        {
+          break;
+        }
+
+        // a frame larger than the MTU goes out alone
+        if (((out_bytes > bench->mtu) && (out_frames > 1)) ||
+            ((uint32_t) (bench->out[0] >> 2) != out_frames) ||
+            ((bench->out[0] & LHDCV5BT_PKT_LATENCY_MASK) != LHDCV5BT_PKT_LATENCY_MID) ||
+            (bench->out[1] != seqno))
+        {
+          res->errors++;
+        }
+        seqno++;
+        res->packets++;
+        res->frames += out_frames;
+        res->bytes += out_bytes;
+      }
+      if (res->errors > 0)
+      {
+        break;
+      }
+    }
+    break;
+  }
+
+  res->ns = bench_now_ns () - t0;
+
+  lhdcv5BT_free_handle (handle);
+
+  return 0;
+}
+
+static void bench_usage
+(
+    const char *prog
+)
+{
+  fprintf (stderr,
+      "usage: %s [options]\n"
+      "  -r rate        sample rate (Hz), default 48000\n"
+      "  -b bits        bits per sample, default 16\n"
+      "  -Q quality     fixed bit rate index (LHDCV5_QUALITY_T), default %u\n"
+      "  -u mtu         packet size (bytes), default %u\n"
+      "  -n blocks      encoder blocks per run, default %u\n"
+      "  -R runs        timed runs, the fastest is reported, default %u\n"
+      "  -w samples     packetizer write size (samples per channel, 0: one block),\n"
+      "                 repeat for more sizes, default 0, 128 and 1024\n",
+      prog, BENCH_DEF_QUALITY, BENCH_DEF_MTU, BENCH_DEF_BLOCKS, BENCH_DEF_RUNS);
+}
+
+static int32_t bench_report
+(
+    const bench_t *bench,
+    const char *name,
+    BENCH_PATH_T path,
+    uint32_t write_samples
+)
+{
+  bench_result_t res;
+  bench_result_t best;
+  uint32_t frames_max = 0;
+
+  memset (&best, 0, sizeof(best));
+  best.ns = UINT64_MAX;
+
+  for (uint32_t r = 0; r < bench->runs; r++)
+  {
+    if (bench_run (bench, path, write_samples, &res) != 0)
+    {
+      fprintf (stderr, "%s: encoder setup failed\n", name);
+      return -1;
+    }
+    if ((res.errors > 0) || (res.ns < best.ns))
+    {
+      best = res;
+    }
+    if (res.errors > 0)
+    {
+      break;
+    }
+  }
+
+  // the packetizer may still hold a packet being filled and the PCM ring
+  frames_max = bench->blocks;
+  if ((path == BENCH_PATH_PKT) &&
+      (best.frames + LHDCV5BT_PKT_MAX_FRAMES + LHDCV5BT_PKT_MAX_RING_BLOCKS < frames_max))
+  {
+    best.errors++;
+  }
+  if (best.frames > frames_max)
+  {
+    best.errors++;
+  }
+
+  printf ("%-12s %8u %9u %8.1f %9.1f %10.1f  %s\n",
+      name,
+      best.packets,
+      best.frames,
+      (best.packets > 0) ? (double) best.bytes / best.packets : 0.0,
+      (double) best.ns / bench->blocks,
+      (best.packets > 0) ? (double) best.ns / best.packets : 0.0,
+      (best.errors == 0) ? "ok" : "FAIL");
+
+  return (best.errors == 0) ? 0 : -1;
+}
+
+int main
+(
+    int argc,
+    char *argv[]
+)
+{
+  bench_t bench;
+  uint32_t pcm_bytes = 0;
+  uint32_t fails = 0;
+  char name[32];
+  int opt = 0;
+
+  memset (&bench, 0, sizeof(bench));
+  bench.sample_rate = LHDCV5_SR_48000HZ;
+  bench.bits_per_sample = LHDCV5BT_SMPL_FMT_S16;
+  bench.quality = BENCH_DEF_QUALITY;
+  bench.mtu = BENCH_DEF_MTU;
+  bench.blocks = BENCH_DEF_BLOCKS;
+  bench.runs = BENCH_DEF_RUNS;
+
+  while ((opt = getopt (argc, argv, "r:b:Q:u:n:R:w:h")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      bench.sample_rate = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'b':
+      bench.bits_per_sample = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'Q':
+      bench.quality = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'u':
+      bench.mtu = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'n':
+      bench.blocks = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'R':
+      bench.runs = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'w':
+      if (bench.write_num >= BENCH_MAX_WRITES)
+      {
+        bench_usage (argv[0]);
+        return 1;
+      }
+      bench.write_samples[bench.write_num++] = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    default:
+      bench_usage (argv[0]);
+      return 1;
+    }
+  }
+
+  if ((bench.mtu <= LHDCV5BT_PKT_HDR_BYTES) || (bench.mtu > BENCH_OUT_BYTES) ||
+      (bench.blocks == 0) || (bench.runs == 0) || (bench.quality > LHDCV5_QUALITY_MAX_BITRATE) ||
+      ((bench.bits_per_sample != LHDCV5BT_SMPL_FMT_S16) &&
+       (bench.bits_per_sample != LHDCV5BT_SMPL_FMT_S24) &&
+       (bench.bits_per_sample != LHDCV5BT_SMPL_FMT_S32)))
+  {
+    bench_usage (argv[0]);
+    return 1;
+  }
+
+  if (bench.write_num == 0)
+  {
+    bench.write_samples[0] = 0;
+    bench.write_samples[1] = 128;
+    bench.write_samples[2] = 1024;
+    bench.write_num = 3;
+  }
+
+  // block size of this configuration, the stream is sized from it
+  {
+    HANDLE_LHDCV5_BT handle = NULL;
+
+    if ((bench_open (&bench, &handle) != 0) ||
+        (lhdcv5BT_get_block_Size (handle, &bench.block_samples) != LHDCV5_FRET_SUCCESS))
+    {
+      fprintf (stderr, "encoder setup failed\n");
+      return 1;
+    }
+    lhdcv5BT_free_handle (handle);
+  }
+
+  // native input: s16, packed s24 or s32, stereo
+  bench.frame_bytes = 2 * ((bench.bits_per_sample == LHDCV5BT_SMPL_FMT_S24) ? 3 :
+      (bench.bits_per_sample / 8));
+  pcm_bytes = bench.blocks * bench.block_samples * bench.frame_bytes;
+  bench.pcm = (uint8_t *) malloc (pcm_bytes);
+  bench.out = (uint8_t *) malloc (BENCH_OUT_BYTES);
+  if ((bench.pcm == NULL) || (bench.out == NULL))
+  {
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+  for (uint32_t i = 0; i < pcm_bytes; i++)
+  {
+    bench.pcm[i] = (uint8_t) (i * 131u + 7u);
+  }
+
+  printf ("%u Hz, %u bits, quality %u, mtu %u, %u samples per block, %u blocks, best of %u runs\n\n",
+      bench.sample_rate, bench.bits_per_sample, bench.quality, bench.mtu,
+      bench.block_samples, bench.blocks, bench.runs);
+  printf ("%-12s %8s %9s %8s %9s %10s  %s\n",
+      "path", "packets", "frames", "B/pkt", "ns/block", "ns/packet", "check");
+
+  if (bench_report (&bench, "encode", BENCH_PATH_ENCODE, 0) != 0)
+  {
+    fails++;
+  }
+  if (bench_report (&bench, "enc_packet", BENCH_PATH_ENC_PACKET, 0) != 0)
+  {
+    fails++;
+  }
+  for (uint32_t w = 0; w < bench.write_num; w++)
+  {
+    uint32_t samples = bench.write_samples[w];
+
+    if (samples == 0)
+    {
+      samples = bench.block_samples;
+    }
+    snprintf (name, sizeof(name), "pkt/%u", samples);
+    if (bench_report (&bench, name, BENCH_PATH_PKT, samples) != 0)
+    {
+      fails++;
+    }
+  }
+
+  free (bench.pcm);
+  free (bench.out);
+
+  return (fails == 0) ? 0 : 1;
+}
@@ -0,0 +1,739 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lhdcv5_util_sim.h"
+
+// bit rate (kbps) of each LHDCV5_QUALITY_T index, LOW3 runs 240 at 44.1KHz
+static const uint32_t sim_bitrate_table[] =
+{
+  64, 128, 192, 256, 320, 400, 500, 900, 1000, 1100, 1200, 1300, 1400
+};
+#define SIM_BITRATE_NUM       (sizeof(sim_bitrate_table) / sizeof(uint32_t))
+#define SIM_BITRATE_44K_LOW3  (240)
+
+#define SIM_AR_POS_MAX        (32)
+#define SIM_AR_GAIN_MAX       (32)
+
+typedef struct _lhdcv5_util_sim
+{
+  lhdcv5_abr_para_t abr;
+
+  uint32_t frame_duration;      // LHDCV5_FRAME_DURATION_T
+  uint32_t block_size;          // samples per channel of one frame
+  uint32_t mtu;
+  uint32_t max_bitrate_inx;
+  uint32_t min_bitrate_inx;
+
+  bool ext_func[LHDCV5_EXT_FUNC_INVALID];
+  int32_t ar_pos[SIM_AR_POS_MAX];
+  float ar_gain[SIM_AR_GAIN_MAX];
+  uint32_t ar_enabled;
+  int32_t gyro[3];
+
+  uint32_t frame_cnt;
+} lhdcv5_util_sim_t;
+
+static uint32_t sim_bitrate_of
+(
+    const lhdcv5_util_sim_t *sim,
+    uint32_t  bitrate_inx
+)
+{
+  if ((bitrate_inx == LHDCV5_QUALITY_LOW3) && (sim->abr.sample_rate == LHDCV5_SR_44100HZ))
+  {
+    return SIM_BITRATE_44K_LOW3;
+  }
+  return sim_bitrate_table[bitrate_inx];
+}
+
+
+int32_t lhdcv5_util_free_handle
+(
+    HANDLE_LHDCV5_BT	handle
+)
+{
+  if (handle == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_get_mem_req
+(
+    uint32_t			version,
+    uint32_t			* mem_req_bytes
+)
+{
+  if ((version != LHDCV5_VERSION_1) || (mem_req_bytes == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *mem_req_bytes = sizeof(lhdcv5_util_sim_t);
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_get_handle
+(
+    uint32_t			version,
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t            mem_size
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if ((version != LHDCV5_VERSION_1) || (handle == NULL) || (mem_size < sizeof(lhdcv5_util_sim_t)))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  memset (sim, 0, sizeof(lhdcv5_util_sim_t));
+  sim->abr.version = version;
+  sim->abr.qualityStatus = LHDCV5_QUALITY_INVALID;
+  sim->max_bitrate_inx = LHDCV5_QUALITY_MAX_BITRATE;
+  sim->min_bitrate_inx = LHDCV5_QUALITY_LOW0;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_get_target_bitrate
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			* bitrate
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if ((sim == NULL) || (bitrate == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *bitrate = sim->abr.lastBitrate * 1000;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_target_bitrate_inx
+(
+    HANDLE_LHDCV5_BT 	handle,
+    uint32_t 			bitrate_inx,
+    uint32_t			* bitrate_inx_set,
+    bool				upd_qual_status
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+  uint32_t inx = bitrate_inx;
+
+  if ((sim == NULL) || (bitrate_inx_set == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  if (bitrate_inx == LHDCV5_QUALITY_AUTO)
+  {
+    inx = sim->abr.is_lless_enabled ? LHDCV5_VBR_DEFAULT_BITRATE : LHDCV5_ABR_DEFAULT_BITRATE;
+  }
+  else if (bitrate_inx >= SIM_BITRATE_NUM)
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  if (inx > sim->max_bitrate_inx)
+  {
+    inx = sim->max_bitrate_inx;
+  }
+  if (inx < sim->min_bitrate_inx)
+  {
+    inx = sim->min_bitrate_inx;
+  }
+
+  sim->abr.lastBitrate = sim_bitrate_of (sim, inx);
+  if (upd_qual_status)
+  {
+    sim->abr.qualityStatus = bitrate_inx;
+  }
+  *bitrate_inx_set = inx;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_get_current_mtu
+(
+    HANDLE_LHDCV5_BT  handle,
+    uint32_t      *current_mtu
+)
+{
+  if ((handle == NULL) || (current_mtu == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *current_mtu = ((lhdcv5_util_sim_t *) handle)->mtu;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_target_mtu
+(
+    HANDLE_LHDCV5_BT  handle,
+    uint32_t      target_mtu
+)
+{
+  if (handle == NULL)
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->mtu = target_mtu;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_max_bitrate_inx
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			max_bitrate_inx,
+    uint32_t			* max_bitrate_inx_set
+)
+{
+  if ((handle == NULL) || (max_bitrate_inx_set == NULL) || (max_bitrate_inx >= SIM_BITRATE_NUM))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->max_bitrate_inx = max_bitrate_inx;
+  *max_bitrate_inx_set = max_bitrate_inx;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_min_bitrate_inx
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			min_bitrate_inx,
+    uint32_t			* min_bitrate_inx_set
+)
+{
+  if ((handle == NULL) || (min_bitrate_inx_set == NULL) || (min_bitrate_inx >= SIM_BITRATE_NUM))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->min_bitrate_inx = min_bitrate_inx;
+  *min_bitrate_inx_set = min_bitrate_inx;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_adjust_bitrate
+(
+    HANDLE_LHDCV5_BT 	handle,
+    LHDCV5_ENC_TYPE_T	* enc_type_ptr,
+    lhdcv5_abr_para_t	** abr_para_ptr
+)
+{
+  if ((handle == NULL) || (enc_type_ptr == NULL) || (abr_para_ptr == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *enc_type_ptr = LHDCV5_ENC_TYPE_LHDCV5;
+  *abr_para_ptr = &((lhdcv5_util_sim_t *) handle)->abr;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_reset_up_bitrate
+(
+    HANDLE_LHDCV5_BT  handle
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if (sim == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+  sim->abr.upBitrateCnt = 0;
+  sim->abr.upBitrateSum = 0;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_reset_down_bitrate
+(
+    HANDLE_LHDCV5_BT  handle
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if (sim == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+  sim->abr.dnBitrateCnt = 0;
+  sim->abr.dnBitrateSum = 0;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_reset_up_bitrate_vbr
+(
+    HANDLE_LHDCV5_BT  handle
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if (sim == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+  sim->abr.lless_upBitrateSum = 0;
+  sim->abr.lless_upBitrateCnt = 0;
+  sim->abr.lless_upCheckBitrateCnt = 0;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_reset_down_bitrate_vbr
+(
+    HANDLE_LHDCV5_BT  handle
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if (sim == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+  sim->abr.lless_dnBitrateSum = 0;
+  sim->abr.lless_dnBitrateCnt = 0;
+  sim->abr.lless_dnCheckBitrateCnt = 0;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_reset_lossless_stat
+(
+    HANDLE_LHDCV5_BT  handle
+)
+{
+  int32_t func_ret = lhdcv5_util_reset_up_bitrate_vbr (handle);
+
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    return func_ret;
+  }
+  return lhdcv5_util_reset_down_bitrate_vbr (handle);
+}
+
+int32_t lhdcv5_util_get_ext_func_state
+(
+    HANDLE_LHDCV5_BT 	handle,
+    LHDCV5_EXT_FUNC_T 	ext_type,
+    bool				* enable_ptr
+)
+{
+  if ((handle == NULL) || (enable_ptr == NULL) || (ext_type >= LHDCV5_EXT_FUNC_INVALID))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *enable_ptr = ((lhdcv5_util_sim_t *) handle)->ext_func[ext_type];
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_ext_func_state
+(
+    HANDLE_LHDCV5_BT 	handle,
+    LHDCV5_EXT_FUNC_T 	ext_type,
+    bool 				func_enable,
+    uint8_t				* data_ptr,
+    uint32_t			data_len,
+    uint32_t			loop_cnt
+)
+{
+  (void) data_ptr;
+  (void) data_len;
+  (void) loop_cnt;
+
+  if ((handle == NULL) || (ext_type >= LHDCV5_EXT_FUNC_INVALID))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->ext_func[ext_type] = func_enable;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_init_encoder
+(
+    HANDLE_LHDCV5_BT 	handle,
+    uint32_t 			sampling_freq,
+    uint32_t 			bits_per_sample,
+    uint32_t 			bitrate_inx,
+    uint32_t 			frame_duration,
+    uint32_t 			mtu,
+    uint32_t 			interval,
+    uint32_t      lossless_supp
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+  uint32_t bitrate_inx_set = 0;
+
+  (void) interval;
+
+  if (sim == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  sim->abr.sample_rate = sampling_freq;
+  sim->abr.bits_per_sample = bits_per_sample;
+  sim->abr.bits_per_sample_ui = bits_per_sample;
+  sim->abr.is_lless_enabled = lossless_supp ? 1 : 0;
+  sim->abr.is_lless_on = 0;
+  sim->frame_duration = frame_duration;
+  sim->block_size = (uint32_t) (((uint64_t) sampling_freq * frame_duration) / LHDCV5_FRAME_1S);
+  sim->mtu = mtu;
+  sim->frame_cnt = 0;
+
+  lhdcv5_util_reset_up_bitrate (handle);
+  lhdcv5_util_reset_down_bitrate (handle);
+  lhdcv5_util_reset_lossless_stat (handle);
+
+  return lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx, &bitrate_inx_set, true);
+}
+
+int32_t lhdcv5_util_get_block_Size
+(
+    HANDLE_LHDCV5_BT 	handle,
+    uint32_t			* block_size
+)
+{
+  if ((handle == NULL) || (block_size == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *block_size = ((lhdcv5_util_sim_t *) handle)->block_size;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_enc_process
+(
+    HANDLE_LHDCV5_BT 	handle,
+    void				* p_pcm,
+    uint32_t			pcm_bytes,
+    uint8_t				* out_put,
+    uint32_t			out_buf_bytes,
+    uint32_t 			* written,
+    uint32_t 			* out_frames)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+  uint32_t frame_bytes = 0;
+
+  if ((sim == NULL) || (p_pcm == NULL) || (pcm_bytes == 0) ||
+      (out_put == NULL) || (written == NULL) || (out_frames == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  // bytes of one frame at the target bit rate
+  frame_bytes = (sim->abr.lastBitrate * 1000 / 8) * sim->frame_duration / LHDCV5_FRAME_1S;
+  if (out_buf_bytes < frame_bytes)
+  {
+    return LHDCV5_FRET_BUF_NOT_ENOUGH;
+  }
+
+  memset (out_put, 0, frame_bytes);
+  sim->frame_cnt++;
+  *written = frame_bytes;
+  *out_frames = 1;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_get_bitrate
+(
+    uint32_t	bitrate_inx,
+    uint32_t	* bitrate
+)
+{
+  if ((bitrate == NULL) || (bitrate_inx >= SIM_BITRATE_NUM))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *bitrate = sim_bitrate_table[bitrate_inx];
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_get_bitrate_inx
+(
+    uint32_t	bitrate,
+    uint32_t	* bitrate_inx
+)
+{
+  if (bitrate_inx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  if (bitrate == SIM_BITRATE_44K_LOW3)
+  {
+    *bitrate_inx = LHDCV5_QUALITY_LOW3;
+    return LHDCV5_FRET_SUCCESS;
+  }
+
+  for (uint32_t i = 0; i < SIM_BITRATE_NUM; i++)
+  {
+    if (sim_bitrate_table[i] == bitrate)
+    {
+      *bitrate_inx = i;
+      return LHDCV5_FRET_SUCCESS;
+    }
+  }
+  return LHDCV5_FRET_INVALID_INPUT_PARAM;
+}
+
+int32_t lhdcv5_util_set_vbr_up_th
+(
+    HANDLE_LHDCV5_BT   handle,
+    uint32_t  value
+)
+{
+  if ((handle == NULL) || (value > 100))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->abr.lless_upLossyRatioTh = value;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_vbr_dn_th
+(
+    HANDLE_LHDCV5_BT   handle,
+    uint32_t  value
+)
+{
+  if ((handle == NULL) || (value > 100))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->abr.lless_dnLosslessRatioTh = value;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_vbr_up_intv
+(
+    HANDLE_LHDCV5_BT   handle,
+    uint32_t  value
+)
+{
+  if (handle == NULL)
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->abr.lless_upRateTimeCnt = value;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_vbr_dn_intv
+(
+    HANDLE_LHDCV5_BT   handle,
+    uint32_t  value
+)
+{
+  if (handle == NULL)
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->abr.lless_dnRateTimeCnt = value;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_get_lossless_enabled
+(
+    HANDLE_LHDCV5_BT   handle,
+    uint32_t  * enabled
+)
+{
+  if ((handle == NULL) || (enabled == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *enabled = ((lhdcv5_util_sim_t *) handle)->abr.is_lless_enabled;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_lossless_enabled
+(
+    HANDLE_LHDCV5_BT   handle,
+    uint32_t  enabled
+)
+{
+  if (handle == NULL)
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->abr.is_lless_enabled = enabled ? 1 : 0;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_get_lossless_status
+(
+    HANDLE_LHDCV5_BT   handle,
+    uint32_t  * status
+)
+{
+  if ((handle == NULL) || (status == NULL))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  *status = ((lhdcv5_util_sim_t *) handle)->abr.is_lless_on;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_set_lossless_status
+(
+    HANDLE_LHDCV5_BT   handle,
+    uint32_t  status
+)
+{
+  if (handle == NULL)
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  ((lhdcv5_util_sim_t *) handle)->abr.is_lless_on = status ? 1 : 0;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_util_vbr_process ()
+//
+// lossless bit rate tuning: one step down when the share of lossless
+// frames reaches the down threshold, one step up when the share of lossy
+// frames reaches the up threshold, within the VBR bit rate range
+//----------------------------------------------------------------
+int32_t lhdcv5_util_vbr_process
+(
+    HANDLE_LHDCV5_BT   handle,
+    LHDCV5_VBR_TYPE_T vbr_type
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+  lhdcv5_abr_para_t *abr = NULL;
+  uint32_t bitrate_inx = 0;
+  uint32_t bitrate_inx_set = 0;
+
+  if (sim == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+  if (vbr_type >= LHDCV5_VBR_INVALID)
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  abr = &sim->abr;
+
+  if ((abr->lless_dnCheckBitrateCnt >= abr->lless_dnRateTimeCnt) && (abr->lless_dnBitrateCnt > 0))
+  {
+    if ((abr->lless_dnBitrateSum * 100 / abr->lless_dnBitrateCnt >= abr->lless_dnLosslessRatioTh) &&
+        (abr->lastBitrate > LHDCV5_VBR_MIN_BITRATE) &&
+        (lhdcv5_util_get_bitrate_inx (abr->lastBitrate, &bitrate_inx) == LHDCV5_FRET_SUCCESS))
+    {
+      lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx - 1, &bitrate_inx_set, false);
+    }
+    lhdcv5_util_reset_down_bitrate_vbr (handle);
+  }
+
+  if ((abr->lless_upCheckBitrateCnt >= abr->lless_upRateTimeCnt) && (abr->lless_upBitrateCnt > 0))
+  {
+    if ((abr->lless_upBitrateSum * 100 / abr->lless_upBitrateCnt >= abr->lless_upLossyRatioTh) &&
+        (abr->lastBitrate < LHDCV5_VBR_MAX_BITRATE) &&
+        (lhdcv5_util_get_bitrate_inx (abr->lastBitrate, &bitrate_inx) == LHDCV5_FRET_SUCCESS))
+    {
+      lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx + 1, &bitrate_inx_set, false);
+    }
+    lhdcv5_util_reset_up_bitrate_vbr (handle);
+  }
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_ar_set_gyro_pos
+(
+    HANDLE_LHDCV5_BT 	handle,
+    int32_t 			world_coordinate_x,
+    int32_t 			world_coordinate_y,
+    int32_t				world_coordinate_z
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if (sim == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+  sim->gyro[0] = world_coordinate_x;
+  sim->gyro[1] = world_coordinate_y;
+  sim->gyro[2] = world_coordinate_z;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_ar_set_cfg
+(
+    HANDLE_LHDCV5_BT 	handle,
+    int32_t 			* pos_ptr,
+    uint32_t			pos_item_num,
+    float 				* gain_ptr,
+    uint32_t			gain_item_num,
+    uint32_t	 		app_ar_enabled
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if ((sim == NULL) || (pos_ptr == NULL) || (gain_ptr == NULL) ||
+      (pos_item_num > SIM_AR_POS_MAX) || (gain_item_num > SIM_AR_GAIN_MAX))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  memcpy (sim->ar_pos, pos_ptr, pos_item_num * sizeof(int32_t));
+  memcpy (sim->ar_gain, gain_ptr, gain_item_num * sizeof(float));
+  sim->ar_enabled = app_ar_enabled;
+  return LHDCV5_FRET_SUCCESS;
+}
+
+int32_t lhdcv5_util_ar_get_cfg
+(
+    HANDLE_LHDCV5_BT 	handle,
+    int32_t 			* pos_ptr,
+    uint32_t			pos_item_num,
+    float 				* gain_ptr,
+    uint32_t			gain_item_num
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if ((sim == NULL) || (pos_ptr == NULL) || (gain_ptr == NULL) ||
+      (pos_item_num > SIM_AR_POS_MAX) || (gain_item_num > SIM_AR_GAIN_MAX))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+  memcpy (pos_ptr, sim->ar_pos, pos_item_num * sizeof(int32_t));
+  memcpy (gain_ptr, sim->ar_gain, gain_item_num * sizeof(float));
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_util_sim_feed_frames ()
+//
+// account encoded frames into the ABR lossless statistics, as the encoder
+// does on each lhdcv5_util_enc_process () call
+//----------------------------------------------------------------
+int32_t lhdcv5_util_sim_feed_frames
+(
+    HANDLE_LHDCV5_BT  handle,
+    uint32_t  frames,
+    uint32_t  lossless_frames
+)
+{
+  lhdcv5_util_sim_t *sim = (lhdcv5_util_sim_t *) handle;
+
+  if ((sim == NULL) || (lossless_frames > frames))
+  {
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  sim->frame_cnt += frames;
+  if (!sim->abr.is_lless_enabled || (frames == 0))
+  {
+    return LHDCV5_FRET_SUCCESS;
+  }
+
+  sim->abr.is_lless_on = (lossless_frames * 2 >= frames) ? 1 : 0;
+  sim->abr.lless_dnBitrateSum += lossless_frames;
+  sim->abr.lless_dnBitrateCnt += frames;
+  sim->abr.lless_upBitrateSum += frames - lossless_frames;
+  sim->abr.lless_upBitrateCnt += frames;
+  return LHDCV5_FRET_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#ifndef __LHDCV5_UTIL_SIM_H__
+#define __LHDCV5_UTIL_SIM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lhdcv5_api.h"
+
+// Deterministic host stand-in for the lhdcv5_util_* encoder API.
+//
+// It keeps the bit rate and ABR/VBR bookkeeping of the real encoder so that
+// lhdcv5BT_enc.c runs unchanged, but does no audio coding: frames are
+// sized from the target bit rate and the lossless share of the encoded
+// frames is whatever the simulator feeds in.
+
+// account encoded frames, lossless_frames of them coded lossless
+int32_t lhdcv5_util_sim_feed_frames
+(
+    HANDLE_LHDCV5_BT  handle,
+    uint32_t  frames,
+    uint32_t  lossless_frames
+);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //End of __LHDCV5_UTIL_SIM_H__
@@ -3,8 +3,13 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
 #include "lhdcv5BT.h"
 #include "lhdcv5BT_ext_func.h"
+#include "lhdcv5BT_enc_pcm.h"
+#include "lhdcv5BT_enc_src.h"
 
 #define LOG_TAG "lhdcv5BT_enc"
 #include <cutils/log.h>
@@ -31,11 +36,10 @@
 #define ABR_DOWN_TARGET_STAGE             0   // The target bitrate stage of ABR table that ABR go when downgrade
 #define PROMOTE_TO_VBR_TARGET_STAGE       2   // The target bitrate stage of VBR table that when ABR go promoting to VBR
 
-static uint32_t gABR_table_index = 0;   // record current bitrate index in ABR table
-static uint32_t auto_bitrate_adjust_table_lhdcv5_44k[] = {128, 192, 240, 320, 400, ABR_MAX_STAGE_BITRATE};
-static uint32_t auto_bitrate_adjust_table_lhdcv5_48k[] = {128, 192, 256, 320, 400, ABR_MAX_STAGE_BITRATE};
-static uint32_t auto_bitrate_adjust_table_lhdcv5_96k[] = {256, 320, 400, 400, 400, ABR_MAX_STAGE_BITRATE};
-static uint32_t auto_bitrate_adjust_table_lhdcv5_192k[] = {256, 320, 400, 400, 400, ABR_MAX_STAGE_BITRATE};
+static const uint32_t auto_bitrate_adjust_table_lhdcv5_44k[] = {128, 192, 240, 320, 400, ABR_MAX_STAGE_BITRATE};
+static const uint32_t auto_bitrate_adjust_table_lhdcv5_48k[] = {128, 192, 256, 320, 400, ABR_MAX_STAGE_BITRATE};
+static const uint32_t auto_bitrate_adjust_table_lhdcv5_96k[] = {256, 320, 400, 400, 400, ABR_MAX_STAGE_BITRATE};
+static const uint32_t auto_bitrate_adjust_table_lhdcv5_192k[] = {256, 320, 400, 400, 400, ABR_MAX_STAGE_BITRATE};
 
 #define LHDCV5_44K_BITRATE_ELEMENTS_SIZE   (sizeof(auto_bitrate_adjust_table_lhdcv5_44k) / sizeof(uint32_t))
 #define LHDCV5_48K_BITRATE_ELEMENTS_SIZE   (sizeof(auto_bitrate_adjust_table_lhdcv5_48k) / sizeof(uint32_t))
@@ -52,18 +56,197 @@ static uint32_t auto_bitrate_adjust_table_lhdcv5_192k[] = {256, 320, 400, 400, 4
 #define DEMOTE_TO_ABR_QLENGTH_THRESHOLD   0     // The threshold that demoting step from VBR to ABR
 #define DEMOTE_TO_ABR_TARGET_STAGE        0     // The target bitrate stage in ABR table of demoting step
 
-static uint32_t var_bitrate_adjust_table_lhdcv5_48k[] = {900, 1000, 1100, 1200, 1300, LHDCV5_VBR_MAX_BITRATE};
+#define PROMOTE_TO_VBR_TARGET_STAGE_HIRES 2     // The target bitrate stage of 24-bit/96KHz VBR tables when promoting
+#define DEMOTE_TO_ABR_TIME_CNT_HIRES      2     // checking interval of demoting 24-bit/96KHz VBR to ABR (by tick count)
+
+static const uint32_t var_bitrate_adjust_table_lhdcv5_48k[] = {900, 1000, 1100, 1200, 1300, LHDCV5_VBR_MAX_BITRATE};
+static const uint32_t var_bitrate_adjust_table_lhdcv5_48k_24bit[] = {1000, 1100, 1200, 1300, LHDCV5_VBR_MAX_BITRATE};
+static const uint32_t var_bitrate_adjust_table_lhdcv5_96k[] = {1100, 1200, 1300, LHDCV5_VBR_MAX_BITRATE};
 #define LHDCV5_48K_VAR_BITRATE_ELEMENTS_SIZE  (sizeof(var_bitrate_adjust_table_lhdcv5_48k) / sizeof(uint32_t))
+#define LHDCV5_48K_24BIT_VAR_BITRATE_ELEMENTS_SIZE  (sizeof(var_bitrate_adjust_table_lhdcv5_48k_24bit) / sizeof(uint32_t))
+#define LHDCV5_96K_VAR_BITRATE_ELEMENTS_SIZE  (sizeof(var_bitrate_adjust_table_lhdcv5_96k) / sizeof(uint32_t))
 /*******************************************************************************/
 
-// Lossless statistics debug log:
+// Per-handle encoder wrapper state
+/*******************************************************************************/
+// The context sits in front of the memory handed to lhdcv5_util_get_handle ();
+// the handle given to callers still points at the util memory, so it can be
+// passed to the util library unchanged.
+#define LHDCV5BT_ENC_CTX_MAGIC            (0x4C483545)  // "LH5E"
+// keeps the util memory at malloc alignment
+#define LHDCV5BT_ENC_ALIGN(x)             (((x) + 15) & ~((size_t) 15))
+#define LHDCV5BT_ENC_CTX_BYTES            LHDCV5BT_ENC_ALIGN(sizeof(lhdcv5BT_enc_ctx_t))
+
+// Statistics counters. Each one has a single writer (the encode path or the
+// bit rate controller) and is read by lhdcv5BT_get_stats () from any thread,
+// so all accesses are relaxed atomics and no lock is taken.
+#define LHDCV5BT_STAT_ADD(ctr, v)         __atomic_fetch_add (&(ctr), (v), __ATOMIC_RELAXED)
+#define LHDCV5BT_STAT_LOAD(ctr)           __atomic_load_n (&(ctr), __ATOMIC_RELAXED)
+#define LHDCV5BT_STAT_STORE(ctr, v)       __atomic_store_n (&(ctr), (v), __ATOMIC_RELAXED)
+
+// LHDC is stereo only
+#define LHDCV5BT_ENC_CHANNELS             2
+
+// Packetizer: the stage takes an encoder output of up to one MTU behind a
+// packet that is just short of full.
+#define LHDCV5BT_PKT_STAGE_BYTES          (2 * LHDCV5_MTU_MAX)
+
+// AR gyro mailbox: reads of a pose before the encoder keeps the previous one
+#define LHDCV5BT_GYRO_READ_TRIES          4
+
+// Staged extended functions: lhdcv5BT_enc_ext_set_t.mask bits
+#define LHDCV5BT_EXT_STATE(field)         (1u << (field))   // LHDCV5_EXT_FUNC_T on/off
+#define LHDCV5BT_EXT_META                 (1u << 8)         // META state with its data
+#define LHDCV5BT_EXT_AR_CFG               (1u << 9)         // AR positions and gains
+// blocks the encoder skips a busy ext_lock for before it waits on it
+#define LHDCV5BT_EXT_TRY_BLOCKS           4
+
+// Resampler: output frames of one pass into the packetizer ring
+#define LHDCV5BT_SRC_STAGE_FRAMES         128
+
+// Encode pipeline: one block handed between the caller and the encode
+// thread. The two semaphores hand the block over and back, so each side
+// only touches the fields while it owns the block.
+typedef struct _lhdcv5BT_enc_pipe
+{
+  HANDLE_LHDCV5_BT handle;
+  pthread_t thread;
+  sem_t queued;                 // block waiting for the encode thread
+  sem_t encoded;                // block encoded, back to the caller
+  bool stop;                    // asks the encode thread to exit
+  uint32_t block_bytes;
+  uint32_t in_block_bytes;      // block as the caller passes it, see lhdcv5BT_set_input_format ()
+  uint8_t *pcm;                 // block of PCM samples
+  uint8_t *out;                 // caller's output buffer
+  uint32_t out_buf_bytes;
+  int32_t ret;                  // lhdcv5BT_encode () result
+  uint32_t out_bytes;
+  uint32_t out_frames;
+} lhdcv5BT_enc_pipe_t;
+
+// Latest gyro pose, a sequence lock: the writer makes seq odd while it
+// updates the coordinates, so the encoder never waits on the sensor
+// thread and retries or skips a frame instead.
+typedef struct _lhdcv5BT_enc_gyro_box
+{
+  uint32_t seq;                 // 0: no pose yet, odd: update in progress
+  int32_t x;
+  int32_t y;
+  int32_t z;
+  uint32_t applied;             // seq of the pose handed to the encoder
+} lhdcv5BT_enc_gyro_box_t;
+
+// A set of extended function changes, applied together by the encode thread
+typedef struct _lhdcv5BT_enc_ext_set
+{
+  uint32_t mask;                // LHDCV5BT_EXT_* items held
+  bool state[LHDCV5_EXT_FUNC_INVALID];
+  bool meta_enabled;
+  uint32_t meta_len;
+  uint32_t meta_loop_cnt;
+  uint8_t meta[LHDCV5_META_LEN_MAX];
+  lhdcv5_ar_cfg_t ar;
+} lhdcv5BT_enc_ext_set_t;
+
+typedef struct _lhdcv5BT_enc_stats_ctr
+{
+  uint32_t rate_frames[LHDCV5BT_STATS_RATE_NUM];
+  uint32_t rate_dwell_ms[LHDCV5BT_STATS_RATE_NUM];
+  uint32_t adjust_ticks;
+  uint32_t up_switches;
+  uint32_t down_switches;
+  uint32_t lossless_frames;
+  uint32_t lossy_frames;
+  uint32_t queue_hist[LHDCV5BT_STATS_QUEUE_BINS];
+  uint32_t encode_calls;
+  uint32_t encode_max_us;
+  uint64_t encode_total_us;
+} lhdcv5BT_enc_stats_ctr_t;
+
+typedef struct _lhdcv5BT_enc_ctx
+{
+  uint32_t magic;
+  uint32_t mem_req_bytes;       // bytes handed to lhdcv5_util_get_handle ()
+
+  // serializes the bit rate controller against lhdcv5BT_set_abr_policy ()
+  pthread_mutex_t lock;
+
+  // ABR/VBR ladders and thresholds, and current stage on the active ABR ladder
+  lhdcv5_abr_policy_t policy;
+  uint32_t abr_table_index;
+
+  // LHDCV5BT_ABR_MODE_PREDICTIVE estimates (Q8 packets)
+  bool pred_primed;             // first sample taken
+  uint32_t pred_prev_queue;     // queue length of the previous tick
+  int32_t pred_queue_q8;        // smoothed queue length
+  int32_t pred_slope_q8;        // smoothed queue length change per tick
+  int32_t pred_latency_us;      // smoothed send latency, 0 until measured
+  int32_t pred_integ_q8;        // integral of the congestion error
+  uint32_t pred_up_cnt;         // consecutive ticks asking for a step up
+  uint32_t pred_down_hold;      // ticks left before another step down
+
+  // statistics, see lhdcv5BT_get_stats ()
+  uint32_t interval_ms;         // period of lhdcv5BT_adjust_bitrate () calls
+  lhdcv5BT_enc_stats_ctr_t stats;
+
+  // PCM input conversion, see lhdcv5BT_set_input_format ()
+  uint32_t bits_per_sample;     // set by lhdcv5BT_init_encoder ()
+  LHDCV5BT_INPUT_FMT_T input_fmt;
+  bool input_planar;
+  lhdcv5_enc_pcm_conv_t conv;   // set up with the encoder
+  uint8_t *cvt_buf;             // one converted block for lhdcv5BT_encode ()
+
+  // sample rate conversion, see lhdcv5BT_set_resampler ()
+  uint32_t src_in_freq;         // 0: input at the encoder rate
+  LHDCV5BT_SRC_QUALITY_T src_quality;
+  lhdcv5_enc_src_t *src;        // set up with the encoder when the rates differ
+
+  // packetizer, see lhdcv5BT_pkt_init (); owned by the encode thread
+  uint8_t *pkt_ring;            // PCM ring, the packet stage follows it
+  uint32_t pkt_block_bytes;     // PCM bytes of one lhdcv5BT_encode () call
+  uint32_t pkt_ring_bytes;      // a multiple of pkt_block_bytes, so no block wraps
+  uint32_t pkt_ring_rd;
+  uint32_t pkt_ring_fill;
+  uint8_t *pkt_stage;           // frames of the packet being built
+  uint32_t pkt_stage_bytes;
+  uint32_t pkt_stage_frames;
+  uint32_t pkt_carry_bytes;     // frames behind the stage that open the next packet
+  uint32_t pkt_carry_frames;
+  uint32_t pkt_chunk_bytes;     // latest lhdcv5BT_encode () output, the expected next one
+  bool pkt_ready;               // stage holds a complete packet
+  uint8_t pkt_latency;
+  uint8_t pkt_seqno;            // also counted by lhdcv5BT_encode_packet ()
+
+  // encode pipeline, see lhdcv5BT_pipe_start ()
+  lhdcv5BT_enc_pipe_t *pipe;
+
+  // AR head tracking, written by lhdcv5BT_set_user_exdata ()
+  lhdcv5BT_enc_gyro_box_t gyro;
+
+  // extended functions, see lhdcv5BT_ext_commit (); the encode thread tries
+  // ext_lock, so a commit in progress delays the apply by a block or more
+  pthread_mutex_t ext_lock;
+  lhdcv5BT_enc_ext_set_t ext_staged;    // lhdcv5BT_ext_stage_* ()
+  lhdcv5BT_enc_ext_set_t ext_pending;   // committed, mask read without the lock
+  uint32_t ext_busy_blocks;             // blocks ext_lock was found busy in a row
+} lhdcv5BT_enc_ctx_t;
 /*******************************************************************************/
-#define LOSSLESS_DEBUG  // show statistics of lossless ratio in VBR or fixed bit rate mode
 
-#ifdef LOSSLESS_DEBUG
-#define LLESS_SHOW_BITRATE_TICKS         (50)   // define how often to log a short-term statistics (by tick count).
-#define LLESS_RECORD_TICKS               (6000) // define total number ticks to a long-term statistics (by tick count).
-#endif
+// Predictive controller: default tuning (Q8: 256 = one packet in queue)
+/*******************************************************************************/
+#define PRED_EWMA_SHIFT                   3     // weight 1/8 of a new sample
+#define PRED_HORIZON_TICKS                8     // look-ahead of the queue trend (by tick count)
+#define PRED_TARGET_QUEUE                 1     // queue length steered to (packets)
+#define PRED_TARGET_LATENCY_US            20000 // send latency regarded as healthy
+#define PRED_LATENCY_PER_PACKET_US        10000 // send latency counted as one queued packet
+#define PRED_LINK_QUALITY_TH              60    // link hint (0~100) below which pressure is added
+#define PRED_KP_Q8                        256   // proportional gain
+#define PRED_KI_Q8                        16    // integral gain
+#define PRED_DOWN_TH_Q8                   512   // output stepping down one stage per multiple
+#define PRED_UP_TH_Q8                     128   // output below minus this counts toward a step up
+#define PRED_DOWN_HOLD_TICKS              4     // ticks after a step down before the next one
+#define PRED_UP_HOLD_TICKS                300   // consecutive quiet ticks to step up one stage
+#define PRED_INTEG_LIMIT_Q8               (16 << 8) // anti-windup clamp of the integral term
 /*******************************************************************************/
 
 static const char * rate_to_string
@@ -96,739 +279,3777 @@ static const char * rate_to_string
   }
 }
 
-#ifdef LOSSLESS_DEBUG
 //----------------------------------------------------------------
-// lhdcv5_enc_lossless_dump_statis ()
+// lhdcv5_enc_get_ctx ()
 //
-// print lossless statistics during VBR
-//  Parameter
-//    handle: lhdc encoder handle
-//    lless_para: loss statistics params
-//    mode: print FIX or VBR
-//  Return
-//    LHDCV5_FRET_SUCCESS: succeed to return the bit rate (index)
-//    otherwise: fail to return the bit rate (index)
+// return the wrapper context of a handle
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//	Return
+//		NULL: handle is not allocated by lhdcv5BT_get_handle ()
 //----------------------------------------------------------------
-static int32_t lhdcv5_enc_lossless_dump_statis(lhdcv5_abr_para_t * lless_para)
+static lhdcv5BT_enc_ctx_t * lhdcv5_enc_get_ctx
+(
+    HANDLE_LHDCV5_BT  handle
+)
 {
-  uint32_t dnlosslessRatio = 0;
-  uint32_t uplossyRatio = 0;
-  float fBitrateSum = 0.0f;
-  float fBitrateCnt = 0.0f;
-  float dnBitrateAVG_all = 0.0;
-  float upBitrateAVG_all = 0.0;
-  int func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
 
-  if (lless_para == NULL)
+  if (handle == NULL)
   {
-    ALOGW ("%s: Handle is NULL!", __func__);
-    return LHDCV5_FRET_INVALID_HANDLE_CB;
+    return NULL;
   }
 
-  // print lossless ratio periodically
-  if (lless_para->lless_stat_showBitrateCnt % LLESS_SHOW_BITRATE_TICKS == 0)
+  ctx = (lhdcv5BT_enc_ctx_t *) ((uint8_t *) handle - LHDCV5BT_ENC_CTX_BYTES);
+  if (ctx->magic != LHDCV5BT_ENC_CTX_MAGIC)
   {
-    // calculate current lossless ratio
-    if (lless_para->lless_dnBitrateCnt > 0)
-    {
-      fBitrateCnt = (float) lless_para->lless_dnBitrateCnt;
-      fBitrateSum = (float) lless_para->lless_dnBitrateSum;
-      dnlosslessRatio = (uint32_t) ((fBitrateSum / fBitrateCnt) * 100);
-    }
-    if (lless_para->lless_upBitrateCnt > 0)
-    {
-      fBitrateCnt = (float) lless_para->lless_upBitrateCnt;
-      fBitrateSum = (float) lless_para->lless_upBitrateSum;
-      uplossyRatio = (uint32_t) ((fBitrateSum / fBitrateCnt) * 100);
-    }
+    ALOGW ("%s: Handle (%p) is not allocated by lhdcv5BT_get_handle!", __func__, handle);
+    return NULL;
+  }
 
-    // print statistics of lossless ratio per tick
-    ALOGD ("[LLESS_DBG][VBR_ADJ],statisK_BRate,%04u,%03u,%03u,dn:[%u/%u],up:[%u/%u] TH:[%u,%u] INTV:[%u,%u]",
-        lless_para->lastBitrate,
-        dnlosslessRatio,
-        uplossyRatio,
-        lless_para->lless_dnBitrateSum,
-        lless_para->lless_dnBitrateCnt,
-        lless_para->lless_upBitrateSum,
-        lless_para->lless_upBitrateCnt,
-        lless_para->lless_dnLosslessRatioTh,
-        lless_para->lless_upLossyRatioTh,
-        lless_para->lless_dnRateTimeCnt,
-        lless_para->lless_upRateTimeCnt);
+  return ctx;
+}
 
-    // print statistics of lossless ratio after a duration
-    if (lless_para->lless_stat_bitrateRec_done == true)
-    {
-      goto reset_before_leave;
-    }
+//----------------------------------------------------------------
+// lhdcv5_enc_load_ladder ()
+//
+// copy a built-in bit rate table into a ladder
+//	Parameter
+//		ladder: ladder to fill
+//		table: bit rates (kbps), lowest stage first
+//		size: number of stages in table
+//----------------------------------------------------------------
+static void lhdcv5_enc_load_ladder
+(
+    lhdcv5_bitrate_ladder_t *ladder,
+    const uint32_t *table,
+    uint32_t  size
+)
+{
+  ladder->stage_num = size;
+  memcpy (ladder->bitrate, table, size * sizeof(uint32_t));
+}
 
-    if (lless_para->lless_stat_showBitrateCnt > LLESS_RECORD_TICKS)
-    {
-      lless_para->lless_stat_bitrateRec_done = true;
+//----------------------------------------------------------------
+// lhdcv5_enc_load_default_policy ()
+//
+// fill a policy with the built-in ABR/VBR tables and thresholds
+//	Parameter
+//		policy: policy to fill
+//----------------------------------------------------------------
+static void lhdcv5_enc_load_default_policy
+(
+    lhdcv5_abr_policy_t *policy
+)
+{
+  lhdcv5_abr_rate_policy_t *abr = NULL;
+  lhdcv5_vbr_policy_t *vbr = NULL;
 
-      if(lless_para->lless_stat_dnBitrateCnt_all > 0)
-      {
-        dnBitrateAVG_all = lless_para->lless_stat_dnBitrateSum_all / lless_para->lless_stat_dnBitrateCnt_all;
-      }
-      ALOGD ("[LLESS_DBG][VBR_ADJ],statisK_BRate,FINAL_DN,%.3f,%u,%u",
-          (dnBitrateAVG_all * 100),
-          (int)lless_para->lless_stat_dnBitrateSum_all,
-          (int)lless_para->lless_stat_dnBitrateCnt_all);
+  memset (policy, 0, sizeof(lhdcv5_abr_policy_t));
 
-      if(lless_para->lless_stat_upBitrateCnt_all > 0)
-      {
-        upBitrateAVG_all = lless_para->lless_stat_upBitrateSum_all / lless_para->lless_stat_upBitrateCnt_all;
-      }
-      ALOGD ("[LLESS_DBG][VBR_ADJ],statisK_BRate,FINAL_UP,%.3f,%u,%u",
-          (upBitrateAVG_all * 100),
-          (int)lless_para->lless_stat_upBitrateSum_all,
-          (int)lless_para->lless_stat_upBitrateCnt_all);
-    }
-    else
-    {
-      lless_para->lless_stat_dnBitrateSum_all += (float)lless_para->lless_dnBitrateSum;
-      lless_para->lless_stat_dnBitrateCnt_all += (float)lless_para->lless_dnBitrateCnt;
+  lhdcv5_enc_load_ladder (&policy->abr[LHDCV5_ABR_44K_RES].ladder,
+      auto_bitrate_adjust_table_lhdcv5_44k, LHDCV5_44K_BITRATE_ELEMENTS_SIZE);
+  lhdcv5_enc_load_ladder (&policy->abr[LHDCV5_ABR_48K_RES].ladder,
+      auto_bitrate_adjust_table_lhdcv5_48k, LHDCV5_48K_BITRATE_ELEMENTS_SIZE);
+  lhdcv5_enc_load_ladder (&policy->abr[LHDCV5_ABR_96K_RES].ladder,
+      auto_bitrate_adjust_table_lhdcv5_96k, LHDCV5_96K_BITRATE_ELEMENTS_SIZE);
+  lhdcv5_enc_load_ladder (&policy->abr[LHDCV5_ABR_192K_RES].ladder,
+      auto_bitrate_adjust_table_lhdcv5_192k, LHDCV5_192K_BITRATE_ELEMENTS_SIZE);
 
-      lless_para->lless_stat_upBitrateSum_all += (float)lless_para->lless_upBitrateSum;
-      lless_para->lless_stat_upBitrateCnt_all += (float)lless_para->lless_upBitrateCnt;
-    }
-    goto reset_before_leave;
+  for (uint32_t i = 0; i < LHDCV5_ABR_INVALID; i++)
+  {
+    abr = &policy->abr[i];
+    abr->up_time_cnt = ABR_UP_RATE_TIME_CNT;
+    abr->down_time_cnt = ABR_DOWN_RATE_TIME_CNT;
+    abr->up_queue_th = ABR_UP_QUEUE_LENGTH_THRESHOLD;
+    abr->down_queue_th = ABR_DOWN_QUEUE_LENGTH_THRESHOLD;
+    abr->down_target_stage = ABR_DOWN_TARGET_STAGE;
   }
 
-  lless_para->lless_stat_showBitrateCnt++;
-  return LHDCV5_FRET_SUCCESS;
+  lhdcv5_enc_load_ladder (&policy->vbr[LHDCV5BT_VBR_48K_RES].ladder,
+      var_bitrate_adjust_table_lhdcv5_48k, LHDCV5_48K_VAR_BITRATE_ELEMENTS_SIZE);
+  lhdcv5_enc_load_ladder (&policy->vbr[LHDCV5BT_VBR_48K_24BIT_RES].ladder,
+      var_bitrate_adjust_table_lhdcv5_48k_24bit, LHDCV5_48K_24BIT_VAR_BITRATE_ELEMENTS_SIZE);
+  lhdcv5_enc_load_ladder (&policy->vbr[LHDCV5BT_VBR_96K_RES].ladder,
+      var_bitrate_adjust_table_lhdcv5_96k, LHDCV5_96K_VAR_BITRATE_ELEMENTS_SIZE);
 
-reset_before_leave:
-  lless_para->lless_stat_showBitrateCnt++;
-  return func_ret;
+  for (uint32_t i = 0; i < LHDCV5BT_VBR_INVALID; i++)
+  {
+    vbr = &policy->vbr[i];
+    vbr->promote_target_stage = PROMOTE_TO_VBR_TARGET_STAGE;
+    vbr->up_time_cnt = VBR_UP_RATE_TIME_CNT;
+    vbr->down_time_cnt = VBR_DOWN_RATE_TIME_CNT;
+    vbr->up_lossy_ratio_th = VBR_UP_LOSSY_RATIO_THRESHOLD;
+    vbr->down_lossless_ratio_th = VBR_DOWN_LOSSLESS_RATIO_THRESHOLD;
+    vbr->demote_time_cnt = ABR_DOWN_RATE_TIME_CNT;
+    vbr->demote_queue_th = DEMOTE_TO_ABR_QLENGTH_THRESHOLD;
+    vbr->demote_target_stage = DEMOTE_TO_ABR_TARGET_STAGE;
+  }
+
+  // hi-res lossless needs more bits: promote higher, and leave VBR sooner
+  // since the transmit queue builds up faster at these bit rates
+  policy->vbr[LHDCV5BT_VBR_48K_24BIT_RES].promote_target_stage = PROMOTE_TO_VBR_TARGET_STAGE_HIRES;
+  policy->vbr[LHDCV5BT_VBR_48K_24BIT_RES].demote_time_cnt = DEMOTE_TO_ABR_TIME_CNT_HIRES;
+  policy->vbr[LHDCV5BT_VBR_96K_RES].promote_target_stage = PROMOTE_TO_VBR_TARGET_STAGE_HIRES;
+  policy->vbr[LHDCV5BT_VBR_96K_RES].demote_time_cnt = DEMOTE_TO_ABR_TIME_CNT_HIRES;
+
+  policy->mode = LHDCV5BT_ABR_MODE_QUEUE;
+  policy->pred.ewma_shift = PRED_EWMA_SHIFT;
+  policy->pred.horizon_ticks = PRED_HORIZON_TICKS;
+  policy->pred.target_queue = PRED_TARGET_QUEUE;
+  policy->pred.target_latency_us = PRED_TARGET_LATENCY_US;
+  policy->pred.latency_per_packet_us = PRED_LATENCY_PER_PACKET_US;
+  policy->pred.link_quality_th = PRED_LINK_QUALITY_TH;
+  policy->pred.kp_q8 = PRED_KP_Q8;
+  policy->pred.ki_q8 = PRED_KI_Q8;
+  policy->pred.down_th_q8 = PRED_DOWN_TH_Q8;
+  policy->pred.up_th_q8 = PRED_UP_TH_Q8;
+  policy->pred.down_hold_ticks = PRED_DOWN_HOLD_TICKS;
+  policy->pred.up_hold_ticks = PRED_UP_HOLD_TICKS;
 }
-#endif
 
 //----------------------------------------------------------------
-// lhdcv5_enc_inx_of_abr_bitrate ()
+// lhdcv5_enc_abr_type_of_vbr ()
 //
-// return the bit rate (index) respond to input bit rate (kbps)
+// return the ABR table a VBR layer demotes to and promotes from
 //	Parameter
-//		abr_type: ABR type
-//		bitrate: bit rate (kbps)
-//		bitrate_inx: ABR bit rate (index) returned
+//		vbr_type: VBR table type
+//----------------------------------------------------------------
+static LHDCV5_ABR_TYPE_T lhdcv5_enc_abr_type_of_vbr
+(
+    uint32_t  vbr_type
+)
+{
+  switch (vbr_type)
+  {
+  case LHDCV5BT_VBR_48K_RES:
+  case LHDCV5BT_VBR_48K_24BIT_RES:
+    return LHDCV5_ABR_48K_RES;
+  case LHDCV5BT_VBR_96K_RES:
+    return LHDCV5_ABR_96K_RES;
+  default:
+    return LHDCV5_ABR_INVALID;
+  }
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_check_ladder ()
+//
+// check a bit rate ladder is usable by the encoder
+//	Parameter
+//		ladder: ladder to check
+//		min_bitrate: lowest bit rate (kbps) allowed
+//		max_bitrate: highest bit rate (kbps) allowed
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to return the bit rate (index)
-//		otherwise: fail to return the bit rate (index)
+//		true: ladder is valid
 //----------------------------------------------------------------
-static int lhdcv5_enc_inx_of_abr_bitrate
+static bool lhdcv5_enc_check_ladder
 (
-    LHDCV5_ABR_TYPE_T abr_type,
-    uint32_t  bitrate,
-    uint32_t  *bitrate_inx
+    const lhdcv5_bitrate_ladder_t *ladder,
+    uint32_t  min_bitrate,
+    uint32_t  max_bitrate
 )
 {
-  uint32_t element_size = LHDCV5_48K_BITRATE_ELEMENTS_SIZE;
-  uint32_t *abr_table = NULL;
+  uint32_t bitrate_inx = 0;
 
-  if (bitrate_inx == NULL)
+  if ((ladder->stage_num == 0) || (ladder->stage_num > LHDCV5BT_ABR_MAX_STAGES))
   {
-    ALOGW ("%s: Input parameter is NULL!!!", __func__);
-    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+    ALOGW ("%s: Invalid number of stages (%u)!", __func__, ladder->stage_num);
+    return false;
   }
 
-  if (abr_type == LHDCV5_ABR_44K_RES)
+  for (uint32_t i = 0; i < ladder->stage_num; i++)
   {
-    element_size = LHDCV5_44K_BITRATE_ELEMENTS_SIZE;
+    if ((ladder->bitrate[i] < min_bitrate) || (ladder->bitrate[i] > max_bitrate) ||
+        ((i > 0) && (ladder->bitrate[i] < ladder->bitrate[i - 1])))
+    {
+      ALOGW ("%s: Invalid bit rate (%u) at stage %u!", __func__, ladder->bitrate[i], i);
+      return false;
+    }
 
-    abr_table = &(auto_bitrate_adjust_table_lhdcv5_44k[0]);
+    if (lhdcv5_util_get_bitrate_inx (ladder->bitrate[i], &bitrate_inx) != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("%s: Bit rate (%u) at stage %u is not supported!", __func__, ladder->bitrate[i], i);
+      return false;
+    }
   }
-  else if (abr_type == LHDCV5_ABR_48K_RES)
-  {
-    element_size = LHDCV5_48K_BITRATE_ELEMENTS_SIZE;
 
-    abr_table = &(auto_bitrate_adjust_table_lhdcv5_48k[0]);
-  }
-  else if (abr_type == LHDCV5_ABR_96K_RES)
-  {
-    element_size = LHDCV5_96K_BITRATE_ELEMENTS_SIZE;
+  return true;
+}
 
-    abr_table = &(auto_bitrate_adjust_table_lhdcv5_96k[0]);
-  }
-  else if (abr_type == LHDCV5_ABR_192K_RES)
-  {
-    element_size = LHDCV5_192K_BITRATE_ELEMENTS_SIZE;
+//----------------------------------------------------------------
+// lhdcv5_enc_check_policy ()
+//
+// check every ladder, interval and threshold of an ABR/VBR policy
+//	Parameter
+//		policy: policy to check
+//	Return
+//		LHDCV5_FRET_SUCCESS: policy is valid
+//		otherwise: policy is rejected
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_check_policy
+(
+    const lhdcv5_abr_policy_t *policy
+)
+{
+  const lhdcv5_abr_rate_policy_t *abr = NULL;
+  const lhdcv5_vbr_policy_t *vbr = NULL;
+  const lhdcv5_abr_pred_policy_t *pred = &policy->pred;
 
-    abr_table = &(auto_bitrate_adjust_table_lhdcv5_192k[0]);
-  }
-  else
+  if (policy->mode >= LHDCV5BT_ABR_MODE_INVALID)
   {
-    ALOGW ("%s: Invalid ABR type (%d)!", __func__, abr_type);
+    ALOGW ("%s: Invalid controller mode (%u)!", __func__, policy->mode);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  if ((bitrate <= 0) || (bitrate > abr_table[element_size - 1]))
+  if ((pred->ewma_shift > 8) || (pred->horizon_ticks > 1000) || (pred->target_queue > 1000) ||
+      (pred->latency_per_packet_us == 0) || (pred->link_quality_th > 100) ||
+      (pred->kp_q8 > (16 << 8)) || (pred->ki_q8 > (16 << 8)) ||
+      (pred->down_th_q8 == 0) || (pred->down_th_q8 > PRED_INTEG_LIMIT_Q8) ||
+      (pred->up_th_q8 > PRED_INTEG_LIMIT_Q8) ||
+      (pred->down_hold_ticks == 0) || (pred->up_hold_ticks == 0))
   {
-    ALOGW ("%s: bit rate is out of range (%d)!!!", __func__, bitrate);
+    ALOGW ("%s: Invalid predictive controller tuning!", __func__);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
+  for (uint32_t i = 0; i < LHDCV5_ABR_INVALID; i++)
+  {
+    abr = &policy->abr[i];
 
-  for (uint32_t i = 0; i < element_size; i++)
+    if (!lhdcv5_enc_check_ladder (&abr->ladder, 1, LHDCV5_VBR_MIN_BITRATE - 1))
+    {
+      ALOGW ("%s: Invalid ABR ladder of type %u!", __func__, i);
+      return LHDCV5_FRET_INVALID_INPUT_PARAM;
+    }
+
+    if ((abr->up_time_cnt == 0) || (abr->down_time_cnt == 0) ||
+        (abr->down_target_stage >= abr->ladder.stage_num))
+    {
+      ALOGW ("%s: Invalid ABR intervals/target of type %u (%u, %u, %u)!", __func__, i,
+          abr->up_time_cnt, abr->down_time_cnt, abr->down_target_stage);
+      return LHDCV5_FRET_INVALID_INPUT_PARAM;
+    }
+  }
+
+  for (uint32_t i = 0; i < LHDCV5BT_VBR_INVALID; i++)
   {
-    if (abr_table[i] >= bitrate)
+    vbr = &policy->vbr[i];
+
+    if (!lhdcv5_enc_check_ladder (&vbr->ladder, LHDCV5_VBR_MIN_BITRATE, LHDCV5_VBR_MAX_BITRATE))
     {
-      *bitrate_inx = i;
-      return LHDCV5_FRET_SUCCESS;
+      ALOGW ("%s: Invalid VBR ladder of type %u!", __func__, i);
+      return LHDCV5_FRET_INVALID_INPUT_PARAM;
+    }
+
+    if ((vbr->up_time_cnt == 0) || (vbr->down_time_cnt == 0) || (vbr->demote_time_cnt == 0) ||
+        (vbr->up_lossy_ratio_th > 100) || (vbr->down_lossless_ratio_th > 100))
+    {
+      ALOGW ("%s: Invalid VBR intervals/thresholds of type %u!", __func__, i);
+      return LHDCV5_FRET_INVALID_INPUT_PARAM;
+    }
+
+    if ((vbr->promote_target_stage >= vbr->ladder.stage_num) ||
+        (vbr->demote_target_stage >= policy->abr[lhdcv5_enc_abr_type_of_vbr (i)].ladder.stage_num))
+    {
+      ALOGW ("%s: Invalid VBR promote/demote target of type %u (%u, %u)!", __func__, i,
+          vbr->promote_target_stage, vbr->demote_target_stage);
+      return LHDCV5_FRET_INVALID_INPUT_PARAM;
     }
   }
 
-  ALOGW ("%s: Fail to find bit rate (index) (%d)!", __func__, bitrate);
-  return LHDCV5_FRET_ERROR;
+  return LHDCV5_FRET_SUCCESS;
 }
 
 //----------------------------------------------------------------
-// lhdcv5_enc_vbr_adjust_bitrate ()
+// lhdcv5_enc_apply_vbr_policy ()
 //
-// Adjust bit rate automatically according to number of lossless frames for LHDC 5.0 encoding
-//  Parameter
-//    handle: a pointer to the resource allocated and is returned
-//        by function lhdcBT_get_handle ()
-//    handle: a pointer to VBR parameters
-//    queueLen: number of packets in a2dp transmit queue
-//  Return
-//    LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically
-//    otherwise: fail to adjust bit rate automatically
+// hand the VBR intervals and thresholds over to the encoder
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		vbr: VBR policy to apply
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to apply the VBR policy
+//		otherwise: fail to apply the VBR policy
 //----------------------------------------------------------------
-static int lhdcv5_enc_vbr_adjust_bitrate
+static int32_t lhdcv5_enc_apply_vbr_policy
 (
     HANDLE_LHDCV5_BT  handle,
-    lhdcv5_abr_para_t *handle_vbr,
-    uint32_t  queueLen
+    const lhdcv5_vbr_policy_t *vbr
 )
 {
-  uint32_t new_bitrate_inx = 0;
-  uint32_t new_bitrate_inx_set = 0;
-  uint32_t last_bitrate_inx = 0;
-
-  uint32_t *abr_table = &(auto_bitrate_adjust_table_lhdcv5_48k[0]);
-  LHDCV5_VBR_TYPE_T vbr_type = LHDCV5_VBR_48K_RES;
-
-  uint32_t queueLength = 0;
-  uint32_t vbr_demote_bitrate_inx = 0;
-
   int32_t func_ret = LHDCV5_FRET_SUCCESS;
 
-  if (handle == NULL)
+  func_ret = lhdcv5_util_set_vbr_up_th(handle, vbr->up_lossy_ratio_th);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
   {
-    ALOGW ("%s: handle is NULL!", __func__);
-    return LHDCV5_FRET_INVALID_HANDLE_CB;
+    ALOGW ("%s: lhdcv5_util_set_vbr_up_th error (%d)!", __func__, func_ret);
+    return func_ret;
   }
 
-  if (handle_vbr == NULL)
+  func_ret = lhdcv5_util_set_vbr_dn_th(handle, vbr->down_lossless_ratio_th);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
   {
-    ALOGW ("%s: handle_vbr is NULL!", __func__);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    ALOGW ("%s: lhdcv5_util_set_vbr_dn_th error (%d)!", __func__, func_ret);
+    return func_ret;
   }
 
-  if (queueLen < 0)
+  func_ret = lhdcv5_util_set_vbr_up_intv(handle, vbr->up_time_cnt);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
   {
-    ALOGW ("%s: Invalid queue length (%u)!", __func__, queueLen);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    ALOGW ("%s: lhdcv5_util_set_vbr_up_intv error (%d)!", __func__, func_ret);
+    return func_ret;
   }
 
-  if (handle_vbr->qualityStatus != LHDCV5_QUALITY_AUTO)
+  func_ret = lhdcv5_util_set_vbr_dn_intv(handle, vbr->down_time_cnt);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
   {
-    ALOGW ("%s: Not in Auto-BitRate mode (%d)", __func__, handle_vbr->qualityStatus);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    ALOGW ("%s: lhdcv5_util_set_vbr_dn_intv error (%d)!", __func__, func_ret);
+    return func_ret;
   }
 
-  if (handle_vbr->sample_rate != LHDCV5_SR_48000HZ)
-  {
-    ALOGW ("%s: Sample rate is invalid (%u)!", __func__, handle_vbr->sample_rate);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
-  }
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_init_ctx ()
+//
+// set up a wrapper context with the built-in ABR/VBR policy
+//	Parameter
+//		ctx: wrapper context of the handle
+//		mem_req_bytes: bytes of util memory following the context
+//----------------------------------------------------------------
+static void lhdcv5_enc_init_ctx
+(
+    lhdcv5BT_enc_ctx_t *ctx,
+    uint32_t  mem_req_bytes
+)
+{
+  memset (ctx, 0, sizeof(lhdcv5BT_enc_ctx_t));
+  ctx->magic = LHDCV5BT_ENC_CTX_MAGIC;
+  ctx->mem_req_bytes = mem_req_bytes;
+  pthread_mutex_init (&ctx->lock, NULL);
+  pthread_mutex_init (&ctx->ext_lock, NULL);
+
+  lhdcv5_enc_load_default_policy (&ctx->policy);
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_reset_pred ()
+//
+// drop the estimates of the predictive controller
+//	Parameter
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static void lhdcv5_enc_reset_pred
+(
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  ctx->pred_primed = false;
+  ctx->pred_prev_queue = 0;
+  ctx->pred_queue_q8 = 0;
+  ctx->pred_slope_q8 = 0;
+  ctx->pred_latency_us = 0;
+  ctx->pred_integ_q8 = 0;
+  ctx->pred_up_cnt = 0;
+  ctx->pred_down_hold = 0;
+}
 
-  if (handle_vbr->bits_per_sample != LHDCV5BT_SMPL_FMT_S16)
+//----------------------------------------------------------------
+// lhdcv5_enc_vbr_type_of ()
+//
+// return the VBR type of a stream running ABR+VBR hybrid mode
+//	Parameter
+//		is_lless_enabled: lossless is enabled on the stream
+//		sample_rate: sample rate (Hz)
+//		bits_per_sample: bits per sample
+//	Return
+//		LHDCV5BT_VBR_INVALID: stream runs ABR (lossy) only
+//----------------------------------------------------------------
+static LHDCV5BT_VBR_TYPE_T lhdcv5_enc_vbr_type_of
+(
+    uint32_t  is_lless_enabled,
+    uint32_t  sample_rate,
+    uint32_t  bits_per_sample
+)
+{
+  if (is_lless_enabled != 1)
   {
-    ALOGW ("%s: Bit per sample is invalid (%u)!", __func__, handle_vbr->bits_per_sample);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    return LHDCV5BT_VBR_INVALID;
   }
 
-  //
-  // VBR to ABR demoting mechanism
-  //
-  // exam queueLength if need demoting to ABR layer from VBR
-  if (handle_vbr->dnBitrateCnt > 0 && handle_vbr->dnBitrateCnt >= ABR_DOWN_RATE_TIME_CNT)
+  switch (sample_rate)
   {
-    queueLength = handle_vbr->dnBitrateSum / handle_vbr->dnBitrateCnt;
-
-    func_ret = lhdcv5_util_reset_down_bitrate (handle);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
+  case LHDCV5_SR_48000HZ:
+    if (bits_per_sample == LHDCV5BT_SMPL_FMT_S16)
     {
-      ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_down_bitrate error %d",  func_ret);
-      goto fail;
+      return LHDCV5BT_VBR_48K_RES;
     }
-
-    if (queueLength > DEMOTE_TO_ABR_QLENGTH_THRESHOLD)
+    if (bits_per_sample == LHDCV5BT_SMPL_FMT_S24)
     {
-      ALOGV ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) queueLength: %u", queueLength);
+      return LHDCV5BT_VBR_48K_24BIT_RES;
+    }
+    return LHDCV5BT_VBR_INVALID;
+  case LHDCV5_SR_96000HZ:
+    return LHDCV5BT_VBR_96K_RES;
+  default:
+    return LHDCV5BT_VBR_INVALID;
+  }
+}
 
-      func_ret = lhdcv5_util_get_bitrate_inx (handle_vbr->lastBitrate, &last_bitrate_inx);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_get_bitrate_inx(%d) error %d",
-            handle_vbr->lastBitrate, func_ret);
-        goto fail;
-      }
+//----------------------------------------------------------------
+// lhdcv5_enc_abr_type_of ()
+//
+// return the ABR table type used at a sample rate
+//	Parameter
+//		sample_rate: sample rate (Hz)
+//	Return
+//		LHDCV5_ABR_INVALID: no ABR table for the sample rate
+//----------------------------------------------------------------
+static LHDCV5_ABR_TYPE_T lhdcv5_enc_abr_type_of
+(
+    uint32_t  sample_rate
+)
+{
+  switch (sample_rate)
+  {
+  case LHDCV5_SR_44100HZ:
+    return LHDCV5_ABR_44K_RES;
+  case LHDCV5_SR_48000HZ:
+    return LHDCV5_ABR_48K_RES;
+  case LHDCV5_SR_96000HZ:
+    return LHDCV5_ABR_96K_RES;
+  case LHDCV5_SR_192000HZ:
+    return LHDCV5_ABR_192K_RES;
+  default:
+    return LHDCV5_ABR_INVALID;
+  }
+}
 
-      vbr_demote_bitrate_inx = DEMOTE_TO_ABR_TARGET_STAGE;
-      func_ret = lhdcv5_util_get_bitrate_inx (abr_table[vbr_demote_bitrate_inx], &new_bitrate_inx);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_get_bitrate_inx(%d) error %d",
-            abr_table[vbr_demote_bitrate_inx], func_ret);
-        goto fail;
-      }
+//----------------------------------------------------------------
+// lhdcv5_enc_reset_stats ()
+//
+// clear the statistics counters of a handle
+//	Parameter
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static void lhdcv5_enc_reset_stats
+(
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  lhdcv5BT_enc_stats_ctr_t *ctr = &ctx->stats;
 
-      ALOGD ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) bitrate(%u)[%u] to bitrate(%u)[%u] queueLength(%u)",
-          handle_vbr->lastBitrate, last_bitrate_inx,
-          abr_table[vbr_demote_bitrate_inx], new_bitrate_inx,
-          queueLength);
-
-      // set new bitrate to ABR table
-      func_ret = lhdcv5_util_set_target_bitrate_inx (handle, new_bitrate_inx, &new_bitrate_inx_set, false);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_set_target_bitrate_inx (%d) error %d",
-            new_bitrate_inx, func_ret);
-        goto fail;
-      }
-
-      // reset counters
-      func_ret = lhdcv5_util_reset_down_bitrate (handle);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_down_bitrate error %d",  func_ret);
-        goto fail;
-      }
-      func_ret = lhdcv5_util_reset_up_bitrate (handle);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_up_bitrate error %d", func_ret);
-        goto fail;
-      }
-      func_ret = lhdcv5_util_reset_down_bitrate_vbr (handle);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_down_bitrate_vbr error %d", func_ret);
-        goto fail;
-      }
-      func_ret = lhdcv5_util_reset_up_bitrate_vbr (handle);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_up_bitrate_vbr error %d", func_ret);
-        goto fail;
-      }
-
-      return LHDCV5_FRET_SUCCESS;
-    }
+  for (uint32_t i = 0; i < LHDCV5BT_STATS_RATE_NUM; i++)
+  {
+    LHDCV5BT_STAT_STORE (ctr->rate_frames[i], 0);
+    LHDCV5BT_STAT_STORE (ctr->rate_dwell_ms[i], 0);
   }
+  for (uint32_t i = 0; i < LHDCV5BT_STATS_QUEUE_BINS; i++)
+  {
+    LHDCV5BT_STAT_STORE (ctr->queue_hist[i], 0);
+  }
+  LHDCV5BT_STAT_STORE (ctr->adjust_ticks, 0);
+  LHDCV5BT_STAT_STORE (ctr->up_switches, 0);
+  LHDCV5BT_STAT_STORE (ctr->down_switches, 0);
+  LHDCV5BT_STAT_STORE (ctr->lossless_frames, 0);
+  LHDCV5BT_STAT_STORE (ctr->lossy_frames, 0);
+  LHDCV5BT_STAT_STORE (ctr->encode_calls, 0);
+  LHDCV5BT_STAT_STORE (ctr->encode_max_us, 0);
+  LHDCV5BT_STAT_STORE (ctr->encode_total_us, 0);
+}
 
-  //
-  // VBR mechanism
-  //
-#ifdef LOSSLESS_DEBUG
-  lhdcv5_enc_lossless_dump_statis(handle_vbr);
-#endif
+//----------------------------------------------------------------
+// lhdcv5_enc_stats_adjust ()
+//
+// count one bit rate controller tick: the queue length seen, the time
+// spent at the bit rate before the tick and the switch it made
+//	Parameter
+//		ctx: wrapper context of the handle
+//		queue_len: number of packets in queue
+//		last_bitrate: bit rate (kbps) before the tick
+//		new_bitrate: bit rate (kbps) after the tick
+//----------------------------------------------------------------
+static void lhdcv5_enc_stats_adjust
+(
+    lhdcv5BT_enc_ctx_t *ctx,
+    uint32_t  queue_len,
+    uint32_t  last_bitrate,
+    uint32_t  new_bitrate
+)
+{
+  lhdcv5BT_enc_stats_ctr_t *ctr = &ctx->stats;
+  uint32_t bitrate_inx = 0;
 
-  func_ret = lhdcv5_util_vbr_process(handle, vbr_type);
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  LHDCV5BT_STAT_ADD (ctr->adjust_ticks, 1);
+  LHDCV5BT_STAT_ADD (ctr->queue_hist[(queue_len < LHDCV5BT_STATS_QUEUE_BINS) ?
+      queue_len : (LHDCV5BT_STATS_QUEUE_BINS - 1)], 1);
+
+  if ((lhdcv5_util_get_bitrate_inx (last_bitrate, &bitrate_inx) == LHDCV5_FRET_SUCCESS) &&
+      (bitrate_inx < LHDCV5BT_STATS_RATE_NUM))
   {
-    ALOGW ("[AUTO_BITRATE][VBR_ADJ] lhdcv5_util_vbr_process error %d", func_ret);
-    goto fail;
+    LHDCV5BT_STAT_ADD (ctr->rate_dwell_ms[bitrate_inx], ctx->interval_ms);
   }
 
-#ifdef DEBUG_ABR_VBR_HYBRID //debug test: when reach to min VBR, force a DEMOTE to ABR in next round
-  if (handle_vbr->lastBitrate == LHDCV5_VBR_MIN_BITRATE) {
-    handle_vbr->dnBitrateSum += 10000;
-    ALOGD ("[AUTO_BITRATE][VBR_ADJ](Test) generate a demote event");
+  if (new_bitrate > last_bitrate)
+  {
+    LHDCV5BT_STAT_ADD (ctr->up_switches, 1);
   }
-#endif
-
-fail:
-  ///////////////////////////////
-  // update params for VBR demoting check
-  if (queueLen > 0)
+  else if (new_bitrate < last_bitrate)
   {
-    handle_vbr->upBitrateSum += queueLen;
-    handle_vbr->dnBitrateSum += queueLen;
+    LHDCV5BT_STAT_ADD (ctr->down_switches, 1);
   }
-  handle_vbr->upBitrateCnt++;
-  handle_vbr->dnBitrateCnt++;
-  ///////////////////////////////
-
-  handle_vbr->lless_dnCheckBitrateCnt++;
-  handle_vbr->lless_upCheckBitrateCnt++;
-
-  return func_ret;
 }
 
 //----------------------------------------------------------------
-// lhdcv5_enc_abr_adjust_bitrate ()
+// lhdcv5_enc_stats_encode ()
 //
-// Adjust bit rate automatically according to number of packets in queue for LHDC 5.0 encoding
+// count one lhdcv5BT_encode () call
 //	Parameter
 //		handle: a pointer to the resource allocated and is returned
-//				by function lhdcBT_get_handle ()
-//		handle: a pointer to ABR parameters
-//		queueLen: number of packets in a2dp transmit queue
-//	Return
-//		LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically 
-//		otherwise: fail to adjust bit rate automatically 
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//		frames: frames encoded by the call
+//		elapsed_us: time taken by the encoder
 //----------------------------------------------------------------
-static int lhdcv5_enc_abr_adjust_bitrate
+static void lhdcv5_enc_stats_encode
 (
     HANDLE_LHDCV5_BT  handle,
-    lhdcv5_abr_para_t *handle_abr,
-    uint32_t  queueLen
-) 
+    lhdcv5BT_enc_ctx_t *ctx,
+    uint32_t  frames,
+    uint32_t  elapsed_us
+)
 {
-  uint32_t element_size = LHDCV5_48K_BITRATE_ELEMENTS_SIZE;
-  uint32_t new_abr_bitrate_inx = 0;
-  uint32_t abr_promote_bitrate_inx = 0;
-  uint32_t new_bitrate_inx = 0;
-  uint32_t new_bitrate_inx_set = 0;
-  uint32_t last_bitrate_inx = 0;
-  uint32_t last_abr_bitrate_inx = 0;
-  uint32_t *abr_table = &(auto_bitrate_adjust_table_lhdcv5_48k[0]);
-  uint32_t *vbr_table = &(var_bitrate_adjust_table_lhdcv5_48k[0]);
-  LHDCV5_ABR_TYPE_T	abr_type = LHDCV5_ABR_48K_RES;
-  int32_t func_ret = LHDCV5_FRET_SUCCESS;
-  uint32_t queueLength = 0;
-  uint32_t queuSumTmp = 0;
+  lhdcv5BT_enc_stats_ctr_t *ctr = &ctx->stats;
+  uint32_t bitrate = 0;
+  uint32_t bitrate_inx = 0;
   uint32_t lossless_status = 0;
 
-  if (handle == NULL)
+  LHDCV5BT_STAT_ADD (ctr->encode_calls, 1);
+  LHDCV5BT_STAT_ADD (ctr->encode_total_us, elapsed_us);
+  // the encode path is the only writer of the maximum
+  if (elapsed_us > LHDCV5BT_STAT_LOAD (ctr->encode_max_us))
   {
-    ALOGW ("%s: handle is NULL!", __func__);
-    return LHDCV5_FRET_INVALID_HANDLE_CB;
+    LHDCV5BT_STAT_STORE (ctr->encode_max_us, elapsed_us);
   }
 
-  if (handle_abr == NULL)
+  if (frames == 0)
   {
-    ALOGW ("%s: handle_abr is NULL!", __func__);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    return;
   }
 
-  if (handle_abr->qualityStatus != LHDCV5_QUALITY_AUTO)
+  if ((lhdcv5_util_get_target_bitrate (handle, &bitrate) == LHDCV5_FRET_SUCCESS) &&
+      (lhdcv5_util_get_bitrate_inx (bitrate / 1000, &bitrate_inx) == LHDCV5_FRET_SUCCESS) &&
+      (bitrate_inx < LHDCV5BT_STATS_RATE_NUM))
   {
-    ALOGW ("%s: Not in Auto-BitRate mode (%d)", __func__, handle_abr->qualityStatus);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    LHDCV5BT_STAT_ADD (ctr->rate_frames[bitrate_inx], frames);
   }
 
-  if (queueLen < 0)
+  if ((lhdcv5_util_get_lossless_status (handle, &lossless_status) == LHDCV5_FRET_SUCCESS) &&
+      (lossless_status != 0))
   {
-    ALOGW ("%s: Invalid queue length (%u)!", __func__, queueLen);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    LHDCV5BT_STAT_ADD (ctr->lossless_frames, frames);
   }
+  else
+  {
+    LHDCV5BT_STAT_ADD (ctr->lossy_frames, frames);
+  }
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_block_bytes ()
+//
+// return PCM bytes of one lhdcv5BT_encode () call, 0 before the encoder
+// is initialized
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static uint32_t lhdcv5_enc_block_bytes
+(
+    HANDLE_LHDCV5_BT  handle,
+    const lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  uint32_t samples_per_frame = 0;
 
-  if (handle_abr->sample_rate == LHDCV5_SR_44100HZ)
+  if ((ctx->bits_per_sample == 0) ||
+      (lhdcv5_util_get_block_Size (handle, &samples_per_frame) != LHDCV5_FRET_SUCCESS))
   {
-    abr_type = LHDCV5_ABR_44K_RES;
-    element_size = LHDCV5_44K_BITRATE_ELEMENTS_SIZE;
-    abr_table = &(auto_bitrate_adjust_table_lhdcv5_44k[0]);
+    return 0;
   }
-  else if (handle_abr->sample_rate == LHDCV5_SR_48000HZ)
+
+  return samples_per_frame * LHDCV5BT_ENC_CHANNELS * (ctx->bits_per_sample / 8);
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_in_block_bytes ()
+//
+// return PCM bytes of one lhdcv5BT_encode () call in the input format of
+// lhdcv5BT_set_input_format (), 0 before the encoder is initialized
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static uint32_t lhdcv5_enc_in_block_bytes
+(
+    HANDLE_LHDCV5_BT  handle,
+    const lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  uint32_t block_bytes = lhdcv5_enc_block_bytes (handle, ctx);
+
+  if ((block_bytes == 0) || (ctx->conv.out_bytes == 0))
   {
-    abr_type = LHDCV5_ABR_48K_RES;
-    element_size = LHDCV5_48K_BITRATE_ELEMENTS_SIZE;
-    abr_table = &(auto_bitrate_adjust_table_lhdcv5_48k[0]);
+    return 0;
   }
-  else if (handle_abr->sample_rate == LHDCV5_SR_96000HZ)
+
+  return block_bytes / ctx->conv.out_bytes * ctx->conv.in_bytes;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_release_input ()
+//
+// drop the input conversion, it is set up again with the encoder
+//	Parameter
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static void lhdcv5_enc_release_input
+(
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  free (ctx->cvt_buf);
+  ctx->cvt_buf = NULL;
+  memset (&ctx->conv, 0, sizeof(lhdcv5_enc_pcm_conv_t));
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_setup_input ()
+//
+// set up the conversion from the input format to the sample format of
+// an initialized encoder
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set up the conversion
+//		otherwise: fail to set up the conversion
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_setup_input
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  static const lhdcv5_enc_pcm_layout_t in_layouts[LHDCV5BT_INPUT_FMT_INVALID] = {
+    LHDCV5_ENC_PCM_S16,           // LHDCV5BT_INPUT_FMT_NATIVE, replaced below
+    LHDCV5_ENC_PCM_S16,
+    LHDCV5_ENC_PCM_S24_PACKED,
+    LHDCV5_ENC_PCM_S24_IN32,
+    LHDCV5_ENC_PCM_S32,
+    LHDCV5_ENC_PCM_FLOAT,
+  };
+  lhdcv5_enc_pcm_layout_t out_layout = LHDCV5_ENC_PCM_S16;
+  lhdcv5_enc_pcm_layout_t in_layout = LHDCV5_ENC_PCM_S16;
+  uint32_t block_bytes = 0;
+
+  lhdcv5_enc_release_input (ctx);
+
+  block_bytes = lhdcv5_enc_block_bytes (handle, ctx);
+  if (block_bytes == 0)
   {
-    abr_type = LHDCV5_ABR_96K_RES;
-    element_size = LHDCV5_96K_BITRATE_ELEMENTS_SIZE;
-    abr_table = &(auto_bitrate_adjust_table_lhdcv5_96k[0]);
+    return LHDCV5_FRET_CODEC_NOT_READY;
   }
-  else if (handle_abr->sample_rate == LHDCV5_SR_192000HZ)
+
+  if (ctx->bits_per_sample == LHDCV5BT_SMPL_FMT_S24)
   {
-    abr_type = LHDCV5_ABR_192K_RES;
-    element_size = LHDCV5_192K_BITRATE_ELEMENTS_SIZE;
-    abr_table = &(auto_bitrate_adjust_table_lhdcv5_192k[0]);
+    out_layout = LHDCV5_ENC_PCM_S24_PACKED;
   }
-  else
+  else if (ctx->bits_per_sample == LHDCV5BT_SMPL_FMT_S32)
   {
-    ALOGW ("%s: Sample rate is invalid (%u)!", __func__, handle_abr->sample_rate);
-    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    out_layout = LHDCV5_ENC_PCM_S32;
   }
+  in_layout = (ctx->input_fmt == LHDCV5BT_INPUT_FMT_NATIVE) ?
+      out_layout : in_layouts[ctx->input_fmt];
 
-  if (handle_abr->dnBitrateCnt > 0 && handle_abr->dnBitrateCnt >= ABR_DOWN_RATE_TIME_CNT)
+  if (lhdcv5_enc_pcm_conv_init (&ctx->conv, in_layout, out_layout, ctx->input_planar) != 0)
   {
-    queueLength = handle_abr->dnBitrateSum / handle_abr->dnBitrateCnt;
+    ALOGW ("%s: Unsupported input format (%u)!", __func__, ctx->input_fmt);
+    return LHDCV5_FRET_ERROR;
+  }
 
-    func_ret = lhdcv5_util_reset_down_bitrate (handle);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
+  if (ctx->conv.active)
+  {
+    ctx->cvt_buf = (uint8_t *) malloc (block_bytes);
+    if (ctx->cvt_buf == NULL)
     {
-      ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_reset_down_bitrate error %d",  func_ret);
-      goto fail;
+      ALOGW ("%s: Fail to allocate memory for input conversion!", __func__);
+      memset (&ctx->conv, 0, sizeof(lhdcv5_enc_pcm_conv_t));
+      return LHDCV5_FRET_ERROR;
     }
+  }
 
-    if (queueLength > ABR_DOWN_QUEUE_LENGTH_THRESHOLD)
-    {
-      ALOGV ("[AUTO_BITRATE][ABR_ADJ](DN) current queueLength:%u", queueLength);
-
-      func_ret = lhdcv5_enc_inx_of_abr_bitrate (
-          abr_type,
-          handle_abr->lastBitrate,
-          &last_abr_bitrate_inx);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_enc_inx_of_abr_bitrate error %d", func_ret);
-        goto fail;
-      }
-
-      func_ret = lhdcv5_util_get_bitrate_inx (handle_abr->lastBitrate, &last_bitrate_inx);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_get_bitrate_inx error %d",  func_ret);
-        goto fail;
-      }
-
-      new_abr_bitrate_inx = ABR_DOWN_TARGET_STAGE;
-      func_ret = lhdcv5_util_get_bitrate_inx (abr_table[new_abr_bitrate_inx], &new_bitrate_inx);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_get_bitrate_inx error %d",  func_ret);
-        goto fail;
-      }
+  ALOGD ("%s: input format %u%s, %u -> %u bytes per sample (%s)", __func__,
+      ctx->input_fmt, ctx->input_planar ? " planar" : "",
+      ctx->conv.in_bytes, ctx->conv.out_bytes, ctx->conv.isa);
 
-      if (new_bitrate_inx <= last_bitrate_inx &&
-          new_abr_bitrate_inx < gABR_table_index)
-      {
-        func_ret = lhdcv5_util_set_target_bitrate_inx (handle, new_bitrate_inx, &new_bitrate_inx_set, false);
-        if (func_ret != LHDCV5_FRET_SUCCESS)
-        {
-          ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_set_target_bitrate_inx error %d", func_ret);
-          goto fail;
-        }
+  return LHDCV5_FRET_SUCCESS;
+}
 
-        lhdcv5_util_get_lossless_status(handle, &lossless_status);
-        if (func_ret != LHDCV5_FRET_SUCCESS)
-        {
-          ALOGW ("[AUTO_BITRATE][VBR_ADJ](DN) lhdcv5_util_get_lossless_status error %d", func_ret);
-          goto fail;
-        }
+//----------------------------------------------------------------
+// lhdcv5_enc_setup_src ()
+//
+// set up the resampler from the input rate of lhdcv5BT_set_resampler ()
+// to the encoder rate, none when they are the same
+//	Parameter
+//		ctx: wrapper context of the handle
+//		sampling_freq: sample frequency of the encoder
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set up the resampler
+//		otherwise: fail to set up the resampler
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_setup_src
+(
+    lhdcv5BT_enc_ctx_t *ctx,
+    uint32_t  sampling_freq
+)
+{
+  lhdcv5_enc_src_destroy (ctx->src);
+  ctx->src = NULL;
 
-        ALOGD ("[AUTO_BITRATE][ABR_ADJ](DN) bitrate(%u)[%u] to bitrate(%u)[%u], queueLength(%u) lossless_on(%u)",
-            abr_table[gABR_table_index], gABR_table_index,
-            abr_table[new_abr_bitrate_inx], new_abr_bitrate_inx,
-            queueLength,
-            lossless_status);
-        func_ret = lhdcv5_util_reset_up_bitrate (handle);
-        if (func_ret != LHDCV5_FRET_SUCCESS)
-        {
-          ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_reset_up_bitrate error %d", func_ret);
-          goto fail;
-        }
-        gABR_table_index = new_abr_bitrate_inx;
-      }
-      else
-      {
-        ALOGD ("[AUTO_BITRATE][ABR_ADJ](DN) next bitrate not changed (%u)[%u]",
-            handle_abr->lastBitrate, gABR_table_index);
-      }
-    }
+  if ((ctx->src_in_freq == 0) || (ctx->src_in_freq == sampling_freq))
+  {
+    return LHDCV5_FRET_SUCCESS;
   }
 
-  if (handle_abr->upBitrateCnt > 0 && handle_abr->upBitrateCnt >= ABR_UP_RATE_TIME_CNT)
+  ctx->src = lhdcv5_enc_src_create (ctx->src_in_freq, sampling_freq,
+      (lhdcv5_enc_src_quality_t) ctx->src_quality, ctx->conv.out_layout);
+  if (ctx->src == NULL)
   {
-    queuSumTmp = handle_abr->upBitrateSum;
+    ALOGW ("%s: Unsupported resampling (%u -> %u)!", __func__, ctx->src_in_freq, sampling_freq);
+    return LHDCV5_FRET_ERROR;
+  }
 
-    func_ret = lhdcv5_util_reset_up_bitrate (handle);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
-    {
-      ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_reset_up_bitrate error %d", func_ret);
-      goto fail;
+  ALOGD ("%s: %u -> %u Hz, %u taps, delay %u us (%s)", __func__, ctx->src_in_freq,
+      sampling_freq, ctx->src->taps, ctx->src->delay_us, ctx->src->isa);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_post_gyro ()
+//
+// store the latest gyro pose for the encoder, never waits on it
+//	Parameter
+//		ctx: wrapper context of the handle
+//		x, y, z: world coordinates of the pose
+//----------------------------------------------------------------
+static void lhdcv5_enc_post_gyro
+(
+    lhdcv5BT_enc_ctx_t *ctx,
+    int32_t   x,
+    int32_t   y,
+    int32_t   z
+)
+{
+  lhdcv5BT_enc_gyro_box_t *box = &ctx->gyro;
+  uint32_t seq = __atomic_load_n (&box->seq, __ATOMIC_RELAXED);
+
+  // writers only contend with each other, for the odd sequence
+  do
+  {
+    seq &= ~1u;
+  } while (!__atomic_compare_exchange_n (&box->seq, &seq, seq + 1, true,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+
+  __atomic_store_n (&box->x, x, __ATOMIC_RELAXED);
+  __atomic_store_n (&box->y, y, __ATOMIC_RELAXED);
+  __atomic_store_n (&box->z, z, __ATOMIC_RELAXED);
+
+  // skip 0 when wrapping, it means no pose
+  __atomic_store_n (&box->seq, (seq + 2 != 0) ? seq + 2 : 2, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_apply_gyro ()
+//
+// hand the latest gyro pose to the encoder if it changed, called once
+// per encoded block on the encode thread
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static void lhdcv5_enc_apply_gyro
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  lhdcv5BT_enc_gyro_box_t *box = &ctx->gyro;
+  uint32_t seq = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t z = 0;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  for (uint32_t i = 0; i < LHDCV5BT_GYRO_READ_TRIES; i++)
+  {
+    seq = __atomic_load_n (&box->seq, __ATOMIC_ACQUIRE);
+    if ((seq == box->applied) || (seq == 0))
+    {
+      return;
+    }
+    if (seq & 1)
+    {
+      continue;
     }
 
-    if (queuSumTmp < ABR_UP_QUEUE_LENGTH_THRESHOLD)
+    x = __atomic_load_n (&box->x, __ATOMIC_RELAXED);
+    y = __atomic_load_n (&box->y, __ATOMIC_RELAXED);
+    z = __atomic_load_n (&box->z, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n (&box->seq, __ATOMIC_RELAXED) != seq)
     {
-      ALOGV ("[AUTO_BITRATE][ABR_ADJ](DN) current queuSumTmp:%u", queuSumTmp);
+      continue;
+    }
 
-      func_ret = lhdcv5_util_get_bitrate_inx (handle_abr->lastBitrate, &last_bitrate_inx);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_get_bitrate_inx error %d", func_ret);
-        goto fail;
-      }
+    box->applied = seq;
+    func_ret = lhdcv5_util_ar_set_gyro_pos (handle, x, y, z);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGD ("%s: Fail to set gyro's position[x:%d y:%d z:%d] for AR (%d)!", __func__,
+          x, y, z, func_ret);
+    }
+    return;
+  }
 
-      // get the last index in abr table
-      new_abr_bitrate_inx = gABR_table_index;
+  // the sensor thread keeps writing, try again with the next block
+}
 
-      if (gABR_table_index < (element_size - 1))
-      {
-        new_abr_bitrate_inx += 1;
-      }
+//----------------------------------------------------------------
+// lhdcv5_enc_ext_merge ()
+//
+// copy the items of one set of extended function changes over another.
+// An AR on/off and the AR configuration are one item, the later one wins:
+// a configuration drops an earlier AR state, and an AR state merged over a
+// configuration sets its enabled flag. dst->mask is left to the caller, as
+// the pending mask is read without the lock.
+//	Parameter
+//		dst: set to update
+//		src: newer changes
+//	Return
+//		the mask of dst with the items of src
+//----------------------------------------------------------------
+static uint32_t lhdcv5_enc_ext_merge
+(
+    lhdcv5BT_enc_ext_set_t *dst,
+    const lhdcv5BT_enc_ext_set_t *src
+)
+{
+  uint32_t mask = dst->mask;
 
-      func_ret = lhdcv5_util_get_bitrate_inx (abr_table[new_abr_bitrate_inx], &new_bitrate_inx);
-      if (func_ret != LHDCV5_FRET_SUCCESS)
-      {
-        ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_get_bitrate_inx error %d", func_ret);
-        goto fail;
-      }
+  if (src->mask & LHDCV5BT_EXT_AR_CFG)
+  {
+    dst->ar = src->ar;
+    mask = (mask & ~LHDCV5BT_EXT_STATE (LHDCV5_EXT_FUNC_AR)) | LHDCV5BT_EXT_AR_CFG;
+  }
 
-      if ((new_bitrate_inx >= last_bitrate_inx) &&
-          (new_abr_bitrate_inx > gABR_table_index))
-      {
-        func_ret = lhdcv5_util_set_target_bitrate_inx (handle, new_bitrate_inx, &new_bitrate_inx_set, false);
-        if (func_ret != LHDCV5_FRET_SUCCESS)
-        {
-          ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_set_target_bitrate_inx error %d", func_ret);
-          goto fail;
-        }
-        lhdcv5_util_get_lossless_status(handle, &lossless_status);
-        if (func_ret != LHDCV5_FRET_SUCCESS)
-        {
-          ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_get_lossless_status error %d", func_ret);
-          goto fail;
-        }
+  for (uint32_t i = 0; i < LHDCV5_EXT_FUNC_INVALID; i++)
+  {
+    if (!(src->mask & LHDCV5BT_EXT_STATE (i)))
+    {
+      continue;
+    }
+    if ((i == LHDCV5_EXT_FUNC_AR) && (mask & LHDCV5BT_EXT_AR_CFG))
+    {
+      dst->ar.enabled = src->state[i];
+      continue;
+    }
+    dst->state[i] = src->state[i];
+    mask |= LHDCV5BT_EXT_STATE (i);
+  }
 
-        ALOGD ("[AUTO_BITRATE][ABR_ADJ](UP) bitrate(%u)[%u] to bitrate(%u)[%u], queuSumTmp(%u) lossless_on(%u)",
-            abr_table[gABR_table_index], gABR_table_index,
-            abr_table[new_abr_bitrate_inx], new_abr_bitrate_inx,
-            queuSumTmp,
-            lossless_status);
-        func_ret = lhdcv5_util_reset_down_bitrate (handle);
-        if (func_ret != LHDCV5_FRET_SUCCESS)
-        {
-          ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_reset_down_bitrate error %d", func_ret);
-          goto fail;
-        }
+  if (src->mask & LHDCV5BT_EXT_META)
+  {
+    dst->meta_enabled = src->meta_enabled;
+    dst->meta_len = src->meta_len;
+    dst->meta_loop_cnt = src->meta_loop_cnt;
+    memcpy (dst->meta, src->meta, src->meta_len);
+    mask |= LHDCV5BT_EXT_META;
+  }
 
-        gABR_table_index = new_abr_bitrate_inx;
-      }
-      else
-      {
-        // if lossless is enabled, check if promote to VBR layer
-        // conditions for promoting to VBR:
-        //  1. must 48KHz + 16 bit
-        //  2. lastBitrate already reach the Max BitRate of ABR table
-        if (handle_abr->is_lless_enabled == 1 &&
-            handle_abr->sample_rate == LHDCV5_SR_48000HZ &&
-            handle_abr->bits_per_sample == LHDCV5BT_SMPL_FMT_S16 &&
-            handle_abr->lastBitrate == ABR_MAX_STAGE_BITRATE)
-        {
-          func_ret = lhdcv5_enc_inx_of_abr_bitrate (abr_type,
-              handle_abr->lastBitrate,
-              &last_abr_bitrate_inx);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_enc_inx_of_abr_bitrate error %d", func_ret);
-            goto fail;
-          }
+  return mask;
+}
 
-          func_ret = lhdcv5_util_get_bitrate_inx (handle_abr->lastBitrate, &last_bitrate_inx);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_get_bitrate_inx error %d", func_ret);
-            goto fail;
-          }
+//----------------------------------------------------------------
+// lhdcv5_enc_ext_post ()
+//
+// hand a set of extended function changes to the encoder, merged with the
+// changes it has not taken yet; ext_lock is held by the caller
+//	Parameter
+//		ctx: wrapper context of the handle
+//		src: changes to commit
+//----------------------------------------------------------------
+static void lhdcv5_enc_ext_post
+(
+    lhdcv5BT_enc_ctx_t *ctx,
+    const lhdcv5BT_enc_ext_set_t *src
+)
+{
+  __atomic_store_n (&ctx->ext_pending.mask,
+      lhdcv5_enc_ext_merge (&ctx->ext_pending, src), __ATOMIC_RELAXED);
+}
 
-          abr_promote_bitrate_inx = PROMOTE_TO_VBR_TARGET_STAGE;
-          func_ret = lhdcv5_util_get_bitrate_inx (vbr_table[abr_promote_bitrate_inx], &new_bitrate_inx);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_get_bitrate_inx error %d", func_ret);
-            goto fail;
-          }
+//----------------------------------------------------------------
+// lhdcv5_enc_apply_ext ()
+//
+// hand committed extended function changes to the encoder, all of them
+// between two blocks; called once per encoded block on the encode thread
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static void lhdcv5_enc_apply_ext
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  lhdcv5BT_enc_ext_set_t set;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
 
-          // set new bitrate to the stage of VBR table
-          func_ret = lhdcv5_util_set_target_bitrate_inx (handle, new_bitrate_inx, &new_bitrate_inx_set, false);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_set_target_bitrate_inx error %d", func_ret);
-            goto fail;
-          }
-          lhdcv5_util_get_lossless_status(handle, &lossless_status);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_get_lossless_status error %d", func_ret);
-            goto fail;
-          }
+  if (__atomic_load_n (&ctx->ext_pending.mask, __ATOMIC_RELAXED) == 0)
+  {
+    return;
+  }
 
-          ALOGD ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) bitrate(%u)[%u] to bitrate(%u)[%u], queuSumTmp(%u) lossless_on(%u)",
-              abr_table[last_abr_bitrate_inx], last_bitrate_inx,
-              vbr_table[abr_promote_bitrate_inx], new_bitrate_inx_set,
-              queuSumTmp,
-              lossless_status);
+  // a commit is in progress, take it with a later block; the lock is only
+  // held for copies, so wait once steady commits kept it busy for a few blocks
+  if (ctx->ext_busy_blocks < LHDCV5BT_EXT_TRY_BLOCKS)
+  {
+    if (pthread_mutex_trylock (&ctx->ext_lock) != 0)
+    {
+      ctx->ext_busy_blocks++;
+      return;
+    }
+  }
+  else
+  {
+    pthread_mutex_lock (&ctx->ext_lock);
+  }
+  ctx->ext_busy_blocks = 0;
+  set.mask = 0;
+  set.mask = lhdcv5_enc_ext_merge (&set, &ctx->ext_pending);
+  __atomic_store_n (&ctx->ext_pending.mask, 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock (&ctx->ext_lock);
 
-          // reset counters
-          func_ret = lhdcv5_util_reset_down_bitrate (handle);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_reset_down_bitrate error %d", func_ret);
-            goto fail;
-          }
-          func_ret = lhdcv5_util_reset_up_bitrate (handle);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_reset_up_bitrate error %d", func_ret);
-            goto fail;
-          }
-          func_ret = lhdcv5_util_reset_down_bitrate_vbr (handle);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_reset_down_bitrate_vbr error %d", func_ret);
-            goto fail;
-          }
-          func_ret = lhdcv5_util_reset_up_bitrate_vbr (handle);
-          if (func_ret != LHDCV5_FRET_SUCCESS)
-          {
-            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_reset_up_bitrate_vbr error %d",  func_ret);
-            goto fail;
-          }
-        }
-        else
-        {
-          ALOGD ("[AUTO_BITRATE][ABR_ADJ](UP) next bitrate not changed (%u)[%u]",
-              handle_abr->lastBitrate, gABR_table_index);
-        }
-      }
+  for (uint32_t i = 0; i < LHDCV5_EXT_FUNC_INVALID; i++)
+  {
+    if (!(set.mask & LHDCV5BT_EXT_STATE (i)))
+    {
+      continue;
+    }
+    func_ret = lhdcv5_util_set_ext_func_state (handle, (LHDCV5_EXT_FUNC_T) i,
+        set.state[i], NULL, 0, LHDCV5_META_LOOP_CNT_STD);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("%s: failed to set ext. function %u state (%d)!", __func__, i, func_ret);
+    }
+  }
+
+  if (set.mask & LHDCV5BT_EXT_META)
+  {
+    func_ret = lhdcv5_util_set_ext_func_state (handle, LHDCV5_EXT_FUNC_META,
+        set.meta_enabled, set.meta, set.meta_len, set.meta_loop_cnt);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("%s: failed to set META data (%d)!", __func__, func_ret);
     }
   }
 
-  if (queueLen > 0)
+  if (set.mask & LHDCV5BT_EXT_AR_CFG)
+  {
+    func_ret = lhdcv5_util_ar_set_cfg (handle,
+        set.ar.pos,
+        LHDCV5BT_AR_POS_NUM,
+        set.ar.gain,
+        LHDCV5BT_AR_GAIN_NUM,
+        set.ar.enabled ? 1 : 0);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("%s: failed to set AR config (%d)!", __func__, func_ret);
+    }
+  }
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_encode ()
+//
+// encode one block of PCM samples in the encoder sample format
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//		p_in_pcm: a pointer to a buffer contains PCM samples for encoding
+//		pcm_bytes: bytes of PCM samples
+//		p_out_buf: a pointer to a buffer to put encoded stream
+//		out_buf_bytes: output buffer's size (in byte)
+//		p_out_bytes: a pointer to number of bytes of encoded stream in buffer
+//		p_out_frames: a pointer to number of frames of encoded stream in buffer
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to encode pcm samples
+//		Other: fail to encode pcm samples
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_encode
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5BT_enc_ctx_t *ctx,
+    void      *p_in_pcm,
+    uint32_t  pcm_bytes,
+    uint8_t   *p_out_buf,
+    uint32_t  out_buf_bytes,
+    uint32_t  *p_out_bytes,
+    uint32_t  *p_out_frames
+)
+{
+  struct timespec ts_start;
+  struct timespec ts_end;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  lhdcv5_enc_apply_ext (handle, ctx);
+  lhdcv5_enc_apply_gyro (handle, ctx);
+
+  clock_gettime (CLOCK_MONOTONIC, &ts_start);
+  func_ret = lhdcv5_util_enc_process (handle,
+      p_in_pcm,
+      pcm_bytes,
+      p_out_buf,
+      out_buf_bytes,
+      p_out_bytes,
+      p_out_frames);
+  clock_gettime (CLOCK_MONOTONIC, &ts_end);
+
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("%s: Failed to encode pcm samples (%d)!", __func__, func_ret);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  lhdcv5_enc_stats_encode (handle, ctx, *p_out_frames,
+      (uint32_t) ((ts_end.tv_sec - ts_start.tv_sec) * 1000000 +
+      (ts_end.tv_nsec - ts_start.tv_nsec) / 1000));
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_clear_pkt ()
+//
+// drop the buffered PCM and the packet being built
+//	Parameter
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static void lhdcv5_enc_clear_pkt
+(
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  ctx->pkt_ring_rd = 0;
+  ctx->pkt_ring_fill = 0;
+  ctx->pkt_stage_bytes = 0;
+  ctx->pkt_stage_frames = 0;
+  ctx->pkt_carry_bytes = 0;
+  ctx->pkt_carry_frames = 0;
+  ctx->pkt_chunk_bytes = 0;
+  ctx->pkt_ready = false;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_release_pkt ()
+//
+// free the packetizer buffers, lhdcv5BT_pkt_init () is needed again
+//	Parameter
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static void lhdcv5_enc_release_pkt
+(
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  free (ctx->pkt_ring);
+  ctx->pkt_ring = NULL;
+  ctx->pkt_stage = NULL;
+  ctx->pkt_block_bytes = 0;
+  ctx->pkt_ring_bytes = 0;
+  lhdcv5_enc_clear_pkt (ctx);
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_check_latency ()
+//
+// check the latency bits of the LHDC header
+//	Parameter
+//		latency: LHDCV5BT_PKT_LATENCY_*
+//----------------------------------------------------------------
+static bool lhdcv5_enc_check_latency
+(
+    uint32_t  latency
+)
+{
+  return (latency == LHDCV5BT_PKT_LATENCY_LOW) ||
+      (latency == LHDCV5BT_PKT_LATENCY_MID) ||
+      (latency == LHDCV5BT_PKT_LATENCY_HIGH);
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_pkt_mtu ()
+//
+// return the current MTU (byte) of the encoder, LHDC header included
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//----------------------------------------------------------------
+static uint32_t lhdcv5_enc_pkt_mtu
+(
+    HANDLE_LHDCV5_BT  handle
+)
+{
+  uint32_t mtu = 0;
+
+  if (lhdcv5_util_get_current_mtu (handle, &mtu) != LHDCV5_FRET_SUCCESS)
+  {
+    return LHDCV5_MTU_MIN;
+  }
+
+  if (mtu < LHDCV5_MTU_MIN)
+  {
+    return LHDCV5_MTU_MIN;
+  }
+  if (mtu > LHDCV5_MTU_MAX)
+  {
+    return LHDCV5_MTU_MAX;
+  }
+  return mtu;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_pkt_full ()
+//
+// check whether the packet being built is complete: the next encoder
+// output, expected as large as the latest one, would not fit in it
+//	Parameter
+//		ctx: wrapper context of the handle
+//		mtu: current MTU (byte)
+//----------------------------------------------------------------
+static bool lhdcv5_enc_pkt_full
+(
+    const lhdcv5BT_enc_ctx_t *ctx,
+    uint32_t  mtu
+)
+{
+  if (ctx->pkt_stage_frames == 0)
+  {
+    return false;
+  }
+
+  return ((LHDCV5BT_PKT_HDR_BYTES + ctx->pkt_stage_bytes + ctx->pkt_chunk_bytes > mtu) ||
+      (ctx->pkt_stage_frames >= LHDCV5BT_PKT_MAX_FRAMES));
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_pkt_fill ()
+//
+// encode buffered PCM blocks into the stage until a packet is complete
+// or less than a block is left
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to encode the buffered blocks
+//		otherwise: fail to encode
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_pkt_fill
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  uint32_t mtu = 0;
+  uint32_t written = 0;
+  uint32_t frames = 0;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  while (!ctx->pkt_ready && (ctx->pkt_ring_fill >= ctx->pkt_block_bytes))
+  {
+    // the stage never holds more than one MTU here, the rest is room for
+    // the output
+    func_ret = lhdcv5_enc_encode (handle, ctx,
+        ctx->pkt_ring + ctx->pkt_ring_rd,
+        ctx->pkt_block_bytes,
+        ctx->pkt_stage + ctx->pkt_stage_bytes,
+        LHDCV5BT_PKT_STAGE_BYTES - ctx->pkt_stage_bytes,
+        &written,
+        &frames);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      return func_ret;
+    }
+
+    ctx->pkt_ring_rd += ctx->pkt_block_bytes;
+    if (ctx->pkt_ring_rd >= ctx->pkt_ring_bytes)
+    {
+      ctx->pkt_ring_rd = 0;
+    }
+    ctx->pkt_ring_fill -= ctx->pkt_block_bytes;
+
+    // the encoder may keep frames back until it has enough of them
+    if ((written == 0) || (frames == 0))
+    {
+      continue;
+    }
+
+    if (frames > LHDCV5BT_PKT_MAX_FRAMES)
+    {
+      ALOGW ("%s: %u frames in one output do not fit in a packet!", __func__, frames);
+      return LHDCV5_FRET_ERROR;
+    }
+
+    mtu = lhdcv5_enc_pkt_mtu (handle);
+    if ((ctx->pkt_stage_frames > 0) &&
+        ((LHDCV5BT_PKT_HDR_BYTES + ctx->pkt_stage_bytes + written > mtu) ||
+        (ctx->pkt_stage_frames + frames > LHDCV5BT_PKT_MAX_FRAMES)))
+    {
+      // close the packet, the output opens the next one
+      ctx->pkt_carry_bytes = written;
+      ctx->pkt_carry_frames = frames;
+      ctx->pkt_ready = true;
+      break;
+    }
+
+    // an output larger than the MTU on its own still goes out as one packet
+    ctx->pkt_stage_bytes += written;
+    ctx->pkt_stage_frames += frames;
+    ctx->pkt_chunk_bytes = written;
+    ctx->pkt_ready = lhdcv5_enc_pkt_full (ctx, mtu);
+  }
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_pkt_write_frames ()
+//
+// convert whole frames of PCM samples into the packetizer ring. The ring
+// holds whole blocks, so no frame is split at its end.
+//	Parameter
+//		ctx: wrapper context of the handle
+//		pcm: PCM samples in the input format
+//		pcm_bytes: bytes of PCM samples
+//		p_used_bytes: a pointer to bytes taken into the ring
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to buffer the samples
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_pkt_write_frames
+(
+    lhdcv5BT_enc_ctx_t *ctx,
+    const uint8_t *pcm,
+    uint32_t  pcm_bytes,
+    uint32_t  *p_used_bytes
+)
+{
+  const uint32_t in_frame_bytes = LHDCV5BT_ENC_CHANNELS * ctx->conv.in_bytes;
+  const uint32_t out_frame_bytes = LHDCV5BT_ENC_CHANNELS * ctx->conv.out_bytes;
+  uint32_t plane_bytes = 0;
+  uint32_t frames = pcm_bytes / in_frame_bytes;
+  uint32_t room = (ctx->pkt_ring_bytes - ctx->pkt_ring_fill) / out_frame_bytes;
+  uint32_t wr = 0;
+  uint32_t part = 0;
+
+  *p_used_bytes = 0;
+
+  if (ctx->conv.planar)
+  {
+    // the planes cannot be resumed part way, take all or nothing
+    if (frames > room)
+    {
+      return LHDCV5_FRET_SUCCESS;
+    }
+    plane_bytes = frames * ctx->conv.in_bytes;
+  }
+  else if (frames > room)
+  {
+    frames = room;
+  }
+
+  if (frames == 0)
+  {
+    return LHDCV5_FRET_SUCCESS;
+  }
+
+  // at most two passes, up to the end of the ring and from its start
+  wr = ctx->pkt_ring_rd + ctx->pkt_ring_fill;
+  if (wr >= ctx->pkt_ring_bytes)
+  {
+    wr -= ctx->pkt_ring_bytes;
+  }
+  part = (ctx->pkt_ring_bytes - wr) / out_frame_bytes;
+  if (part > frames)
+  {
+    part = frames;
+  }
+  lhdcv5_enc_pcm_convert (&ctx->conv, pcm, plane_bytes, ctx->pkt_ring + wr, part);
+  lhdcv5_enc_pcm_convert (&ctx->conv, pcm + part * (ctx->conv.planar ? ctx->conv.in_bytes : in_frame_bytes),
+      plane_bytes, ctx->pkt_ring, frames - part);
+
+  ctx->pkt_ring_fill += frames * out_frame_bytes;
+  *p_used_bytes = frames * in_frame_bytes;
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_pkt_write_src ()
+//
+// resample whole frames of PCM samples into the packetizer ring, taking
+// no more input than the ring has room for once resampled
+//	Parameter
+//		ctx: wrapper context of the handle
+//		pcm: PCM samples in the input format
+//		pcm_bytes: bytes of PCM samples
+//		p_used_bytes: a pointer to bytes taken into the ring
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to buffer the samples
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_pkt_write_src
+(
+    lhdcv5BT_enc_ctx_t *ctx,
+    const uint8_t *pcm,
+    uint32_t  pcm_bytes,
+    uint32_t  *p_used_bytes
+)
+{
+  uint8_t stage[LHDCV5BT_SRC_STAGE_FRAMES * LHDCV5BT_ENC_CHANNELS * sizeof(int32_t)];
+  const uint32_t in_frame_bytes = LHDCV5BT_ENC_CHANNELS * ctx->conv.in_bytes;
+  const uint32_t out_frame_bytes = LHDCV5BT_ENC_CHANNELS * ctx->conv.out_bytes;
+  const uint32_t cvt_frames = ctx->pkt_block_bytes / out_frame_bytes;
+  uint32_t frames = pcm_bytes / in_frame_bytes;
+  uint32_t room = (ctx->pkt_ring_bytes - ctx->pkt_ring_fill) / out_frame_bytes;
+  uint32_t max_frames = lhdcv5_enc_src_max_input (ctx->src, room);
+  uint32_t plane_bytes = 0;
+  uint32_t taken = 0;
+  uint32_t n = 0;
+  uint32_t out_bytes = 0;
+  uint32_t wr = 0;
+  uint32_t part = 0;
+  const uint8_t *in = NULL;
+
+  *p_used_bytes = 0;
+
+  if (ctx->conv.planar)
+  {
+    // the planes cannot be resumed part way, take all or nothing
+    if (frames > max_frames)
+    {
+      return LHDCV5_FRET_SUCCESS;
+    }
+    plane_bytes = frames * ctx->conv.in_bytes;
+  }
+  else if (frames > max_frames)
+  {
+    frames = max_frames;
+  }
+
+  while (taken < frames)
+  {
+    n = lhdcv5_enc_src_max_input (ctx->src, LHDCV5BT_SRC_STAGE_FRAMES);
+    if (n > frames - taken)
+    {
+      n = frames - taken;
+    }
+    if (ctx->conv.active && (n > cvt_frames))
+    {
+      n = cvt_frames;
+    }
+
+    if (ctx->conv.active)
+    {
+      lhdcv5_enc_pcm_convert (&ctx->conv,
+          pcm + taken * (ctx->conv.planar ? ctx->conv.in_bytes : in_frame_bytes),
+          plane_bytes, ctx->cvt_buf, n);
+      in = ctx->cvt_buf;
+    }
+    else
+    {
+      in = pcm + taken * in_frame_bytes;
+    }
+    out_bytes = lhdcv5_enc_src_process (ctx->src, in, n, stage) * out_frame_bytes;
+    taken += n;
+
+    // at most two copies, up to the end of the ring and from its start
+    wr = ctx->pkt_ring_rd + ctx->pkt_ring_fill;
+    if (wr >= ctx->pkt_ring_bytes)
+    {
+      wr -= ctx->pkt_ring_bytes;
+    }
+    part = ctx->pkt_ring_bytes - wr;
+    if (part > out_bytes)
+    {
+      part = out_bytes;
+    }
+    memcpy (ctx->pkt_ring + wr, stage, part);
+    memcpy (ctx->pkt_ring, stage + part, out_bytes - part);
+    ctx->pkt_ring_fill += out_bytes;
+  }
+
+  *p_used_bytes = taken * in_frame_bytes;
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_pipe_thread ()
+//
+// encode thread of the pipeline: encodes each queued block into the
+// caller's buffer. The handle lock is held around each block, so the
+// bit rate controller never runs inside the util encoder.
+//	Parameter
+//		arg: the pipeline
+//----------------------------------------------------------------
+static void * lhdcv5_enc_pipe_thread
+(
+    void  *arg
+)
+{
+  lhdcv5BT_enc_pipe_t *pipe = (lhdcv5BT_enc_pipe_t *) arg;
+  lhdcv5BT_enc_ctx_t *ctx = lhdcv5_enc_get_ctx (pipe->handle);
+
+  for (;;)
+  {
+    while (sem_wait (&pipe->queued) != 0)
+    {
+      // EINTR, wait again
+    }
+
+    if (__atomic_load_n (&pipe->stop, __ATOMIC_ACQUIRE))
+    {
+      break;
+    }
+
+    pthread_mutex_lock (&ctx->lock);
+    pipe->ret = lhdcv5_enc_encode (pipe->handle, ctx,
+        pipe->pcm,
+        pipe->block_bytes,
+        pipe->out,
+        pipe->out_buf_bytes,
+        &pipe->out_bytes,
+        &pipe->out_frames);
+    pthread_mutex_unlock (&ctx->lock);
+
+    sem_post (&pipe->encoded);
+  }
+
+  return NULL;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_stop_pipe ()
+//
+// stop the encode thread and free the pipeline. Every block is returned
+// by the lhdcv5BT_pipe_encode () call that queued it, so none is in
+// flight here and no audio is dropped.
+//	Parameter
+//		ctx: wrapper context of the handle
+//----------------------------------------------------------------
+static void lhdcv5_enc_stop_pipe
+(
+    lhdcv5BT_enc_ctx_t *ctx
+)
+{
+  lhdcv5BT_enc_pipe_t *pipe = ctx->pipe;
+
+  if (pipe == NULL)
+  {
+    return;
+  }
+
+  __atomic_store_n (&pipe->stop, true, __ATOMIC_RELEASE);
+  sem_post (&pipe->queued);
+  pthread_join (pipe->thread, NULL);
+
+  sem_destroy (&pipe->queued);
+  sem_destroy (&pipe->encoded);
+  free (pipe);
+  ctx->pipe = NULL;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_inx_of_abr_bitrate ()
+//
+// return the bit rate (index) respond to input bit rate (kbps)
+//	Parameter
+//		ctx: wrapper context of the handle
+//		abr_type: ABR type
+//		bitrate: bit rate (kbps)
+//		bitrate_inx: ABR bit rate (index) returned
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to return the bit rate (index)
+//		otherwise: fail to return the bit rate (index)
+//----------------------------------------------------------------
+static int lhdcv5_enc_inx_of_abr_bitrate
+(
+    const lhdcv5BT_enc_ctx_t *ctx,
+    LHDCV5_ABR_TYPE_T abr_type,
+    uint32_t  bitrate,
+    uint32_t  *bitrate_inx
+)
+{
+  uint32_t element_size = 0;
+  const uint32_t *abr_table = NULL;
+
+  if ((ctx == NULL) || (bitrate_inx == NULL))
+  {
+    ALOGW ("%s: Input parameter is NULL!!!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  if ((uint32_t) abr_type >= LHDCV5_ABR_INVALID)
+  {
+    ALOGW ("%s: Invalid ABR type (%d)!", __func__, abr_type);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  element_size = ctx->policy.abr[abr_type].ladder.stage_num;
+  abr_table = ctx->policy.abr[abr_type].ladder.bitrate;
+
+  if ((bitrate <= 0) || (bitrate > abr_table[element_size - 1]))
+  {
+    ALOGW ("%s: bit rate is out of range (%d)!!!", __func__, bitrate);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+
+  for (uint32_t i = 0; i < element_size; i++)
+  {
+    if (abr_table[i] >= bitrate)
+    {
+      *bitrate_inx = i;
+      return LHDCV5_FRET_SUCCESS;
+    }
+  }
+
+  ALOGW ("%s: Fail to find bit rate (index) (%d)!", __func__, bitrate);
+  return LHDCV5_FRET_ERROR;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_vbr_process ()
+//
+// run the encoder's lossless bit rate tuning, kept within the VBR ladder
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		handle_vbr: a pointer to VBR parameters
+//		vbr_policy: VBR ladder and thresholds of the stream
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to run the lossless tuning
+//		otherwise: fail to run the lossless tuning
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_vbr_process
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5_abr_para_t *handle_vbr,
+    const lhdcv5_vbr_policy_t *vbr_policy
+)
+{
+  const lhdcv5_bitrate_ladder_t *ladder = &vbr_policy->ladder;
+  uint32_t bitrate = 0;
+  uint32_t bitrate_inx = 0;
+  uint32_t bitrate_inx_set = 0;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  // the encoder library has one lossless tuning, hi-res streams are kept
+  // on their own ladder by the clamp below
+  func_ret = lhdcv5_util_vbr_process (handle, LHDCV5_VBR_48K_RES);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    return func_ret;
+  }
+
+  if (handle_vbr->lastBitrate < ladder->bitrate[0])
+  {
+    bitrate = ladder->bitrate[0];
+  }
+  else if (handle_vbr->lastBitrate > ladder->bitrate[ladder->stage_num - 1])
+  {
+    bitrate = ladder->bitrate[ladder->stage_num - 1];
+  }
+  else
+  {
+    return LHDCV5_FRET_SUCCESS;
+  }
+
+  func_ret = lhdcv5_util_get_bitrate_inx (bitrate, &bitrate_inx);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    return func_ret;
+  }
+
+  ALOGD ("[AUTO_BITRATE][VBR_ADJ](CLAMP) bitrate(%u) to bitrate(%u)", handle_vbr->lastBitrate, bitrate);
+
+  return lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx, &bitrate_inx_set, false);
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_vbr_adjust_bitrate ()
+//
+// Adjust bit rate automatically according to number of lossless frames for LHDC 5.0 encoding
+//  Parameter
+//    handle: a pointer to the resource allocated and is returned
+//        by function lhdcBT_get_handle ()
+//    handle: a pointer to VBR parameters
+//    queueLen: number of packets in a2dp transmit queue
+//  Return
+//    LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically
+//    otherwise: fail to adjust bit rate automatically
+//----------------------------------------------------------------
+static int lhdcv5_enc_vbr_adjust_bitrate
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5_abr_para_t *handle_vbr,
+    uint32_t  queueLen
+)
+{
+  uint32_t new_bitrate_inx = 0;
+  uint32_t new_bitrate_inx_set = 0;
+  uint32_t last_bitrate_inx = 0;
+
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  const lhdcv5_vbr_policy_t *vbr_policy = NULL;
+  const uint32_t *abr_table = NULL;
+  LHDCV5BT_VBR_TYPE_T vbr_type = LHDCV5BT_VBR_INVALID;
+
+  uint32_t queueLength = 0;
+  uint32_t vbr_demote_bitrate_inx = 0;
+
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (handle_vbr == NULL)
+  {
+    ALOGW ("%s: handle_vbr is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+
+  if (queueLen < 0)
+  {
+    ALOGW ("%s: Invalid queue length (%u)!", __func__, queueLen);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+
+  if (handle_vbr->qualityStatus != LHDCV5_QUALITY_AUTO)
+  {
+    ALOGW ("%s: Not in Auto-BitRate mode (%d)", __func__, handle_vbr->qualityStatus);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+
+  vbr_type = lhdcv5_enc_vbr_type_of (handle_vbr->is_lless_enabled,
+      handle_vbr->sample_rate, handle_vbr->bits_per_sample);
+  if (vbr_type == LHDCV5BT_VBR_INVALID)
+  {
+    ALOGW ("%s: No VBR table for sample rate (%u) bit per sample (%u)!", __func__,
+        handle_vbr->sample_rate, handle_vbr->bits_per_sample);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+
+  vbr_policy = &ctx->policy.vbr[vbr_type];
+  abr_table = ctx->policy.abr[lhdcv5_enc_abr_type_of_vbr (vbr_type)].ladder.bitrate;
+
+  //
+  // VBR to ABR demoting mechanism
+  //
+  // exam queueLength if need demoting to ABR layer from VBR
+  if (handle_vbr->dnBitrateCnt > 0 && handle_vbr->dnBitrateCnt >= vbr_policy->demote_time_cnt)
+  {
+    queueLength = handle_vbr->dnBitrateSum / handle_vbr->dnBitrateCnt;
+
+    func_ret = lhdcv5_util_reset_down_bitrate (handle);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_down_bitrate error %d",  func_ret);
+      goto fail;
+    }
+
+    if (queueLength > vbr_policy->demote_queue_th)
+    {
+      ALOGV ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) queueLength: %u", queueLength);
+
+      func_ret = lhdcv5_util_get_bitrate_inx (handle_vbr->lastBitrate, &last_bitrate_inx);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_get_bitrate_inx(%d) error %d",
+            handle_vbr->lastBitrate, func_ret);
+        goto fail;
+      }
+
+      vbr_demote_bitrate_inx = vbr_policy->demote_target_stage;
+      func_ret = lhdcv5_util_get_bitrate_inx (abr_table[vbr_demote_bitrate_inx], &new_bitrate_inx);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_get_bitrate_inx(%d) error %d",
+            abr_table[vbr_demote_bitrate_inx], func_ret);
+        goto fail;
+      }
+
+      ALOGD ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) bitrate(%u)[%u] to bitrate(%u)[%u] queueLength(%u)",
+          handle_vbr->lastBitrate, last_bitrate_inx,
+          abr_table[vbr_demote_bitrate_inx], new_bitrate_inx,
+          queueLength);
+
+      // set new bitrate to ABR table
+      func_ret = lhdcv5_util_set_target_bitrate_inx (handle, new_bitrate_inx, &new_bitrate_inx_set, false);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_set_target_bitrate_inx (%d) error %d",
+            new_bitrate_inx, func_ret);
+        goto fail;
+      }
+      // continue ABR from the stage demoted to
+      ctx->abr_table_index = vbr_demote_bitrate_inx;
+
+      // reset counters
+      func_ret = lhdcv5_util_reset_down_bitrate (handle);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_down_bitrate error %d",  func_ret);
+        goto fail;
+      }
+      func_ret = lhdcv5_util_reset_up_bitrate (handle);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_up_bitrate error %d", func_ret);
+        goto fail;
+      }
+      func_ret = lhdcv5_util_reset_down_bitrate_vbr (handle);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_down_bitrate_vbr error %d", func_ret);
+        goto fail;
+      }
+      func_ret = lhdcv5_util_reset_up_bitrate_vbr (handle);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][VBR_ADJ](DEMOTE) lhdcv5_util_reset_up_bitrate_vbr error %d", func_ret);
+        goto fail;
+      }
+
+      return LHDCV5_FRET_SUCCESS;
+    }
+  }
+
+  //
+  // VBR mechanism
+  //
+  func_ret = lhdcv5_enc_vbr_process (handle, handle_vbr, vbr_policy);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("[AUTO_BITRATE][VBR_ADJ] lhdcv5_enc_vbr_process error %d", func_ret);
+    goto fail;
+  }
+
+#ifdef DEBUG_ABR_VBR_HYBRID //debug test: when reach to min VBR, force a DEMOTE to ABR in next round
+  if (handle_vbr->lastBitrate == LHDCV5_VBR_MIN_BITRATE) {
+    handle_vbr->dnBitrateSum += 10000;
+    ALOGD ("[AUTO_BITRATE][VBR_ADJ](Test) generate a demote event");
+  }
+#endif
+
+fail:
+  ///////////////////////////////
+  // update params for VBR demoting check
+  if (queueLen > 0)
+  {
+    handle_vbr->upBitrateSum += queueLen;
+    handle_vbr->dnBitrateSum += queueLen;
+  }
+  handle_vbr->upBitrateCnt++;
+  handle_vbr->dnBitrateCnt++;
+  ///////////////////////////////
+
+  handle_vbr->lless_dnCheckBitrateCnt++;
+  handle_vbr->lless_upCheckBitrateCnt++;
+
+  return func_ret;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_abr_adjust_bitrate ()
+//
+// Adjust bit rate automatically according to number of packets in queue for LHDC 5.0 encoding
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcBT_get_handle ()
+//		handle: a pointer to ABR parameters
+//		queueLen: number of packets in a2dp transmit queue
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically 
+//		otherwise: fail to adjust bit rate automatically 
+//----------------------------------------------------------------
+static int lhdcv5_enc_abr_adjust_bitrate
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5_abr_para_t *handle_abr,
+    uint32_t  queueLen
+) 
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  uint32_t element_size = 0;
+  uint32_t new_abr_bitrate_inx = 0;
+  uint32_t abr_promote_bitrate_inx = 0;
+  uint32_t new_bitrate_inx = 0;
+  uint32_t new_bitrate_inx_set = 0;
+  uint32_t last_bitrate_inx = 0;
+  uint32_t last_abr_bitrate_inx = 0;
+  const lhdcv5_abr_rate_policy_t *abr_policy = NULL;
+  const lhdcv5_vbr_policy_t *vbr_policy = NULL;
+  const uint32_t *abr_table = NULL;
+  const uint32_t *vbr_table = NULL;
+  LHDCV5_ABR_TYPE_T	abr_type = LHDCV5_ABR_48K_RES;
+  LHDCV5BT_VBR_TYPE_T	vbr_type = LHDCV5BT_VBR_INVALID;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+  uint32_t queueLength = 0;
+  uint32_t queuSumTmp = 0;
+  uint32_t lossless_status = 0;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (handle_abr == NULL)
+  {
+    ALOGW ("%s: handle_abr is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+
+  if (handle_abr->qualityStatus != LHDCV5_QUALITY_AUTO)
+  {
+    ALOGW ("%s: Not in Auto-BitRate mode (%d)", __func__, handle_abr->qualityStatus);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+
+  if (queueLen < 0)
+  {
+    ALOGW ("%s: Invalid queue length (%u)!", __func__, queueLen);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+
+  abr_type = lhdcv5_enc_abr_type_of (handle_abr->sample_rate);
+  if (abr_type == LHDCV5_ABR_INVALID)
+  {
+    ALOGW ("%s: Sample rate is invalid (%u)!", __func__, handle_abr->sample_rate);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+  vbr_type = lhdcv5_enc_vbr_type_of (handle_abr->is_lless_enabled,
+      handle_abr->sample_rate, handle_abr->bits_per_sample);
+  abr_policy = &ctx->policy.abr[abr_type];
+  vbr_policy = &ctx->policy.vbr[(vbr_type != LHDCV5BT_VBR_INVALID) ? vbr_type : LHDCV5BT_VBR_48K_RES];
+  element_size = abr_policy->ladder.stage_num;
+  abr_table = abr_policy->ladder.bitrate;
+  vbr_table = vbr_policy->ladder.bitrate;
+
+  if (handle_abr->dnBitrateCnt > 0 && handle_abr->dnBitrateCnt >= abr_policy->down_time_cnt)
+  {
+    queueLength = handle_abr->dnBitrateSum / handle_abr->dnBitrateCnt;
+
+    func_ret = lhdcv5_util_reset_down_bitrate (handle);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_reset_down_bitrate error %d",  func_ret);
+      goto fail;
+    }
+
+    if (queueLength > abr_policy->down_queue_th)
+    {
+      ALOGV ("[AUTO_BITRATE][ABR_ADJ](DN) current queueLength:%u", queueLength);
+
+      func_ret = lhdcv5_enc_inx_of_abr_bitrate (ctx,
+          abr_type,
+          handle_abr->lastBitrate,
+          &last_abr_bitrate_inx);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_enc_inx_of_abr_bitrate error %d", func_ret);
+        goto fail;
+      }
+
+      func_ret = lhdcv5_util_get_bitrate_inx (handle_abr->lastBitrate, &last_bitrate_inx);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_get_bitrate_inx error %d",  func_ret);
+        goto fail;
+      }
+
+      new_abr_bitrate_inx = abr_policy->down_target_stage;
+      func_ret = lhdcv5_util_get_bitrate_inx (abr_table[new_abr_bitrate_inx], &new_bitrate_inx);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_get_bitrate_inx error %d",  func_ret);
+        goto fail;
+      }
+
+      if (new_bitrate_inx <= last_bitrate_inx &&
+          new_abr_bitrate_inx < ctx->abr_table_index)
+      {
+        func_ret = lhdcv5_util_set_target_bitrate_inx (handle, new_bitrate_inx, &new_bitrate_inx_set, false);
+        if (func_ret != LHDCV5_FRET_SUCCESS)
+        {
+          ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_set_target_bitrate_inx error %d", func_ret);
+          goto fail;
+        }
+
+        lhdcv5_util_get_lossless_status(handle, &lossless_status);
+        if (func_ret != LHDCV5_FRET_SUCCESS)
+        {
+          ALOGW ("[AUTO_BITRATE][VBR_ADJ](DN) lhdcv5_util_get_lossless_status error %d", func_ret);
+          goto fail;
+        }
+
+        ALOGD ("[AUTO_BITRATE][ABR_ADJ](DN) bitrate(%u)[%u] to bitrate(%u)[%u], queueLength(%u) lossless_on(%u)",
+            abr_table[ctx->abr_table_index], ctx->abr_table_index,
+            abr_table[new_abr_bitrate_inx], new_abr_bitrate_inx,
+            queueLength,
+            lossless_status);
+        func_ret = lhdcv5_util_reset_up_bitrate (handle);
+        if (func_ret != LHDCV5_FRET_SUCCESS)
+        {
+          ALOGW ("[AUTO_BITRATE][ABR_ADJ](DN) lhdcv5_util_reset_up_bitrate error %d", func_ret);
+          goto fail;
+        }
+        ctx->abr_table_index = new_abr_bitrate_inx;
+      }
+      else
+      {
+        ALOGD ("[AUTO_BITRATE][ABR_ADJ](DN) next bitrate not changed (%u)[%u]",
+            handle_abr->lastBitrate, ctx->abr_table_index);
+      }
+    }
+  }
+
+  if (handle_abr->upBitrateCnt > 0 && handle_abr->upBitrateCnt >= abr_policy->up_time_cnt)
+  {
+    queuSumTmp = handle_abr->upBitrateSum;
+
+    func_ret = lhdcv5_util_reset_up_bitrate (handle);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_reset_up_bitrate error %d", func_ret);
+      goto fail;
+    }
+
+    if (queuSumTmp < abr_policy->up_queue_th)
+    {
+      ALOGV ("[AUTO_BITRATE][ABR_ADJ](DN) current queuSumTmp:%u", queuSumTmp);
+
+      func_ret = lhdcv5_util_get_bitrate_inx (handle_abr->lastBitrate, &last_bitrate_inx);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_get_bitrate_inx error %d", func_ret);
+        goto fail;
+      }
+
+      // get the last index in abr table
+      new_abr_bitrate_inx = ctx->abr_table_index;
+
+      if (ctx->abr_table_index < (element_size - 1))
+      {
+        new_abr_bitrate_inx += 1;
+      }
+
+      func_ret = lhdcv5_util_get_bitrate_inx (abr_table[new_abr_bitrate_inx], &new_bitrate_inx);
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_get_bitrate_inx error %d", func_ret);
+        goto fail;
+      }
+
+      if ((new_bitrate_inx >= last_bitrate_inx) &&
+          (new_abr_bitrate_inx > ctx->abr_table_index))
+      {
+        func_ret = lhdcv5_util_set_target_bitrate_inx (handle, new_bitrate_inx, &new_bitrate_inx_set, false);
+        if (func_ret != LHDCV5_FRET_SUCCESS)
+        {
+          ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_set_target_bitrate_inx error %d", func_ret);
+          goto fail;
+        }
+        lhdcv5_util_get_lossless_status(handle, &lossless_status);
+        if (func_ret != LHDCV5_FRET_SUCCESS)
+        {
+          ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_get_lossless_status error %d", func_ret);
+          goto fail;
+        }
+
+        ALOGD ("[AUTO_BITRATE][ABR_ADJ](UP) bitrate(%u)[%u] to bitrate(%u)[%u], queuSumTmp(%u) lossless_on(%u)",
+            abr_table[ctx->abr_table_index], ctx->abr_table_index,
+            abr_table[new_abr_bitrate_inx], new_abr_bitrate_inx,
+            queuSumTmp,
+            lossless_status);
+        func_ret = lhdcv5_util_reset_down_bitrate (handle);
+        if (func_ret != LHDCV5_FRET_SUCCESS)
+        {
+          ALOGW ("[AUTO_BITRATE][ABR_ADJ](UP) lhdcv5_util_reset_down_bitrate error %d", func_ret);
+          goto fail;
+        }
+
+        ctx->abr_table_index = new_abr_bitrate_inx;
+      }
+      else
+      {
+        // if lossless is enabled, check if promote to VBR layer
+        // conditions for promoting to VBR:
+        //  1. must have a VBR table (48KHz 16/24 bit, 96KHz)
+        //  2. lastBitrate already reach the Max BitRate of ABR table
+        if (vbr_type != LHDCV5BT_VBR_INVALID &&
+            handle_abr->lastBitrate == abr_table[element_size - 1])
+        {
+          func_ret = lhdcv5_enc_inx_of_abr_bitrate (ctx, abr_type,
+              handle_abr->lastBitrate,
+              &last_abr_bitrate_inx);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_enc_inx_of_abr_bitrate error %d", func_ret);
+            goto fail;
+          }
+
+          func_ret = lhdcv5_util_get_bitrate_inx (handle_abr->lastBitrate, &last_bitrate_inx);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_get_bitrate_inx error %d", func_ret);
+            goto fail;
+          }
+
+          abr_promote_bitrate_inx = vbr_policy->promote_target_stage;
+          func_ret = lhdcv5_util_get_bitrate_inx (vbr_table[abr_promote_bitrate_inx], &new_bitrate_inx);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_get_bitrate_inx error %d", func_ret);
+            goto fail;
+          }
+
+          // set new bitrate to the stage of VBR table
+          func_ret = lhdcv5_util_set_target_bitrate_inx (handle, new_bitrate_inx, &new_bitrate_inx_set, false);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_set_target_bitrate_inx error %d", func_ret);
+            goto fail;
+          }
+          lhdcv5_util_get_lossless_status(handle, &lossless_status);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_get_lossless_status error %d", func_ret);
+            goto fail;
+          }
+
+          ALOGD ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) bitrate(%u)[%u] to bitrate(%u)[%u], queuSumTmp(%u) lossless_on(%u)",
+              abr_table[last_abr_bitrate_inx], last_bitrate_inx,
+              vbr_table[abr_promote_bitrate_inx], new_bitrate_inx_set,
+              queuSumTmp,
+              lossless_status);
+
+          // reset counters
+          func_ret = lhdcv5_util_reset_down_bitrate (handle);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_reset_down_bitrate error %d", func_ret);
+            goto fail;
+          }
+          func_ret = lhdcv5_util_reset_up_bitrate (handle);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_reset_up_bitrate error %d", func_ret);
+            goto fail;
+          }
+          func_ret = lhdcv5_util_reset_down_bitrate_vbr (handle);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_reset_down_bitrate_vbr error %d", func_ret);
+            goto fail;
+          }
+          func_ret = lhdcv5_util_reset_up_bitrate_vbr (handle);
+          if (func_ret != LHDCV5_FRET_SUCCESS)
+          {
+            ALOGW ("[AUTO_BITRATE][ABR_ADJ](PROMOTE) lhdcv5_util_reset_up_bitrate_vbr error %d",  func_ret);
+            goto fail;
+          }
+        }
+        else
+        {
+          ALOGD ("[AUTO_BITRATE][ABR_ADJ](UP) next bitrate not changed (%u)[%u]",
+              handle_abr->lastBitrate, ctx->abr_table_index);
+        }
+      }
+    }
+  }
+
+  if (queueLen > 0)
+  {
+    handle_abr->upBitrateSum += queueLen;
+    handle_abr->dnBitrateSum += queueLen;
+  }
+
+  handle_abr->upBitrateCnt++;
+  handle_abr->dnBitrateCnt++;
+
+fail:
+  return func_ret;
+}
+
+
+/*
+ ******************************************************************
+ LHDC library public API group
+ ******************************************************************
+ */
+
+//----------------------------------------------------------------
+// lhdcv5BT_free_handle ()
+//
+// Free all resources allocated
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned 
+//				by function lhdcv5BT_get_handle ()
+//	Return
+//		LHDCV5_FRET_SUCCESS: Succeed to free all resources
+//		otherwise: Fail to free all resources
+//----------------------------------------------------------------
+int32_t lhdcv5BT_free_handle
+(
+    HANDLE_LHDCV5_BT	handle
+) 
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  lhdcv5_enc_stop_pipe (ctx);
+
+  // reset resources
+  func_ret = lhdcv5_util_free_handle (handle);
+
+  // free handle and its wrapper context
+  ALOGD ("%s: free handle %p!", __func__, handle);
+  ctx->magic = 0;
+  pthread_mutex_destroy (&ctx->lock);
+  pthread_mutex_destroy (&ctx->ext_lock);
+  lhdcv5_enc_release_pkt (ctx);
+  lhdcv5_enc_release_input (ctx);
+  lhdcv5_enc_src_destroy (ctx->src);
+  free(ctx);
+
+  return func_ret;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_get_handle ()
+//
+// Allocate resources required by LHDC 5.0 Encoder 
+// 	Parameter
+//		version: version defined in BT A2DP capability
+//		handle: a pointer to the resource allocated 
+// 	Return
+//		LHDCV5_FRET_SUCCESS: Succeed to allocate resources
+//		otherwise: Fail to allocate resources
+//----------------------------------------------------------------
+int32_t lhdcv5BT_get_handle
+(
+    uint32_t			version,
+    HANDLE_LHDCV5_BT	*handle
+) 
+{
+  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
+  uint32_t mem_req_bytes = 0;
+
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  HANDLE_LHDCV5_BT hLhdcBT = NULL;
+
+  if (version != LHDCV5_VERSION_1)
+  {
+    ALOGW ("%s: Invalid version (%u)!", __func__, version);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  func_ret = lhdcv5_util_get_mem_req (
+      version,
+      &mem_req_bytes);
+
+  if (func_ret != LHDCV5_FRET_SUCCESS || mem_req_bytes <= 0)
+  {
+    ALOGW ("%s: Fail to get required memory size (%d)!", __func__, func_ret);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  // wrapper context first, util memory right behind it
+  ctx = (lhdcv5BT_enc_ctx_t *)malloc(LHDCV5BT_ENC_CTX_BYTES + mem_req_bytes);
+  if (ctx == NULL)
+  {
+    ALOGW ("%s: Fail to allocate memory for encoder!", __func__);
+    return LHDCV5_FRET_ERROR;
+  }
+  lhdcv5_enc_init_ctx (ctx, mem_req_bytes);
+  hLhdcBT = (HANDLE_LHDCV5_BT)((uint8_t *)ctx + LHDCV5BT_ENC_CTX_BYTES);
+
+  func_ret = lhdcv5_util_get_handle (
+      version,
+      hLhdcBT, mem_req_bytes);
+
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("%s: Fail to get handle (%d)!", __func__, func_ret);
+    free(ctx);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  *handle = hLhdcBT;
+
+  if ((*handle) == NULL)
+  {
+    ALOGW ("%s: Get handle NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_get_bitrate ()
+//
+// Get the bit rate used during LHDC 5.0 encoding
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned 
+//				by function lhdcv5BT_get_handle ()
+//		bitrate: a pointer to bit rate used during LHDC 5.0 encoding,
+//				 range [64000, 1000000]
+//	Return
+//		LHDCV5_FRET_SUCCESS: Succeed to allocate resources
+//		otherwise: Fail to allocate resources
+//----------------------------------------------------------------
+int32_t lhdcv5BT_get_bitrate
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			*bitrate
+) 
+{
+  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (bitrate == NULL)
+  {
+    ALOGW ("%s: Input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  func_ret = lhdcv5_util_get_target_bitrate (handle, bitrate);
+
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("%s: Failed to get bit rate (%d)!", __func__, func_ret);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  if ((*bitrate < 64000) || (*bitrate > 1000000))
+  {
+    ALOGW ("%s: Invalid bit rate returned (%u)!", __func__, *bitrate);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5_enc_set_bitrate ()
+//
+// Set the bit rate used during LHDC 5.0 encoding, called with ctx->lock held
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//		bitrate_inx: an index of bit rate to set
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set the bit rate
+//		Other: fail to set the bit rate
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_set_bitrate
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5BT_enc_ctx_t *ctx,
+    uint32_t  bitrate_inx
+)
+{
+  LHDCV5_ABR_TYPE_T abr_type = LHDCV5_ABR_INVALID;
+  LHDCV5_ENC_TYPE_T enc_type = LHDCV5_ENC_TYPE_LHDCV5;
+  lhdcv5_abr_para_t * abr_para = NULL;
+  uint32_t abr_table_size = 0;
+
+  uint32_t  bitrate_inx_set = LHDCV5_QUALITY_INVALID;
+  uint32_t  lless_enabled = 0;
+  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
+
+  // reset ABR table index record
+  ctx->abr_table_index = 0;
+  lhdcv5_enc_reset_pred (ctx);
+
+  // prepare new ABR table index record for update
+  func_ret = lhdcv5_util_adjust_bitrate (handle, &enc_type, &abr_para);
+  if ((func_ret != LHDCV5_FRET_SUCCESS) || (abr_para == NULL))
+  {
+    ALOGW ("%s: Failed to get auto bit rate parameters (%d) (%p)!", __func__, func_ret, abr_para);
+    return LHDCV5_FRET_ERROR;
+  }
+  abr_type = lhdcv5_enc_abr_type_of (abr_para->sample_rate);
+  if (abr_type != LHDCV5_ABR_INVALID) {
+    abr_table_size = ctx->policy.abr[abr_type].ladder.stage_num;
+  }
+
+  func_ret = lhdcv5_util_get_lossless_enabled(handle, &lless_enabled);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("%s: Failed to get lossless enabled (%d)!", __func__, func_ret);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  // handle standard/control index
+  switch(bitrate_inx)
+  {
+  case LHDCV5_QUALITY_CTRL_RESET_ABR:
+  {
+    if (lless_enabled == 1)
+    {
+      bitrate_inx = LHDCV5_VBR_DEFAULT_BITRATE;
+    }
+    else
+    {
+      bitrate_inx = LHDCV5_ABR_DEFAULT_BITRATE;
+      if (abr_table_size > 0) {
+        ctx->abr_table_index = abr_table_size - 1;
+      }
+    }
+
+    // change current bitrate only, not change current quality index
+    func_ret = lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx, &bitrate_inx_set, false);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("%s: lhdcv5_util_set_target_bitrate_inx error (%d)!", __func__, func_ret);
+      return LHDCV5_FRET_ERROR;
+    }
+    ALOGD ("%s: [Reset BiTrAtE] (%s) ABR_table_index(%d)", __func__,
+        rate_to_string (bitrate_inx_set), ctx->abr_table_index);
+  }
+  break;
+
+  //LOW0 ~ ABR
+  case LHDCV5_QUALITY_AUTO:
+  case LHDCV5_QUALITY_HIGH5:
+  case LHDCV5_QUALITY_HIGH4:
+  case LHDCV5_QUALITY_HIGH3:
+  case LHDCV5_QUALITY_HIGH2:
+  case LHDCV5_QUALITY_HIGH1:
+  case LHDCV5_QUALITY_HIGH:
+  case LHDCV5_QUALITY_MID:
+  case LHDCV5_QUALITY_LOW:
+  case LHDCV5_QUALITY_LOW4:
+  case LHDCV5_QUALITY_LOW3:
+  case LHDCV5_QUALITY_LOW2:
+  case LHDCV5_QUALITY_LOW1:
+  case LHDCV5_QUALITY_LOW0:
+  {
+    if (bitrate_inx == LHDCV5_QUALITY_AUTO && abr_table_size > 0) {
+      ctx->abr_table_index = abr_table_size - 1;
+    }
+
+    func_ret = lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx, &bitrate_inx_set, true);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("%s: lhdcv5_util_set_target_bitrate_inx error (%d)!", __func__, func_ret);
+      return LHDCV5_FRET_ERROR;
+    }
+    ALOGD ("%s: [Set BiTrAtE] (%s) ABR_table_index(%d)", __func__,
+        rate_to_string (bitrate_inx_set), ctx->abr_table_index);
+  }
+  break;
+
+  default:
+  {
+    ALOGD ("%s: Not supported index (%s)", __func__, rate_to_string (bitrate_inx));
+    func_ret = LHDCV5_FRET_ERROR;
+  }
+  break;
+  }
+
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("%s: failed to set bitrate (%d) err(%d)!", __func__, bitrate_inx, func_ret);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  ALOGD ("%s: Update target bitrate (%s) bitrate_inx(%d)",  __func__,
+      rate_to_string (bitrate_inx_set), bitrate_inx);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_set_bitrate ()
+//
+// Set the bit rate used during LHDC 5.0 encoding
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned 
+//				by function lhdcBT_get_handle ()
+//		bitrate_inx: an index of bit rate to set
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set the bit rate
+//		Other: fail to set the bit rate
+//----------------------------------------------------------------
+int32_t lhdcv5BT_set_bitrate
+(
+    HANDLE_LHDCV5_BT 	handle,
+    uint32_t			bitrate_inx
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  pthread_mutex_lock (&ctx->lock);
+  func_ret = lhdcv5_enc_set_bitrate (handle, ctx, bitrate_inx);
+  pthread_mutex_unlock (&ctx->lock);
+
+  return func_ret;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_set_max_bitrate ()
+//
+// Set the MAX. bit rate for LHDC 5.0 encoding
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned 
+//				by function lhdcBT_get_handle ()
+//		max_bitrate_inx: MAX. bit rate (index) for LHDC 5.0 encoding
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set the MAX. bit rate
+//		Other: fail to set the MAX. bit rate
+//----------------------------------------------------------------
+int32_t lhdcv5BT_set_max_bitrate
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			max_bitrate_inx
+) 
+{
+  uint32_t max_bitrate_inx_set = LHDCV5_QUALITY_INVALID; //for return check
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  // max_bitrate_inx policy: LOW ~ MAX
+  if ((max_bitrate_inx < LHDCV5_QUALITY_LOW) ||
+      (max_bitrate_inx > LHDCV5_QUALITY_MAX_BITRATE))
+  {
+    ALOGW ("%s: Invalid max bit rate index (%u)!", __func__, max_bitrate_inx);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  func_ret = lhdcv5_util_set_max_bitrate_inx (handle, max_bitrate_inx, &max_bitrate_inx_set);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("%s: failed to set max. bit rate index (%u), (%d)!", __func__, max_bitrate_inx, func_ret);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  ALOGD ("%s: Update Max target bitrate(%s)",  __func__, rate_to_string (max_bitrate_inx_set));
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_set_min_bitrate ()
+//
+// Set the MIN. bit rate for LHDC 5.0 encoding
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned 
+//				by function lhdcBT_get_handle ()
+//		min_bitrate_inx: MIN. bit rate (index) for LHDC 5.0 encoding
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set the MIN. bit rate
+//		Other: fail to set the MIN. bit rate
+//----------------------------------------------------------------
+
+int32_t lhdcv5BT_set_min_bitrate
+(
+    HANDLE_LHDCV5_BT 	handle,
+    uint32_t			min_bitrate_inx
+)
+{
+  uint32_t   min_bitrate_inx_set = LHDCV5_QUALITY_INVALID;
+  int32_t			func_ret = LHDCV5_FRET_SUCCESS;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  // min policy: (LOW0 ~ LOW)
+  if ((min_bitrate_inx < LHDCV5_QUALITY_LOW0) ||
+      (min_bitrate_inx > LHDCV5_QUALITY_LOW))
+  {
+      ALOGW ("%s: Invalid min bit rate index (%u)!", __func__, min_bitrate_inx);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  func_ret = lhdcv5_util_set_min_bitrate_inx (handle, min_bitrate_inx, &min_bitrate_inx_set);
+
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("%s: failed to set min. bit rate (%d)!", __func__, func_ret);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  ALOGD ("%s: Update Min target bitrate(%s)",  __func__, rate_to_string (min_bitrate_inx_set));
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5_enc_pred_step ()
+//
+// move the encoder to the bit rate picked by the predictive controller
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		abr_para: ABR parameters of the handle
+//		bitrate: new bit rate (kbps)
+//		dir: direction tag for the log
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set the bit rate
+//		otherwise: fail to set the bit rate
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_pred_step
+(
+    HANDLE_LHDCV5_BT  handle,
+    const lhdcv5_abr_para_t *abr_para,
+    uint32_t  bitrate,
+    const char *dir
+)
+{
+  uint32_t last_bitrate = abr_para->lastBitrate;
+  uint32_t bitrate_inx = 0;
+  uint32_t bitrate_inx_set = 0;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  func_ret = lhdcv5_util_get_bitrate_inx (bitrate, &bitrate_inx);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("[AUTO_BITRATE][PRED_ADJ](%s) lhdcv5_util_get_bitrate_inx(%u) error %d", dir, bitrate, func_ret);
+    return func_ret;
+  }
+
+  func_ret = lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx, &bitrate_inx_set, false);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("[AUTO_BITRATE][PRED_ADJ](%s) lhdcv5_util_set_target_bitrate_inx(%u) error %d", dir, bitrate_inx, func_ret);
+    return func_ret;
+  }
+
+  // the queue mode counters and the lossless statistics restart at the new rate
+  lhdcv5_util_reset_up_bitrate (handle);
+  lhdcv5_util_reset_down_bitrate (handle);
+  lhdcv5_util_reset_up_bitrate_vbr (handle);
+  lhdcv5_util_reset_down_bitrate_vbr (handle);
+
+  ALOGD ("[AUTO_BITRATE][PRED_ADJ](%s) bitrate(%u) to bitrate(%u)[%u]",
+      dir, last_bitrate, bitrate, bitrate_inx_set);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5_enc_pred_adjust_bitrate ()
+//
+// Predictive bit rate controller. The congestion error is the queue length
+// expected horizon_ticks ahead (smoothed length plus smoothed trend) above
+// target_queue, plus send latency above target_latency_us and a poor link
+// hint, all in packets. A PI model of that error steps down one or more
+// stages before the queue overflows, and steps up one stage after
+// up_hold_ticks quiet ticks. The VBR layer of a hybrid stream counts as one
+// stage above the ABR ladder; inside it the encoder tunes the lossless rate.
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//		abr_para: ABR parameters of the handle
+//		feedback: transmit feedback of this tick
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically
+//		otherwise: fail to adjust bit rate automatically
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_pred_adjust_bitrate
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5BT_enc_ctx_t *ctx,
+    lhdcv5_abr_para_t *abr_para,
+    const lhdcv5_abr_feedback_t *feedback
+)
+{
+  const lhdcv5_abr_pred_policy_t *pred = &ctx->policy.pred;
+  const lhdcv5_abr_rate_policy_t *abr_policy = NULL;
+  const lhdcv5_vbr_policy_t *vbr_policy = NULL;
+  LHDCV5_ABR_TYPE_T abr_type = LHDCV5_ABR_INVALID;
+  LHDCV5BT_VBR_TYPE_T vbr_type = LHDCV5BT_VBR_INVALID;
+  uint32_t element_size = 0;
+  uint32_t top_stage = 0;
+  uint32_t stage = 0;
+  uint32_t new_stage = 0;
+  uint32_t steps = 0;
+  uint32_t queue = 0;
+  bool in_vbr = false;
+  bool stepped = false;
+  int64_t err_q8 = 0;
+  int64_t out_q8 = 0;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  abr_type = lhdcv5_enc_abr_type_of (abr_para->sample_rate);
+  if (abr_type == LHDCV5_ABR_INVALID)
+  {
+    ALOGW ("%s: Sample rate is invalid (%u)!", __func__, abr_para->sample_rate);
+    return LHDCV5_FRET_INVALID_HANDLE_PARA;
+  }
+  abr_policy = &ctx->policy.abr[abr_type];
+  element_size = abr_policy->ladder.stage_num;
+
+  // position on the ABR ladder, the VBR layer is the stage above its top
+  vbr_type = lhdcv5_enc_vbr_type_of (abr_para->is_lless_enabled,
+      abr_para->sample_rate, abr_para->bits_per_sample);
+  if (vbr_type != LHDCV5BT_VBR_INVALID)
+  {
+    vbr_policy = &ctx->policy.vbr[vbr_type];
+    in_vbr = (abr_para->lastBitrate >= LHDCV5_VBR_MIN_BITRATE);
+    top_stage = element_size;
+  }
+  else
+  {
+    top_stage = element_size - 1;
+  }
+
+  if (in_vbr)
+  {
+    stage = element_size;
+  }
+  else if (lhdcv5_enc_inx_of_abr_bitrate (ctx, abr_type, abr_para->lastBitrate, &stage) != LHDCV5_FRET_SUCCESS)
+  {
+    stage = element_size - 1;
+  }
+
+  //
+  // estimates
+  //
+  queue = (feedback->queue_len > 0xFFFF) ? 0xFFFF : feedback->queue_len;
+  if (!ctx->pred_primed)
+  {
+    ctx->pred_primed = true;
+    ctx->pred_prev_queue = queue;
+    ctx->pred_queue_q8 = (int32_t) (queue << 8);
+  }
+  ctx->pred_slope_q8 += ((((int32_t) queue - (int32_t) ctx->pred_prev_queue) * 256) -
+      ctx->pred_slope_q8) >> pred->ewma_shift;
+  ctx->pred_queue_q8 += ((int32_t) (queue << 8) - ctx->pred_queue_q8) >> pred->ewma_shift;
+  ctx->pred_prev_queue = queue;
+
+  if (feedback->send_latency_us > 0)
+  {
+    if (ctx->pred_latency_us == 0)
+    {
+      ctx->pred_latency_us = (int32_t) feedback->send_latency_us;
+    }
+    ctx->pred_latency_us += ((int32_t) feedback->send_latency_us - ctx->pred_latency_us) >> pred->ewma_shift;
+  }
+
+  //
+  // congestion error and PI output
+  //
+  err_q8 = (int64_t) ctx->pred_queue_q8 + (int64_t) ctx->pred_slope_q8 * pred->horizon_ticks -
+      ((int64_t) pred->target_queue << 8);
+
+  if (ctx->pred_latency_us > (int32_t) pred->target_latency_us)
+  {
+    err_q8 += ((int64_t) (ctx->pred_latency_us - (int32_t) pred->target_latency_us) << 8) /
+        pred->latency_per_packet_us;
+  }
+
+  if ((feedback->link_quality != LHDCV5BT_LINK_QUALITY_UNKNOWN) &&
+      (feedback->link_quality < pred->link_quality_th))
+  {
+    err_q8 += ((int64_t) (pred->link_quality_th - feedback->link_quality) << 8) / 10;
+  }
+
+  if (err_q8 > PRED_INTEG_LIMIT_Q8)
+  {
+    err_q8 = PRED_INTEG_LIMIT_Q8;
+  }
+  ctx->pred_integ_q8 += (int32_t) err_q8;
+  if (ctx->pred_integ_q8 > PRED_INTEG_LIMIT_Q8)
+  {
+    ctx->pred_integ_q8 = PRED_INTEG_LIMIT_Q8;
+  }
+  else if (ctx->pred_integ_q8 < -PRED_INTEG_LIMIT_Q8)
+  {
+    ctx->pred_integ_q8 = -PRED_INTEG_LIMIT_Q8;
+  }
+
+  out_q8 = ((int64_t) pred->kp_q8 * err_q8 + (int64_t) pred->ki_q8 * ctx->pred_integ_q8) >> 8;
+
+  ALOGV ("[AUTO_BITRATE][PRED_ADJ] q(%u) avg(%d) slope(%d) lat(%d) err(%d) out(%d) stage(%u/%u)",
+      queue, ctx->pred_queue_q8, ctx->pred_slope_q8, ctx->pred_latency_us,
+      (int32_t) err_q8, (int32_t) out_q8, stage, top_stage);
+
+  //
+  // decision
+  //
+  if (ctx->pred_down_hold > 0)
+  {
+    ctx->pred_down_hold--;
+  }
+
+  if ((out_q8 > (int64_t) pred->down_th_q8) && (ctx->pred_down_hold == 0))
+  {
+    ctx->pred_up_cnt = 0;
+
+    // one stage per multiple of the threshold, leaving the VBR layer takes one
+    steps = (uint32_t) (out_q8 / pred->down_th_q8);
+    new_stage = (stage > steps) ? (stage - steps) : 0;
+
+    if (new_stage != stage)
+    {
+      func_ret = lhdcv5_enc_pred_step (handle, abr_para,
+          abr_policy->ladder.bitrate[new_stage], in_vbr ? "DEMOTE" : "DN");
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        return func_ret;
+      }
+      ctx->abr_table_index = new_stage;
+      ctx->pred_integ_q8 = 0;
+      stepped = true;
+    }
+    ctx->pred_down_hold = pred->down_hold_ticks;
+  }
+  else if (out_q8 < -((int64_t) pred->up_th_q8))
+  {
+    ctx->pred_up_cnt++;
+    if ((ctx->pred_up_cnt >= pred->up_hold_ticks) && (stage < top_stage))
+    {
+      ctx->pred_up_cnt = 0;
+
+      // skip stages repeating the current bit rate
+      new_stage = stage + 1;
+      while ((new_stage < element_size) &&
+          (abr_policy->ladder.bitrate[new_stage] <= abr_para->lastBitrate))
+      {
+        new_stage++;
+      }
+
+      if (new_stage < element_size)
+      {
+        func_ret = lhdcv5_enc_pred_step (handle, abr_para,
+            abr_policy->ladder.bitrate[new_stage], "UP");
+        ctx->abr_table_index = new_stage;
+        stepped = true;
+      }
+      else if (vbr_policy != NULL)
+      {
+        func_ret = lhdcv5_enc_pred_step (handle, abr_para,
+            vbr_policy->ladder.bitrate[vbr_policy->promote_target_stage], "PROMOTE");
+        ctx->abr_table_index = element_size - 1;
+        stepped = true;
+      }
+      if (func_ret != LHDCV5_FRET_SUCCESS)
+      {
+        return func_ret;
+      }
+      // at the top (repeated top bit rates, no VBR layer) nothing changed,
+      // so the integral is kept
+      if (stepped)
+      {
+        ctx->pred_integ_q8 = 0;
+      }
+    }
+  }
+  else
+  {
+    ctx->pred_up_cnt = 0;
+  }
+
+  // no layer change: the encoder tunes the lossless bit rate inside the VBR layer
+  if (in_vbr && !stepped)
+  {
+    func_ret = lhdcv5_enc_vbr_process (handle, abr_para, vbr_policy);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("[AUTO_BITRATE][PRED_ADJ] lhdcv5_enc_vbr_process error %d", func_ret);
+    }
+    abr_para->lless_dnCheckBitrateCnt++;
+    abr_para->lless_upCheckBitrateCnt++;
+  }
+
+  return func_ret;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5_enc_adjust_bitrate ()
+//
+// Run one tick of the ABR/VBR controller, called with ctx->lock held
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		ctx: wrapper context of the handle
+//		feedback: transmit feedback of this tick
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically
+//		Other: fail to adjust bit rate automatically
+//----------------------------------------------------------------
+static int32_t lhdcv5_enc_adjust_bitrate
+(
+    HANDLE_LHDCV5_BT  handle,
+    lhdcv5BT_enc_ctx_t *ctx,
+    const lhdcv5_abr_feedback_t *feedback
+)
+{
+  uint32_t queueLen = feedback->queue_len;
+  uint32_t last_bitrate = 0;
+  LHDCV5_ENC_TYPE_T	enc_type = LHDCV5_ENC_TYPE_LHDCV5;
+  lhdcv5_abr_para_t	* abr_para = NULL;
+  const lhdcv5_bitrate_ladder_t *abr_ladder = NULL;
+  LHDCV5BT_VBR_TYPE_T	vbr_type = LHDCV5BT_VBR_INVALID;
+  int32_t				func_ret = LHDCV5_FRET_ERROR;
+
+  //get ABR parameters: abr_para from lib
+  func_ret = lhdcv5_util_adjust_bitrate (handle, &enc_type, &abr_para);
+  if ((func_ret != LHDCV5_FRET_SUCCESS) || (abr_para == NULL))
+  {
+    ALOGW ("%s: Failed to get auto bit rate parameters (%d) (%p)!", __func__, func_ret, abr_para);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  switch (enc_type)
+  {
+  case LHDCV5_ENC_TYPE_LHDCV5:
+    if (abr_para->qualityStatus != LHDCV5_QUALITY_AUTO)
+    {
+      ALOGW ("%s: Not in Auto Bit Rate mode (%d)", __func__, abr_para->qualityStatus);
+      return LHDCV5_FRET_INVALID_HANDLE_PARA;
+    }
+    last_bitrate = abr_para->lastBitrate;
+
+    if (ctx->policy.mode == LHDCV5BT_ABR_MODE_PREDICTIVE)
+    {
+      func_ret = lhdcv5_enc_pred_adjust_bitrate (handle, ctx, abr_para, feedback);
+    }
+    else if (abr_para->is_lless_enabled == 0)
+    {
+      // go ABR mode (lossy mode) only
+      func_ret = lhdcv5_enc_abr_adjust_bitrate (handle, abr_para, queueLen);
+    }
+    else if ((vbr_type = lhdcv5_enc_vbr_type_of (abr_para->is_lless_enabled,
+        abr_para->sample_rate, abr_para->bits_per_sample)) != LHDCV5BT_VBR_INVALID)
+    {
+      // go ABR+VBR hybrid mode(lossy+lossless mode)
+      abr_ladder = &ctx->policy.abr[lhdcv5_enc_abr_type_of_vbr (vbr_type)].ladder;
+      if (abr_para->lastBitrate >= abr_ladder->bitrate[0] &&
+          abr_para->lastBitrate <= abr_ladder->bitrate[abr_ladder->stage_num - 1])
+      {
+        // run in ABR layer
+        func_ret = lhdcv5_enc_abr_adjust_bitrate (handle, abr_para, queueLen);
+      }
+      else if (
+          abr_para->lastBitrate >= LHDCV5_VBR_MIN_BITRATE &&
+          abr_para->lastBitrate <= LHDCV5_VBR_MAX_BITRATE)
+      {
+        // run in VBR layer
+        func_ret = lhdcv5_enc_vbr_adjust_bitrate (handle, abr_para, queueLen);
+      }
+    } else {
+      ALOGW ("%s: Non supported hybrid auto bit rate mode!", __func__);
+      return LHDCV5_FRET_ERROR;
+    }
+
+    lhdcv5_enc_stats_adjust (ctx, queueLen, last_bitrate, abr_para->lastBitrate);
+
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      ALOGW ("%s: Failed to adjust auto bit rate (%d)!", __func__, func_ret);
+      return LHDCV5_FRET_ERROR;
+    }
+    break;
+
+  default:
+    ALOGW ("%s: Invalid encode type (%d)!", __func__, enc_type);
+    return LHDCV5_FRET_INVALID_CODEC;
+  }
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_adjust_bitrate () - ABR
+//
+// Adjust bit rate automatically according to number of packets in queue for LHDC 5.0 encoding
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned 
+//				by function lhdcBT_get_handle ()
+//		queue_len: number of packets in queue
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically 
+//		Other: fail to adjust bit rate automatically 
+//----------------------------------------------------------------
+
+int32_t lhdcv5BT_adjust_bitrate
+(
+    HANDLE_LHDCV5_BT 	handle,
+    uint32_t			queueLen
+) 
+{
+  lhdcv5_abr_feedback_t feedback;
+
+  if (queueLen < 0)
+  {
+    ALOGW ("%s: Invalid input queue length (%u)!", __func__, queueLen);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  feedback.queue_len = queueLen;
+  feedback.send_latency_us = 0;
+  feedback.link_quality = LHDCV5BT_LINK_QUALITY_UNKNOWN;
+
+  return lhdcv5BT_adjust_bitrate_ex (handle, &feedback);
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_adjust_bitrate_ex () - ABR
+//
+// Adjust bit rate automatically from the transmit feedback of one tick.
+// Decisions are reported through lastBitrate of the ABR parameters, the
+// quality index stays LHDCV5_QUALITY_AUTO.
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		feedback: queue length, send latency and link hint of this tick
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically
+//		Other: fail to adjust bit rate automatically
+//----------------------------------------------------------------
+int32_t lhdcv5BT_adjust_bitrate_ex
+(
+    HANDLE_LHDCV5_BT	handle,
+    const lhdcv5_abr_feedback_t	* feedback
+)
+{
+  lhdcv5BT_enc_ctx_t	* ctx = NULL;
+  int32_t				func_ret = LHDCV5_FRET_ERROR;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (feedback == NULL)
+  {
+    ALOGW ("%s: Input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  pthread_mutex_lock (&ctx->lock);
+  func_ret = lhdcv5_enc_adjust_bitrate (handle, ctx, feedback);
+  pthread_mutex_unlock (&ctx->lock);
+
+  return func_ret;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_get_default_abr_policy ()
+//
+// Get the built-in ABR/VBR policy
+//	Parameter
+//		policy: a pointer to the policy returned
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to get the policy
+//		Other: fail to get the policy
+//----------------------------------------------------------------
+int32_t lhdcv5BT_get_default_abr_policy
+(
+    lhdcv5_abr_policy_t	* policy
+)
+{
+  if (policy == NULL)
+  {
+    ALOGW ("%s: Input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  lhdcv5_enc_load_default_policy (policy);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_get_abr_policy ()
+//
+// Get the ABR/VBR policy in use by a handle
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		policy: a pointer to the policy returned
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to get the policy
+//		Other: fail to get the policy
+//----------------------------------------------------------------
+int32_t lhdcv5BT_get_abr_policy
+(
+    HANDLE_LHDCV5_BT	handle,
+    lhdcv5_abr_policy_t	* policy
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (policy == NULL)
+  {
+    ALOGW ("%s: Input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  pthread_mutex_lock (&ctx->lock);
+  memcpy (policy, &ctx->policy, sizeof(lhdcv5_abr_policy_t));
+  pthread_mutex_unlock (&ctx->lock);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_set_abr_policy ()
+//
+// Replace the ABR/VBR ladders, intervals and thresholds of a handle.
+// The policy is checked first and installed as a whole between two
+// bit rate adjustments; it may be called on a running encoder.
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		policy: the policy to install
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to install the policy
+//		Other: policy rejected, the handle keeps its current policy
+//----------------------------------------------------------------
+int32_t lhdcv5BT_set_abr_policy
+(
+    HANDLE_LHDCV5_BT	handle,
+    const lhdcv5_abr_policy_t	* policy
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  LHDCV5_ENC_TYPE_T enc_type = LHDCV5_ENC_TYPE_LHDCV5;
+  lhdcv5_abr_para_t * abr_para = NULL;
+  LHDCV5_ABR_TYPE_T abr_type = LHDCV5_ABR_INVALID;
+  LHDCV5BT_VBR_TYPE_T vbr_type = LHDCV5BT_VBR_INVALID;
+  uint32_t abr_table_index = 0;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (policy == NULL)
+  {
+    ALOGW ("%s: Input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  func_ret = lhdcv5_enc_check_policy (policy);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    return func_ret;
+  }
+
+  pthread_mutex_lock (&ctx->lock);
+
+  // hand the new VBR policy to a running stream first, ctx->policy is only
+  // replaced once the encoder took it
+  func_ret = lhdcv5_util_adjust_bitrate (handle, &enc_type, &abr_para);
+  if ((func_ret == LHDCV5_FRET_SUCCESS) && (abr_para != NULL) &&
+      (abr_para->qualityStatus == LHDCV5_QUALITY_AUTO))
+  {
+    vbr_type = lhdcv5_enc_vbr_type_of (abr_para->is_lless_enabled,
+        abr_para->sample_rate, abr_para->bits_per_sample);
+    if (vbr_type == LHDCV5BT_VBR_INVALID)
+    {
+      vbr_type = LHDCV5BT_VBR_48K_RES;
+    }
+
+    func_ret = lhdcv5_enc_apply_vbr_policy (handle, &policy->vbr[vbr_type]);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      // some thresholds may have been taken, restore the current ones
+      lhdcv5_enc_apply_vbr_policy (handle, &ctx->policy.vbr[vbr_type]);
+    }
+    else
+    {
+      if (policy->mode != ctx->policy.mode)
+      {
+        lhdcv5_enc_reset_pred (ctx);
+      }
+      memcpy (&ctx->policy, policy, sizeof(lhdcv5_abr_policy_t));
+
+      // re-place the running stream on the new ladders
+      abr_type = lhdcv5_enc_abr_type_of (abr_para->sample_rate);
+      if (abr_type != LHDCV5_ABR_INVALID)
+      {
+        if (lhdcv5_enc_inx_of_abr_bitrate (ctx, abr_type, abr_para->lastBitrate,
+            &abr_table_index) != LHDCV5_FRET_SUCCESS)
+        {
+          // above the ABR ladder (VBR layer) or not on it: top stage
+          abr_table_index = ctx->policy.abr[abr_type].ladder.stage_num - 1;
+        }
+        ctx->abr_table_index = abr_table_index;
+      }
+    }
+  }
+  else
+  {
+    // not running ABR yet, lhdcv5BT_init_encoder () applies the policy
+    if (policy->mode != ctx->policy.mode)
+    {
+      lhdcv5_enc_reset_pred (ctx);
+    }
+    memcpy (&ctx->policy, policy, sizeof(lhdcv5_abr_policy_t));
+    func_ret = LHDCV5_FRET_SUCCESS;
+  }
+  abr_table_index = ctx->abr_table_index;
+
+  pthread_mutex_unlock (&ctx->lock);
+
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    ALOGW ("%s: Failed to apply VBR policy (%d)!", __func__, func_ret);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  ALOGD ("%s: ABR/VBR policy installed, ABR_table_index(%u)", __func__, abr_table_index);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_set_ext_func_state ()
+//
+// Set the ext. function state (AR, JAS, Meta, LARC). The change is
+// committed on its own, like lhdcv5BT_ext_commit (), so the encoder takes
+// it between two blocks; changes staged by the caller are left alone.
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned 
+//				by function lhdcBT_get_handle ()
+//		field: specify the ext. function
+//		enabled: ext. function is set to “enabled” (true) or “disabled” (false)
+//		priv: a pointer to the exra data needed for ext. function
+//		priv_data_len: number of bytes of the extra data
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set specified ext. function to “enabled” (true) or “disabled” (false)
+//		Other: fail to set .
+//----------------------------------------------------------------
+
+int32_t lhdcv5BT_set_ext_func_state
+(
+    HANDLE_LHDCV5_BT 	handle,
+    LHDCV5_EXT_FUNC_T	field,
+    bool 				enabled,
+    void 				* priv,
+    uint32_t 			priv_data_len
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  lhdcv5BT_enc_ext_set_t set;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if ((field < LHDCV5_EXT_FUNC_AR) ||
+      (field >= LHDCV5_EXT_FUNC_INVALID))
+  {
+    ALOGW ("%s: Invalid ext. func. field (%d)!", __func__, field);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  if ((field == LHDCV5_EXT_FUNC_META) &&
+      (((priv == NULL) && (priv_data_len > 0)) || (priv_data_len > LHDCV5_META_LEN_MAX)))
+  {
+    ALOGW ("%s: Invalid META data (%p, %u bytes)!", __func__, priv, priv_data_len);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (field == LHDCV5_EXT_FUNC_META)
+  {
+    set.mask = LHDCV5BT_EXT_META;
+    set.meta_enabled = enabled;
+    set.meta_len = priv_data_len;	// data length MUST be 8 for META
+    set.meta_loop_cnt = LHDCV5_META_LOOP_CNT_STD;
+    if (priv_data_len > 0)
+    {
+      memcpy (set.meta, priv, priv_data_len);
+    }
+  }
+  else
+  {
+    set.mask = LHDCV5BT_EXT_STATE (field);
+    set.state[field] = enabled;
+  }
+
+  pthread_mutex_lock (&ctx->ext_lock);
+  lhdcv5_enc_ext_post (ctx, &set);
+  pthread_mutex_unlock (&ctx->ext_lock);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_ext_stage_state ()
+//
+// Stage the state of an ext. function that takes no data (AR, JAS, LARC),
+// applied by the encoder after lhdcv5BT_ext_commit ()
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		field: specify the ext. function, META goes through lhdcv5BT_ext_stage_meta ()
+//		enabled: ext. function is set to "enabled" (true) or "disabled" (false)
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to stage the state
+//		Other: fail to stage the state
+//----------------------------------------------------------------
+int32_t lhdcv5BT_ext_stage_state
+(
+    HANDLE_LHDCV5_BT	handle,
+    LHDCV5_EXT_FUNC_T	field,
+    bool				enabled
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if ((field < LHDCV5_EXT_FUNC_AR) ||
+      (field >= LHDCV5_EXT_FUNC_INVALID) ||
+      (field == LHDCV5_EXT_FUNC_META))
+  {
+    ALOGW ("%s: Invalid ext. func. field (%d)!", __func__, field);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  pthread_mutex_lock (&ctx->ext_lock);
+  if ((field == LHDCV5_EXT_FUNC_AR) && (ctx->ext_staged.mask & LHDCV5BT_EXT_AR_CFG))
+  {
+    // the later request wins, see lhdcv5_enc_ext_merge ()
+    ctx->ext_staged.ar.enabled = enabled;
+  }
+  else
+  {
+    ctx->ext_staged.state[field] = enabled;
+    ctx->ext_staged.mask |= LHDCV5BT_EXT_STATE (field);
+  }
+  pthread_mutex_unlock (&ctx->ext_lock);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_ext_stage_meta ()
+//
+// Stage the META state and data, applied by the encoder after
+// lhdcv5BT_ext_commit ()
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		enabled: META is set to "enabled" (true) or "disabled" (false)
+//		data: metadata, copied; may be NULL when data_len is 0
+//		data_len: number of bytes of metadata, up to LHDCV5_META_LEN_MAX
+//		loop_cnt: frames carrying the metadata, up to LHDCV5_META_LOOP_CNT_MAX
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to stage the metadata
+//		Other: fail to stage the metadata
+//----------------------------------------------------------------
+int32_t lhdcv5BT_ext_stage_meta
+(
+    HANDLE_LHDCV5_BT	handle,
+    bool				enabled,
+    const uint8_t		* data,
+    uint32_t			data_len,
+    uint32_t			loop_cnt
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (((data == NULL) && (data_len > 0)) ||
+      (data_len > LHDCV5_META_LEN_MAX) ||
+      (loop_cnt > LHDCV5_META_LOOP_CNT_MAX))
+  {
+    ALOGW ("%s: Invalid META data (%p, %u bytes, loop %u)!", __func__,
+        data, data_len, loop_cnt);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  pthread_mutex_lock (&ctx->ext_lock);
+  ctx->ext_staged.meta_enabled = enabled;
+  ctx->ext_staged.meta_len = data_len;
+  ctx->ext_staged.meta_loop_cnt = loop_cnt;
+  if (data_len > 0)
+  {
+    memcpy (ctx->ext_staged.meta, data, data_len);
+  }
+  ctx->ext_staged.mask |= LHDCV5BT_EXT_META;
+  pthread_mutex_unlock (&ctx->ext_lock);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_ext_stage_ar ()
+//
+// Stage the AR configuration, applied by the encoder after
+// lhdcv5BT_ext_commit (); positions and gains always change together
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		cfg: AR configuration, copied
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to stage the configuration
+//		Other: fail to stage the configuration
+//----------------------------------------------------------------
+int32_t lhdcv5BT_ext_stage_ar
+(
+    HANDLE_LHDCV5_BT	handle,
+    const lhdcv5_ar_cfg_t	* cfg
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (cfg == NULL)
+  {
+    ALOGW ("%s: Input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  pthread_mutex_lock (&ctx->ext_lock);
+  ctx->ext_staged.ar = *cfg;
+  ctx->ext_staged.mask = (ctx->ext_staged.mask & ~LHDCV5BT_EXT_STATE (LHDCV5_EXT_FUNC_AR)) |
+      LHDCV5BT_EXT_AR_CFG;
+  pthread_mutex_unlock (&ctx->ext_lock);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_ext_commit ()
+//
+// Hand the staged ext. function changes to the encoder, which applies all
+// of them before its next block; merged with an earlier commit it has not
+// taken yet
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to commit the changes
+//		Other: fail to commit the changes
+//----------------------------------------------------------------
+int32_t lhdcv5BT_ext_commit
+(
+    HANDLE_LHDCV5_BT	handle
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  pthread_mutex_lock (&ctx->ext_lock);
+  if (ctx->ext_staged.mask != 0)
+  {
+    lhdcv5_enc_ext_post (ctx, &ctx->ext_staged);
+    ALOGD ("%s: ext. function changes 0x%X committed", __func__, ctx->ext_staged.mask);
+    ctx->ext_staged.mask = 0;
+  }
+  pthread_mutex_unlock (&ctx->ext_lock);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_ext_discard ()
+//
+// Drop the ext. function changes staged since the last commit
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to drop the changes
+//		Other: fail to drop the changes
+//----------------------------------------------------------------
+int32_t lhdcv5BT_ext_discard
+(
+    HANDLE_LHDCV5_BT	handle
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  pthread_mutex_lock (&ctx->ext_lock);
+  ctx->ext_staged.mask = 0;
+  pthread_mutex_unlock (&ctx->ext_lock);
+
+  return LHDCV5_FRET_SUCCESS;
+}
+
+//----------------------------------------------------------------
+// lhdcv5BT_init_encoder ()
+//
+// Initialize LHDC 5.0 encoder
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned 
+//				by function lhdcBT_get_handle ()
+//		sampling_freq: sample frequency
+//		bit_per_sample: bits per sample
+//		bitrate_inx: bit rate index
+//		mtu: BT A2DP MTU 
+//		interval: interval: period of time triggering LHDC 5.0 encoding in ms
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to initialize 
+//		Other: fail to initialize.
+//----------------------------------------------------------------
+int32_t lhdcv5BT_init_encoder
+(
+    HANDLE_LHDCV5_BT 	handle,
+    uint32_t 			sampling_freq,
+    uint32_t 			bits_per_sample,
+    uint32_t 			bitrate_inx,
+    uint32_t 			mtu,
+    uint32_t       interval,
+    uint32_t      is_lossless_enable
+) 
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  LHDCV5_ABR_TYPE_T abr_type = LHDCV5_ABR_INVALID;
+  LHDCV5BT_VBR_TYPE_T vbr_type = LHDCV5BT_VBR_INVALID;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if ((sampling_freq != LHDCV5_SR_44100HZ) &&
+      (sampling_freq != LHDCV5_SR_48000HZ) &&
+      (sampling_freq != LHDCV5_SR_96000HZ) &&
+      (sampling_freq != LHDCV5_SR_192000HZ))
+  {
+    ALOGW ("%s: Invalid sampling frequency (%u)!", __func__, sampling_freq);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  if ((bits_per_sample != LHDCV5BT_SMPL_FMT_S16) &&
+      (bits_per_sample != LHDCV5BT_SMPL_FMT_S24) &&
+      (bits_per_sample != LHDCV5BT_SMPL_FMT_S32))
+  {
+    ALOGW ("%s: Invalid bits per sample (%u)!", __func__, bits_per_sample);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  // LOW0 ~ ABR
+  if ((bitrate_inx < LHDCV5_QUALITY_LOW0) ||
+      (bitrate_inx > LHDCV5_QUALITY_AUTO))
+  {
+    ALOGW ("%s: Invalid bit rate (index) (%d)!", __func__, bitrate_inx);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  // the encode thread must not run into the util re-initialization
+  lhdcv5_enc_stop_pipe (ctx);
+
+  pthread_mutex_lock (&ctx->lock);
+
+  //reset ABR table index record
+  ctx->abr_table_index = 0;
+  lhdcv5_enc_reset_pred (ctx);
+  ctx->interval_ms = interval;
+  lhdcv5_enc_reset_stats (ctx);
+  // hand the latest gyro pose to the new encoder instance
+  ctx->gyro.applied = 0;
+  // the block size may change, the packetizer is set up again by the caller
+  lhdcv5_enc_release_pkt (ctx);
+  lhdcv5_enc_release_input (ctx);
+  lhdcv5_enc_src_destroy (ctx->src);
+  ctx->src = NULL;
+  ctx->bits_per_sample = 0;
+
+  func_ret = lhdcv5_util_init_encoder (handle,
+      sampling_freq,
+      bits_per_sample,
+      bitrate_inx,
+      LHDCV5_FRAME_5MS,
+      mtu,
+      interval,
+      is_lossless_enable);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
   {
-    handle_abr->upBitrateSum += queueLen;
-    handle_abr->dnBitrateSum += queueLen;
+    pthread_mutex_unlock (&ctx->lock);
+    ALOGW ("%s: Failed to init LHDC 5.0 encoder (%d)!", __func__, func_ret);
+    return LHDCV5_FRET_ERROR;
   }
+  ctx->bits_per_sample = bits_per_sample;
 
-  handle_abr->upBitrateCnt++;
-  handle_abr->dnBitrateCnt++;
+  if ((lhdcv5_enc_setup_input (handle, ctx) != LHDCV5_FRET_SUCCESS) ||
+      (lhdcv5_enc_setup_src (ctx, sampling_freq) != LHDCV5_FRET_SUCCESS))
+  {
+    ctx->bits_per_sample = 0;
+    pthread_mutex_unlock (&ctx->lock);
+    return LHDCV5_FRET_ERROR;
+  }
 
-fail:
-  return func_ret;
-}
+  // configure ABR, VBR control parameters
+  if (bitrate_inx == LHDCV5_QUALITY_AUTO)
+  {
+    // sampling_freq is checked above, every supported rate has a table
+    abr_type = lhdcv5_enc_abr_type_of (sampling_freq);
+    if (abr_type != LHDCV5_ABR_INVALID)
+    {
+      ctx->abr_table_index = ctx->policy.abr[abr_type].ladder.stage_num - 1;
+    }
+
+    vbr_type = lhdcv5_enc_vbr_type_of (is_lossless_enable, sampling_freq, bits_per_sample);
+    func_ret = lhdcv5_enc_apply_vbr_policy (handle,
+        &ctx->policy.vbr[(vbr_type != LHDCV5BT_VBR_INVALID) ? vbr_type : LHDCV5BT_VBR_48K_RES]);
+    if (func_ret != LHDCV5_FRET_SUCCESS)
+    {
+      pthread_mutex_unlock (&ctx->lock);
+      return LHDCV5_FRET_ERROR;
+    }
+  }
 
+  pthread_mutex_unlock (&ctx->lock);
+
+  ALOGD ("%s: success!", __func__);
+
+  return LHDCV5_FRET_SUCCESS;
+}
 
-/*
- ******************************************************************
- LHDC library public API group
- ******************************************************************
- */
 
 //----------------------------------------------------------------
-// lhdcv5BT_free_handle ()
+// lhdcv5BT_set_input_format ()
 //
-// Free all resources allocated
+// Set the PCM format taken by lhdcv5BT_encode (), lhdcv5BT_pipe_encode ()
+// and lhdcv5BT_pkt_write_pcm (). Samples are converted to the encoder
+// format as they are copied in, so no block is copied twice. Set before
+// lhdcv5BT_init_encoder (), or the packetizer and the pipeline are
+// dropped and have to be started again.
 //	Parameter
-//		handle: a pointer to the resource allocated and is returned 
+//		handle: a pointer to the resource allocated and is returned
 //				by function lhdcv5BT_get_handle ()
+//		input_fmt: sample format (LHDCV5BT_INPUT_FMT_*)
+//		planar: false: interleaved stereo samples
+//				true: the right channel plane follows the left one
 //	Return
-//		LHDCV5_FRET_SUCCESS: Succeed to free all resources
-//		otherwise: Fail to free all resources
+//		LHDCV5_FRET_SUCCESS: succeed to set the input format
+//		Other: fail to set the input format
 //----------------------------------------------------------------
-int32_t lhdcv5BT_free_handle
+int32_t lhdcv5BT_set_input_format
 (
-    HANDLE_LHDCV5_BT	handle
-) 
+    HANDLE_LHDCV5_BT	handle,
+    LHDCV5BT_INPUT_FMT_T	input_fmt,
+    bool				planar
+)
 {
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
   int32_t func_ret = LHDCV5_FRET_SUCCESS;
 
   if (handle == NULL)
@@ -837,15 +4058,28 @@ int32_t lhdcv5BT_free_handle
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  // reset resources
-  func_ret = lhdcv5_util_free_handle (handle);
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if ((uint32_t) input_fmt >= LHDCV5BT_INPUT_FMT_INVALID)
+  {
+    ALOGW ("%s: Invalid input format (%u)!", __func__, input_fmt);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  // buffered blocks are in the old input format
+  lhdcv5_enc_stop_pipe (ctx);
+  lhdcv5_enc_release_pkt (ctx);
 
-  // free handle
-  if(handle)
+  ctx->input_fmt = input_fmt;
+  ctx->input_planar = planar;
+
+  if (ctx->bits_per_sample != 0)
   {
-    ALOGD ("%s: free handle %p!", __func__, handle);
-    free(handle);
-    handle = NULL;
+    func_ret = lhdcv5_enc_setup_input (handle, ctx);
   }
 
   return func_ret;
@@ -853,123 +4087,148 @@ int32_t lhdcv5BT_free_handle
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_get_handle ()
+// lhdcv5BT_set_resampler ()
 //
-// Allocate resources required by LHDC 5.0 Encoder 
-// 	Parameter
-//		version: version defined in BT A2DP capability
-//		handle: a pointer to the resource allocated 
-// 	Return
-//		LHDCV5_FRET_SUCCESS: Succeed to allocate resources
-//		otherwise: Fail to allocate resources
+// Set the sample rate of the input, converted to the sample rate of the
+// encoder by a polyphase resampler set up in lhdcv5BT_init_encoder (),
+// e.g. to run 44.1 kHz sources through the 48 kHz encoder and its VBR.
+// The resampled input is taken by lhdcv5BT_pkt_write_pcm (), which takes
+// PCM of any size; lhdcv5BT_encode () and the pipeline are refused.
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		input_freq: input sample frequency, 0 for the encoder's
+//		quality: filter preset (LHDCV5BT_SRC_QUALITY_*)
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to set the resampler
+//		Other: fail to set the resampler
 //----------------------------------------------------------------
-int32_t lhdcv5BT_get_handle
+int32_t lhdcv5BT_set_resampler
 (
-    uint32_t			version,
-    HANDLE_LHDCV5_BT	*handle
-) 
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			input_freq,
+    LHDCV5BT_SRC_QUALITY_T	quality
+)
 {
-  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
-  uint32_t mem_req_bytes = 0;
-
-  HANDLE_LHDCV5_BT hLhdcBT = NULL;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
 
-  if (version != LHDCV5_VERSION_1)
+  if (handle == NULL)
   {
-    ALOGW ("%s: Invalid version (%u)!", __func__, version);
-    return LHDCV5_FRET_ERROR;
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  if (handle == NULL)
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
   {
-    ALOGW ("%s: Input parameter is NULL!", __func__);
-    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  func_ret = lhdcv5_util_get_mem_req (
-      version,
-      &mem_req_bytes);
-
-  if (func_ret != LHDCV5_FRET_SUCCESS || mem_req_bytes <= 0)
+  if ((input_freq != 0) &&
+      (input_freq != LHDCV5_SR_44100HZ) &&
+      (input_freq != LHDCV5_SR_48000HZ) &&
+      (input_freq != LHDCV5_SR_96000HZ) &&
+      (input_freq != LHDCV5_SR_192000HZ))
   {
-    ALOGW ("%s: Fail to get required memory size (%d)!", __func__, func_ret);
-    return LHDCV5_FRET_ERROR;
+    ALOGW ("%s: Invalid input frequency (%u)!", __func__, input_freq);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  hLhdcBT = (HANDLE_LHDCV5_BT)malloc(mem_req_bytes);
-  if (hLhdcBT == NULL)
+  if ((uint32_t) quality >= LHDCV5BT_SRC_QUALITY_INVALID)
   {
-    ALOGW ("%s: Fail to allocate memory for encoder!", __func__);
-    return LHDCV5_FRET_ERROR;
+    ALOGW ("%s: Invalid quality (%u)!", __func__, quality);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  func_ret = lhdcv5_util_get_handle (
-      version,
-      hLhdcBT, mem_req_bytes);
+  ctx->src_in_freq = input_freq;
+  ctx->src_quality = quality;
 
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  return LHDCV5_FRET_SUCCESS;
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_get_resampler_delay ()
+//
+// Get the group delay of the resampler set up by lhdcv5BT_init_encoder (),
+// to be added to the latency reported to the audio framework
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		delay_us: group delay returned (in us), 0 without a resampler
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to get the delay
+//		Other: fail to get the delay
+//----------------------------------------------------------------
+int32_t lhdcv5BT_get_resampler_delay
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			* delay_us
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+
+  if (handle == NULL)
   {
-    ALOGW ("%s: Fail to get handle (%d)!", __func__, func_ret);
-    free(hLhdcBT);
-    return LHDCV5_FRET_ERROR;
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  *handle = hLhdcBT;
+  if (delay_us == NULL)
+  {
+    ALOGW ("%s: Input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
 
-  if ((*handle) == NULL)
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
   {
-    ALOGW ("%s: Get handle NULL!", __func__);
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
+  *delay_us = (ctx->src != NULL) ? ctx->src->delay_us : 0;
+
   return LHDCV5_FRET_SUCCESS;
 }
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_get_bitrate ()
+// lhdcv5BT_get_block_Size ()
 //
-// Get the bit rate used during LHDC 5.0 encoding
+// Get number of samples per block for LHDC 5.0 encoder
 //	Parameter
-//		handle: a pointer to the resource allocated and is returned 
-//				by function lhdcv5BT_get_handle ()
-//		bitrate: a pointer to bit rate used during LHDC 5.0 encoding,
-//				 range [64000, 1000000]
+//		handle: a pointer to the resource allocated and is returned by function lhdcv5Bt_get_handle ()
+//		samples_per_frame: number of samples per block returned
 //	Return
-//		LHDCV5_FRET_SUCCESS: Succeed to allocate resources
-//		otherwise: Fail to allocate resources
+//		LHDCV5_FRET_SUCCESS: succeed to get number of samples per block 
+//		Other: fail to get number of samples per block.
 //----------------------------------------------------------------
-int32_t lhdcv5BT_get_bitrate
+int32_t lhdcv5BT_get_block_Size
 (
     HANDLE_LHDCV5_BT	handle,
-    uint32_t			*bitrate
-) 
+    uint32_t			* samples_per_frame
+)
 {
   int32_t		func_ret = LHDCV5_FRET_SUCCESS;
 
+
   if (handle == NULL)
   {
     ALOGW ("%s: Handle is NULL!", __func__);
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  if (bitrate == NULL)
+  if (samples_per_frame == NULL)
   {
     ALOGW ("%s: Input parameter is NULL!", __func__);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  func_ret = lhdcv5_util_get_target_bitrate (handle, bitrate);
-
-  if (func_ret != LHDCV5_FRET_SUCCESS)
-  {
-    ALOGW ("%s: Failed to get bit rate (%d)!", __func__, func_ret);
-    return LHDCV5_FRET_ERROR;
-  }
+  func_ret = lhdcv5_util_get_block_Size (handle, samples_per_frame);
 
-  if ((*bitrate < 64000) || (*bitrate > 1000000))
+  if ((func_ret != LHDCV5_FRET_SUCCESS) || ((*samples_per_frame) <= 0))
   {
-    ALOGW ("%s: Invalid bit rate returned (%u)!", __func__, *bitrate);
+    ALOGW ("%s: Failed to get block size (%d) (%d)!", __func__, func_ret, *samples_per_frame);
     return LHDCV5_FRET_ERROR;
   }
 
@@ -978,31 +4237,118 @@ int32_t lhdcv5BT_get_bitrate
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_set_bitrate ()
+// lhdcv5BT_encode ()
 //
-// Set the bit rate used during LHDC 5.0 encoding
+// Encode pcm samples by LHDC 5.0
 //	Parameter
 //		handle: a pointer to the resource allocated and is returned 
 //				by function lhdcBT_get_handle ()
-//		bitrate_inx: an index of bit rate to set
+//		p_in_pcm: a pointer to a buffer contains PCM samples for encoding,
+//				in the format of lhdcv5BT_set_input_format ()
+//		pcm_bytes: bytes of PCM samples, one block if the input is converted
+//		p_out_buf: a pointer to a buffer to put encoded stream
+//		out_buf_bytes: output buffer's size (in byte)
+//		p_out_bytes: a pointer to number of bytes of encoded stream in buffer
+//		p_out_frames: a pointer to number of frames of encoded stream in buffer
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to set the bit rate
-//		Other: fail to set the bit rate
+//		LHDCV5_FRET_SUCCESS: succeed to encode pcm samples
+//		LHDCV5_FRET_CODEC_NOT_READY: the encode pipeline is running
+//		Other: fail to encode pcm samples
 //----------------------------------------------------------------
-int32_t lhdcv5BT_set_bitrate
+int32_t lhdcv5BT_encode
 (
     HANDLE_LHDCV5_BT 	handle,
-    uint32_t			bitrate_inx
+    void				* p_in_pcm,
+    uint32_t			pcm_bytes,
+    uint8_t				* p_out_buf,
+    uint32_t			out_buf_bytes,
+    uint32_t 			* p_out_bytes,
+    uint32_t 			* p_out_frames
 )
 {
-  LHDCV5_ABR_TYPE_T abr_type = LHDCV5_ABR_INVALID;
-  LHDCV5_ENC_TYPE_T enc_type = LHDCV5_ENC_TYPE_LHDCV5;
-  lhdcv5_abr_para_t * abr_para = NULL;
-  uint32_t abr_table_size = 0;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  uint32_t in_block_bytes = 0;
 
-  uint32_t  bitrate_inx_set = LHDCV5_QUALITY_INVALID;
-  uint32_t  lless_enabled = 0;
-  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if ((p_in_pcm == NULL) || (p_out_buf == NULL) ||
+      (p_out_bytes == NULL) || (p_out_frames == NULL))
+  {
+    ALOGW ("%s: input parameter is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  if (ctx->pipe != NULL)
+  {
+    ALOGW ("%s: Encode pipeline is running, blocks go through lhdcv5BT_pipe_encode ()!", __func__);
+    return LHDCV5_FRET_CODEC_NOT_READY;
+  }
+
+  if (ctx->src != NULL)
+  {
+    ALOGW ("%s: Resampled input is taken by lhdcv5BT_pkt_write_pcm () only!", __func__);
+    return LHDCV5_FRET_ERROR;
+  }
+
+  if (!ctx->conv.active)
+  {
+    return lhdcv5_enc_encode (handle, ctx, p_in_pcm, pcm_bytes,
+        p_out_buf, out_buf_bytes, p_out_bytes, p_out_frames);
+  }
+
+  // the encoder takes whole blocks, convert one into the encoder format
+  in_block_bytes = lhdcv5_enc_in_block_bytes (handle, ctx);
+  if (pcm_bytes != in_block_bytes)
+  {
+    ALOGW ("%s: Invalid block bytes (%u != %u)!", __func__, pcm_bytes, in_block_bytes);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
+
+  lhdcv5_enc_pcm_convert (&ctx->conv, (const uint8_t *) p_in_pcm, pcm_bytes / LHDCV5BT_ENC_CHANNELS,
+      ctx->cvt_buf, pcm_bytes / (LHDCV5BT_ENC_CHANNELS * ctx->conv.in_bytes));
+
+  return lhdcv5_enc_encode (handle, ctx, ctx->cvt_buf, lhdcv5_enc_block_bytes (handle, ctx),
+      p_out_buf, out_buf_bytes, p_out_bytes, p_out_frames);
+}
+
+
+//----------------------------------------------------------------
+// lhdcv5BT_pipe_start ()
+//
+// Start the encode pipeline of an initialized encoder: lhdcv5BT_pipe_encode ()
+// converts a block on the caller's thread and has it encoded by an encode
+// thread, which takes the ext function changes between two blocks. It is
+// stopped by lhdcv5BT_init_encoder (), so call it again after every
+// encoder (re)configuration.
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		depth: 0 or up to LHDCV5BT_PIPE_MAX_DEPTH, each call returns its own
+//				block, so one block is in flight whatever the depth
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to start the pipeline
+//		Other: fail to start the pipeline
+//----------------------------------------------------------------
+int32_t lhdcv5BT_pipe_start
+(
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			depth
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  lhdcv5BT_enc_pipe_t *pipe = NULL;
+  uint8_t *buf = NULL;
+  uint32_t block_bytes = 0;
 
   if (handle == NULL)
   {
@@ -1010,136 +4356,84 @@ int32_t lhdcv5BT_set_bitrate
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  // reset ABR table index record
-  gABR_table_index = 0;
-
-  // prepare new ABR table index record for update
-  func_ret = lhdcv5_util_adjust_bitrate (handle, &enc_type, &abr_para);
-  if ((func_ret != LHDCV5_FRET_SUCCESS) || (abr_para == NULL))
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
   {
-    ALOGW ("%s: Failed to get auto bit rate parameters (%d) (%p)!", __func__, func_ret, abr_para);
-    return LHDCV5_FRET_ERROR;
-  }
-  if (abr_para->sample_rate == LHDCV5_SR_44100HZ) {
-    abr_type = LHDCV5_ABR_44K_RES;
-    abr_table_size = LHDCV5_44K_BITRATE_ELEMENTS_SIZE;
-  } else if (abr_para->sample_rate == LHDCV5_SR_48000HZ) {
-    abr_type = LHDCV5_ABR_48K_RES;
-    abr_table_size = LHDCV5_48K_BITRATE_ELEMENTS_SIZE;
-  } else if (abr_para->sample_rate == LHDCV5_SR_96000HZ) {
-    abr_type = LHDCV5_ABR_96K_RES;
-    abr_table_size = LHDCV5_96K_BITRATE_ELEMENTS_SIZE;
-  } else if (abr_para->sample_rate == LHDCV5_SR_192000HZ) {
-    abr_type = LHDCV5_ABR_192K_RES;
-    abr_table_size = LHDCV5_192K_BITRATE_ELEMENTS_SIZE;
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  func_ret = lhdcv5_util_get_lossless_enabled(handle, &lless_enabled);
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  if (depth > LHDCV5BT_PIPE_MAX_DEPTH)
   {
-    ALOGW ("%s: Failed to get lossless enabled (%d)!", __func__, func_ret);
-    return LHDCV5_FRET_ERROR;
+    ALOGW ("%s: Invalid depth (%u blocks)!", __func__, depth);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  // handle standard/control index
-  switch(bitrate_inx)
-  {
-  case LHDCV5_QUALITY_CTRL_RESET_ABR:
+  block_bytes = lhdcv5_enc_block_bytes (handle, ctx);
+  if ((block_bytes == 0) || (lhdcv5_enc_in_block_bytes (handle, ctx) == 0))
   {
-    if (lless_enabled == 1)
-    {
-      bitrate_inx = LHDCV5_VBR_DEFAULT_BITRATE;
-    }
-    else
-    {
-      bitrate_inx = LHDCV5_ABR_DEFAULT_BITRATE;
-      gABR_table_index = abr_table_size - 1;
-    }
-
-    // change current bitrate only, not change current quality index
-    func_ret = lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx, &bitrate_inx_set, false);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
-    {
-      ALOGW ("%s: lhdcv5_util_set_target_bitrate_inx error (%d)!", __func__, func_ret);
-      return LHDCV5_FRET_ERROR;
-    }
-    ALOGD ("%s: [Reset BiTrAtE] (%s) ABR_table_index(%d)", __func__,
-        rate_to_string (bitrate_inx_set), gABR_table_index);
+    ALOGW ("%s: Encoder is not initialized!", __func__);
+    return LHDCV5_FRET_CODEC_NOT_READY;
   }
-  break;
 
-  //LOW0 ~ ABR
-  case LHDCV5_QUALITY_AUTO:
-  case LHDCV5_QUALITY_HIGH5:
-  case LHDCV5_QUALITY_HIGH4:
-  case LHDCV5_QUALITY_HIGH3:
-  case LHDCV5_QUALITY_HIGH2:
-  case LHDCV5_QUALITY_HIGH1:
-  case LHDCV5_QUALITY_HIGH:
-  case LHDCV5_QUALITY_MID:
-  case LHDCV5_QUALITY_LOW:
-  case LHDCV5_QUALITY_LOW4:
-  case LHDCV5_QUALITY_LOW3:
-  case LHDCV5_QUALITY_LOW2:
-  case LHDCV5_QUALITY_LOW1:
-  case LHDCV5_QUALITY_LOW0:
+  if (ctx->src != NULL)
   {
-    if (bitrate_inx == LHDCV5_QUALITY_AUTO) {
-      gABR_table_index = abr_table_size - 1;
-    }
-
-    func_ret = lhdcv5_util_set_target_bitrate_inx (handle, bitrate_inx, &bitrate_inx_set, true);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
-    {
-      ALOGW ("%s: lhdcv5_util_set_target_bitrate_inx error (%d)!", __func__, func_ret);
-      return LHDCV5_FRET_ERROR;
-    }
-    ALOGD ("%s: [Set BiTrAtE] (%s) ABR_table_index(%d)", __func__,
-        rate_to_string (bitrate_inx_set), gABR_table_index);
+    ALOGW ("%s: Resampled input is taken by lhdcv5BT_pkt_write_pcm () only!", __func__);
+    return LHDCV5_FRET_ERROR;
   }
-  break;
 
-  default:
+  lhdcv5_enc_stop_pipe (ctx);
+
+  // pipeline, then the PCM buffer of the block
+  buf = (uint8_t *) malloc (LHDCV5BT_ENC_ALIGN(sizeof(lhdcv5BT_enc_pipe_t)) + block_bytes);
+  if (buf == NULL)
   {
-    ALOGD ("%s: Not supported index (%s)", __func__, rate_to_string (bitrate_inx));
-    func_ret = LHDCV5_FRET_ERROR;
-  }
-  break;
+    ALOGW ("%s: Fail to allocate memory for pipeline!", __func__);
+    return LHDCV5_FRET_ERROR;
   }
 
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  pipe = (lhdcv5BT_enc_pipe_t *) buf;
+  memset (pipe, 0, sizeof(lhdcv5BT_enc_pipe_t));
+  pipe->pcm = buf + LHDCV5BT_ENC_ALIGN(sizeof(lhdcv5BT_enc_pipe_t));
+  pipe->handle = handle;
+  pipe->block_bytes = block_bytes;
+  pipe->in_block_bytes = lhdcv5_enc_in_block_bytes (handle, ctx);
+  sem_init (&pipe->queued, 0, 0);
+  sem_init (&pipe->encoded, 0, 0);
+
+  if (pthread_create (&pipe->thread, NULL, lhdcv5_enc_pipe_thread, pipe) != 0)
   {
-    ALOGW ("%s: failed to set bitrate (%d) err(%d)!", __func__, bitrate_inx, func_ret);
+    ALOGW ("%s: Fail to create encode thread!", __func__);
+    sem_destroy (&pipe->queued);
+    sem_destroy (&pipe->encoded);
+    free (pipe);
     return LHDCV5_FRET_ERROR;
   }
+  ctx->pipe = pipe;
 
-  ALOGD ("%s: Update target bitrate (%s) bitrate_inx(%d)",  __func__,
-      rate_to_string (bitrate_inx_set), bitrate_inx);
+  ALOGD ("%s: block %u bytes", __func__, block_bytes);
 
   return LHDCV5_FRET_SUCCESS;
 }
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_set_max_bitrate ()
+// lhdcv5BT_pipe_stop ()
 //
-// Set the MAX. bit rate for LHDC 5.0 encoding
+// Stop the encode pipeline. Every block has been returned by the call
+// that queued it, so nothing is dropped.
 //	Parameter
-//		handle: a pointer to the resource allocated and is returned 
-//				by function lhdcBT_get_handle ()
-//		max_bitrate_inx: MAX. bit rate (index) for LHDC 5.0 encoding
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to set the MAX. bit rate
-//		Other: fail to set the MAX. bit rate
+//		LHDCV5_FRET_SUCCESS: succeed to stop the pipeline
+//		Other: fail to stop the pipeline
 //----------------------------------------------------------------
-int32_t lhdcv5BT_set_max_bitrate
+int32_t lhdcv5BT_pipe_stop
 (
-    HANDLE_LHDCV5_BT	handle,
-    uint32_t			max_bitrate_inx
-) 
+    HANDLE_LHDCV5_BT	handle
+)
 {
-  uint32_t max_bitrate_inx_set = LHDCV5_QUALITY_INVALID; //for return check
-  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
 
   if (handle == NULL)
   {
@@ -1147,48 +4441,51 @@ int32_t lhdcv5BT_set_max_bitrate
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  // max_bitrate_inx policy: LOW ~ MAX
-  if ((max_bitrate_inx < LHDCV5_QUALITY_LOW) ||
-      (max_bitrate_inx > LHDCV5_QUALITY_MAX_BITRATE))
-  {
-    ALOGW ("%s: Invalid max bit rate index (%u)!", __func__, max_bitrate_inx);
-    return LHDCV5_FRET_INVALID_INPUT_PARAM;
-  }
-
-  func_ret = lhdcv5_util_set_max_bitrate_inx (handle, max_bitrate_inx, &max_bitrate_inx_set);
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
   {
-    ALOGW ("%s: failed to set max. bit rate index (%u), (%d)!", __func__, max_bitrate_inx, func_ret);
-    return LHDCV5_FRET_ERROR;
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  ALOGD ("%s: Update Max target bitrate(%s)",  __func__, rate_to_string (max_bitrate_inx_set));
+  lhdcv5_enc_stop_pipe (ctx);
 
   return LHDCV5_FRET_SUCCESS;
 }
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_set_min_bitrate ()
+// lhdcv5BT_pipe_encode ()
 //
-// Set the MIN. bit rate for LHDC 5.0 encoding
+// lhdcv5BT_encode () through the encode pipeline: the block is converted
+// here, encoded by the encode thread and its stream is returned by this
+// same call, like lhdcv5BT_encode () does.
 //	Parameter
-//		handle: a pointer to the resource allocated and is returned 
-//				by function lhdcBT_get_handle ()
-//		min_bitrate_inx: MIN. bit rate (index) for LHDC 5.0 encoding
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		p_in_pcm: a pointer to a buffer contains PCM samples for encoding,
+//				in the format of lhdcv5BT_set_input_format ()
+//		pcm_bytes: bytes of PCM samples, one block
+//		p_out_buf: a pointer to a buffer to put encoded stream
+//		out_buf_bytes: output buffer's size (in byte)
+//		p_out_bytes: a pointer to number of bytes of encoded stream in buffer
+//		p_out_frames: a pointer to number of frames of encoded stream in buffer
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to set the MIN. bit rate
-//		Other: fail to set the MIN. bit rate
+//		LHDCV5_FRET_SUCCESS: succeed to encode the block
+//		Other: fail to encode the block
 //----------------------------------------------------------------
-
-int32_t lhdcv5BT_set_min_bitrate
+int32_t lhdcv5BT_pipe_encode
 (
     HANDLE_LHDCV5_BT 	handle,
-    uint32_t			min_bitrate_inx
+    void				* p_in_pcm,
+    uint32_t			pcm_bytes,
+    uint8_t				* p_out_buf,
+    uint32_t			out_buf_bytes,
+    uint32_t 			* p_out_bytes,
+    uint32_t 			* p_out_frames
 )
 {
-  uint32_t   min_bitrate_inx_set = LHDCV5_QUALITY_INVALID;
-  int32_t			func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  lhdcv5BT_enc_pipe_t *pipe = NULL;
 
   if (handle == NULL)
   {
@@ -1196,50 +4493,95 @@ int32_t lhdcv5BT_set_min_bitrate
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  // min policy: (LOW0 ~ LOW)
-  if ((min_bitrate_inx < LHDCV5_QUALITY_LOW0) ||
-      (min_bitrate_inx > LHDCV5_QUALITY_LOW))
+  if ((p_in_pcm == NULL) || (p_out_buf == NULL) ||
+      (p_out_bytes == NULL) || (p_out_frames == NULL))
   {
-      ALOGW ("%s: Invalid min bit rate index (%u)!", __func__, min_bitrate_inx);
+    ALOGW ("%s: input parameter is NULL!", __func__);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  func_ret = lhdcv5_util_set_min_bitrate_inx (handle, min_bitrate_inx, &min_bitrate_inx_set);
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
 
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  pipe = ctx->pipe;
+  if (pipe == NULL)
   {
-    ALOGW ("%s: failed to set min. bit rate (%d)!", __func__, func_ret);
-    return LHDCV5_FRET_ERROR;
+    ALOGW ("%s: Pipeline is not started!", __func__);
+    return LHDCV5_FRET_CODEC_NOT_READY;
   }
 
-  ALOGD ("%s: Update Min target bitrate(%s)",  __func__, rate_to_string (min_bitrate_inx_set));
+  if (pcm_bytes != pipe->in_block_bytes)
+  {
+    ALOGW ("%s: Invalid block bytes (%u != %u)!", __func__, pcm_bytes, pipe->in_block_bytes);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+  }
 
-  return LHDCV5_FRET_SUCCESS;
+  // the encode thread owns the block from the post until it posts back
+  lhdcv5_enc_pcm_convert (&ctx->conv, (const uint8_t *) p_in_pcm, pcm_bytes / LHDCV5BT_ENC_CHANNELS,
+      pipe->pcm, pcm_bytes / (LHDCV5BT_ENC_CHANNELS * ctx->conv.in_bytes));
+  pipe->out = p_out_buf;
+  pipe->out_buf_bytes = out_buf_bytes;
+  pipe->out_bytes = 0;
+  pipe->out_frames = 0;
+  sem_post (&pipe->queued);
+
+  while (sem_wait (&pipe->encoded) != 0)
+  {
+    // EINTR, wait again
+  }
+
+  *p_out_bytes = pipe->out_bytes;
+  *p_out_frames = pipe->out_frames;
+
+  return pipe->ret;
 }
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_adjust_bitrate () - ABR
+// lhdcv5BT_encode_packet ()
 //
-// Adjust bit rate automatically according to number of packets in queue for LHDC 5.0 encoding
+// Encode pcm samples by LHDC 5.0 straight into a caller owned packet
+// buffer: the frames go behind the LHDC header at hdr_offset, which is
+// filled in place, so the room in front (e.g. for the RTP header) stays
+// untouched and no copy of the payload is needed.
 //	Parameter
-//		handle: a pointer to the resource allocated and is returned 
-//				by function lhdcBT_get_handle ()
-//		queue_len: number of packets in queue
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		p_in_pcm: a pointer to a buffer contains PCM samples for encoding
+//		pcm_bytes: bytes of PCM samples, one block
+//		latency: latency bits of the LHDC header (LHDCV5BT_PKT_LATENCY_*)
+//		p_pkt_buf: a pointer to the packet buffer
+//		pkt_buf_bytes: packet buffer's size (in byte)
+//		hdr_offset: offset of the LHDC header in the packet buffer
+//		p_payload_bytes: a pointer to bytes of LHDC header and frames,
+//				0 if the encoder returned no frame
+//		p_out_frames: a pointer to number of frames in the packet
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to adjust bit rate automatically 
-//		Other: fail to adjust bit rate automatically 
+//		LHDCV5_FRET_SUCCESS: succeed to encode pcm samples
+//		LHDCV5_FRET_CODEC_NOT_READY: the encode pipeline is running
+//		Other: fail to encode pcm samples
 //----------------------------------------------------------------
-
-int32_t lhdcv5BT_adjust_bitrate
+int32_t lhdcv5BT_encode_packet
 (
     HANDLE_LHDCV5_BT 	handle,
-    uint32_t			queueLen
-) 
+    void				* p_in_pcm,
+    uint32_t			pcm_bytes,
+    uint32_t			latency,
+    uint8_t				* p_pkt_buf,
+    uint32_t			pkt_buf_bytes,
+    uint32_t			hdr_offset,
+    uint32_t 			* p_payload_bytes,
+    uint32_t 			* p_out_frames
+)
 {
-  LHDCV5_ENC_TYPE_T	enc_type = LHDCV5_ENC_TYPE_LHDCV5;
-  lhdcv5_abr_para_t	* abr_para = NULL;
-  int32_t				func_ret = LHDCV5_FRET_ERROR;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  uint8_t *p_hdr = NULL;
+  uint32_t written = 0;
+  uint32_t frames = 0;
+  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
 
   if (handle == NULL)
   {
@@ -1247,99 +4589,103 @@ int32_t lhdcv5BT_adjust_bitrate
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  if (queueLen < 0)
+  if ((p_in_pcm == NULL) || (p_pkt_buf == NULL) ||
+      (p_payload_bytes == NULL) || (p_out_frames == NULL))
   {
-    ALOGW ("%s: Invalid input queue length (%u)!", __func__, queueLen);
+    ALOGW ("%s: input parameter is NULL!", __func__);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  //get ABR parameters: abr_para from lib
-  func_ret = lhdcv5_util_adjust_bitrate (handle, &enc_type, &abr_para);
-  if ((func_ret != LHDCV5_FRET_SUCCESS) || (abr_para == NULL))
+  if (!lhdcv5_enc_check_latency (latency))
   {
-    ALOGW ("%s: Failed to get auto bit rate parameters (%d) (%p)!", __func__, func_ret, abr_para);
-    return LHDCV5_FRET_ERROR;
+    ALOGW ("%s: Invalid latency (%u)!", __func__, latency);
+    return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  switch (enc_type)
+  if ((hdr_offset >= pkt_buf_bytes) ||
+      (pkt_buf_bytes - hdr_offset <= LHDCV5BT_PKT_HDR_BYTES))
   {
-  case LHDCV5_ENC_TYPE_LHDCV5:
-    if (abr_para->qualityStatus != LHDCV5_QUALITY_AUTO)
-    {
-      ALOGW ("%s: Not in Auto Bit Rate mode (%d)", __func__, abr_para->qualityStatus);
-      return LHDCV5_FRET_INVALID_HANDLE_PARA;
-    }
+    ALOGW ("%s: No room behind header offset (%u/%u)!", __func__, hdr_offset, pkt_buf_bytes);
+    return LHDCV5_FRET_BUF_NOT_ENOUGH;
+  }
 
-    if (abr_para->is_lless_enabled == 0)
-    {
-      // go ABR mode (lossy mode) only
-      func_ret = lhdcv5_enc_abr_adjust_bitrate (handle, abr_para, queueLen);
-    }
-    else if (abr_para->is_lless_enabled == 1 &&
-        abr_para->sample_rate == LHDCV5_SR_48000HZ &&
-        abr_para->bits_per_sample == LHDCV5BT_SMPL_FMT_S16)
-    {
-      // go ABR+VBR hybrid mode(lossy+lossless mode)
-      if (abr_para->lastBitrate >= ABR_MIN_STAGE_BITRATE &&
-          abr_para->lastBitrate <= ABR_MAX_STAGE_BITRATE)
-      {
-        // run in ABR layer
-        func_ret = lhdcv5_enc_abr_adjust_bitrate (handle, abr_para, queueLen);
-      }
-      else if (
-          abr_para->lastBitrate >= LHDCV5_VBR_MIN_BITRATE &&
-          abr_para->lastBitrate <= LHDCV5_VBR_MAX_BITRATE)
-      {
-        // run in VBR layer
-        func_ret = lhdcv5_enc_vbr_adjust_bitrate (handle, abr_para, queueLen);
-      }
-    } else {
-      ALOGW ("%s: Non supported hybrid auto bit rate mode!", __func__);
-      return LHDCV5_FRET_ERROR;
-    }
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
 
-    if (func_ret != LHDCV5_FRET_SUCCESS)
-    {
-      ALOGW ("%s: Failed to adjust auto bit rate (%d)!", __func__, func_ret);
-      return LHDCV5_FRET_ERROR;
-    }
-    break;
+  if (ctx->pipe != NULL)
+  {
+    ALOGW ("%s: Encode pipeline is running, blocks go through lhdcv5BT_pipe_encode ()!", __func__);
+    return LHDCV5_FRET_CODEC_NOT_READY;
+  }
 
-  default:
-    ALOGW ("%s: Invalid encode type (%d)!", __func__, enc_type);
-    return LHDCV5_FRET_INVALID_CODEC;
+  *p_payload_bytes = 0;
+  *p_out_frames = 0;
+
+  p_hdr = p_pkt_buf + hdr_offset;
+  func_ret = lhdcv5BT_encode (handle,
+      p_in_pcm,
+      pcm_bytes,
+      p_hdr + LHDCV5BT_PKT_HDR_BYTES,
+      pkt_buf_bytes - hdr_offset - LHDCV5BT_PKT_HDR_BYTES,
+      &written,
+      &frames);
+  if (func_ret != LHDCV5_FRET_SUCCESS)
+  {
+    return func_ret;
+  }
+
+  // the encoder may keep frames back until it has enough of them
+  if ((written == 0) || (frames == 0))
+  {
+    return LHDCV5_FRET_SUCCESS;
+  }
+
+  if (frames > LHDCV5BT_PKT_MAX_FRAMES)
+  {
+    ALOGW ("%s: %u frames do not fit in the LHDC header!", __func__, frames);
+    return LHDCV5_FRET_ERROR;
   }
 
+  p_hdr[0] = (uint8_t) (((frames << 2) & LHDCV5BT_PKT_HDR_FRAME_NO_MASK) | latency);
+  p_hdr[1] = ctx->pkt_seqno++;
+
+  *p_payload_bytes = LHDCV5BT_PKT_HDR_BYTES + written;
+  *p_out_frames = frames;
+
   return LHDCV5_FRET_SUCCESS;
 }
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_set_ext_func_state ()
+// lhdcv5BT_get_stats ()
 //
-// Set the ext. function state (AR, JAS, Meta, LARC)
-//	Parameter
-//		handle: a pointer to the resource allocated and is returned 
-//				by function lhdcBT_get_handle ()
-//		field: specify the ext. function
-//		enabled: ext. function is set to “enabled” (true) or “disabled” (false)
-//		priv: a pointer to the exra data needed for ext. function
-//		priv_data_len: number of bytes of the extra data
+// Take a snapshot of the encoder statistics. The counters are updated
+// with relaxed atomics, so a monitoring thread can poll them without
+// stalling the encoder; the snapshot is not taken at a single instant.
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		stats: statistics returned
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to set specified ext. function to “enabled” (true) or “disabled” (false)
-//		Other: fail to set .
+//		LHDCV5_FRET_SUCCESS: succeed to get the statistics
+//		Other: fail to get the statistics
 //----------------------------------------------------------------
-
-int32_t lhdcv5BT_set_ext_func_state
+int32_t lhdcv5BT_get_stats
 (
-    HANDLE_LHDCV5_BT 	handle,
-    LHDCV5_EXT_FUNC_T	field,
-    bool 				enabled,
-    void 				* priv,
-    uint32_t 			priv_data_len
+    HANDLE_LHDCV5_BT	handle,
+    lhdcv5_enc_stats_t	* stats
 )
 {
-  int32_t	func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  lhdcv5BT_enc_stats_ctr_t *ctr = NULL;
+  uint32_t * pct_out[3];
+  const uint32_t pct[3] = {50, 90, 99};
+  uint64_t queue_total = 0;
+  uint64_t queue_cum = 0;
+  uint32_t p = 0;
 
   if (handle == NULL)
   {
@@ -1347,24 +4693,59 @@ int32_t lhdcv5BT_set_ext_func_state
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  if ((field < LHDCV5_EXT_FUNC_AR) ||
-      (field >= LHDCV5_EXT_FUNC_INVALID))
+  if (stats == NULL)
   {
-    ALOGW ("%s: Invalid ext. func. field (%d)!", __func__, field);
+    ALOGW ("%s: Input parameter is NULL!", __func__);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  func_ret = lhdcv5_util_set_ext_func_state (handle,
-      (LHDCV5_EXT_FUNC_T) field,
-      enabled,
-      priv,
-      priv_data_len,	// data length MUST be 8 for META
-      LHDCV5_META_LOOP_CNT_STD);
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+  ctr = &ctx->stats;
+
+  memset (stats, 0, sizeof(lhdcv5_enc_stats_t));
 
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  for (uint32_t i = 0; i < LHDCV5BT_STATS_RATE_NUM; i++)
   {
-    ALOGW ("%s: failed to set ext. function state (%d)!", __func__, func_ret);
-    return LHDCV5_FRET_ERROR;
+    lhdcv5_util_get_bitrate (i, &stats->rate_kbps[i]);
+    stats->rate_frames[i] = LHDCV5BT_STAT_LOAD (ctr->rate_frames[i]);
+    stats->rate_dwell_ms[i] = LHDCV5BT_STAT_LOAD (ctr->rate_dwell_ms[i]);
+  }
+
+  stats->adjust_ticks = LHDCV5BT_STAT_LOAD (ctr->adjust_ticks);
+  stats->up_switches = LHDCV5BT_STAT_LOAD (ctr->up_switches);
+  stats->down_switches = LHDCV5BT_STAT_LOAD (ctr->down_switches);
+  stats->lossless_frames = LHDCV5BT_STAT_LOAD (ctr->lossless_frames);
+  stats->lossy_frames = LHDCV5BT_STAT_LOAD (ctr->lossy_frames);
+
+  for (uint32_t i = 0; i < LHDCV5BT_STATS_QUEUE_BINS; i++)
+  {
+    stats->queue_hist[i] = LHDCV5BT_STAT_LOAD (ctr->queue_hist[i]);
+    queue_total += stats->queue_hist[i];
+  }
+
+  // percentile: shortest queue length covering the share of ticks
+  pct_out[0] = &stats->queue_p50;
+  pct_out[1] = &stats->queue_p90;
+  pct_out[2] = &stats->queue_p99;
+  for (uint32_t i = 0; (i < LHDCV5BT_STATS_QUEUE_BINS) && (queue_total > 0); i++)
+  {
+    queue_cum += stats->queue_hist[i];
+    while ((p < 3) && (queue_cum * 100 >= queue_total * pct[p]))
+    {
+      *pct_out[p++] = i;
+    }
+  }
+
+  stats->encode_calls = LHDCV5BT_STAT_LOAD (ctr->encode_calls);
+  stats->encode_max_us = LHDCV5BT_STAT_LOAD (ctr->encode_max_us);
+  stats->encode_total_us = LHDCV5BT_STAT_LOAD (ctr->encode_total_us);
+  if (stats->encode_calls > 0)
+  {
+    stats->encode_avg_us = (uint32_t) (stats->encode_total_us / stats->encode_calls);
   }
 
   return LHDCV5_FRET_SUCCESS;
@@ -1372,35 +4753,30 @@ int32_t lhdcv5BT_set_ext_func_state
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_init_encoder ()
+// lhdcv5BT_pkt_init ()
 //
-// Initialize LHDC 5.0 encoder
+// Set up the PCM accumulator and A2DP packetizer of an initialized
+// encoder. It is dropped by lhdcv5BT_init_encoder (), so call it again
+// after every encoder (re)configuration.
 //	Parameter
-//		handle: a pointer to the resource allocated and is returned 
-//				by function lhdcBT_get_handle ()
-//		sampling_freq: sample frequency
-//		bit_per_sample: bits per sample
-//		bitrate_inx: bit rate index
-//		mtu: BT A2DP MTU 
-//		interval: interval: period of time triggering LHDC 5.0 encoding in ms
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		latency: latency bits of the LHDC header (LHDCV5BT_PKT_LATENCY_*)
+//		ring_blocks: PCM ring size (in block), 0 for LHDCV5BT_PKT_DEF_RING_BLOCKS
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to initialize 
-//		Other: fail to initialize.
+//		LHDCV5_FRET_SUCCESS: succeed to set up the packetizer
+//		Other: fail to set up the packetizer
 //----------------------------------------------------------------
-int32_t lhdcv5BT_init_encoder
+int32_t lhdcv5BT_pkt_init
 (
-    HANDLE_LHDCV5_BT 	handle,
-    uint32_t 			sampling_freq,
-    uint32_t 			bits_per_sample,
-    uint32_t 			bitrate_inx,
-    uint32_t 			mtu,
-    uint32_t       interval,
-    uint32_t      is_lossless_enable
-) 
+    HANDLE_LHDCV5_BT	handle,
+    uint32_t			latency,
+    uint32_t			ring_blocks
+)
 {
-  LHDCV5_ABR_TYPE_T abr_type = LHDCV5_ABR_INVALID;
-  uint32_t abr_table_size = 0;
-  int32_t func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  uint32_t block_bytes = 0;
+  uint8_t *buf = NULL;
 
   if (handle == NULL)
   {
@@ -1408,121 +4784,129 @@ int32_t lhdcv5BT_init_encoder
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  if ((sampling_freq != LHDCV5_SR_44100HZ) &&
-      (sampling_freq != LHDCV5_SR_48000HZ) &&
-      (sampling_freq != LHDCV5_SR_96000HZ) &&
-      (sampling_freq != LHDCV5_SR_192000HZ))
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
   {
-    ALOGW ("%s: Invalid sampling frequency (%u)!", __func__, sampling_freq);
-    return LHDCV5_FRET_INVALID_INPUT_PARAM;
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  if ((bits_per_sample != LHDCV5BT_SMPL_FMT_S16) &&
-      (bits_per_sample != LHDCV5BT_SMPL_FMT_S24) &&
-      (bits_per_sample != LHDCV5BT_SMPL_FMT_S32))
+  if (!lhdcv5_enc_check_latency (latency))
   {
-    ALOGW ("%s: Invalid bits per sample (%u)!", __func__, bits_per_sample);
+    ALOGW ("%s: Invalid latency (%u)!", __func__, latency);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  // LOW0 ~ ABR
-  if ((bitrate_inx < LHDCV5_QUALITY_LOW0) ||
-      (bitrate_inx > LHDCV5_QUALITY_AUTO))
+  if (ring_blocks == 0)
   {
-    ALOGW ("%s: Invalid bit rate (index) (%d)!", __func__, bitrate_inx);
+    ring_blocks = LHDCV5BT_PKT_DEF_RING_BLOCKS;
+  }
+  if (ring_blocks > LHDCV5BT_PKT_MAX_RING_BLOCKS)
+  {
+    ALOGW ("%s: Invalid ring size (%u blocks)!", __func__, ring_blocks);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  //reset ABR table index record
-  gABR_table_index = 0;
+  block_bytes = lhdcv5_enc_block_bytes (handle, ctx);
+  if (block_bytes == 0)
+  {
+    ALOGW ("%s: Encoder is not initialized!", __func__);
+    return LHDCV5_FRET_CODEC_NOT_READY;
+  }
 
-  func_ret = lhdcv5_util_init_encoder (handle,
-      sampling_freq,
-      bits_per_sample,
-      bitrate_inx,
-      LHDCV5_FRAME_5MS,
-      mtu,
-      interval,
-      is_lossless_enable);
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  buf = (uint8_t *) malloc (block_bytes * ring_blocks + LHDCV5BT_PKT_STAGE_BYTES);
+  if (buf == NULL)
   {
-    ALOGW ("%s: Failed to init LHDC 5.0 encoder (%d)!", __func__, func_ret);
+    ALOGW ("%s: Fail to allocate memory for packetizer!", __func__);
     return LHDCV5_FRET_ERROR;
   }
 
-  // configure ABR, VBR control parameters
-  if (bitrate_inx == LHDCV5_QUALITY_AUTO)
-  {
-    if (sampling_freq == LHDCV5_SR_44100HZ) {
-      abr_type = LHDCV5_ABR_44K_RES;
-      abr_table_size = LHDCV5_44K_BITRATE_ELEMENTS_SIZE;
-    } else if (sampling_freq == LHDCV5_SR_48000HZ) {
-      abr_type = LHDCV5_ABR_48K_RES;
-      abr_table_size = LHDCV5_48K_BITRATE_ELEMENTS_SIZE;
-    } else if (sampling_freq == LHDCV5_SR_96000HZ) {
-      abr_type = LHDCV5_ABR_96K_RES;
-      abr_table_size = LHDCV5_96K_BITRATE_ELEMENTS_SIZE;
-    } else if (sampling_freq == LHDCV5_SR_192000HZ) {
-      abr_type = LHDCV5_ABR_192K_RES;
-      abr_table_size = LHDCV5_192K_BITRATE_ELEMENTS_SIZE;
-    }
+  lhdcv5_enc_release_pkt (ctx);
+  ctx->pkt_ring = buf;
+  ctx->pkt_block_bytes = block_bytes;
+  ctx->pkt_ring_bytes = block_bytes * ring_blocks;
+  ctx->pkt_stage = buf + ctx->pkt_ring_bytes;
+  ctx->pkt_latency = (uint8_t) latency;
+  ctx->pkt_seqno = 0;
+  lhdcv5_enc_src_reset (ctx->src);
 
-    gABR_table_index = abr_table_size - 1;
+  ALOGD ("%s: block %u bytes, ring %u blocks, latency %u", __func__,
+      block_bytes, ring_blocks, latency);
 
-     func_ret = lhdcv5_util_set_vbr_up_th(handle, VBR_UP_LOSSY_RATIO_THRESHOLD);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
-    {
-      ALOGW ("%s: lhdcv5_util_set_vbr_up_th error (%d)!", __func__, func_ret);
-      return LHDCV5_FRET_ERROR;
-    }
+  return LHDCV5_FRET_SUCCESS;
+}
 
-    func_ret = lhdcv5_util_set_vbr_dn_th(handle, VBR_DOWN_LOSSLESS_RATIO_THRESHOLD);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
-    {
-      ALOGW ("%s: lhdcv5_util_set_vbr_dn_th error (%d)!", __func__, func_ret);
-      return LHDCV5_FRET_ERROR;
-    }
 
-    func_ret = lhdcv5_util_set_vbr_up_intv(handle, VBR_UP_RATE_TIME_CNT);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
-    {
-      ALOGW ("%s: lhdcv5_util_set_vbr_up_intv error (%d)!", __func__, func_ret);
-      return LHDCV5_FRET_ERROR;
-    }
+//----------------------------------------------------------------
+// lhdcv5BT_pkt_reset ()
+//
+// Drop the buffered PCM, the resampler history and the packet being
+// built, e.g. when the stream is suspended. The sequence number keeps
+// counting.
+//	Parameter
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//	Return
+//		LHDCV5_FRET_SUCCESS: succeed to reset the packetizer
+//		Other: fail to reset the packetizer
+//----------------------------------------------------------------
+int32_t lhdcv5BT_pkt_reset
+(
+    HANDLE_LHDCV5_BT	handle
+)
+{
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
 
-    func_ret = lhdcv5_util_set_vbr_dn_intv(handle, VBR_DOWN_RATE_TIME_CNT);
-    if (func_ret != LHDCV5_FRET_SUCCESS)
-    {
-      ALOGW ("%s: lhdcv5_util_set_vbr_dn_intv error (%d)!", __func__, func_ret);
-      return LHDCV5_FRET_ERROR;
-    }
+  if (handle == NULL)
+  {
+    ALOGW ("%s: Handle is NULL!", __func__);
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  ALOGD ("%s: success!", __func__);
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
+
+  lhdcv5_enc_clear_pkt (ctx);
+  lhdcv5_enc_src_reset (ctx->src);
 
   return LHDCV5_FRET_SUCCESS;
 }
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_get_block_Size ()
+// lhdcv5BT_pkt_write_pcm ()
 //
-// Get number of samples per block for LHDC 5.0 encoder
+// Buffer PCM samples of any size for the packetizer. Only what fits in
+// the ring is taken; lhdcv5BT_pkt_get_packet () makes room again. Input
+// that is converted (see lhdcv5BT_set_input_format ()) or resampled (see
+// lhdcv5BT_set_resampler ()) is taken in whole frames, planar input all
+// at once or not at all.
 //	Parameter
-//		handle: a pointer to the resource allocated and is returned by function lhdcv5Bt_get_handle ()
-//		samples_per_frame: number of samples per block returned
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		p_in_pcm: a pointer to PCM samples, in the format of
+//				lhdcv5BT_set_input_format ()
+//		pcm_bytes: bytes of PCM samples
+//		p_used_bytes: a pointer to bytes taken into the ring
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to get number of samples per block 
-//		Other: fail to get number of samples per block.
+//		LHDCV5_FRET_SUCCESS: succeed to buffer the samples
+//		Other: fail to buffer the samples
 //----------------------------------------------------------------
-int32_t lhdcv5BT_get_block_Size
+int32_t lhdcv5BT_pkt_write_pcm
 (
     HANDLE_LHDCV5_BT	handle,
-    uint32_t			* samples_per_frame
+    const void			* p_in_pcm,
+    uint32_t			pcm_bytes,
+    uint32_t			* p_used_bytes
 )
 {
-  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
-
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  const uint8_t *pcm = (const uint8_t *) p_in_pcm;
+  uint32_t wr = 0;
+  uint32_t used = 0;
+  uint32_t part = 0;
 
   if (handle == NULL)
   {
@@ -1530,52 +4914,98 @@ int32_t lhdcv5BT_get_block_Size
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  if (samples_per_frame == NULL)
+  if (((p_in_pcm == NULL) && (pcm_bytes > 0)) || (p_used_bytes == NULL))
   {
-    ALOGW ("%s: Input parameter is NULL!", __func__);
+    ALOGW ("%s: input parameter is NULL!", __func__);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  func_ret = lhdcv5_util_get_block_Size (handle, samples_per_frame);
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
 
-  if ((func_ret != LHDCV5_FRET_SUCCESS) || ((*samples_per_frame) <= 0))
+  if (ctx->pkt_ring == NULL)
   {
-    ALOGW ("%s: Failed to get block size (%d) (%d)!", __func__, func_ret, *samples_per_frame);
-    return LHDCV5_FRET_ERROR;
+    ALOGW ("%s: Packetizer is not initialized!", __func__);
+    return LHDCV5_FRET_CODEC_NOT_READY;
+  }
+
+  if (ctx->src != NULL)
+  {
+    return lhdcv5_enc_pkt_write_src (ctx, pcm, pcm_bytes, p_used_bytes);
   }
 
+  if (ctx->conv.active)
+  {
+    return lhdcv5_enc_pkt_write_frames (ctx, pcm, pcm_bytes, p_used_bytes);
+  }
+
+  used = ctx->pkt_ring_bytes - ctx->pkt_ring_fill;
+  if (used > pcm_bytes)
+  {
+    used = pcm_bytes;
+  }
+  *p_used_bytes = used;
+  if (used == 0)
+  {
+    return LHDCV5_FRET_SUCCESS;
+  }
+
+  // at most two copies, up to the end of the ring and from its start
+  wr = ctx->pkt_ring_rd + ctx->pkt_ring_fill;
+  if (wr >= ctx->pkt_ring_bytes)
+  {
+    wr -= ctx->pkt_ring_bytes;
+  }
+  part = ctx->pkt_ring_bytes - wr;
+  if (part > used)
+  {
+    part = used;
+  }
+  memcpy (ctx->pkt_ring + wr, pcm, part);
+  memcpy (ctx->pkt_ring, pcm + part, used - part);
+
+  ctx->pkt_ring_fill += used;
+
   return LHDCV5_FRET_SUCCESS;
 }
 
 
 //----------------------------------------------------------------
-// lhdcv5BT_encode ()
+// lhdcv5BT_pkt_get_packet ()
 //
-// Encode pcm samples by LHDC 5.0
+// Encode the buffered PCM and return the next packet, filled up to the
+// current MTU and led by the LHDC header. No packet (0 bytes) is returned
+// until enough PCM is buffered to complete one. A lower MTU applies from
+// the packet after the one being built.
 //	Parameter
-//		handle: a pointer to the resource allocated and is returned 
-//				by function lhdcBT_get_handle ()
-//		p_in_pcm: a pointer to a buffer contains PCM samples for encoding
-//		p_out_buf: a pointer to a buffer to put encoded stream
-//		out_buf_bytes: output buffer's size (in byte)
-//		p_out_bytes: a pointer to number of bytes of encoded stream in buffer
-//		p_out_frames: a pointer to number of frames of encoded stream in buffer
+//		handle: a pointer to the resource allocated and is returned
+//				by function lhdcv5BT_get_handle ()
+//		p_out_buf: a pointer to a buffer to put the packet
+//		out_buf_bytes: output buffer's size (in byte), the current MTU is enough
+//		p_out_bytes: a pointer to bytes of the packet, 0 if none
+//		p_out_frames: a pointer to number of frames in the packet
 //	Return
-//		LHDCV5_FRET_SUCCESS: succeed to encode pcm samples
-//		Other: fail to encode pcm samples
+//		LHDCV5_FRET_SUCCESS: succeed to return a packet or none
+//		LHDCV5_FRET_BUF_NOT_ENOUGH: output buffer too small, the packet is kept
+//		LHDCV5_FRET_CODEC_NOT_READY: packetizer not initialized, or the encode
+//				pipeline is running
+//		Other: fail to encode
 //----------------------------------------------------------------
-int32_t lhdcv5BT_encode
+int32_t lhdcv5BT_pkt_get_packet
 (
-    HANDLE_LHDCV5_BT 	handle,
-    void				* p_in_pcm,
-    uint32_t			pcm_bytes,
+    HANDLE_LHDCV5_BT	handle,
     uint8_t				* p_out_buf,
     uint32_t			out_buf_bytes,
-    uint32_t 			* p_out_bytes,
-    uint32_t 			* p_out_frames
+    uint32_t			* p_out_bytes,
+    uint32_t			* p_out_frames
 )
 {
-  int32_t		func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  uint32_t pkt_bytes = 0;
+  int32_t func_ret = LHDCV5_FRET_SUCCESS;
 
   if (handle == NULL)
   {
@@ -1583,27 +5013,71 @@ int32_t lhdcv5BT_encode
     return LHDCV5_FRET_INVALID_HANDLE_CB;
   }
 
-  if ((p_in_pcm == NULL) || (p_out_buf == NULL) ||
-      (p_out_bytes == NULL) || (p_out_frames == NULL))
+  if ((p_out_buf == NULL) || (p_out_bytes == NULL) || (p_out_frames == NULL))
   {
     ALOGW ("%s: input parameter is NULL!", __func__);
     return LHDCV5_FRET_INVALID_INPUT_PARAM;
   }
 
-  func_ret = lhdcv5_util_enc_process (handle,
-      p_in_pcm,
-      pcm_bytes,
-      p_out_buf,
-      out_buf_bytes,
-      p_out_bytes,
-      p_out_frames);
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return LHDCV5_FRET_INVALID_HANDLE_CB;
+  }
 
+  if (ctx->pkt_ring == NULL)
+  {
+    ALOGW ("%s: Packetizer is not initialized!", __func__);
+    return LHDCV5_FRET_CODEC_NOT_READY;
+  }
+
+  if (ctx->pipe != NULL)
+  {
+    ALOGW ("%s: Encode pipeline is running, blocks go through lhdcv5BT_pipe_encode ()!", __func__);
+    return LHDCV5_FRET_CODEC_NOT_READY;
+  }
+
+  *p_out_bytes = 0;
+  *p_out_frames = 0;
+
+  func_ret = lhdcv5_enc_pkt_fill (handle, ctx);
   if (func_ret != LHDCV5_FRET_SUCCESS)
   {
-    ALOGW ("%s: Failed to encode pcm samples (%d)!", __func__, func_ret);
+    ALOGW ("%s: Failed to encode buffered pcm samples (%d)!", __func__, func_ret);
     return LHDCV5_FRET_ERROR;
   }
 
+  if (!ctx->pkt_ready)
+  {
+    return LHDCV5_FRET_SUCCESS;
+  }
+
+  pkt_bytes = LHDCV5BT_PKT_HDR_BYTES + ctx->pkt_stage_bytes;
+  if (out_buf_bytes < pkt_bytes)
+  {
+    ALOGW ("%s: Output buffer too small (%u < %u)!", __func__, out_buf_bytes, pkt_bytes);
+    return LHDCV5_FRET_BUF_NOT_ENOUGH;
+  }
+
+  p_out_buf[0] = (uint8_t) (((ctx->pkt_stage_frames << 2) & LHDCV5BT_PKT_HDR_FRAME_NO_MASK) |
+      ctx->pkt_latency);
+  p_out_buf[1] = ctx->pkt_seqno++;
+  memcpy (p_out_buf + LHDCV5BT_PKT_HDR_BYTES, ctx->pkt_stage, ctx->pkt_stage_bytes);
+  *p_out_bytes = pkt_bytes;
+  *p_out_frames = ctx->pkt_stage_frames;
+
+  // the output that did not fit opens the next packet
+  memmove (ctx->pkt_stage, ctx->pkt_stage + ctx->pkt_stage_bytes, ctx->pkt_carry_bytes);
+  ctx->pkt_stage_bytes = ctx->pkt_carry_bytes;
+  ctx->pkt_stage_frames = ctx->pkt_carry_frames;
+  if (ctx->pkt_carry_bytes > 0)
+  {
+    ctx->pkt_chunk_bytes = ctx->pkt_carry_bytes;
+  }
+  ctx->pkt_carry_bytes = 0;
+  ctx->pkt_carry_frames = 0;
+  ctx->pkt_ready = lhdcv5_enc_pkt_full (ctx, lhdcv5_enc_pkt_mtu (handle));
+
   return LHDCV5_FRET_SUCCESS;
 }
 
@@ -1658,7 +5132,8 @@ static int lhdcBT_set_cfg_meta_v1
 {
   PST_LHDC_SET_META pset_meta = (PST_LHDC_SET_META) userConfig;
   unsigned char	* pmeta_metadata = NULL;
-  int				func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  lhdcv5BT_enc_ext_set_t set;
 
   if (handle == NULL)
   {
@@ -1697,21 +5172,33 @@ static int lhdcBT_set_cfg_meta_v1
     return EXTEND_FUNC_RET_INVALID_PARAMETER;
   }
 
-  pmeta_metadata = (uint8_t*) (pset_meta + 1);
+  if ((pset_meta->meta_metadata_length > LHDCV5_META_LEN_MAX) ||
+      (pset_meta->meta_set > LHDCV5_META_LOOP_CNT_MAX))
+  {
+    ALOGW("(LHDC-exAPI) %s: Invalid META data (%d bytes, loop %d)!", __func__,
+        pset_meta->meta_metadata_length, pset_meta->meta_set);
+    return EXTEND_FUNC_RET_INVALID_PARAMETER;
+  }
 
-  func_ret = lhdcv5_util_set_ext_func_state (handle,
-      LHDCV5_EXT_FUNC_META,
-      pset_meta->meta_enable,
-      pmeta_metadata,
-      pset_meta->meta_metadata_length,
-      pset_meta->meta_set);
+  pmeta_metadata = (uint8_t*) (pset_meta + 1);
 
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
   {
-    ALOGW ("(LHDC-exAPI) %s: Fail to set META data (%d)!",  __func__, func_ret);
-    return EXTEND_FUNC_RET_ERROR;
+    return EXTEND_FUNC_RET_INVALID_HANDLE;
   }
 
+  // committed on its own, the encoder takes it between two blocks
+  set.mask = LHDCV5BT_EXT_META;
+  set.meta_enabled = (pset_meta->meta_enable != 0);
+  set.meta_len = pset_meta->meta_metadata_length;
+  set.meta_loop_cnt = pset_meta->meta_set;
+  memcpy (set.meta, pmeta_metadata, set.meta_len);
+
+  pthread_mutex_lock (&ctx->ext_lock);
+  lhdcv5_enc_ext_post (ctx, &set);
+  pthread_mutex_unlock (&ctx->ext_lock);
+
   return EXTEND_FUNC_RET_OK;
 }
 
@@ -1792,7 +5279,7 @@ static int lhdcBT_get_cfg_meta_v1
 //----------------------------------------------------------------
 // lhdcBT_set_data_gyro_2d_v1 ()
 //
-// Set data for gyro (x, y)
+// Set data for gyro (x, y), posted to the encoder without waiting on it
 //	Parameter
 //		handle: a pointer to the resource allocated and is returned 
 //				by function lhdcBT_get_handle ()
@@ -1810,7 +5297,7 @@ static int lhdcBT_set_data_gyro_2d_v1
 ) 
 {
   PST_LHDC_AR_GYRO pargyro = (PST_LHDC_AR_GYRO) userData;
-  int 		func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
 
   if (handle == NULL)
   {
@@ -1831,27 +5318,23 @@ static int lhdcBT_set_data_gyro_2d_v1
     return EXTEND_FUNC_RET_BUF_UNDERRUN;
   }
 
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
+  {
+    return EXTEND_FUNC_RET_INVALID_HANDLE;
+  }
 
   ALOGV ("(LHDC-exAPI) %s: set coordinate[x:%d y:%d z:%d]",  __func__,
       pargyro->world_coordinate_x,
       pargyro->world_coordinate_y,
       pargyro->world_coordinate_z);
 
-  func_ret = lhdcv5_util_ar_set_gyro_pos (handle,
+  // the encoder takes the latest pose at its next block
+  lhdcv5_enc_post_gyro (ctx,
       pargyro->world_coordinate_x,
       pargyro->world_coordinate_y,
       pargyro->world_coordinate_z);
 
-  if (func_ret != LHDCV5_FRET_SUCCESS)
-  {
-    ALOGD ("(LHDC-exAPI) %s: Fail to set gyro's position[x:%d y:%d z:%d] for AR (%d)!",  __func__,
-        pargyro->world_coordinate_x,
-        pargyro->world_coordinate_y,
-        pargyro->world_coordinate_z,
-        func_ret);
-    return EXTEND_FUNC_RET_ERROR;
-  }
-
   return EXTEND_FUNC_RET_OK;
 }
 
@@ -1877,7 +5360,8 @@ static int lhdcBT_set_cfg_ar_v3
 ) 
 {
   PST_LHDC_AR pset_ar_cfg = (PST_LHDC_AR) userConfig;
-  int 		func_ret = LHDCV5_FRET_SUCCESS;
+  lhdcv5BT_enc_ctx_t *ctx = NULL;
+  lhdcv5BT_enc_ext_set_t set;
 
   if (handle == NULL)
   {
@@ -1931,20 +5415,23 @@ static int lhdcBT_set_cfg_ar_v3
   ALOGD("(LHDC-exAPI) %s: Rev_gain(%f) ThreeD_gain(%f)" , __func__,
       pset_ar_cfg->Rev_gain, pset_ar_cfg->ThreeD_gain);
 
-  ALOGD ("(LHDC-exAPI) %s: to set AR enable: %d",  __func__, pset_ar_cfg->app_ar_enabled);
-  func_ret = lhdcv5_util_ar_set_cfg (handle,
-      &pset_ar_cfg->Ch1_Pos,
-      6,
-      &pset_ar_cfg->Ch1_L_PreGain,
-      32,
-      pset_ar_cfg->app_ar_enabled);
-
-  if (func_ret != LHDCV5_FRET_SUCCESS)
+  ctx = lhdcv5_enc_get_ctx (handle);
+  if (ctx == NULL)
   {
-    ALOGW ("(LHDC-exAPI) %s: func_ret %d",  __func__, func_ret);
-    return EXTEND_FUNC_RET_ERROR;
+    return EXTEND_FUNC_RET_INVALID_HANDLE;
   }
 
+  // committed on its own, the encoder takes it between two blocks
+  ALOGD ("(LHDC-exAPI) %s: to set AR enable: %d",  __func__, pset_ar_cfg->app_ar_enabled);
+  set.mask = LHDCV5BT_EXT_AR_CFG;
+  set.ar.enabled = (pset_ar_cfg->app_ar_enabled != 0);
+  memcpy (set.ar.pos, &pset_ar_cfg->Ch1_Pos, sizeof(set.ar.pos));
+  memcpy (set.ar.gain, &pset_ar_cfg->Ch1_L_PreGain, sizeof(set.ar.gain));
+
+  pthread_mutex_lock (&ctx->ext_lock);
+  lhdcv5_enc_ext_post (ctx, &set);
+  pthread_mutex_unlock (&ctx->ext_lock);
+
   return EXTEND_FUNC_RET_OK;
 }
 
@@ -2261,7 +5748,7 @@ void lhdcv5BT_set_user_exdata
     switch (exFuncVer)
     {
     case EXTEND_FUNC_VER_SET_DATA_GYRO2D_V1:
-      ALOGD ("(LHDC-exAPI) %s: SET_DATA_GYRO",  __func__);
+      ALOGV ("(LHDC-exAPI) %s: SET_DATA_GYRO",  __func__);
       func_ret = lhdcBT_set_data_gyro_2d_v1 (handle, userData, clen);
 
       if (func_ret != LHDCV5_FRET_SUCCESS)
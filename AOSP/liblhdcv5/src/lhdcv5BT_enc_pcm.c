@@ -0,0 +1,837 @@
+/*
+ * lhdcv5BT_enc_pcm.c
+ *
+ * Input format conversion of pcm samples ahead of the LHDC V5 encoder. Every
+ * conversion is split into a load stage (input layout -> intermediate), an
+ * optional zip stage interleaving planar input, and a store stage
+ * (intermediate -> encoder layout), run on chunks of
+ * LHDCV5_ENC_PCM_CHUNK_SAMPLES so that the input is read once. Integer input
+ * uses a q31 intermediate and is bit exact when widened; float input is its
+ * own intermediate and is scaled, clamped and rounded by the store stage; NaN
+ * samples become silence in every kernel set.
+ *
+ * SSE2, AVX2 and NEON versions exist for all stages but the packed 24 bit
+ * load and stores, which are scalar only.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "lhdcv5BT_enc_pcm.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LHDCV5_ENC_PCM_HAVE_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// largest float below 2^31, anything above overflows int32 conversion
+#define LHDCV5_ENC_PCM_S32_MAX_F  (2147483520.0f)
+
+typedef struct
+{
+  lhdcv5_enc_pcm_load_fn load_q31_s16;
+  lhdcv5_enc_pcm_load_fn load_q31_s32;      // shift by conv->in_shift
+  lhdcv5_enc_pcm_store_fn store_q31_s16;    // rounding, saturating
+  lhdcv5_enc_pcm_store_fn store_f_s16;
+  lhdcv5_enc_pcm_store_fn store_f_s32;      // clamp to conv->out_min/out_max
+  lhdcv5_enc_pcm_zip_fn zip;
+  const char *name;
+} lhdcv5_enc_pcm_ops_t;
+
+
+/*******************************************************************************
+ * scalar kernels
+ ******************************************************************************/
+static void load_q31_s16_c(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const int16_t *src = (const int16_t *)in;
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i;
+
+  (void)conv;
+  for (i = 0; i < n; i++) {
+    q[i] = (int32_t)((uint32_t)src[i] << 16);
+  }
+}
+
+static void load_q31_s32_c(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const int32_t *src = (const int32_t *)in;
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    q[i] = (int32_t)((uint32_t)src[i] << conv->in_shift);
+  }
+}
+
+static void load_q31_s24p_c(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i;
+
+  (void)conv;
+  for (i = 0; i < n; i++) {
+    q[i] = (int32_t)(((uint32_t)in[3 * i + 0] << 8) |
+                     ((uint32_t)in[3 * i + 1] << 16) |
+                     ((uint32_t)in[3 * i + 2] << 24));
+  }
+}
+
+static void store_q31_s16_c(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  int16_t *dst = (int16_t *)out;
+  int32_t v;
+  uint32_t i;
+
+  (void)conv;
+  for (i = 0; i < n; i++) {
+    v = (q[i] >> 16) + ((q[i] >> 15) & 1);
+    dst[i] = (int16_t)((v > INT16_MAX) ? INT16_MAX : v);
+  }
+}
+
+static void store_q31_s32_c(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  (void)conv;
+  memcpy(out, tmp, n * sizeof(int32_t));
+}
+
+static void store_q31_s24p_c(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  int32_t v;
+  uint32_t i;
+
+  (void)conv;
+  for (i = 0; i < n; i++) {
+    v = (q[i] >> 8) + ((q[i] >> 7) & 1);
+    v = (v > 8388607) ? 8388607 : v;
+    out[3 * i + 0] = (uint8_t)v;
+    out[3 * i + 1] = (uint8_t)(v >> 8);
+    out[3 * i + 2] = (uint8_t)(v >> 16);
+  }
+}
+
+static inline float pcm_clampf(float v, float lo, float hi)
+{
+  if (v < lo) {
+    return lo;
+  }
+  if (v > hi) {
+    return hi;
+  }
+  // NaN fails both compares
+  return (v == v) ? v : 0.0f;
+}
+
+static void store_f_s16_c(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  int16_t *dst = (int16_t *)out;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    dst[i] = (int16_t)lrintf(pcm_clampf(f[i] * conv->out_scale, conv->out_min, conv->out_max));
+  }
+}
+
+static void store_f_s32_c(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  int32_t *dst = (int32_t *)out;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    dst[i] = (int32_t)lrintf(pcm_clampf(f[i] * conv->out_scale, conv->out_min, conv->out_max));
+  }
+}
+
+static void store_f_s24p_c(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  int32_t v;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    v = (int32_t)lrintf(pcm_clampf(f[i] * conv->out_scale, conv->out_min, conv->out_max));
+    out[3 * i + 0] = (uint8_t)v;
+    out[3 * i + 1] = (uint8_t)(v >> 8);
+    out[3 * i + 2] = (uint8_t)(v >> 16);
+  }
+}
+
+static void zip_c(const void *left, const void *right, void *tmp, uint32_t n)
+{
+  const uint32_t *l = (const uint32_t *)left;
+  const uint32_t *r = (const uint32_t *)right;
+  uint32_t *dst = (uint32_t *)tmp;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    dst[2 * i] = l[i];
+    dst[2 * i + 1] = r[i];
+  }
+}
+
+static const lhdcv5_enc_pcm_ops_t pcm_ops_c = {
+  load_q31_s16_c,
+  load_q31_s32_c,
+  store_q31_s16_c,
+  store_f_s16_c,
+  store_f_s32_c,
+  zip_c,
+  "c",
+};
+
+
+/*******************************************************************************
+ * SSE2 kernels
+ ******************************************************************************/
+#if defined(__SSE2__)
+static void load_q31_s16_sse2(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  __m128i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+    // interleaving zeros below each sample is a shift left by 16
+    _mm_storeu_si128((__m128i *)(q + i), _mm_unpacklo_epi16(zero, v));
+    _mm_storeu_si128((__m128i *)(q + i + 4), _mm_unpackhi_epi16(zero, v));
+  }
+  load_q31_s16_c(in + 2 * i, q + i, n - i, conv);
+}
+
+static void load_q31_s32_sse2(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const __m128i shift = _mm_cvtsi32_si128((int)conv->in_shift);
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  __m128i v;
+
+  for (; i + 4 <= n; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(in + 4 * i));
+    _mm_storeu_si128((__m128i *)(q + i), _mm_sll_epi32(v, shift));
+  }
+  load_q31_s32_c(in + 4 * i, q + i, n - i, conv);
+}
+
+static inline __m128i pcm_round_shr_sse2(__m128i v, int shift)
+{
+  const __m128i one = _mm_set1_epi32(1);
+  __m128i s = _mm_cvtsi32_si128(shift);
+  __m128i s1 = _mm_cvtsi32_si128(shift - 1);
+
+  return _mm_add_epi32(_mm_sra_epi32(v, s), _mm_and_si128(_mm_sra_epi32(v, s1), one));
+}
+
+static void store_q31_s16_sse2(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  uint32_t i = 0;
+  __m128i lo, hi;
+
+  for (; i + 8 <= n; i += 8) {
+    lo = pcm_round_shr_sse2(_mm_loadu_si128((const __m128i *)(q + i)), 16);
+    hi = pcm_round_shr_sse2(_mm_loadu_si128((const __m128i *)(q + i + 4)), 16);
+    _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_packs_epi32(lo, hi));
+  }
+  store_q31_s16_c(q + i, out + 2 * i, n - i, conv);
+}
+
+static inline __m128i pcm_cvt_f_sse2(const float *f, __m128 scale, __m128 lo, __m128 hi)
+{
+  __m128 v = _mm_mul_ps(_mm_loadu_ps(f), scale);
+
+  // NaN to 0 first, max/min would turn it into lo
+  v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+  return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, lo), hi));
+}
+
+static void store_f_s16_sse2(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const __m128 scale = _mm_set1_ps(conv->out_scale);
+  const __m128 lo = _mm_set1_ps(conv->out_min);
+  const __m128 hi = _mm_set1_ps(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128((__m128i *)(out + 2 * i),
+        _mm_packs_epi32(pcm_cvt_f_sse2(f + i, scale, lo, hi),
+                        pcm_cvt_f_sse2(f + i + 4, scale, lo, hi)));
+  }
+  store_f_s16_c(f + i, out + 2 * i, n - i, conv);
+}
+
+static void store_f_s32_sse2(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const __m128 scale = _mm_set1_ps(conv->out_scale);
+  const __m128 lo = _mm_set1_ps(conv->out_min);
+  const __m128 hi = _mm_set1_ps(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_si128((__m128i *)(out + 4 * i), pcm_cvt_f_sse2(f + i, scale, lo, hi));
+  }
+  store_f_s32_c(f + i, out + 4 * i, n - i, conv);
+}
+
+static void zip_sse2(const void *left, const void *right, void *tmp, uint32_t n)
+{
+  const uint8_t *l = (const uint8_t *)left;
+  const uint8_t *r = (const uint8_t *)right;
+  uint8_t *dst = (uint8_t *)tmp;
+  uint32_t i = 0;
+  __m128i a, b;
+
+  for (; i + 4 <= n; i += 4) {
+    a = _mm_loadu_si128((const __m128i *)(l + 4 * i));
+    b = _mm_loadu_si128((const __m128i *)(r + 4 * i));
+    _mm_storeu_si128((__m128i *)(dst + 8 * i), _mm_unpacklo_epi32(a, b));
+    _mm_storeu_si128((__m128i *)(dst + 8 * i + 16), _mm_unpackhi_epi32(a, b));
+  }
+  zip_c(l + 4 * i, r + 4 * i, dst + 8 * i, n - i);
+}
+
+static const lhdcv5_enc_pcm_ops_t pcm_ops_sse2 = {
+  load_q31_s16_sse2,
+  load_q31_s32_sse2,
+  store_q31_s16_sse2,
+  store_f_s16_sse2,
+  store_f_s32_sse2,
+  zip_sse2,
+  "sse2",
+};
+#endif /* __SSE2__ */
+
+
+/*******************************************************************************
+ * AVX2 kernels, selected at run time
+ ******************************************************************************/
+#if defined(LHDCV5_ENC_PCM_HAVE_AVX2)
+#define PCM_AVX2 __attribute__((target("avx2")))
+
+PCM_AVX2 static void load_q31_s16_avx2(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + 2 * i)));
+    _mm256_storeu_si256((__m256i *)(q + i), _mm256_slli_epi32(v, 16));
+  }
+  load_q31_s16_c(in + 2 * i, q + i, n - i, conv);
+}
+
+PCM_AVX2 static void load_q31_s32_avx2(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const __m128i shift = _mm_cvtsi32_si128((int)conv->in_shift);
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm256_loadu_si256((const __m256i *)(in + 4 * i));
+    _mm256_storeu_si256((__m256i *)(q + i), _mm256_sll_epi32(v, shift));
+  }
+  load_q31_s32_c(in + 4 * i, q + i, n - i, conv);
+}
+
+PCM_AVX2 static inline __m256i pcm_round_shr_avx2(__m256i v, int shift)
+{
+  const __m256i one = _mm256_set1_epi32(1);
+  __m128i s = _mm_cvtsi32_si128(shift);
+  __m128i s1 = _mm_cvtsi32_si128(shift - 1);
+
+  return _mm256_add_epi32(_mm256_sra_epi32(v, s), _mm256_and_si256(_mm256_sra_epi32(v, s1), one));
+}
+
+PCM_AVX2 static void store_q31_s16_avx2(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = pcm_round_shr_avx2(_mm256_loadu_si256((const __m256i *)(q + i)), 16);
+    _mm_storeu_si128((__m128i *)(out + 2 * i),
+        _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+  }
+  store_q31_s16_c(q + i, out + 2 * i, n - i, conv);
+}
+
+PCM_AVX2 static inline __m256i pcm_cvt_f_avx2(const float *f, __m256 scale, __m256 lo, __m256 hi)
+{
+  __m256 v = _mm256_mul_ps(_mm256_loadu_ps(f), scale);
+
+  // NaN to 0 first, max/min would turn it into lo
+  v = _mm256_and_ps(v, _mm256_cmp_ps(v, v, _CMP_ORD_Q));
+  return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(v, lo), hi));
+}
+
+PCM_AVX2 static void store_f_s16_avx2(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const __m256 scale = _mm256_set1_ps(conv->out_scale);
+  const __m256 lo = _mm256_set1_ps(conv->out_min);
+  const __m256 hi = _mm256_set1_ps(conv->out_max);
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = pcm_cvt_f_avx2(f + i, scale, lo, hi);
+    _mm_storeu_si128((__m128i *)(out + 2 * i),
+        _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+  }
+  store_f_s16_c(f + i, out + 2 * i, n - i, conv);
+}
+
+PCM_AVX2 static void store_f_s32_avx2(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const __m256 scale = _mm256_set1_ps(conv->out_scale);
+  const __m256 lo = _mm256_set1_ps(conv->out_min);
+  const __m256 hi = _mm256_set1_ps(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_si256((__m256i *)(out + 4 * i), pcm_cvt_f_avx2(f + i, scale, lo, hi));
+  }
+  store_f_s32_c(f + i, out + 4 * i, n - i, conv);
+}
+
+PCM_AVX2 static void zip_avx2(const void *left, const void *right, void *tmp, uint32_t n)
+{
+  const uint8_t *l = (const uint8_t *)left;
+  const uint8_t *r = (const uint8_t *)right;
+  uint8_t *dst = (uint8_t *)tmp;
+  uint32_t i = 0;
+  __m256i a, b, lo, hi;
+
+  for (; i + 8 <= n; i += 8) {
+    a = _mm256_loadu_si256((const __m256i *)(l + 4 * i));
+    b = _mm256_loadu_si256((const __m256i *)(r + 4 * i));
+    // unpack works per 128 bit lane, put the lane halves back in order
+    lo = _mm256_unpacklo_epi32(a, b);
+    hi = _mm256_unpackhi_epi32(a, b);
+    _mm256_storeu_si256((__m256i *)(dst + 8 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + 8 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  zip_c(l + 4 * i, r + 4 * i, dst + 8 * i, n - i);
+}
+
+static const lhdcv5_enc_pcm_ops_t pcm_ops_avx2 = {
+  load_q31_s16_avx2,
+  load_q31_s32_avx2,
+  store_q31_s16_avx2,
+  store_f_s16_avx2,
+  store_f_s32_avx2,
+  zip_avx2,
+  "avx2",
+};
+#endif /* LHDCV5_ENC_PCM_HAVE_AVX2 */
+
+
+/*******************************************************************************
+ * NEON kernels
+ ******************************************************************************/
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static void load_q31_s16_neon(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  int16x8_t v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = vld1q_s16((const int16_t *)(in + 2 * i));
+    vst1q_s32(q + i, vshll_n_s16(vget_low_s16(v), 16));
+    vst1q_s32(q + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+  }
+  load_q31_s16_c(in + 2 * i, q + i, n - i, conv);
+}
+
+static void load_q31_s32_neon(const uint8_t *in, void *tmp, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const int32x4_t shift = vdupq_n_s32((int32_t)conv->in_shift);
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    vst1q_s32(q + i, vshlq_s32(vld1q_s32((const int32_t *)(in + 4 * i)), shift));
+  }
+  load_q31_s32_c(in + 4 * i, q + i, n - i, conv);
+}
+
+static void store_q31_s16_neon(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  uint32_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    vst1q_s16((int16_t *)(out + 2 * i),
+        vcombine_s16(vqrshrn_n_s32(vld1q_s32(q + i), 16),
+                     vqrshrn_n_s32(vld1q_s32(q + i + 4), 16)));
+  }
+  store_q31_s16_c(q + i, out + 2 * i, n - i, conv);
+}
+
+static inline int32x4_t pcm_cvt_f_neon(const float *f, float scale, float32x4_t lo, float32x4_t hi)
+{
+  float32x4_t v = vmulq_n_f32(vld1q_f32(f), scale);
+
+  // NaN to 0 first, as the other kernel sets
+  v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), vceqq_f32(v, v)));
+  v = vminq_f32(vmaxq_f32(v, lo), hi);
+
+#if defined(__aarch64__)
+  return vcvtnq_s32_f32(v);
+#else
+  // armv7 converts toward zero, round half away from zero instead
+  uint32x4_t neg = vcltq_f32(v, vdupq_n_f32(0.0f));
+  float32x4_t half = vbslq_f32(neg, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+  return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+
+static void store_f_s16_neon(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const float32x4_t lo = vdupq_n_f32(conv->out_min);
+  const float32x4_t hi = vdupq_n_f32(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    vst1q_s16((int16_t *)(out + 2 * i),
+        vcombine_s16(vqmovn_s32(pcm_cvt_f_neon(f + i, conv->out_scale, lo, hi)),
+                     vqmovn_s32(pcm_cvt_f_neon(f + i + 4, conv->out_scale, lo, hi))));
+  }
+  store_f_s16_c(f + i, out + 2 * i, n - i, conv);
+}
+
+static void store_f_s32_neon(const void *tmp, uint8_t *out, uint32_t n,
+    const lhdcv5_enc_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const float32x4_t lo = vdupq_n_f32(conv->out_min);
+  const float32x4_t hi = vdupq_n_f32(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    vst1q_s32((int32_t *)(out + 4 * i), pcm_cvt_f_neon(f + i, conv->out_scale, lo, hi));
+  }
+  store_f_s32_c(f + i, out + 4 * i, n - i, conv);
+}
+
+static void zip_neon(const void *left, const void *right, void *tmp, uint32_t n)
+{
+  const uint32_t *l = (const uint32_t *)left;
+  const uint32_t *r = (const uint32_t *)right;
+  uint32_t *dst = (uint32_t *)tmp;
+  uint32x4x2_t v;
+  uint32_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    v.val[0] = vld1q_u32(l + i);
+    v.val[1] = vld1q_u32(r + i);
+    vst2q_u32(dst + 2 * i, v);
+  }
+  zip_c(l + i, r + i, dst + 2 * i, n - i);
+}
+
+static const lhdcv5_enc_pcm_ops_t pcm_ops_neon = {
+  load_q31_s16_neon,
+  load_q31_s32_neon,
+  store_q31_s16_neon,
+  store_f_s16_neon,
+  store_f_s32_neon,
+  zip_neon,
+  "neon",
+};
+#endif /* __ARM_NEON */
+
+
+/*******************************************************************************
+ * converter setup
+ ******************************************************************************/
+// kernel sets usable on this cpu, the scalar reference first and the
+// preferred one last
+static uint32_t pcm_list_ops(const lhdcv5_enc_pcm_ops_t *list[LHDCV5_ENC_PCM_MAX_ISA])
+{
+  uint32_t num = 0;
+
+  list[num++] = &pcm_ops_c;
+#if defined(__SSE2__)
+  list[num++] = &pcm_ops_sse2;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  list[num++] = &pcm_ops_neon;
+#endif
+#if defined(LHDCV5_ENC_PCM_HAVE_AVX2)
+  if (__builtin_cpu_supports("avx2")) {
+    list[num++] = &pcm_ops_avx2;
+  }
+#endif
+
+  return num;
+}
+
+uint32_t lhdcv5_enc_pcm_isa_num(void)
+{
+  const lhdcv5_enc_pcm_ops_t *list[LHDCV5_ENC_PCM_MAX_ISA];
+
+  return pcm_list_ops(list);
+}
+
+const char *lhdcv5_enc_pcm_isa_name(uint32_t isa)
+{
+  const lhdcv5_enc_pcm_ops_t *list[LHDCV5_ENC_PCM_MAX_ISA];
+
+  if (isa >= pcm_list_ops(list)) {
+    return NULL;
+  }
+
+  return list[isa]->name;
+}
+
+uint32_t lhdcv5_enc_pcm_layout_bytes(lhdcv5_enc_pcm_layout_t layout)
+{
+  switch (layout) {
+    case LHDCV5_ENC_PCM_S16:
+      return 2;
+    case LHDCV5_ENC_PCM_S24_PACKED:
+      return 3;
+    case LHDCV5_ENC_PCM_S24_IN32:
+    case LHDCV5_ENC_PCM_S32:
+    case LHDCV5_ENC_PCM_FLOAT:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// description
+//   set up conversion from an input layout to the layout the encoder takes
+//   with a given kernel set
+// Parameter
+//   conv: converter to set up
+//   in_layout: layout of the input samples
+//   out_layout: encoder input layout (S16, S24_PACKED or S32)
+//   planar: input is one plane of samples per channel
+//   isa: kernel set, below lhdcv5_enc_pcm_isa_num
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5_enc_pcm_conv_init_isa(lhdcv5_enc_pcm_conv_t *conv, lhdcv5_enc_pcm_layout_t in_layout,
+    lhdcv5_enc_pcm_layout_t out_layout, bool planar, uint32_t isa)
+{
+  const lhdcv5_enc_pcm_ops_t *list[LHDCV5_ENC_PCM_MAX_ISA];
+  const lhdcv5_enc_pcm_ops_t *ops;
+
+  if ((conv == NULL) || (isa >= pcm_list_ops(list))) {
+    return -1;
+  }
+  ops = list[isa];
+
+  if ((out_layout != LHDCV5_ENC_PCM_S16) &&
+      (out_layout != LHDCV5_ENC_PCM_S24_PACKED) &&
+      (out_layout != LHDCV5_ENC_PCM_S32)) {
+    return -1;
+  }
+
+  if (lhdcv5_enc_pcm_layout_bytes(in_layout) == 0) {
+    return -1;
+  }
+
+  memset(conv, 0, sizeof(lhdcv5_enc_pcm_conv_t));
+  conv->in_layout = in_layout;
+  conv->out_layout = out_layout;
+  conv->in_bytes = lhdcv5_enc_pcm_layout_bytes(in_layout);
+  conv->out_bytes = lhdcv5_enc_pcm_layout_bytes(out_layout);
+  conv->planar = planar;
+  conv->zip = ops->zip;
+  conv->isa = ops->name;
+
+  if ((in_layout == out_layout) && !planar) {
+    conv->active = false;
+    return 0;
+  }
+
+  conv->active = true;
+
+  if (in_layout == LHDCV5_ENC_PCM_FLOAT) {
+    // float input is the intermediate, scaled to the output full scale
+    switch (out_layout) {
+      case LHDCV5_ENC_PCM_S16:
+        conv->out_scale = 32768.0f;
+        conv->out_max = 32767.0f;
+        conv->store = ops->store_f_s16;
+        break;
+      case LHDCV5_ENC_PCM_S24_PACKED:
+        conv->out_scale = 8388608.0f;
+        conv->out_max = 8388607.0f;
+        conv->store = store_f_s24p_c;
+        break;
+      case LHDCV5_ENC_PCM_S32:
+      default:
+        conv->out_scale = 2147483648.0f;
+        conv->out_max = LHDCV5_ENC_PCM_S32_MAX_F;
+        conv->store = ops->store_f_s32;
+        break;
+    }
+    conv->out_min = -conv->out_scale;
+    return 0;
+  }
+
+  // bit exact integer path through a q31 intermediate
+  switch (in_layout) {
+    case LHDCV5_ENC_PCM_S16:
+      conv->load = ops->load_q31_s16;
+      break;
+    case LHDCV5_ENC_PCM_S24_PACKED:
+      conv->load = load_q31_s24p_c;
+      break;
+    case LHDCV5_ENC_PCM_S24_IN32:
+      conv->in_shift = 8;
+      conv->load = ops->load_q31_s32;
+      break;
+    case LHDCV5_ENC_PCM_S32:
+    default:
+      conv->in_shift = 0;
+      conv->load = ops->load_q31_s32;
+      break;
+  }
+
+  switch (out_layout) {
+    case LHDCV5_ENC_PCM_S16:
+      conv->store = ops->store_q31_s16;
+      break;
+    case LHDCV5_ENC_PCM_S24_PACKED:
+      conv->store = store_q31_s24p_c;
+      break;
+    case LHDCV5_ENC_PCM_S32:
+    default:
+      conv->store = store_q31_s32_c;
+      break;
+  }
+
+  return 0;
+}
+
+// description
+//   set up conversion from an input layout to the layout the encoder takes
+//   with the best kernel set of this cpu
+// Parameter
+//   conv: converter to set up
+//   in_layout: layout of the input samples
+//   out_layout: encoder input layout (S16, S24_PACKED or S32)
+//   planar: input is one plane of samples per channel
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5_enc_pcm_conv_init(lhdcv5_enc_pcm_conv_t *conv, lhdcv5_enc_pcm_layout_t in_layout,
+    lhdcv5_enc_pcm_layout_t out_layout, bool planar)
+{
+  return lhdcv5_enc_pcm_conv_init_isa(conv, in_layout, out_layout, planar,
+      lhdcv5_enc_pcm_isa_num() - 1);
+}
+
+
+// description
+//   convert stereo frames into the encoder layout
+// Parameter
+//   conv: converter from lhdcv5_enc_pcm_conv_init
+//   in: first input sample; of the left plane for planar input
+//   plane_bytes: planar input: distance of the right plane from the left one
+//   out: encoder input, frames * 2 * conv->out_bytes
+//   frames: number of stereo frames
+void lhdcv5_enc_pcm_convert(const lhdcv5_enc_pcm_conv_t *conv, const uint8_t *in,
+    uint32_t plane_bytes, uint8_t *out, uint32_t frames)
+{
+  union {
+    int32_t q[LHDCV5_ENC_PCM_CHUNK_SAMPLES];
+    float f[LHDCV5_ENC_PCM_CHUNK_SAMPLES];
+  } tmp;
+  int32_t left[LHDCV5_ENC_PCM_CHUNK_SAMPLES / LHDCV5_ENC_PCM_CHANNELS];
+  int32_t right[LHDCV5_ENC_PCM_CHUNK_SAMPLES / LHDCV5_ENC_PCM_CHANNELS];
+  const uint32_t chunk_frames = LHDCV5_ENC_PCM_CHUNK_SAMPLES / LHDCV5_ENC_PCM_CHANNELS;
+  uint32_t samples = frames * LHDCV5_ENC_PCM_CHANNELS;
+  uint32_t start, n;
+
+  if ((conv == NULL) || (frames == 0)) {
+    return;
+  }
+
+  if (!conv->active) {
+    memcpy(out, in, samples * conv->out_bytes);
+    return;
+  }
+
+  if (!conv->planar) {
+    for (start = 0; start < samples; start += n) {
+      n = samples - start;
+      if (n > LHDCV5_ENC_PCM_CHUNK_SAMPLES) {
+        n = LHDCV5_ENC_PCM_CHUNK_SAMPLES;
+      }
+      if (conv->load == NULL) {
+        conv->store(in + start * conv->in_bytes, out + start * conv->out_bytes, n, conv);
+      } else {
+        conv->load(in + start * conv->in_bytes, &tmp, n, conv);
+        conv->store(&tmp, out + start * conv->out_bytes, n, conv);
+      }
+    }
+    return;
+  }
+
+  for (start = 0; start < frames; start += n) {
+    n = frames - start;
+    if (n > chunk_frames) {
+      n = chunk_frames;
+    }
+    if (conv->load == NULL) {
+      conv->zip(in + start * conv->in_bytes, in + plane_bytes + start * conv->in_bytes, &tmp, n);
+    } else {
+      conv->load(in + start * conv->in_bytes, left, n, conv);
+      conv->load(in + plane_bytes + start * conv->in_bytes, right, n, conv);
+      conv->zip(left, right, &tmp, n);
+    }
+    conv->store(&tmp, out + start * LHDCV5_ENC_PCM_CHANNELS * conv->out_bytes,
+        n * LHDCV5_ENC_PCM_CHANNELS, conv);
+  }
+}
@@ -0,0 +1,81 @@
+/*
+ * lhdcv5BT_enc_pcm.h
+ *
+ * Input format conversion of pcm samples ahead of the LHDC V5 encoder.
+ */
+
+#ifndef LHDCV5BT_ENC_PCM_H
+#define LHDCV5BT_ENC_PCM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// samples converted per pass through the intermediate buffer
+#define LHDCV5_ENC_PCM_CHUNK_SAMPLES    64
+
+// stereo only, as the encoder
+#define LHDCV5_ENC_PCM_CHANNELS         2
+
+// kernel sets a build can carry: scalar, sse2 or neon, avx2
+#define LHDCV5_ENC_PCM_MAX_ISA          3
+
+// sample layouts handled by the converter
+typedef enum {
+  LHDCV5_ENC_PCM_S16 = 0,       // int16
+  LHDCV5_ENC_PCM_S24_IN32,      // 24 bit, sign extended in int32
+  LHDCV5_ENC_PCM_S32,           // int32, full scale (also s24/s16 left-justified)
+  LHDCV5_ENC_PCM_S24_PACKED,    // 3 bytes little endian (encoder input for 24 bit depth)
+  LHDCV5_ENC_PCM_FLOAT,         // float32, full scale 1.0
+} lhdcv5_enc_pcm_layout_t;
+
+struct _lhdcv5_enc_pcm_conv;
+
+// first stage: in -> intermediate (q31 int32 or float32) of n samples
+typedef void (*lhdcv5_enc_pcm_load_fn)(const uint8_t *in, void *tmp, uint32_t n,
+    const struct _lhdcv5_enc_pcm_conv *conv);
+// second stage: intermediate -> out of n samples
+typedef void (*lhdcv5_enc_pcm_store_fn)(const void *tmp, uint8_t *out, uint32_t n,
+    const struct _lhdcv5_enc_pcm_conv *conv);
+// planar input: interleave two planes of n intermediate samples
+typedef void (*lhdcv5_enc_pcm_zip_fn)(const void *left, const void *right, void *tmp,
+    uint32_t n);
+
+typedef struct _lhdcv5_enc_pcm_conv
+{
+  lhdcv5_enc_pcm_layout_t in_layout;
+  lhdcv5_enc_pcm_layout_t out_layout;
+  uint32_t in_bytes;        // bytes per input sample
+  uint32_t out_bytes;       // bytes per output sample
+  bool planar;              // input is one plane per channel
+  bool active;              // false: input is passed to the encoder as is
+  uint32_t in_shift;        // q31 path: left shift of input samples
+  float out_scale;          // float path: output full scale
+  float out_min;            // float path: output clamp range
+  float out_max;
+  lhdcv5_enc_pcm_load_fn load;    // NULL: input is the intermediate (float)
+  lhdcv5_enc_pcm_store_fn store;
+  lhdcv5_enc_pcm_zip_fn zip;
+  const char *isa;          // kernel set picked at init, for logging
+} lhdcv5_enc_pcm_conv_t;
+
+int32_t lhdcv5_enc_pcm_conv_init(lhdcv5_enc_pcm_conv_t *conv, lhdcv5_enc_pcm_layout_t in_layout,
+    lhdcv5_enc_pcm_layout_t out_layout, bool planar);
+
+// kernel sets usable on this cpu: 0 is the scalar reference, the last one is
+// what lhdcv5_enc_pcm_conv_init picks; for benchmarks and reference checks
+uint32_t lhdcv5_enc_pcm_isa_num(void);
+const char *lhdcv5_enc_pcm_isa_name(uint32_t isa);
+int32_t lhdcv5_enc_pcm_conv_init_isa(lhdcv5_enc_pcm_conv_t *conv, lhdcv5_enc_pcm_layout_t in_layout,
+    lhdcv5_enc_pcm_layout_t out_layout, bool planar, uint32_t isa);
+uint32_t lhdcv5_enc_pcm_layout_bytes(lhdcv5_enc_pcm_layout_t layout);
+void lhdcv5_enc_pcm_convert(const lhdcv5_enc_pcm_conv_t *conv, const uint8_t *in,
+    uint32_t plane_bytes, uint8_t *out, uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* End of LHDCV5BT_ENC_PCM_H */
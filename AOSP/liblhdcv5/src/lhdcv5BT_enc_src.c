@@ -0,0 +1,439 @@
+/*
+ * lhdcv5BT_enc_src.c
+ *
+ * Polyphase sample rate converter ahead of the LHDC V5 encoder, e.g. to
+ * take 44.1 kHz sources into the 48 kHz encoder. The rate ratio is reduced
+ * to up/down; a Kaiser windowed sinc of up * taps coefficients is split into
+ * up phases, so every output sample costs one dot product of taps per
+ * channel. The history is kept as float planes per channel, the output is
+ * stored back into the encoder layout by the pcm converter.
+ *
+ * The dot product has SSE2, AVX2 and NEON versions, the filter design and
+ * the history load are scalar.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "lhdcv5BT_enc_src.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LHDCV5_ENC_SRC_HAVE_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// history room: the taps - 1 frames kept before the next output, a chunk
+// behind them, and the input skipped by one output when decimating
+#define SRC_HIST_FRAMES(taps, down, up) \
+  ((taps) + LHDCV5_ENC_SRC_CHUNK_FRAMES + (down) / (up) + 1)
+
+typedef struct
+{
+  uint32_t taps;
+  double cutoff;            // of the lower Nyquist frequency
+  double beta;              // Kaiser window shape
+} lhdcv5_enc_src_preset_t;
+
+static const lhdcv5_enc_src_preset_t src_presets[] = {
+  { LHDCV5_ENC_SRC_TAPS_LOW, 0.80, 5.0 },     // ~50 dB stop band
+  { LHDCV5_ENC_SRC_TAPS_MID, 0.88, 7.0 },     // ~70 dB
+  { LHDCV5_ENC_SRC_TAPS_HIGH, 0.93, 9.0 },    // ~90 dB
+};
+
+
+/*******************************************************************************
+ * dot product kernels
+ ******************************************************************************/
+static void src_dot_c(const float *coef, const float *left, const float *right,
+    uint32_t taps, float *out)
+{
+  float l = 0.0f;
+  float r = 0.0f;
+  uint32_t i;
+
+  for (i = 0; i < taps; i++) {
+    l += coef[i] * left[i];
+    r += coef[i] * right[i];
+  }
+  out[0] = l;
+  out[1] = r;
+}
+
+#if defined(__SSE2__)
+static inline float src_hsum_sse2(__m128 v)
+{
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+static void src_dot_sse2(const float *coef, const float *left, const float *right,
+    uint32_t taps, float *out)
+{
+  __m128 l = _mm_setzero_ps();
+  __m128 r = _mm_setzero_ps();
+  __m128 c;
+  float tail[2];
+  uint32_t i = 0;
+
+  for (; i + 4 <= taps; i += 4) {
+    c = _mm_loadu_ps(coef + i);
+    l = _mm_add_ps(l, _mm_mul_ps(c, _mm_loadu_ps(left + i)));
+    r = _mm_add_ps(r, _mm_mul_ps(c, _mm_loadu_ps(right + i)));
+  }
+  src_dot_c(coef + i, left + i, right + i, taps - i, tail);
+  out[0] = src_hsum_sse2(l) + tail[0];
+  out[1] = src_hsum_sse2(r) + tail[1];
+}
+#endif /* __SSE2__ */
+
+#if defined(LHDCV5_ENC_SRC_HAVE_AVX2)
+#define SRC_AVX2 __attribute__((target("avx2")))
+
+SRC_AVX2 static inline float src_hsum_avx2(__m256 v)
+{
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+SRC_AVX2 static void src_dot_avx2(const float *coef, const float *left, const float *right,
+    uint32_t taps, float *out)
+{
+  __m256 l = _mm256_setzero_ps();
+  __m256 r = _mm256_setzero_ps();
+  __m256 c;
+  float tail[2];
+  uint32_t i = 0;
+
+  for (; i + 8 <= taps; i += 8) {
+    c = _mm256_loadu_ps(coef + i);
+    l = _mm256_add_ps(l, _mm256_mul_ps(c, _mm256_loadu_ps(left + i)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(c, _mm256_loadu_ps(right + i)));
+  }
+  src_dot_c(coef + i, left + i, right + i, taps - i, tail);
+  out[0] = src_hsum_avx2(l) + tail[0];
+  out[1] = src_hsum_avx2(r) + tail[1];
+}
+#endif /* LHDCV5_ENC_SRC_HAVE_AVX2 */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static inline float src_hsum_neon(float32x4_t v)
+{
+  float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+
+  return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+static void src_dot_neon(const float *coef, const float *left, const float *right,
+    uint32_t taps, float *out)
+{
+  float32x4_t l = vdupq_n_f32(0.0f);
+  float32x4_t r = vdupq_n_f32(0.0f);
+  float32x4_t c;
+  float tail[2];
+  uint32_t i = 0;
+
+  for (; i + 4 <= taps; i += 4) {
+    c = vld1q_f32(coef + i);
+    l = vmlaq_f32(l, c, vld1q_f32(left + i));
+    r = vmlaq_f32(r, c, vld1q_f32(right + i));
+  }
+  src_dot_c(coef + i, left + i, right + i, taps - i, tail);
+  out[0] = src_hsum_neon(l) + tail[0];
+  out[1] = src_hsum_neon(r) + tail[1];
+}
+#endif /* __ARM_NEON */
+
+static void src_select_dot(lhdcv5_enc_src_t *src)
+{
+  src->dot = src_dot_c;
+  src->isa = "c";
+#if defined(__SSE2__)
+  src->dot = src_dot_sse2;
+  src->isa = "sse2";
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  src->dot = src_dot_neon;
+  src->isa = "neon";
+#endif
+#if defined(LHDCV5_ENC_SRC_HAVE_AVX2)
+  if (__builtin_cpu_supports("avx2")) {
+    src->dot = src_dot_avx2;
+    src->isa = "avx2";
+  }
+#endif
+}
+
+
+/*******************************************************************************
+ * filter design
+ ******************************************************************************/
+static uint32_t src_gcd(uint32_t a, uint32_t b)
+{
+  uint32_t t;
+
+  while (b != 0) {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// modified Bessel function of the first kind, order 0
+static double src_bessel_i0(double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+  double q = x * x / 4.0;
+  uint32_t k;
+
+  for (k = 1; k < 64; k++) {
+    term *= q / ((double)k * (double)k);
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+// Kaiser windowed sinc at the up sampled rate, split into phases; every
+// phase is normalized to unity gain at DC so no phase pattern rides on
+// the output
+static void src_design(lhdcv5_enc_src_t *src, uint32_t in_rate, uint32_t out_rate,
+    const lhdcv5_enc_src_preset_t *preset)
+{
+  const uint32_t n = src->up * src->taps;
+  const double center = (double)(n - 1) / 2.0;
+  const double nyquist = (double)((in_rate < out_rate) ? in_rate : out_rate) / 2.0;
+  const double fc = preset->cutoff * nyquist / ((double)src->up * (double)in_rate);
+  const double i0_beta = src_bessel_i0(preset->beta);
+  double x, w, h, sum;
+  uint32_t p, j, m;
+
+  for (p = 0; p < src->up; p++) {
+    sum = 0.0;
+    for (j = 0; j < src->taps; j++) {
+      // the newest history frame meets the first tap of the phase
+      m = p + (src->taps - 1 - j) * src->up;
+      x = ((double)m - center) / center;
+      w = src_bessel_i0(preset->beta * sqrt(fmax(0.0, 1.0 - x * x))) / i0_beta;
+      x = 2.0 * fc * ((double)m - center);
+      h = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+      src->coef[p * src->taps + j] = (float)(h * w);
+      sum += h * w;
+    }
+    for (j = 0; j < src->taps; j++) {
+      src->coef[p * src->taps + j] = (float)(src->coef[p * src->taps + j] / sum);
+    }
+  }
+
+  // linear phase: half the filter length at the up sampled rate
+  src->delay_us = (uint32_t)(center * 1000000.0 / ((double)src->up * (double)in_rate) + 0.5);
+}
+
+
+/*******************************************************************************
+ * converter
+ ******************************************************************************/
+// description
+//   create a converter between two rates
+// Parameter
+//   in_rate: input sample rate (Hz)
+//   out_rate: output sample rate (Hz), the encoder's
+//   quality: filter preset
+//   layout: encoder input layout (S16, S24_PACKED or S32) of input and output
+// return:
+//   the converter, NULL if the ratio or layout is not supported
+lhdcv5_enc_src_t *lhdcv5_enc_src_create(uint32_t in_rate, uint32_t out_rate,
+    lhdcv5_enc_src_quality_t quality, lhdcv5_enc_pcm_layout_t layout)
+{
+  const lhdcv5_enc_src_preset_t *preset = NULL;
+  lhdcv5_enc_src_t *src = NULL;
+  uint32_t g, up, down, hist_frames;
+  uint8_t *buf = NULL;
+
+  if ((in_rate == 0) || (out_rate == 0) || ((uint32_t)quality > LHDCV5_ENC_SRC_HIGH)) {
+    return NULL;
+  }
+  preset = &src_presets[quality];
+
+  g = src_gcd(in_rate, out_rate);
+  up = out_rate / g;
+  down = in_rate / g;
+  if (up > LHDCV5_ENC_SRC_MAX_UP) {
+    return NULL;
+  }
+
+  hist_frames = SRC_HIST_FRAMES(preset->taps, down, up);
+  buf = (uint8_t *)calloc(1, sizeof(lhdcv5_enc_src_t) +
+      (up * preset->taps + LHDCV5_ENC_PCM_CHANNELS * hist_frames) * sizeof(float));
+  if (buf == NULL) {
+    return NULL;
+  }
+
+  src = (lhdcv5_enc_src_t *)buf;
+  src->coef = (float *)(buf + sizeof(lhdcv5_enc_src_t));
+  src->hist[0] = src->coef + up * preset->taps;
+  src->hist[1] = src->hist[0] + hist_frames;
+
+  if (lhdcv5_enc_pcm_conv_init(&src->store, LHDCV5_ENC_PCM_FLOAT, layout, false) != 0) {
+    free(buf);
+    return NULL;
+  }
+
+  src->up = up;
+  src->down = down;
+  src->taps = preset->taps;
+  src->layout = layout;
+  src->frame_bytes = LHDCV5_ENC_PCM_CHANNELS * lhdcv5_enc_pcm_layout_bytes(layout);
+  src_select_dot(src);
+  src_design(src, in_rate, out_rate, preset);
+  lhdcv5_enc_src_reset(src);
+
+  return src;
+}
+
+void lhdcv5_enc_src_destroy(lhdcv5_enc_src_t *src)
+{
+  free(src);
+}
+
+// description
+//   drop the history, the next input starts from silence
+void lhdcv5_enc_src_reset(lhdcv5_enc_src_t *src)
+{
+  if (src == NULL) {
+    return;
+  }
+
+  memset(src->hist[0], 0, (src->taps - 1) * sizeof(float));
+  memset(src->hist[1], 0, (src->taps - 1) * sizeof(float));
+  src->fill = src->taps - 1;
+  src->pos = src->taps - 1;
+  src->phase = 0;
+}
+
+// description
+//   return the most input frames that produce no more than out_frames
+//   output frames
+uint32_t lhdcv5_enc_src_max_input(const lhdcv5_enc_src_t *src, uint32_t out_frames)
+{
+  // output k needs history frame pos + (phase + k * down) / up
+  uint64_t reach = ((uint64_t)out_frames * src->down + src->phase) / src->up;
+  uint64_t avail = src->fill - ((src->pos < src->fill) ? src->pos : src->fill);
+
+  if (src->pos > src->fill) {
+    reach += src->pos - src->fill;
+  }
+  if (reach <= avail) {
+    return 0;
+  }
+  reach -= avail;
+  return (reach > UINT32_MAX) ? UINT32_MAX : (uint32_t)reach;
+}
+
+static void src_load(lhdcv5_enc_src_t *src, const uint8_t *in, uint32_t frames)
+{
+  float *l = src->hist[0] + src->fill;
+  float *r = src->hist[1] + src->fill;
+  uint32_t i;
+
+  switch (src->layout) {
+    case LHDCV5_ENC_PCM_S16:
+      for (i = 0; i < frames; i++) {
+        l[i] = (float)((const int16_t *)in)[2 * i] * (1.0f / 32768.0f);
+        r[i] = (float)((const int16_t *)in)[2 * i + 1] * (1.0f / 32768.0f);
+      }
+      break;
+    case LHDCV5_ENC_PCM_S24_PACKED:
+      for (i = 0; i < frames; i++) {
+        l[i] = (float)((int32_t)(((uint32_t)in[6 * i] << 8) | ((uint32_t)in[6 * i + 1] << 16) |
+            ((uint32_t)in[6 * i + 2] << 24)) >> 8) * (1.0f / 8388608.0f);
+        r[i] = (float)((int32_t)(((uint32_t)in[6 * i + 3] << 8) | ((uint32_t)in[6 * i + 4] << 16) |
+            ((uint32_t)in[6 * i + 5] << 24)) >> 8) * (1.0f / 8388608.0f);
+      }
+      break;
+    case LHDCV5_ENC_PCM_S32:
+    default:
+      for (i = 0; i < frames; i++) {
+        l[i] = (float)((const int32_t *)in)[2 * i] * (1.0f / 2147483648.0f);
+        r[i] = (float)((const int32_t *)in)[2 * i + 1] * (1.0f / 2147483648.0f);
+      }
+      break;
+  }
+  src->fill += frames;
+}
+
+// description
+//   convert stereo frames in the encoder layout; all of the input is
+//   taken, lhdcv5_enc_src_max_input () bounds the output
+// Parameter
+//   src: converter from lhdcv5_enc_src_create
+//   in: input frames
+//   frames: number of input frames
+//   out: output frames
+// return:
+//   number of output frames
+uint32_t lhdcv5_enc_src_process(lhdcv5_enc_src_t *src, const uint8_t *in, uint32_t frames,
+    uint8_t *out)
+{
+  float tmp[LHDCV5_ENC_PCM_CHUNK_SAMPLES];
+  const uint32_t chunk_frames = LHDCV5_ENC_PCM_CHUNK_SAMPLES / LHDCV5_ENC_PCM_CHANNELS;
+  uint32_t produced = 0;
+  uint32_t base, take, n;
+
+  for (;;) {
+    n = 0;
+    while (src->pos < src->fill) {
+      base = src->pos + 1 - src->taps;
+      src->dot(src->coef + src->phase * src->taps, src->hist[0] + base, src->hist[1] + base,
+          src->taps, tmp + LHDCV5_ENC_PCM_CHANNELS * n);
+      src->phase += src->down;
+      src->pos += src->phase / src->up;
+      src->phase %= src->up;
+      if (++n == chunk_frames) {
+        lhdcv5_enc_pcm_convert(&src->store, (const uint8_t *)tmp, 0,
+            out + produced * src->frame_bytes, n);
+        produced += n;
+        n = 0;
+      }
+    }
+    lhdcv5_enc_pcm_convert(&src->store, (const uint8_t *)tmp, 0,
+        out + produced * src->frame_bytes, n);
+    produced += n;
+
+    if (frames == 0) {
+      break;
+    }
+
+    // keep the taps - 1 frames the next output reaches back to
+    base = src->pos + 1 - src->taps;
+    if (base > src->fill) {
+      base = src->fill;
+    }
+    memmove(src->hist[0], src->hist[0] + base, (src->fill - base) * sizeof(float));
+    memmove(src->hist[1], src->hist[1] + base, (src->fill - base) * sizeof(float));
+    src->fill -= base;
+    src->pos -= base;
+
+    take = (frames < LHDCV5_ENC_SRC_CHUNK_FRAMES) ? frames : LHDCV5_ENC_SRC_CHUNK_FRAMES;
+    src_load(src, in, take);
+    in += take * src->frame_bytes;
+    frames -= take;
+  }
+
+  return produced;
+}
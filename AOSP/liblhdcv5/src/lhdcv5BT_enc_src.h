@@ -0,0 +1,68 @@
+/*
+ * lhdcv5BT_enc_src.h
+ *
+ * Polyphase sample rate converter ahead of the LHDC V5 encoder.
+ */
+
+#ifndef LHDCV5BT_ENC_SRC_H
+#define LHDCV5BT_ENC_SRC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lhdcv5BT_enc_pcm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// largest interpolation factor, e.g. 320 for 44.1 kHz -> 96 kHz
+#define LHDCV5_ENC_SRC_MAX_UP           320
+
+// input frames loaded into the history per pass
+#define LHDCV5_ENC_SRC_CHUNK_FRAMES     128
+
+// filter taps per output sample of every quality preset
+#define LHDCV5_ENC_SRC_TAPS_LOW         16
+#define LHDCV5_ENC_SRC_TAPS_MID         32
+#define LHDCV5_ENC_SRC_TAPS_HIGH        64
+
+typedef enum {
+  LHDCV5_ENC_SRC_LOW = 0,
+  LHDCV5_ENC_SRC_MID,
+  LHDCV5_ENC_SRC_HIGH,
+} lhdcv5_enc_src_quality_t;
+
+// stereo dot product of the filter with both history planes
+typedef void (*lhdcv5_enc_src_dot_fn)(const float *coef, const float *left, const float *right,
+    uint32_t taps, float *out);
+
+typedef struct _lhdcv5_enc_src
+{
+  uint32_t up;              // interpolation factor (phases)
+  uint32_t down;            // decimation factor
+  uint32_t taps;            // filter taps per phase
+  uint32_t phase;           // phase of the next output
+  uint32_t pos;             // history frame of the next output
+  uint32_t fill;            // frames in the history
+  uint32_t delay_us;        // group delay of the filter
+  lhdcv5_enc_pcm_layout_t layout; // encoder sample layout, in and out
+  uint32_t frame_bytes;
+  lhdcv5_enc_pcm_conv_t store;    // float -> encoder layout
+  lhdcv5_enc_src_dot_fn dot;
+  const char *isa;          // kernel set picked at init, for logging
+  float *coef;              // up phases of taps, each in history order
+  float *hist[LHDCV5_ENC_PCM_CHANNELS];
+} lhdcv5_enc_src_t;
+
+lhdcv5_enc_src_t *lhdcv5_enc_src_create(uint32_t in_rate, uint32_t out_rate,
+    lhdcv5_enc_src_quality_t quality, lhdcv5_enc_pcm_layout_t layout);
+void lhdcv5_enc_src_destroy(lhdcv5_enc_src_t *src);
+void lhdcv5_enc_src_reset(lhdcv5_enc_src_t *src);
+uint32_t lhdcv5_enc_src_max_input(const lhdcv5_enc_src_t *src, uint32_t out_frames);
+uint32_t lhdcv5_enc_src_process(lhdcv5_enc_src_t *src, const uint8_t *in, uint32_t frames,
+    uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* End of LHDCV5BT_ENC_SRC_H */
@@ -0,0 +1,228 @@
+/*
+ * lhdcv5_dec_pcm_bench.c
+ *
+ * Host benchmark of the V5 decoder output conversion (lhdcv5BT_dec_pcm.c).
+ *
+ * Every decoder layout is converted to every output layout, at unity gain
+ * (integer path) and with a gain (float path), by each kernel set this cpu
+ * supports. The output of each kernel set is compared with the scalar
+ * reference on the same input, which includes full scale and clipping
+ * samples. The run fails when any kernel set differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include "lhdcv5BT_dec_pcm.h"
+
+// 10 ms stereo at 48 kHz, one decoded frame
+#define BENCH_DEF_FRAME_SAMPLES   960
+#define BENCH_DEF_FRAMES          256
+#define BENCH_DEF_RUNS            20
+#define BENCH_GAIN_MB             (-600)
+
+typedef struct
+{
+  lhdcv5_pcm_layout_t layout;
+  const char *name;
+} bench_layout_t;
+
+static const bench_layout_t bench_in[] = {
+  { LHDCV5_PCM_S16, "s16" },
+  { LHDCV5_PCM_S24_IN32, "s24in32" },
+  { LHDCV5_PCM_S32, "s32" },
+};
+
+static const bench_layout_t bench_out[] = {
+  { LHDCV5_PCM_S16, "s16" },
+  { LHDCV5_PCM_S24_IN32, "s24in32" },
+  { LHDCV5_PCM_S32, "s32" },
+  { LHDCV5_PCM_S24_PACKED, "s24p" },
+  { LHDCV5_PCM_FLOAT, "float" },
+};
+
+#define BENCH_NUM(a)  (sizeof(a) / sizeof((a)[0]))
+
+static uint32_t bench_rng = 1;
+
+static uint32_t bench_rand(void)
+{
+  bench_rng = bench_rng * 1664525u + 1013904223u;
+  return bench_rng;
+}
+
+static uint64_t bench_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// decoder frames into slots of the widest layout, converted in place
+static void bench_load(uint8_t *buf, const uint8_t *src, uint32_t frame_samples,
+    uint32_t frames, uint32_t in_bytes)
+{
+  uint32_t f;
+
+  for (f = 0; f < frames; f++) {
+    memcpy(buf + f * frame_samples * 4, src + f * frame_samples * in_bytes,
+        frame_samples * in_bytes);
+  }
+}
+
+// random samples of a decoder layout, the first ones at the range limits
+static void bench_fill(uint8_t *buf, lhdcv5_pcm_layout_t layout, uint32_t samples)
+{
+  static const int32_t edge32[] = { INT32_MIN, INT32_MAX, 0, -1, 1 };
+  static const int32_t edge24[] = { -8388608, 8388607, 0, -1, 1 };
+  static const int16_t edge16[] = { INT16_MIN, INT16_MAX, 0, -1, 1 };
+  uint32_t i;
+
+  for (i = 0; i < samples; i++) {
+    uint32_t r = bench_rand();
+
+    if (layout == LHDCV5_PCM_S16) {
+      int16_t v = (i < BENCH_NUM(edge16)) ? edge16[i] : (int16_t)(r >> 16);
+      memcpy(buf + 2 * i, &v, 2);
+    } else if (layout == LHDCV5_PCM_S24_IN32) {
+      int32_t v = (i < BENCH_NUM(edge24)) ? edge24[i] : ((int32_t)r >> 8);
+      memcpy(buf + 4 * i, &v, 4);
+    } else {
+      int32_t v = (i < BENCH_NUM(edge32)) ? edge32[i] : (int32_t)r;
+      memcpy(buf + 4 * i, &v, 4);
+    }
+  }
+}
+
+static void bench_usage(const char *name)
+{
+  fprintf(stderr,
+      "usage: %s [-f frame_samples] [-n frames] [-r runs]\n"
+      "  -f  samples (all channels) of one converted frame, default %u\n"
+      "  -n  frames converted per timed run, default %u\n"
+      "  -r  timed runs, the fastest is reported, default %u\n",
+      name, BENCH_DEF_FRAME_SAMPLES, BENCH_DEF_FRAMES, BENCH_DEF_RUNS);
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t frame_samples = BENCH_DEF_FRAME_SAMPLES;
+  uint32_t frames = BENCH_DEF_FRAMES;
+  uint32_t runs = BENCH_DEF_RUNS;
+  uint32_t isa_num = lhdcv5_pcm_isa_num();
+  uint32_t samples, buf_bytes;
+  uint32_t fails = 0;
+  uint8_t *src, *ref, *buf;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:n:r:h")) != -1) {
+    switch (opt) {
+      case 'f':
+        frame_samples = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'n':
+        frames = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'r':
+        runs = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      default:
+        bench_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if ((frame_samples == 0) || (frames == 0) || (runs == 0)) {
+    bench_usage(argv[0]);
+    return 1;
+  }
+
+  samples = frame_samples * frames;
+  buf_bytes = samples * 4;
+  src = malloc(buf_bytes);
+  ref = malloc(buf_bytes);
+  buf = malloc(buf_bytes);
+  if ((src == NULL) || (ref == NULL) || (buf == NULL)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  printf("kernel sets:");
+  for (uint32_t k = 0; k < isa_num; k++) {
+    printf(" %s", lhdcv5_pcm_isa_name(k));
+  }
+  printf("\n%u samples per frame, %u frames per run, best of %u runs\n\n",
+      frame_samples, frames, runs);
+  printf("%-8s %-8s %-5s %-5s %10s %9s  %s\n",
+      "in", "out", "gain", "isa", "Msmpl/s", "ns/frame", "vs c");
+
+  for (uint32_t i = 0; i < BENCH_NUM(bench_in); i++) {
+    bench_fill(src, bench_in[i].layout, samples);
+
+    for (uint32_t o = 0; o < BENCH_NUM(bench_out); o++) {
+      for (uint32_t g = 0; g < 2; g++) {
+        int32_t gain_mb = (g == 0) ? 0 : BENCH_GAIN_MB;
+        uint32_t out_bytes = lhdcv5_pcm_layout_bytes(bench_out[o].layout);
+
+        for (uint32_t k = 0; k < isa_num; k++) {
+          lhdcv5_pcm_conv_t conv;
+          uint64_t best = UINT64_MAX;
+          const char *check = "ref";
+
+          lhdcv5_pcm_conv_init_isa(&conv, bench_in[i].layout, bench_out[o].layout,
+              gain_mb, false, k);
+          if (!conv.active) {
+            break;
+          }
+
+          for (uint32_t r = 0; r < runs; r++) {
+            uint64_t t0, t1;
+
+            bench_load(buf, src, frame_samples, frames, conv.in_bytes);
+            t0 = bench_now_ns();
+            for (uint32_t f = 0; f < frames; f++) {
+              lhdcv5_pcm_convert(&conv, buf + f * frame_samples * 4, frame_samples);
+            }
+            t1 = bench_now_ns();
+            if ((t1 - t0) < best) {
+              best = t1 - t0;
+            }
+          }
+
+          // the last run left every frame converted, compare with the reference;
+          // bytes past out_bytes of a slot are stale input and not compared
+          for (uint32_t f = 0; f < frames; f++) {
+            memset(buf + f * frame_samples * 4 + frame_samples * out_bytes, 0,
+                frame_samples * (4 - out_bytes));
+          }
+          if (k == 0) {
+            memcpy(ref, buf, buf_bytes);
+          } else if (memcmp(ref, buf, buf_bytes) == 0) {
+            check = "same";
+          } else {
+            check = "DIFF";
+            fails++;
+          }
+
+          printf("%-8s %-8s %-5d %-5s %10.1f %9.0f  %s\n",
+              bench_in[i].name, bench_out[o].name, gain_mb, conv.isa,
+              (double)samples * 1000.0 / (double)best,
+              (double)best / (double)frames, check);
+        }
+      }
+    }
+  }
+
+  printf("\n%u kernel mismatches\n", fails);
+
+  free(src);
+  free(ref);
+  free(buf);
+
+  return (fails == 0) ? 0 : 1;
+}
@@ -5,6 +5,7 @@ extern "C" {
 #endif
 
 #include "lhdcv5_util_dec.h"
+#include "lhdc_dec_trace.h"
 
 #define LHDCV5BT_SAMPLE_RATE_44K    (44100)
 #define LHDCV5BT_SAMPLE_RATE_48K    (48000)
@@ -28,6 +29,30 @@ extern "C" {
 #define LHDCV5BT_FRAME_DUR_5MS   (50)
 #define LHDCV5BT_FRAME_DUR_10MS  (100)
 
+// pcm layout written by the decoder wrapper
+typedef enum
+{
+  LHDCV5BT_DEC_OUT_FMT_NATIVE = 0,    // as decoded: s16 for 16 bit, s24/s32 in 32-bit words otherwise
+  LHDCV5BT_DEC_OUT_FMT_S16,           // int16
+  LHDCV5BT_DEC_OUT_FMT_S24_PACKED,    // 3 bytes per sample, little endian
+  LHDCV5BT_DEC_OUT_FMT_S32_LJ,        // int32, left-justified
+  LHDCV5BT_DEC_OUT_FMT_FLOAT,         // float32, full scale 1.0
+  LHDCV5BT_DEC_OUT_FMT_MAX,
+} LHDCV5BT_DEC_OUT_FMT_T;
+
+// packet loss concealment applied when the packet sequence number jumps
+typedef enum
+{
+  LHDCV5BT_DEC_PLC_NONE = 0,          // lost packets leave a gap in the output
+  LHDCV5BT_DEC_PLC_REPEAT_FADE,       // repeat the last good frame, fading out
+  LHDCV5BT_DEC_PLC_MAX,
+} LHDCV5BT_DEC_PLC_MODE_T;
+
+// concealed frames needed to fade from full scale to silence
+#define LHDCV5BT_DEC_PLC_FADE_FRAMES        (4)
+// default cap of concealed frames per loss event
+#define LHDCV5BT_DEC_PLC_MAX_FRAMES         (32)
+
 typedef struct  
 {
   lhdc_ver_t version;
@@ -35,8 +60,52 @@ typedef struct
   uint32_t bits_depth;
   uint32_t bit_rate;
   uint32_t lossless_enable;
+  uint32_t out_format;          // LHDCV5BT_DEC_OUT_FMT_T, 0 keeps the decoder native layout
+  int32_t  out_gain_mb;         // output gain in millibel (1/100 dB), 0 for unity
+  uint32_t out_dither_enable;   // TPDF dither when reducing 24/32 bit to LHDCV5BT_DEC_OUT_FMT_S16
+  uint32_t plc_mode;            // LHDCV5BT_DEC_PLC_MODE_T
+  uint32_t plc_max_frames;      // cap of concealed frames per loss, 0 for LHDCV5BT_DEC_PLC_MAX_FRAMES
+  uint32_t channel;             // lhdc_channel_t, LEFT/RIGHT decode one half of split (TWS) frames as mono
 } tLHDCV5_DEC_CONFIG;
 
+#define LHDCV5BT_DEC_HDR_BYTES              (2)
+#define LHDCV5BT_DEC_MAX_PACKET_FRAMES      (A2DP_LHDC_HDR_FRAME_NO_MASK >> 2)
+
+typedef struct
+{
+  uint32_t offset;    // byte offset of the frame from the start of the packet
+  uint32_t len;       // frame length (bytes)
+} tLHDCV5_DEC_FRAME_ENTRY;
+
+// index of one A2DP packet, built once by lhdcv5BT_dec_parse_packet
+typedef struct
+{
+  uint8_t  latency;
+  uint8_t  seqno;
+  uint32_t frame_num;       // number of valid entries in frames[]
+  uint32_t payload_bytes;   // total length of all frames, header excluded
+  tLHDCV5_DEC_FRAME_ENTRY frames[LHDCV5BT_DEC_MAX_PACKET_FRAMES];
+} tLHDCV5_DEC_PACKET_DESC;
+
+// one segment of a packet split over several buffers
+typedef struct
+{
+  const uint8_t *base;
+  uint32_t len;
+} tLHDCV5_DEC_IOVEC;
+
+// one packet of a lhdcv5BT_dec_decode_batch call
+typedef struct
+{
+  const uint8_t *data;      // [in] packet, starting at the LHDC header
+  uint32_t len;             // [in] packet length (bytes)
+  uint16_t rtp_seq;         // [in] RTP sequence number, passed through for the caller
+  uint32_t rtp_timestamp;   // [in] RTP timestamp, passed through for the caller
+  int32_t  result;          // [out] LHDCV5BT_DEC_API_RET_T of this packet
+  uint32_t pcm_offset;      // [out] offset (bytes) of this packet's pcm in the output region
+  uint32_t pcm_bytes;       // [out] pcm bytes produced by this packet
+} tLHDCV5_DEC_BATCH_ENTRY;
+
 
 // lib APIs
 int32_t lhdcv5BT_dec_init_decoder(HANDLE_LHDCV5_BT *handle, tLHDCV5_DEC_CONFIG *config);
@@ -44,6 +113,49 @@ int32_t lhdcv5BT_dec_check_frame_data_enough(const uint8_t *frameData, uint32_t
 int32_t lhdcv5BT_dec_decode(const uint8_t *frameData, uint32_t frameBytes, uint8_t* pcmData, uint32_t* pcmBytes, uint32_t bits_depth);
 int32_t lhdcv5BT_dec_deinit_decoder(HANDLE_LHDCV5_BT handle);
 
+// handle-based lib APIs: the wrapper state of a stream lives in the handle
+// returned by lhdcv5BT_dec_init_decoder. The util decoder below it is a
+// single global instance, so only one handle can be live at a time; a second
+// init returns LHDCV5BT_DEC_API_DECODER_BUSY until the first is deinitialized.
+// The legacy check/decode APIs above operate on the live handle.
+int32_t lhdcv5BT_dec_check_frame_data_enough_r(HANDLE_LHDCV5_BT handle, const uint8_t *frameData, uint32_t frameBytes, uint32_t *packetBytes);
+int32_t lhdcv5BT_dec_decode_r(HANDLE_LHDCV5_BT handle, const uint8_t *frameData, uint32_t frameBytes, uint8_t* pcmData, uint32_t* pcmBytes);
+
+// caller-owned memory and in-place reconfiguration: the memory size depends
+// only on version and plc_mode, reconfigure never allocates
+int32_t lhdcv5BT_dec_get_mem_req(const tLHDCV5_DEC_CONFIG *config, uint32_t *memBytes);
+int32_t lhdcv5BT_dec_init_decoder_mem(HANDLE_LHDCV5_BT *handle, tLHDCV5_DEC_CONFIG *config, void *mem, uint32_t memBytes);
+int32_t lhdcv5BT_dec_reconfigure(HANDLE_LHDCV5_BT handle, tLHDCV5_DEC_CONFIG *config);
+
+// output space (bytes) one decoded frame needs with the current configuration
+int32_t lhdcv5BT_dec_get_frame_pcm_bytes(HANDLE_LHDCV5_BT handle, uint32_t *frameBytes);
+// output space (bytes) the next decode of a packet needs, concealment of lost
+// packets ahead of it included; a smaller buffer gets OUTPUT_NOT_ENOUGH
+int32_t lhdcv5BT_dec_get_packet_pcm_bytes(HANDLE_LHDCV5_BT handle, const uint8_t *frameData, uint32_t frameBytes, uint32_t *pcmBytes);
+
+// single-pass packet APIs: parse the header and frame boundaries once, then
+// decode straight from the index without walking the packet again.
+int32_t lhdcv5BT_dec_parse_packet(HANDLE_LHDCV5_BT handle, const uint8_t *frameData, uint32_t frameBytes, tLHDCV5_DEC_PACKET_DESC *desc);
+int32_t lhdcv5BT_dec_decode_packet(HANDLE_LHDCV5_BT handle, const uint8_t *frameData, const tLHDCV5_DEC_PACKET_DESC *desc, uint8_t* pcmData, uint32_t* pcmBytes);
+
+// decode a batch of packets into one contiguous pcm region
+int32_t lhdcv5BT_dec_decode_batch(HANDLE_LHDCV5_BT handle, tLHDCV5_DEC_BATCH_ENTRY *packets, uint32_t packetNum, uint8_t* pcmData, uint32_t* pcmBytes);
+
+// scatter-gather input: the packet is given as a list of segments
+int32_t lhdcv5BT_dec_check_frame_data_enough_iov(HANDLE_LHDCV5_BT handle, const tLHDCV5_DEC_IOVEC *iov, uint32_t iovcnt, uint32_t *packetBytes);
+int32_t lhdcv5BT_dec_decode_iov(HANDLE_LHDCV5_BT handle, const tLHDCV5_DEC_IOVEC *iov, uint32_t iovcnt, uint8_t* pcmData, uint32_t* pcmBytes);
+
+// streaming input: push any slice of an LHDC packet stream, pull whole decoded
+// frames. Incomplete packets are kept and resumed, decoded frames are never
+// decoded again. Corrupt bytes are skipped up to the next packet header, the
+// call that finds them returns LHDCV5BT_DEC_API_FRAME_INFO_FAIL.
+int32_t lhdcv5BT_dec_push_bytes(HANDLE_LHDCV5_BT handle, const uint8_t *data, uint32_t len, uint32_t *consumed);
+int32_t lhdcv5BT_dec_pcm_available(HANDLE_LHDCV5_BT handle, uint32_t *pcmBytes);
+int32_t lhdcv5BT_dec_pull_pcm(HANDLE_LHDCV5_BT handle, uint8_t* pcmData, uint32_t* pcmBytes);
+
+// drain the per-handle trace ring, recs == NULL prints it to the log
+int32_t lhdcv5BT_dec_dump_trace(HANDLE_LHDCV5_BT handle, lhdc_dec_trace_rec_t *recs, uint32_t maxNum, uint32_t *recNum);
+
 #define LHDCBT_DEC_NOT_UPD_SEQ_NO			0
 #define LHDCBT_DEC_UPD_SEQ_NO				1
 
@@ -61,6 +173,7 @@ typedef enum __LHDCV5BT_DEC_API_RET__
   LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH  = -9,
   LHDCV5BT_DEC_API_DECODE_FAIL        = -10,
   LHDCV5BT_DEC_API_ALLOC_MEM_FAIL  = -11,
+  LHDCV5BT_DEC_API_DECODER_BUSY      = -12,
 
 } LHDCV5BT_DEC_API_RET_T;
 
@@ -0,0 +1,69 @@
+#ifndef _LHDCV5BT_DEC_JB_H_
+#define _LHDCV5BT_DEC_JB_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lhdcv5BT_dec.h"
+
+// Adaptive jitter buffer in front of the LHDC V5 decoder.
+//
+// Packets are put in as they arrive from the link and taken out at the
+// playout clock. Order is restored by the 8-bit LHDC sequence number, timing
+// comes from the RTP timestamp. The playout delay follows the measured
+// inter-arrival jitter between min_depth_us and max_depth_us: it grows at
+// once on a late packet and shrinks slowly while the link stays clean.
+// Packets that never arrive are skipped; the decoder sees the sequence gap
+// and conceals it when packet loss concealment is enabled.
+//
+// lhdcv5BT_jb_put and lhdcv5BT_jb_get may be called from different threads.
+
+typedef void * HANDLE_LHDCV5_JB;
+
+// most packets held at once, capacity must be a power of 2 up to this
+#define LHDCV5BT_JB_MAX_PACKETS             (64)
+#define LHDCV5BT_JB_DEF_PACKETS             (32)
+#define LHDCV5BT_JB_DEF_PACKET_BYTES        (1024)
+#define LHDCV5BT_JB_DEF_MIN_DEPTH_US        (20000)
+#define LHDCV5BT_JB_DEF_MAX_DEPTH_US        (200000)
+
+typedef struct
+{
+  uint32_t clock_rate;          // RTP timestamp rate (Hz), the stream sample rate for A2DP
+  uint32_t min_depth_us;        // lowest playout delay, 0 for LHDCV5BT_JB_DEF_MIN_DEPTH_US
+  uint32_t max_depth_us;        // highest playout delay, 0 for LHDCV5BT_JB_DEF_MAX_DEPTH_US
+  uint32_t capacity;            // packets held, 0 for LHDCV5BT_JB_DEF_PACKETS
+  uint32_t max_packet_bytes;    // largest packet accepted, 0 for LHDCV5BT_JB_DEF_PACKET_BYTES
+} tLHDCV5_JB_CONFIG;
+
+typedef struct
+{
+  uint32_t received;            // packets accepted
+  uint32_t played;              // packets handed to the decoder
+  uint32_t skipped;             // packets never received before their playout time
+  uint32_t late;                // packets arrived after their slot was played or skipped
+  uint32_t duplicate;           // packets received twice
+  uint32_t overflow;            // packets dropped to keep the buffer within capacity
+  uint32_t held;                // packets currently buffered
+  uint32_t jitter_us;           // smoothed inter-arrival jitter
+  uint32_t target_depth_us;     // current playout delay
+} tLHDCV5_JB_STATS;
+
+int32_t lhdcv5BT_jb_create(HANDLE_LHDCV5_JB *jb, const tLHDCV5_JB_CONFIG *config);
+int32_t lhdcv5BT_jb_destroy(HANDLE_LHDCV5_JB jb);
+int32_t lhdcv5BT_jb_reset(HANDLE_LHDCV5_JB jb);
+
+// queue one packet (starting at the LHDC header), data is copied
+int32_t lhdcv5BT_jb_put(HANDLE_LHDCV5_JB jb, const uint8_t *data, uint32_t len,
+    uint32_t rtp_timestamp, uint64_t arrival_us);
+
+// decode the next packet due at now_us, *pcmBytes is 0 when none is due
+int32_t lhdcv5BT_jb_get(HANDLE_LHDCV5_JB jb, HANDLE_LHDCV5_BT dec, uint64_t now_us,
+    uint8_t *pcmData, uint32_t *pcmBytes);
+
+int32_t lhdcv5BT_jb_get_stats(HANDLE_LHDCV5_JB jb, tLHDCV5_JB_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _LHDCV5BT_DEC_JB_H_ */
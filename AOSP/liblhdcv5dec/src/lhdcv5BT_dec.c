@@ -3,13 +3,139 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include "lhdcv5BT_dec.h"
+#include "lhdc_dec_trace.h"
+#include "lhdcv5BT_dec_pcm.h"
 
 #define LOG_NDEBUG 0
 #define LOG_TAG "lhdcv5BT_dec"
 #include <cutils/log.h>
 
-static uint8_t serial_no = 0xff;
+// Larger than any LHDC V5 frame (1000 kbps * 10 ms = 1250 bytes).
+#define LHDCV5BT_DEC_BOUNCE_BYTES   2048
+// byte stream accumulation, room for one maximum frame behind decoded-ready ones
+#define LHDCV5BT_DEC_STREAM_BYTES   (2 * LHDCV5BT_DEC_BOUNCE_BYTES)
+// indexed frames waiting for lhdcv5BT_dec_pull_pcm, power of 2
+#define LHDCV5BT_DEC_STREAM_FRAMES  64
+// more than the frame header lhdcv5_util_dec_fetch_frame_info looks at: a
+// header still failing with this many bytes buffered is corrupt, not cut short
+#define LHDCV5BT_DEC_FRAME_INFO_BYTES   16
+
+// unity gain of the concealment fade, Q15
+#define LHDCV5BT_DEC_PLC_UNITY      (1 << 15)
+#define LHDCV5BT_DEC_PLC_STEP       (LHDCV5BT_DEC_PLC_UNITY / LHDCV5BT_DEC_PLC_FADE_FRAMES)
+
+// position inside a scatter-gather packet
+typedef struct
+{
+  const tLHDCV5_DEC_IOVEC *iov;
+  uint32_t iovcnt;
+  uint32_t seg;     // current segment
+  uint32_t pos;     // byte offset in current segment
+} lhdcv5_iov_cursor_t;
+
+// frame index of one scatter-gather packet
+typedef struct
+{
+  uint8_t  seqno;
+  uint32_t frame_num;
+  uint32_t payload_bytes;
+  struct {
+    const uint8_t *ptr;         // frame start, NULL when the frame straddles segments
+    lhdcv5_iov_cursor_t cur;    // frame start as segment position
+    uint32_t len;
+  } frames[LHDCV5BT_DEC_MAX_PACKET_FRAMES];
+} lhdcv5_iov_desc_t;
+
+// frame of the byte stream indexed by lhdcv5BT_dec_push_bytes
+typedef struct
+{
+  uint16_t skip;        // bytes before the frame (packet headers)
+  uint16_t len;         // frame bytes
+  uint32_t conceal;     // frames to conceal before this frame
+} lhdcv5_stream_frame_t;
+
+// byte stream accumulation of lhdcv5BT_dec_push_bytes / lhdcv5BT_dec_pull_pcm
+typedef struct
+{
+  uint32_t rd;              // first byte not yet consumed by decoding
+  uint32_t idx;             // first byte not yet indexed
+  uint32_t wr;              // end of buffered bytes
+  uint32_t frames_left;     // frames of the current packet not yet indexed
+  uint32_t pend_skip;       // header bytes indexed ahead of the next frame
+  uint32_t pend_conceal;    // concealment due ahead of the next frame
+  bool resync;              // looking for a packet header after corrupt bytes
+  uint32_t q_head;
+  uint32_t q_num;
+  uint32_t avail_bytes;     // pcm bytes lhdcv5BT_dec_pull_pcm can produce now
+  lhdcv5_stream_frame_t q[LHDCV5BT_DEC_STREAM_FRAMES];
+  uint8_t acc[LHDCV5BT_DEC_STREAM_BYTES];
+} lhdcv5_stream_t;
+
+// Per-stream decoder state. HANDLE_LHDCV5_BT returned by lhdcv5BT_dec_init_decoder
+// points to one of these; the memory required by the util decoder follows it in
+// the same allocation.
+typedef struct _lhdcv5BT_dec_ctx
+{
+  tLHDCV5_DEC_CONFIG config;
+  lhdc_channel_t channel;
+  uint8_t serial_no;
+  bool seq_synced;          // serial_no holds the successor of a received packet
+  uint32_t last_frame_num;  // frames in the last decoded packet, to size concealment
+  uint32_t frame_samples;   // samples per channel of one decoded frame
+  uint32_t frame_bytes;     // pcm bytes of one frame as written by the util decoder
+  uint32_t out_frame_bytes; // pcm bytes of one frame after output conversion
+  uint32_t slot_bytes;      // output space needed to decode one frame in place
+  lhdcv5_pcm_conv_t pcm_conv;
+  uint8_t *plc_frame;       // native pcm of the last decoded frame, NULL when concealment is off
+  bool plc_valid;
+  uint32_t plc_gain;        // Q15 gain reached by the concealment fade
+  print_log_fp log_cb;
+  uint32_t mem_req_bytes;
+  uint32_t *util_mem;       // memory handed over to lhdcv5_util_init_decoder
+  uint32_t mem_bytes;       // size of the block holding this context
+  bool mem_owned;           // block allocated by lhdcv5BT_dec_init_decoder
+  bool util_ready;          // util decoder initialized with config
+  lhdc_dec_trace_ring_t trace;
+  lhdcv5_iov_desc_t iov_desc;
+  uint8_t bounce[LHDCV5BT_DEC_BOUNCE_BYTES];   // frames straddling iovec segments
+  lhdcv5_stream_t stream;
+} lhdcv5BT_dec_ctx_t;
+
+#define LHDCV5BT_DEC_ALIGN(x)   (((x) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1))
+#define LHDCV5BT_DEC_CTX_BYTES  LHDCV5BT_DEC_ALIGN(sizeof(lhdcv5BT_dec_ctx_t))
+
+// concealment frame buffer, sized for the longest frame (10 ms at 192 kHz,
+// 2 channels in 32-bit words) so any reconfiguration fits
+#define LHDCV5BT_DEC_PLC_BYTES  ((LHDCV5BT_SAMPLE_RATE_192K / 100) * 2 * sizeof(int32_t))
+
+// The util decoder is one global instance (its APIs take no handle), so it
+// belongs to one wrapper instance at a time. The owner is also the instance
+// used by the legacy (handle-less) check/decode APIs.
+static pthread_mutex_t owner_lock = PTHREAD_MUTEX_INITIALIZER;
+static lhdcv5BT_dec_ctx_t *owner_ctx = NULL;
+
+
+// description
+//   pin the instance used by the legacy (handle-less) APIs, owner_lock is held
+//   until unlock_lhdcv5_owner so a concurrent deinit cannot free it meanwhile
+// return:
+//   owner of the util decoder, NULL when none is live
+static lhdcv5BT_dec_ctx_t *lock_lhdcv5_owner(void)
+{
+  pthread_mutex_lock(&owner_lock);
+
+  return owner_ctx;
+}
+
+
+// description
+//   unpin the instance returned by lock_lhdcv5_owner
+static void unlock_lhdcv5_owner(void)
+{
+  pthread_mutex_unlock(&owner_lock);
+}
 
 // description
 //   a function to log in LHDC decoder library
@@ -28,21 +154,20 @@ static void print_log_cb(char *msg)
 // description
 //   check number of frames in one packet and return pointer to first byte of 1st frame in current packet
 // Parameter
+//   frame_num: return number of frames announced by the packet header
+//   seq_no: return sequence number of the packet
 //   input: pointer to input buffer
 //   input_len: length (bytes) of input buffer pointed by input
 //   pLout: pointer to pointer to output buffer
 //   pLlen: length (bytes) of encoded stream in output buffer
-//   upd_seq_no: sequence number type
 // return:
-//   > 0: number of frames in current packet
-//   == 0: No frames in current packet
+//   == 0: succeed
 //   < 0: error
-static int32_t assemble_lhdcv5_packet(uint32_t *frame_num, uint8_t *input, uint32_t input_len,
-    uint8_t **pLout, uint32_t *pLlen, int upd_seq_no)
+static int32_t assemble_lhdcv5_packet(uint32_t *frame_num, uint8_t *seq_no,
+    uint8_t *input, uint32_t input_len, uint8_t **pLout, uint32_t *pLlen)
 {
   uint8_t hdr = 0, seqno = 0xff;
   uint32_t status = 0;
-  uint32_t lhdc_total_frame_nb = 0;
 
   if ((input == NULL) ||
       (pLout == NULL) ||
@@ -51,7 +176,7 @@ static int32_t assemble_lhdcv5_packet(uint32_t *frame_num, uint8_t *input, uint3
     return -1;
   }
 
-  if (input_len < 2) {
+  if (input_len < LHDCV5BT_DEC_HDR_BYTES) {
     ALOGD("%s: input len too small", __func__);
     return -1;
   }
@@ -60,7 +185,7 @@ static int32_t assemble_lhdcv5_packet(uint32_t *frame_num, uint8_t *input, uint3
   input++;
   seqno = (*input);
   input++;
-  input_len -= 2;
+  input_len -= LHDCV5BT_DEC_HDR_BYTES;
 
   //Check latency and update value when changed.
   status = hdr & A2DP_LHDC_HDR_LATENCY_MASK;
@@ -68,55 +193,308 @@ static int32_t assemble_lhdcv5_packet(uint32_t *frame_num, uint8_t *input, uint3
   //Get number of frame in packet.
   status = (hdr & A2DP_LHDC_HDR_FRAME_NO_MASK) >> 2;
 
-  if (status <= 0) {
-    ALOGD("%s: no any frame in packet.", __func__);
-    *frame_num = 0;
+  *seq_no = seqno;
+  *pLlen = input_len;
+  *pLout = input;
+  *frame_num = status;
+
+  return 0;
+}
+
+
+// description
+//   compare sequence number of incoming packet with the expected one
+// Parameter
+//   ctx: decoder instance owning the sequence number
+//   seqno: sequence number of incoming packet
+//   upd_seq_no: LHDCBT_DEC_UPD_SEQ_NO to take the packet as the latest one,
+//     LHDCBT_DEC_NOT_UPD_SEQ_NO to only look at it
+// return:
+//   number of packets lost in between, 0 for the first packet and for jumps
+//   backwards (reordered or restarted stream)
+static uint32_t check_lhdcv5_seq_no(lhdcv5BT_dec_ctx_t *ctx, uint8_t seqno, int upd_seq_no)
+{
+  uint32_t lost = 0;
+
+  if (seqno != ctx->serial_no) {
+    if (upd_seq_no == LHDCBT_DEC_UPD_SEQ_NO) {
+      LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_WARN, LHDC_DEC_TRACE_EVT_PACKET_LOST,
+          seqno, ctx->serial_no);
+    }
+
+    if (ctx->seq_synced) {
+      lost = (uint8_t)(seqno - ctx->serial_no);
+      if (lost > 0x7f) {
+        lost = 0;
+      }
+    }
+  }
+
+  if (upd_seq_no == LHDCBT_DEC_UPD_SEQ_NO) {
+    ctx->serial_no = seqno + 1;
+    ctx->seq_synced = true;
+  }
+
+  return lost;
+}
+
+
+// description
+//   apply a linear gain ramp to one frame of native pcm
+// Parameter
+//   ctx: decoder instance
+//   pcm: native pcm of one frame
+//   g0: Q15 gain at the first sample
+//   g1: Q15 gain after the last sample
+static void fade_lhdcv5_native(lhdcv5BT_dec_ctx_t *ctx, uint8_t *pcm, uint32_t g0, uint32_t g1)
+{
+  uint32_t n = ctx->frame_samples;
+  uint32_t ch = ctx->frame_bytes / (n * ctx->pcm_conv.in_bytes);
+  int32_t g = (int32_t)(g0 << 8);
+  int32_t step = (((int32_t)g1 - (int32_t)g0) * 256) / (int32_t)n;
+  uint32_t i, c;
+
+  if ((g0 == 0) && (g1 == 0)) {
+    memset(pcm, 0, ctx->frame_bytes);
+    return;
+  }
+
+  if (ctx->pcm_conv.in_bytes == 2) {
+    int16_t *p = (int16_t *)pcm;
+    for (i = 0; i < n; i++, g += step) {
+      for (c = 0; c < ch; c++, p++) {
+        *p = (int16_t)(((int32_t)*p * (g >> 8)) >> 15);
+      }
+    }
+  } else {
+    int32_t *p = (int32_t *)pcm;
+    for (i = 0; i < n; i++, g += step) {
+      for (c = 0; c < ch; c++, p++) {
+        *p = (int32_t)(((int64_t)*p * (g >> 8)) >> 15);
+      }
+    }
+  }
+}
+
+
+// description
+//   number of lost frames conceal_lhdcv5_frames writes pcm for: none until a
+//   good frame has been decoded
+// Parameter
+//   ctx: decoder instance
+//   lost_frames: number of frames to conceal, from count_lhdcv5_lost_frames
+// return:
+//   number of concealment frames produced
+static uint32_t conceal_lhdcv5_frame_num(const lhdcv5BT_dec_ctx_t *ctx, uint32_t lost_frames)
+{
+  if ((ctx->plc_frame == NULL) || !ctx->plc_valid) {
     return 0;
   }
 
-  lhdc_total_frame_nb = status;
+  return lost_frames;
+}
+
+
+// description
+//   emit concealment pcm for frames lost before the current packet: the last
+//   good frame is repeated while fading out, then silence keeps the cadence
+// Parameter
+//   ctx: decoder instance
+//   lost_frames: number of frames to conceal, from count_lhdcv5_lost_frames
+//   pcmData: pointer to output position
+//   pcmSpaceBytes: space (bytes) available for concealment
+//   pcmBytes: return length (bytes) of concealment pcm written
+static void conceal_lhdcv5_frames(lhdcv5BT_dec_ctx_t *ctx, uint32_t lost_frames,
+    uint8_t *pcmData, uint32_t pcmSpaceBytes, uint32_t *pcmBytes)
+{
+  uint32_t num, i, g1;
+  uint8_t *out;
+
+  *pcmBytes = 0;
+
+  num = conceal_lhdcv5_frame_num(ctx, lost_frames);
+  if (num == 0) {
+    return;
+  }
+
+  if (num > (pcmSpaceBytes / ctx->slot_bytes)) {
+    num = pcmSpaceBytes / ctx->slot_bytes;
+  }
+
+  for (i = 0; i < num; i++)
+  {
+    out = pcmData + *pcmBytes;
+    memcpy(out, ctx->plc_frame, ctx->frame_bytes);
+
+    g1 = (ctx->plc_gain > LHDCV5BT_DEC_PLC_STEP) ? (ctx->plc_gain - LHDCV5BT_DEC_PLC_STEP) : 0;
+    fade_lhdcv5_native(ctx, out, ctx->plc_gain, g1);
+    ctx->plc_gain = g1;
+
+    if (ctx->pcm_conv.active) {
+      lhdcv5_pcm_convert(&ctx->pcm_conv, out, ctx->frame_bytes / ctx->pcm_conv.in_bytes);
+    }
+    *pcmBytes += ctx->out_frame_bytes;
+  }
+
+  LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_WARN, LHDC_DEC_TRACE_EVT_CONCEAL,
+      num, lost_frames);
+}
+
 
-  if (seqno != serial_no) {
-    ALOGD("%s: packet lost! now(%d), expect(%d)", __func__, seqno, serial_no);
-    //serial_no = seqno;
-    //return -1;
+// description
+//   sequence check of a packet about to be decoded
+// Parameter
+//   ctx: decoder instance
+//   seqno: sequence number of the packet
+//   frame_num: number of frames in the packet
+//   upd_seq_no: LHDCBT_DEC_UPD_SEQ_NO to take the packet, LHDCBT_DEC_NOT_UPD_SEQ_NO
+//     to only look at it
+// return:
+//   number of frames to conceal ahead of the packet, 0 when concealment is off
+static uint32_t count_lhdcv5_lost_frames(lhdcv5BT_dec_ctx_t *ctx, uint8_t seqno,
+    uint32_t frame_num, int upd_seq_no)
+{
+  uint32_t lost;
+  uint32_t frames = 0;
+  uint32_t max_frames;
+
+  lost = check_lhdcv5_seq_no(ctx, seqno, upd_seq_no);
+  if ((lost > 0) && (ctx->plc_frame != NULL)) {
+    frames = lost * ((ctx->last_frame_num != 0) ? ctx->last_frame_num : frame_num);
+    max_frames = (ctx->config.plc_max_frames != 0) ?
+        ctx->config.plc_max_frames : LHDCV5BT_DEC_PLC_MAX_FRAMES;
+    if (frames > max_frames) {
+      frames = max_frames;
+    }
   }
 
   if (upd_seq_no == LHDCBT_DEC_UPD_SEQ_NO) {
-    serial_no = seqno + 1;
+    ctx->last_frame_num = frame_num;
   }
 
-  *pLlen = input_len;
-  *pLout = input;
+  return frames;
+}
 
-  *frame_num = (int) lhdc_total_frame_nb;
 
-  ALOGD("%s: total frame number (%d)", __func__, *frame_num);
-  return 0;
+// description
+//   start decoding a packet: conceals the frames of packets lost before it
+//   ahead of its own frames
+// Parameter
+//   ctx: decoder instance
+//   seqno: sequence number of the packet
+//   frame_num: number of frames in the packet
+//   pcmData: pointer to output position
+//   pcmSpaceBytes: space (bytes) left at output position
+//   pcmBytes: return length (bytes) of concealment pcm written
+// return:
+//   == 0: succeed
+//   LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH: the concealment and the frames of the
+//     packet do not fit, nothing is consumed so the packet can be passed again
+//     with the space lhdcv5BT_dec_get_packet_pcm_bytes returns
+static int32_t start_lhdcv5_packet(lhdcv5BT_dec_ctx_t *ctx, uint8_t seqno, uint32_t frame_num,
+    uint8_t *pcmData, uint32_t pcmSpaceBytes, uint32_t *pcmBytes)
+{
+  uint32_t conceal_frames;
+  uint32_t need;
+
+  *pcmBytes = 0;
+
+  conceal_frames = conceal_lhdcv5_frame_num(ctx,
+      count_lhdcv5_lost_frames(ctx, seqno, frame_num, LHDCBT_DEC_NOT_UPD_SEQ_NO));
+  need = (conceal_frames + frame_num) * ctx->slot_bytes;
+  if (need > pcmSpaceBytes) {
+    LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_WARN, LHDC_DEC_TRACE_EVT_OUTPUT_NOT_ENOUGH,
+        need, pcmSpaceBytes);
+    return LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH;
+  }
+
+  conceal_lhdcv5_frames(ctx, count_lhdcv5_lost_frames(ctx, seqno, frame_num, LHDCBT_DEC_UPD_SEQ_NO),
+      pcmData, pcmSpaceBytes, pcmBytes);
+
+  return LHDCV5BT_DEC_API_SUCCEED;
 }
 
 
 // description
-//   init. LHDC V5 decoder
+//   set up output format conversion of a decoder instance from its configuration
 // Parameter
-//   handle: codec handle(ptr for heap) from bt stack
-//   config: configuration for LHDC V5 decoder
+//   ctx: decoder instance, config and frame_bytes already set
 // return:
 //   == 0: succeed
-//   != 0: error code
-int32_t lhdcv5BT_dec_init_decoder(HANDLE_LHDCV5_BT *handle, tLHDCV5_DEC_CONFIG *config)
+//   < 0: error
+static int32_t setup_lhdcv5_pcm_conv(lhdcv5BT_dec_ctx_t *ctx)
 {
-  int32_t func_ret = LHDCV5_UTIL_DEC_SUCCESS;
-  uint32_t mem_req_bytes = 0;
-  HANDLE_LHDCV5_BT hLhdcBT = NULL;
+  lhdcv5_pcm_layout_t in_layout, out_layout;
+
+  switch (ctx->config.bits_depth) {
+    case LHDCV5BT_BIT_DEPTH_16:
+      in_layout = LHDCV5_PCM_S16;
+      break;
+    case LHDCV5BT_BIT_DEPTH_24:
+      in_layout = LHDCV5_PCM_S24_IN32;
+      break;
+    default:
+      in_layout = LHDCV5_PCM_S32;
+      break;
+  }
 
-  ALOGD("%s: decoder lib version = %s", __func__, lhdcv5_util_dec_get_version());
+  switch (ctx->config.out_format) {
+    case LHDCV5BT_DEC_OUT_FMT_S16:
+      out_layout = LHDCV5_PCM_S16;
+      break;
+    case LHDCV5BT_DEC_OUT_FMT_S24_PACKED:
+      out_layout = LHDCV5_PCM_S24_PACKED;
+      break;
+    case LHDCV5BT_DEC_OUT_FMT_S32_LJ:
+      out_layout = LHDCV5_PCM_S32;
+      break;
+    case LHDCV5BT_DEC_OUT_FMT_FLOAT:
+      out_layout = LHDCV5_PCM_FLOAT;
+      break;
+    case LHDCV5BT_DEC_OUT_FMT_NATIVE:
+    default:
+      out_layout = in_layout;
+      break;
+  }
 
-  if (handle == NULL || config == NULL) {
-    ALOGD("%s: null ptr handle %p config %p", __func__, handle, config);
+  if (lhdcv5_pcm_conv_init(&ctx->pcm_conv, in_layout, out_layout, ctx->config.out_gain_mb,
+      ctx->config.out_dither_enable != 0) != 0) {
     return LHDCV5BT_DEC_API_INVALID_INPUT;
   }
 
+  ctx->out_frame_bytes = ctx->frame_bytes / ctx->pcm_conv.in_bytes * ctx->pcm_conv.out_bytes;
+  ctx->slot_bytes = (ctx->out_frame_bytes > ctx->frame_bytes) ? ctx->out_frame_bytes : ctx->frame_bytes;
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   drop everything buffered by lhdcv5BT_dec_push_bytes
+static void reset_lhdcv5_stream(lhdcv5_stream_t *st)
+{
+  st->rd = 0;
+  st->idx = 0;
+  st->wr = 0;
+  st->frames_left = 0;
+  st->pend_skip = 0;
+  st->pend_conceal = 0;
+  st->resync = false;
+  st->q_head = 0;
+  st->q_num = 0;
+  st->avail_bytes = 0;
+}
+
+
+// description
+//   check a decoder configuration
+// Parameter
+//   config: configuration for LHDC V5 decoder
+// return:
+//   == 0: succeed
+//   < 0: error
+static int32_t check_lhdcv5_config(const tLHDCV5_DEC_CONFIG *config)
+{
   ALOGD("%s: bits_depth:%u sample_rate=%u bit_rate=%u version=%d lossless_enable=%d", __func__,
       config->bits_depth, config->sample_rate, config->bit_rate, config->version, config->lossless_enable);
 
@@ -151,149 +529,1023 @@ int32_t lhdcv5BT_dec_init_decoder(HANDLE_LHDCV5_BT *handle, tLHDCV5_DEC_CONFIG *
     return LHDCV5BT_DEC_API_INVALID_INPUT;
   }
 
-  lhdcv5_util_dec_register_log_cb(&print_log_cb);
+  if ((config->out_format >= LHDCV5BT_DEC_OUT_FMT_MAX) ||
+      ((config->out_dither_enable != 0) && (config->out_dither_enable != 1))) {
+    ALOGD("%s: out_format %u dither %u not supported", __func__,
+        config->out_format, config->out_dither_enable);
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  if (config->plc_mode >= LHDCV5BT_DEC_PLC_MAX) {
+    ALOGD("%s: plc_mode %u not supported", __func__, config->plc_mode);
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  if ((config->channel != LHDC_OUTPUT_STEREO) &&
+      (config->channel != LHDC_OUTPUT_LEFT_CAHNNEL) &&
+      (config->channel != LHDC_OUTPUT_RIGHT_CAHNNEL)) {
+    ALOGD("%s: channel %u not supported", __func__, config->channel);
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
 
-  func_ret = lhdcv5_util_dec_get_mem_req(config->version, &mem_req_bytes);
-  if (func_ret != LHDCV5_UTIL_DEC_SUCCESS || mem_req_bytes <= 0) {
+// description
+//   memory layout of a decoder instance: context, util decoder memory, then
+//   the concealment frame when enabled
+// Parameter
+//   config: configuration for LHDC V5 decoder, already checked
+//   utilBytes: return bytes required by the util decoder
+//   memBytes: return total bytes of the instance
+// return:
+//   == 0: succeed
+//   < 0: error
+static int32_t get_lhdcv5_mem_layout(const tLHDCV5_DEC_CONFIG *config, uint32_t *utilBytes,
+    uint32_t *memBytes)
+{
+  int32_t func_ret;
+
+  func_ret = lhdcv5_util_dec_get_mem_req(config->version, utilBytes);
+  if (func_ret != LHDCV5_UTIL_DEC_SUCCESS || *utilBytes <= 0) {
     ALOGW("%s: Fail to get required memory size (%d)!", __func__, func_ret);
     return LHDCV5BT_DEC_API_ALLOC_MEM_FAIL;
   }
 
-  hLhdcBT = (HANDLE_LHDCV5_BT)malloc(mem_req_bytes);
-  if (hLhdcBT == NULL) {
-    ALOGW ("%s: Fail to allocate memory!", __func__);
-    return LHDCV5BT_DEC_API_ALLOC_MEM_FAIL;
+  *memBytes = LHDCV5BT_DEC_CTX_BYTES + LHDCV5BT_DEC_ALIGN(*utilBytes);
+  if (config->plc_mode != LHDCV5BT_DEC_PLC_NONE) {
+    *memBytes += LHDCV5BT_DEC_PLC_BYTES;
   }
 
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   (re)initialize the util decoder and all per-stream state of an instance
+//   from a configuration; the memory layout must already fit the configuration
+// Parameter
+//   ctx: decoder instance
+//   config: configuration for LHDC V5 decoder, already checked
+// return:
+//   == 0: succeed
+//   < 0: error, util decoder left uninitialized
+static int32_t setup_lhdcv5_decoder(lhdcv5BT_dec_ctx_t *ctx, const tLHDCV5_DEC_CONFIG *config)
+{
+  int32_t func_ret;
+
+  ctx->config = *config;
+  ctx->channel = (lhdc_channel_t)config->channel;
+  ctx->serial_no = 0xff;
+  ctx->seq_synced = false;
+  ctx->last_frame_num = 0;
+  ctx->plc_valid = false;
+  ctx->plc_gain = LHDCV5BT_DEC_PLC_UNITY;
+  reset_lhdcv5_stream(&ctx->stream);
+
+  lhdcv5_util_dec_register_log_cb(ctx->log_cb);
+
   ALOGD("%s: init lhdcv5 decoder...", __func__);
   //TODO: send mem_req_bytes for size check
-  func_ret = lhdcv5_util_init_decoder(hLhdcBT, config->bits_depth,
+  func_ret = lhdcv5_util_init_decoder(ctx->util_mem, config->bits_depth,
       config->sample_rate, config->bit_rate, config->lossless_enable, config->version);
   if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
     ALOGW ("%s: failed to init decoder (%d)!", __func__, func_ret);
-    free(hLhdcBT);
     return LHDCV5BT_DEC_API_INIT_DECODER_FAIL;
   }
+  ctx->util_ready = true;
 
-  *handle = hLhdcBT;
-  if ((*handle) == NULL) {
-    ALOGW ("%s: handle return NULL!", __func__);
-    return LHDCV5BT_DEC_API_INIT_DECODER_FAIL;
+  func_ret = lhdcv5_util_dec_channel_selsect(ctx->channel);
+  if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
+    ALOGW ("%s: failed to configure channel (%d)!", __func__, func_ret);
+    func_ret = LHDCV5BT_DEC_API_CHANNEL_SETUP_FAIL;
+    goto fail;
   }
 
-  func_ret = lhdcv5_util_dec_channel_selsect(LHDC_OUTPUT_STEREO);
+  // frame geometry is fixed until the next configuration, query it once
+  func_ret = lhdcv5_util_dec_get_sample_size(&ctx->frame_samples);
   if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
-    ALOGW ("%s: failed to configure channel (%d)!", __func__, func_ret);
-    return LHDCV5BT_DEC_API_CHANNEL_SETUP_FAIL;
+    ALOGW ("%s: fetch frame samples failed (%d)!", __func__, func_ret);
+    func_ret = LHDCV5BT_DEC_API_FRAME_INFO_FAIL;
+    goto fail;
+  }
+
+  if (config->bits_depth == LHDCV5BT_BIT_DEPTH_16) {
+    ctx->frame_bytes = ctx->frame_samples * 2;
+  } else {
+    // 24 or 32
+    ctx->frame_bytes = ctx->frame_samples * 4;
+  }
+  if (ctx->channel == LHDC_OUTPUT_STEREO) {
+    ctx->frame_bytes *= 2;
+  }
+
+  func_ret = setup_lhdcv5_pcm_conv(ctx);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    ALOGW ("%s: output format %u gain %d not supported!", __func__,
+        config->out_format, config->out_gain_mb);
+    goto fail;
   }
 
-  serial_no = 0xff;
+  ctx->plc_frame = NULL;
+  if (config->plc_mode != LHDCV5BT_DEC_PLC_NONE) {
+    if (ctx->frame_bytes > LHDCV5BT_DEC_PLC_BYTES) {
+      ALOGW ("%s: frame %u bytes exceeds concealment buffer!", __func__, ctx->frame_bytes);
+      func_ret = LHDCV5BT_DEC_API_INIT_DECODER_FAIL;
+      goto fail;
+    }
+    ctx->plc_frame = (uint8_t *)ctx->util_mem + LHDCV5BT_DEC_ALIGN(ctx->mem_req_bytes);
+  }
 
-  ALOGD("%s: init lhdcv5 decoder success", __func__);
   return LHDCV5BT_DEC_API_SUCCEED;
+
+fail:
+  lhdcv5_util_dec_destroy();
+  ctx->util_ready = false;
+  return func_ret;
 }
 
 
 // description
-//   check whether all frames of one packet are in buffer?
+//   memory needed by lhdcv5BT_dec_init_decoder_mem for a configuration. The
+//   size depends only on version and plc_mode, so one block serves every
+//   sample rate, bit depth and lossless setting.
 // Parameter
-//   frameData: pointer to input buffer
-//   frameBytes: length (bytes) of input buffer pointed by frameData
-//   packetBytes: return the final number of queued data in decoder lib (for validation)
+//   config: configuration for LHDC V5 decoder
+//   memBytes: return required bytes
 // return:
 //   == 0: succeed
 //   < 0: error
-int32_t lhdcv5BT_dec_check_frame_data_enough(const uint8_t *frameData,
-    uint32_t frameBytes, uint32_t *packetBytes)
+int32_t lhdcv5BT_dec_get_mem_req(const tLHDCV5_DEC_CONFIG *config, uint32_t *memBytes)
 {
-  uint8_t *frameDataStart = (uint8_t *)frameData;
-  uint8_t *in_buf = NULL;
-  uint32_t in_len = 0;
-  uint32_t frame_num = 0;
-  lhdc_frame_Info_t lhdc_frame_Info;
-  uint32_t ptr_offset = 0;
-  int32_t func_ret = LHDCV5_UTIL_DEC_SUCCESS;
+  uint32_t util_bytes = 0;
+  int32_t func_ret;
 
-  if ((frameData == NULL) || (packetBytes == NULL)) {
-    return LHDCV5_UTIL_DEC_ERROR_PARAM;
+  if ((config == NULL) || (memBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
   }
 
-  *packetBytes = 0;
-
-  func_ret = assemble_lhdcv5_packet(&frame_num, frameDataStart, frameBytes, &in_buf, &in_len,
-      LHDCBT_DEC_NOT_UPD_SEQ_NO);
-  if (func_ret < 0 || in_buf == NULL) {
-    ALOGE("%s: failed setup input buffer", __func__);
-    return LHDCV5BT_DEC_API_FAIL;
+  func_ret = check_lhdcv5_config(config);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
   }
 
-  if (frame_num == 0) {
-    return LHDCV5BT_DEC_API_SUCCEED;
-  }
+  return get_lhdcv5_mem_layout(config, &util_bytes, memBytes);
+}
 
-  ALOGD("%s: incoming frame size(%d), decoding size(%d), total frame num(%d)", __func__,
-      frameBytes, in_len, frame_num);
 
-  ptr_offset = 0;
+// description
+//   init. LHDC V5 decoder in caller-owned memory, nothing is allocated.
+//   The memory must stay valid until lhdcv5BT_dec_deinit_decoder.
+// Parameter
+//   handle: return decoder instance, placed at the start of mem
+//   config: configuration for LHDC V5 decoder
+//   mem: 8-byte aligned memory of at least lhdcv5BT_dec_get_mem_req bytes
+//   memBytes: size of mem
+// return:
+//   == 0: succeed
+//   != 0: error code
+int32_t lhdcv5BT_dec_init_decoder_mem(HANDLE_LHDCV5_BT *handle, tLHDCV5_DEC_CONFIG *config,
+    void *mem, uint32_t memBytes)
+{
+  int32_t func_ret = LHDCV5_UTIL_DEC_SUCCESS;
+  uint32_t mem_req_bytes = 0;
+  uint32_t need_bytes = 0;
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)mem;
 
-  while ((frame_num > 0) && (ptr_offset < in_len))
-  {
-    func_ret = lhdcv5_util_dec_fetch_frame_info(in_buf + ptr_offset, in_len, &lhdc_frame_Info);
-    if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
-      ALOGD("%s: fetch frame info fail (%d)", __func__, func_ret);
-      return LHDCV5BT_DEC_API_FRAME_INFO_FAIL;
-    }
+  ALOGD("%s: decoder lib version = %s", __func__, lhdcv5_util_dec_get_version());
 
-    ALOGV("%s: frame_num[%d]: ptr_offset (%d), frame_len (%d)", __func__,
-        (int)frame_num, (int)ptr_offset, (int)lhdc_frame_Info.frame_len);
+  if ((handle == NULL) || (config == NULL) || (mem == NULL) ||
+      (((uintptr_t)mem & (sizeof(uint64_t) - 1)) != 0)) {
+    ALOGD("%s: invalid ptr handle %p config %p mem %p", __func__, handle, config, mem);
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
 
-    if ((ptr_offset + lhdc_frame_Info.frame_len) > in_len) {
-      ALOGD(" %s: frame_num[%d]: Not Enough... ptr_offset(%d), frame_len(%d)",
-          __func__, (int)frame_num, (int)ptr_offset, (int)lhdc_frame_Info.frame_len);
-      return LHDCV5BT_DEC_API_INPUT_NOT_ENOUGH;
-    }
+  func_ret = check_lhdcv5_config(config);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
 
-    ptr_offset += lhdc_frame_Info.frame_len;
+  func_ret = get_lhdcv5_mem_layout(config, &mem_req_bytes, &need_bytes);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
 
-    frame_num--;
+  if (memBytes < need_bytes) {
+    ALOGW("%s: memory %u bytes, %u required!", __func__, memBytes, need_bytes);
+    return LHDCV5BT_DEC_API_ALLOC_MEM_FAIL;
+  }
+
+  // check before touching mem, it may be the live instance itself; the lock
+  // is kept until setup is done so legacy calls never see a partial instance
+  pthread_mutex_lock(&owner_lock);
+  if (owner_ctx != NULL) {
+    pthread_mutex_unlock(&owner_lock);
+    ALOGW("%s: another decoder instance is live!", __func__);
+    return LHDCV5BT_DEC_API_DECODER_BUSY;
+  }
+
+  memset(ctx, 0, sizeof(lhdcv5BT_dec_ctx_t));
+  ctx->log_cb = &print_log_cb;
+  ctx->mem_req_bytes = mem_req_bytes;
+  ctx->util_mem = (uint32_t *)((uint8_t *)ctx + LHDCV5BT_DEC_CTX_BYTES);
+  ctx->mem_bytes = memBytes;
+  ctx->mem_owned = false;
+  lhdc_dec_trace_reset(&ctx->trace);
+
+  func_ret = setup_lhdcv5_decoder(ctx, config);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    pthread_mutex_unlock(&owner_lock);
+    return func_ret;
   }
+  owner_ctx = ctx;
+  pthread_mutex_unlock(&owner_lock);
 
-  *packetBytes = ptr_offset;
+  *handle = (HANDLE_LHDCV5_BT)ctx;
 
+  ALOGD("%s: init lhdcv5 decoder success (frame_samples %u, channel %u, out_format %u, pcm kernels %s)",
+      __func__, ctx->frame_samples, config->channel, config->out_format, ctx->pcm_conv.isa);
   return LHDCV5BT_DEC_API_SUCCEED;
 }
 
 
 // description
-//   decode all frames in one packet
+//   init. LHDC V5 decoder
 // Parameter
-//   frameData: pointer to input buffer from bt stack
-//   frameBytes: length (bytes) of input buffer pointed by frameData
-//   pcmData: pointer to output buffer to bt stack
-//   pcmBytes: length (bytes) of pcm samples in output buffer
-//   bits_depth: bit per sample
+//   handle: codec handle(ptr for heap) from bt stack
+//   config: configuration for LHDC V5 decoder
 // return:
 //   == 0: succeed
-//   < 0: error
-int32_t lhdcv5BT_dec_decode(const uint8_t *frameData, uint32_t frameBytes,
-    uint8_t *pcmData, uint32_t *pcmBytes, uint32_t bits_depth)
+//   != 0: error code
+int32_t lhdcv5BT_dec_init_decoder(HANDLE_LHDCV5_BT *handle, tLHDCV5_DEC_CONFIG *config)
 {
-  uint8_t *frameDataStart = (uint8_t *)frameData;
-  uint32_t dec_sum = 0;
-  uint32_t lhdc_out_len = 0;
-  uint8_t *in_buf = NULL;   //buffer position to input to decode process
-  uint32_t in_len = 0;
-  uint32_t frame_num = 0;
-  lhdc_frame_Info_t lhdc_frame_Info;
-  uint32_t ptr_offset = 0;
-  uint32_t frame_samples;
-  uint32_t frame_bytes;
-  uint32_t pcmSpaceBytes;
   int32_t func_ret = LHDCV5_UTIL_DEC_SUCCESS;
+  uint32_t mem_bytes = 0;
+  void *mem = NULL;
 
-  ALOGV("%s: enter frameBytes %d", __func__, (int)frameBytes);
+  if (handle == NULL || config == NULL) {
+    ALOGD("%s: null ptr handle %p config %p", __func__, handle, config);
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  func_ret = lhdcv5BT_dec_get_mem_req(config, &mem_bytes);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  mem = malloc(mem_bytes);
+  if (mem == NULL) {
+    ALOGW ("%s: Fail to allocate memory!", __func__);
+    return LHDCV5BT_DEC_API_ALLOC_MEM_FAIL;
+  }
+
+  func_ret = lhdcv5BT_dec_init_decoder_mem(handle, config, mem, mem_bytes);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    free(mem);
+    return func_ret;
+  }
+
+  ((lhdcv5BT_dec_ctx_t *)mem)->mem_owned = true;
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   switch an initialized decoder to a new configuration (sample rate, bit
+//   depth, bit rate, lossless, output format) in place. Nothing is freed or
+//   allocated; buffered stream data and concealment history are dropped.
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder(_mem)
+//   config: new configuration for LHDC V5 decoder
+// return:
+//   == 0: succeed
+//   LHDCV5BT_DEC_API_ALLOC_MEM_FAIL: the instance memory is too small for
+//     config (concealment turned on), the previous configuration stays
+//   other < 0: error, the instance must be deinitialized
+int32_t lhdcv5BT_dec_reconfigure(HANDLE_LHDCV5_BT handle, tLHDCV5_DEC_CONFIG *config)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  uint32_t mem_req_bytes = 0;
+  uint32_t need_bytes = 0;
+  int32_t func_ret;
+
+  if ((ctx == NULL) || (config == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  func_ret = check_lhdcv5_config(config);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  func_ret = get_lhdcv5_mem_layout(config, &mem_req_bytes, &need_bytes);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  if ((need_bytes > ctx->mem_bytes) || (mem_req_bytes > ctx->mem_req_bytes)) {
+    ALOGW("%s: memory %u bytes, %u required!", __func__, ctx->mem_bytes, need_bytes);
+    return LHDCV5BT_DEC_API_ALLOC_MEM_FAIL;
+  }
+
+  // the util decoder is rebuilt under owner_lock, out of reach of legacy calls
+  pthread_mutex_lock(&owner_lock);
+  if (ctx->util_ready) {
+    lhdcv5_util_dec_destroy();
+    ctx->util_ready = false;
+  }
+
+  func_ret = setup_lhdcv5_decoder(ctx, config);
+  pthread_mutex_unlock(&owner_lock);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  ALOGD("%s: reconfigured (sample_rate %u bits_depth %u lossless %u channel %u frame_samples %u)",
+      __func__, config->sample_rate, config->bits_depth, config->lossless_enable,
+      config->channel, ctx->frame_samples);
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   output space one decoded frame needs: native pcm of the configured
+//   channels, or the converted layout when that is larger
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   frameBytes: return bytes per frame
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_get_frame_pcm_bytes(HANDLE_LHDCV5_BT handle, uint32_t *frameBytes)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+
+  if ((ctx == NULL) || (frameBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  *frameBytes = ctx->slot_bytes;
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   output space the next decode of a packet needs: its own frames plus the
+//   concealment of packets lost before it. The packet is not consumed.
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   frameData: pointer to the packet, starting at the LHDC header
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+//   pcmBytes: return bytes of output space
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_get_packet_pcm_bytes(HANDLE_LHDCV5_BT handle, const uint8_t *frameData,
+    uint32_t frameBytes, uint32_t *pcmBytes)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  uint32_t frame_num;
+
+  if ((ctx == NULL) || (frameData == NULL) || (pcmBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  if (frameBytes < LHDCV5BT_DEC_HDR_BYTES) {
+    return LHDCV5BT_DEC_API_INPUT_NOT_ENOUGH;
+  }
+
+  frame_num = (frameData[0] & A2DP_LHDC_HDR_FRAME_NO_MASK) >> 2;
+  *pcmBytes = 0;
+  if (frame_num > 0) {
+    *pcmBytes = (conceal_lhdcv5_frame_num(ctx,
+        count_lhdcv5_lost_frames(ctx, frameData[1], frame_num, LHDCBT_DEC_NOT_UPD_SEQ_NO)) +
+        frame_num) * ctx->slot_bytes;
+  }
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   parse packet header and locate all frames of one packet in a single pass
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   frameData: pointer to input buffer
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+//   desc: return header fields and offset/length of every frame in the packet
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_parse_packet(HANDLE_LHDCV5_BT handle, const uint8_t *frameData,
+    uint32_t frameBytes, tLHDCV5_DEC_PACKET_DESC *desc)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  uint8_t *frameDataStart = (uint8_t *)frameData;
+  uint8_t *in_buf = NULL;
+  uint32_t in_len = 0;
+  uint32_t frame_num = 0;
+  uint8_t seqno = 0;
+  lhdc_frame_Info_t lhdc_frame_Info;
+  uint32_t ptr_offset = 0;
+  int32_t func_ret = LHDCV5_UTIL_DEC_SUCCESS;
+
+  if ((ctx == NULL) || (frameData == NULL) || (desc == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  desc->frame_num = 0;
+  desc->payload_bytes = 0;
+
+  func_ret = assemble_lhdcv5_packet(&frame_num, &seqno, frameDataStart, frameBytes, &in_buf, &in_len);
+  if (func_ret < 0 || in_buf == NULL) {
+    ALOGE("%s: failed setup input buffer", __func__);
+    return LHDCV5BT_DEC_API_FAIL;
+  }
+
+  desc->latency = frameDataStart[0] & A2DP_LHDC_HDR_LATENCY_MASK;
+  desc->seqno = seqno;
+
+  if (frame_num == 0) {
+    LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_NO_FRAME,
+        frameDataStart[0], frameBytes);
+  }
+
+  ptr_offset = 0;
+
+  while ((frame_num > 0) && (ptr_offset < in_len))
+  {
+    func_ret = lhdcv5_util_dec_fetch_frame_info(in_buf + ptr_offset, in_len, &lhdc_frame_Info);
+    if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
+      LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_ERROR, LHDC_DEC_TRACE_EVT_FRAME_INFO_FAIL,
+          func_ret, ptr_offset);
+      return LHDCV5BT_DEC_API_FRAME_INFO_FAIL;
+    }
+
+    if ((ptr_offset + lhdc_frame_Info.frame_len) > in_len) {
+      LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_INFO, LHDC_DEC_TRACE_EVT_INPUT_NOT_ENOUGH,
+          ptr_offset, lhdc_frame_Info.frame_len);
+      return LHDCV5BT_DEC_API_INPUT_NOT_ENOUGH;
+    }
+
+    desc->frames[desc->frame_num].offset = LHDCV5BT_DEC_HDR_BYTES + ptr_offset;
+    desc->frames[desc->frame_num].len = lhdc_frame_Info.frame_len;
+    desc->frame_num++;
+
+    ptr_offset += lhdc_frame_Info.frame_len;
+
+    frame_num--;
+  }
+
+  desc->payload_bytes = ptr_offset;
+
+  LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_PACKET,
+      seqno | (desc->frame_num << 8), frameBytes);
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   check whether all frames of one packet are in buffer?
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   frameData: pointer to input buffer
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+//   packetBytes: return the final number of queued data in decoder lib (for validation)
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_check_frame_data_enough_r(HANDLE_LHDCV5_BT handle,
+    const uint8_t *frameData, uint32_t frameBytes, uint32_t *packetBytes)
+{
+  tLHDCV5_DEC_PACKET_DESC desc;
+  int32_t func_ret;
+
+  if ((handle == NULL) || (frameData == NULL) || (packetBytes == NULL)) {
+    return LHDCV5_UTIL_DEC_ERROR_PARAM;
+  }
+
+  *packetBytes = 0;
+
+  func_ret = lhdcv5BT_dec_parse_packet(handle, frameData, frameBytes, &desc);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  *packetBytes = desc.payload_bytes;
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   check whether all frames of one packet are in buffer, on the live decoder
+//   instance (legacy API)
+// Parameter
+//   frameData: pointer to input buffer
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+//   packetBytes: return the final number of queued data in decoder lib (for validation)
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_check_frame_data_enough(const uint8_t *frameData,
+    uint32_t frameBytes, uint32_t *packetBytes)
+{
+  int32_t func_ret;
+
+  func_ret = lhdcv5BT_dec_check_frame_data_enough_r((HANDLE_LHDCV5_BT)lock_lhdcv5_owner(),
+      frameData, frameBytes, packetBytes);
+  unlock_lhdcv5_owner();
+
+  return func_ret;
+}
+
+
+// description
+//   decode one frame, arguments are not validated
+// Parameter
+//   ctx: decoder instance
+//   in: pointer to the frame
+//   in_len: length (bytes) of the frame
+//   pcmData: pointer to output position
+//   pcmSpaceBytes: space (bytes) left at output position
+//   pcmBytes: return length (bytes) of pcm samples of this frame
+// return:
+//   == 0: succeed
+//   < 0: error
+static int32_t decode_lhdcv5_one_frame(lhdcv5BT_dec_ctx_t *ctx, const uint8_t *in,
+    uint32_t in_len, uint8_t *pcmData, uint32_t pcmSpaceBytes, uint32_t *pcmBytes)
+{
+  uint32_t samples;
+  int32_t func_ret;
+
+  // the util decoder writes native samples first, conversion happens in place
+  if (ctx->slot_bytes > pcmSpaceBytes) {
+    LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_WARN, LHDC_DEC_TRACE_EVT_OUTPUT_NOT_ENOUGH,
+        ctx->slot_bytes, pcmSpaceBytes);
+    return LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH;
+  }
+
+  func_ret = lhdcv5_util_dec_process(pcmData, (uint8_t *)in, in_len, pcmBytes);
+  if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
+    LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_ERROR, LHDC_DEC_TRACE_EVT_DECODE_FAIL,
+        func_ret, in_len);
+    return LHDCV5BT_DEC_API_DECODE_FAIL;
+  }
+
+  if (ctx->plc_frame != NULL) {
+    ctx->plc_valid = (*pcmBytes == ctx->frame_bytes);
+    if (ctx->plc_valid) {
+      memcpy(ctx->plc_frame, pcmData, ctx->frame_bytes);
+      if (ctx->plc_gain < LHDCV5BT_DEC_PLC_UNITY) {
+        // first frame after concealment, fade back in from the level reached
+        fade_lhdcv5_native(ctx, pcmData, ctx->plc_gain, LHDCV5BT_DEC_PLC_UNITY);
+      }
+    }
+    ctx->plc_gain = LHDCV5BT_DEC_PLC_UNITY;
+  }
+
+  if (ctx->pcm_conv.active) {
+    samples = *pcmBytes / ctx->pcm_conv.in_bytes;
+    lhdcv5_pcm_convert(&ctx->pcm_conv, pcmData, samples);
+    *pcmBytes = samples * ctx->pcm_conv.out_bytes;
+  }
+
+  LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_FRAME,
+      in_len, *pcmBytes);
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   decode frames listed in a packet descriptor, arguments are not validated
+// Parameter
+//   ctx: decoder instance
+//   frameData: pointer to input buffer the descriptor was built from
+//   desc: packet descriptor from lhdcv5BT_dec_parse_packet
+//   pcmData: pointer to output buffer
+//   pcmSpaceBytes: size (bytes) of output buffer
+//   pcmBytes: return length (bytes) of pcm samples written to output buffer
+// return:
+//   == 0: succeed
+//   < 0: error
+static int32_t decode_lhdcv5_frames(lhdcv5BT_dec_ctx_t *ctx, const uint8_t *frameData,
+    const tLHDCV5_DEC_PACKET_DESC *desc, uint8_t *pcmData, uint32_t pcmSpaceBytes,
+    uint32_t *pcmBytes)
+{
+  uint32_t dec_sum = 0;
+  uint32_t lhdc_out_len = 0;
+  uint32_t i;
+  int32_t func_ret = LHDCV5BT_DEC_API_SUCCEED;
+
+  *pcmBytes = 0;
+
+  if (desc->frame_num == 0) {
+    return LHDCV5BT_DEC_API_SUCCEED;
+  }
+
+  func_ret = start_lhdcv5_packet(ctx, desc->seqno, desc->frame_num, pcmData, pcmSpaceBytes,
+      &dec_sum);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  for (i = 0; i < desc->frame_num; i++)
+  {
+    func_ret = decode_lhdcv5_one_frame(ctx, frameData + desc->frames[i].offset,
+        desc->frames[i].len, pcmData + dec_sum, pcmSpaceBytes - dec_sum, &lhdc_out_len);
+    if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+      return func_ret;
+    }
+
+    dec_sum += lhdc_out_len;
+  }
+
+  *pcmBytes = dec_sum;
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   decode all frames of one packet already indexed by lhdcv5BT_dec_parse_packet
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   frameData: pointer to input buffer the descriptor was built from
+//   desc: packet descriptor from lhdcv5BT_dec_parse_packet
+//   pcmData: pointer to output buffer to bt stack
+//   pcmBytes: length (bytes) of pcm samples in output buffer
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_decode_packet(HANDLE_LHDCV5_BT handle, const uint8_t *frameData,
+    const tLHDCV5_DEC_PACKET_DESC *desc, uint8_t *pcmData, uint32_t *pcmBytes)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  uint32_t pcmSpaceBytes;
+
+  if ((ctx == NULL) ||
+      (frameData == NULL) ||
+      (desc == NULL) ||
+      (pcmData == NULL) ||
+      (pcmBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  pcmSpaceBytes = *pcmBytes;
+
+  return decode_lhdcv5_frames(ctx, frameData, desc, pcmData, pcmSpaceBytes, pcmBytes);
+}
+
+
+// description
+//   decode all frames in one packet
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   frameData: pointer to input buffer from bt stack
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+//   pcmData: pointer to output buffer to bt stack
+//   pcmBytes: length (bytes) of pcm samples in output buffer
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_decode_r(HANDLE_LHDCV5_BT handle, const uint8_t *frameData,
+    uint32_t frameBytes, uint8_t *pcmData, uint32_t *pcmBytes)
+{
+  tLHDCV5_DEC_PACKET_DESC desc;
+  int32_t func_ret;
+
+  if ((handle == NULL) ||
+      (frameData == NULL) ||
+      (pcmData == NULL) ||
+      (pcmBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  func_ret = lhdcv5BT_dec_parse_packet(handle, frameData, frameBytes, &desc);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    *pcmBytes = 0;
+    return func_ret;
+  }
+
+  return decode_lhdcv5_frames((lhdcv5BT_dec_ctx_t *)handle, frameData, &desc,
+      pcmData, *pcmBytes, pcmBytes);
+}
+
+
+// description
+//   decode several packets into one contiguous pcm region in a single call
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   packets: packet list, per-packet result/pcm_offset/pcm_bytes are filled in
+//   packetNum: number of entries in packets
+//   pcmData: pointer to output buffer
+//   pcmBytes: [in] size of output buffer, [out] total pcm bytes of all packets
+// return:
+//   == 0: all packets processed, see packets[].result for each of them
+//   < 0: error, packets not processed carry LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH;
+//     the first of them was not consumed and can be passed again
+int32_t lhdcv5BT_dec_decode_batch(HANDLE_LHDCV5_BT handle, tLHDCV5_DEC_BATCH_ENTRY *packets,
+    uint32_t packetNum, uint8_t *pcmData, uint32_t *pcmBytes)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  tLHDCV5_DEC_PACKET_DESC desc;
+  uint32_t pcmSpaceBytes;
+  uint32_t dec_sum = 0;
+  uint32_t i;
+  int32_t func_ret;
+
+  if ((ctx == NULL) ||
+      (packets == NULL) ||
+      (pcmData == NULL) ||
+      (pcmBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  pcmSpaceBytes = *pcmBytes;
+  *pcmBytes = 0;
+
+  for (i = 0; i < packetNum; i++) {
+    packets[i].result = LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH;
+    packets[i].pcm_offset = dec_sum;
+    packets[i].pcm_bytes = 0;
+  }
+
+  for (i = 0; i < packetNum; i++)
+  {
+    tLHDCV5_DEC_BATCH_ENTRY *pkt = &packets[i];
+
+    pkt->pcm_offset = dec_sum;
+
+    if (pkt->data == NULL) {
+      pkt->result = LHDCV5BT_DEC_API_INVALID_INPUT;
+      continue;
+    }
+
+    func_ret = lhdcv5BT_dec_parse_packet(handle, pkt->data, pkt->len, &desc);
+    if (func_ret == LHDCV5BT_DEC_API_SUCCEED) {
+      func_ret = decode_lhdcv5_frames(ctx, pkt->data, &desc, pcmData + dec_sum,
+          pcmSpaceBytes - dec_sum, &pkt->pcm_bytes);
+    }
+
+    pkt->result = func_ret;
+
+    if (func_ret == LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH) {
+      // checked before decoding, nothing of this packet was consumed
+      pkt->pcm_bytes = 0;
+      *pcmBytes = dec_sum;
+      return LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH;
+    }
+
+    if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+      pkt->pcm_bytes = 0;
+    }
+
+    dec_sum += pkt->pcm_bytes;
+  }
+
+  *pcmBytes = dec_sum;
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
 
-  if ((frameData == NULL) ||
+
+// description
+//   number of bytes readable without crossing a segment boundary, skips empty segments
+static uint32_t iov_contig(lhdcv5_iov_cursor_t *cur)
+{
+  while ((cur->seg < cur->iovcnt) && (cur->pos >= cur->iov[cur->seg].len)) {
+    cur->seg++;
+    cur->pos = 0;
+  }
+
+  if (cur->seg >= cur->iovcnt) {
+    return 0;
+  }
+
+  return cur->iov[cur->seg].len - cur->pos;
+}
+
+
+// description
+//   copy bytes out of a scatter-gather packet
+// Parameter
+//   cur: read position, advanced only when advance is true
+//   dst: destination
+//   len: bytes to copy
+//   advance: move cur past the copied bytes
+// return:
+//   number of bytes copied
+static uint32_t iov_copy(lhdcv5_iov_cursor_t *cur, uint8_t *dst, uint32_t len, bool advance)
+{
+  lhdcv5_iov_cursor_t c = *cur;
+  uint32_t done = 0;
+  uint32_t avail, n;
+
+  while (done < len) {
+    avail = iov_contig(&c);
+    if (avail == 0) {
+      break;
+    }
+    n = (avail < (len - done)) ? avail : (len - done);
+    memcpy(dst + done, c.iov[c.seg].base + c.pos, n);
+    c.pos += n;
+    done += n;
+  }
+
+  if (advance) {
+    *cur = c;
+  }
+
+  return done;
+}
+
+
+static void iov_skip(lhdcv5_iov_cursor_t *cur, uint32_t len)
+{
+  uint32_t avail, n;
+
+  while (len > 0) {
+    avail = iov_contig(cur);
+    if (avail == 0) {
+      break;
+    }
+    n = (avail < len) ? avail : len;
+    cur->pos += n;
+    len -= n;
+  }
+}
+
+
+// description
+//   locate all frames of a scatter-gather packet. Frames inside one segment are
+//   referenced in place; frames crossing a segment boundary are only marked and
+//   get copied into the bounce buffer when decoded.
+// Parameter
+//   ctx: decoder instance
+//   iov: packet segments, starting at the LHDC header
+//   iovcnt: number of segments
+//   desc: return frame index
+// return:
+//   == 0: succeed
+//   < 0: error
+static int32_t index_lhdcv5_iov(lhdcv5BT_dec_ctx_t *ctx, const tLHDCV5_DEC_IOVEC *iov,
+    uint32_t iovcnt, lhdcv5_iov_desc_t *desc)
+{
+  lhdcv5_iov_cursor_t cur;
+  lhdc_frame_Info_t lhdc_frame_Info;
+  uint8_t hdr[LHDCV5BT_DEC_HDR_BYTES];
+  const uint8_t *ptr;
+  uint32_t total = 0;
+  uint32_t in_len, remain, avail, peek;
+  uint32_t frame_num;
+  uint32_t ptr_offset = 0;
+  uint32_t i;
+  int32_t func_ret;
+
+  for (i = 0; i < iovcnt; i++) {
+    if ((iov[i].base == NULL) && (iov[i].len > 0)) {
+      return LHDCV5BT_DEC_API_INVALID_INPUT;
+    }
+    total += iov[i].len;
+  }
+
+  desc->frame_num = 0;
+  desc->payload_bytes = 0;
+
+  cur.iov = iov;
+  cur.iovcnt = iovcnt;
+  cur.seg = 0;
+  cur.pos = 0;
+
+  if (iov_copy(&cur, hdr, LHDCV5BT_DEC_HDR_BYTES, true) < LHDCV5BT_DEC_HDR_BYTES) {
+    ALOGE("%s: input len too small", __func__);
+    return LHDCV5BT_DEC_API_FAIL;
+  }
+
+  frame_num = (hdr[0] & A2DP_LHDC_HDR_FRAME_NO_MASK) >> 2;
+  desc->seqno = hdr[1];
+  in_len = total - LHDCV5BT_DEC_HDR_BYTES;
+
+  while ((frame_num > 0) && (ptr_offset < in_len))
+  {
+    remain = in_len - ptr_offset;
+    avail = iov_contig(&cur);
+    ptr = cur.iov[cur.seg].base + cur.pos;
+
+    func_ret = lhdcv5_util_dec_fetch_frame_info((uint8_t *)ptr,
+        (avail < remain) ? avail : remain, &lhdc_frame_Info);
+    if ((avail < remain) &&
+        ((func_ret != LHDCV5_UTIL_DEC_SUCCESS) || (lhdc_frame_Info.frame_len > avail))) {
+      // frame crosses the end of this segment, parse it from a linear copy
+      peek = (remain < LHDCV5BT_DEC_BOUNCE_BYTES) ? remain : LHDCV5BT_DEC_BOUNCE_BYTES;
+      iov_copy(&cur, ctx->bounce, peek, false);
+      func_ret = lhdcv5_util_dec_fetch_frame_info(ctx->bounce, peek, &lhdc_frame_Info);
+      ptr = NULL;
+    }
+
+    if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
+      LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_ERROR, LHDC_DEC_TRACE_EVT_FRAME_INFO_FAIL,
+          func_ret, ptr_offset);
+      return LHDCV5BT_DEC_API_FRAME_INFO_FAIL;
+    }
+
+    if (lhdc_frame_Info.frame_len > remain) {
+      LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_INFO, LHDC_DEC_TRACE_EVT_INPUT_NOT_ENOUGH,
+          ptr_offset, lhdc_frame_Info.frame_len);
+      return LHDCV5BT_DEC_API_INPUT_NOT_ENOUGH;
+    }
+
+    if ((ptr == NULL) && (lhdc_frame_Info.frame_len > LHDCV5BT_DEC_BOUNCE_BYTES)) {
+      ALOGE("%s: frame_len %u exceeds bounce buffer", __func__, lhdc_frame_Info.frame_len);
+      return LHDCV5BT_DEC_API_FAIL;
+    }
+
+    desc->frames[desc->frame_num].ptr = ptr;
+    desc->frames[desc->frame_num].cur = cur;
+    desc->frames[desc->frame_num].len = lhdc_frame_Info.frame_len;
+    desc->frame_num++;
+
+    iov_skip(&cur, lhdc_frame_Info.frame_len);
+    ptr_offset += lhdc_frame_Info.frame_len;
+
+    frame_num--;
+  }
+
+  desc->payload_bytes = ptr_offset;
+
+  LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_PACKET,
+      desc->seqno | (desc->frame_num << 8), total);
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   check whether all frames of one scatter-gather packet are present
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   iov: packet segments, starting at the LHDC header
+//   iovcnt: number of segments
+//   packetBytes: return the final number of queued data in decoder lib (for validation)
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_check_frame_data_enough_iov(HANDLE_LHDCV5_BT handle,
+    const tLHDCV5_DEC_IOVEC *iov, uint32_t iovcnt, uint32_t *packetBytes)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  int32_t func_ret;
+
+  if ((ctx == NULL) || (iov == NULL) || (packetBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  *packetBytes = 0;
+
+  func_ret = index_lhdcv5_iov(ctx, iov, iovcnt, &ctx->iov_desc);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  *packetBytes = ctx->iov_desc.payload_bytes;
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   decode all frames of one scatter-gather packet, only frames crossing a
+//   segment boundary are copied
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   iov: packet segments, starting at the LHDC header
+//   iovcnt: number of segments
+//   pcmData: pointer to output buffer
+//   pcmBytes: length (bytes) of pcm samples in output buffer
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_decode_iov(HANDLE_LHDCV5_BT handle, const tLHDCV5_DEC_IOVEC *iov,
+    uint32_t iovcnt, uint8_t *pcmData, uint32_t *pcmBytes)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  lhdcv5_iov_desc_t *desc;
+  lhdcv5_iov_cursor_t cur;
+  const uint8_t *in;
+  uint32_t pcmSpaceBytes;
+  uint32_t dec_sum = 0;
+  uint32_t lhdc_out_len = 0;
+  uint32_t i;
+  int32_t func_ret;
+
+  if ((ctx == NULL) ||
+      (iov == NULL) ||
       (pcmData == NULL) ||
       (pcmBytes == NULL)) {
     return LHDCV5BT_DEC_API_INVALID_INPUT;
@@ -302,83 +1554,390 @@ int32_t lhdcv5BT_dec_decode(const uint8_t *frameData, uint32_t frameBytes,
   pcmSpaceBytes = *pcmBytes;
   *pcmBytes = 0;
 
-  /*
-  if(frameBytes >= 16) {
-    for(int i=0; i<16; i++) {
-      ALOGD(" %s: dumpFrame[%d]= 0x%02X", __func__, i, (int)*(frameDataStart+i));
+  desc = &ctx->iov_desc;
+  func_ret = index_lhdcv5_iov(ctx, iov, iovcnt, desc);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  if (desc->frame_num == 0) {
+    return LHDCV5BT_DEC_API_SUCCEED;
+  }
+
+  func_ret = start_lhdcv5_packet(ctx, desc->seqno, desc->frame_num, pcmData, pcmSpaceBytes,
+      &dec_sum);
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  for (i = 0; i < desc->frame_num; i++)
+  {
+    in = desc->frames[i].ptr;
+    if (in == NULL) {
+      cur = desc->frames[i].cur;
+      iov_copy(&cur, ctx->bounce, desc->frames[i].len, false);
+      in = ctx->bounce;
+    }
+
+    func_ret = decode_lhdcv5_one_frame(ctx, in, desc->frames[i].len,
+        pcmData + dec_sum, pcmSpaceBytes - dec_sum, &lhdc_out_len);
+    if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+      return func_ret;
     }
+
+    dec_sum += lhdc_out_len;
+  }
+
+  *pcmBytes = dec_sum;
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   pass over bytes of the byte stream that are not a frame (packet headers,
+//   corrupt bytes). With no frame indexed they are consumed at once, so they
+//   never hold buffer space.
+// Parameter
+//   st: byte stream
+//   n: number of bytes at st->idx
+static void skip_lhdcv5_stream(lhdcv5_stream_t *st, uint32_t n)
+{
+  st->idx += n;
+
+  if (st->q_num == 0) {
+    st->rd = st->idx;
+    st->pend_skip = 0;
   } else {
-    for(int i=0; i<(int)frameBytes; i++) {
-      ALOGD(" %s: dumpFrame[%d]= 0x%02X", __func__, i, (int)*(frameDataStart+i));
+    st->pend_skip += n;
+  }
+}
+
+
+// description
+//   index complete frames of the byte stream, resuming where the last call
+//   stopped. A corrupt frame header drops the rest of its packet: bytes are
+//   skipped until a packet header is followed by a valid frame header.
+// Parameter
+//   ctx: decoder instance
+// return:
+//   == 0: succeed, incomplete data stays buffered
+//   LHDCV5BT_DEC_API_FRAME_INFO_FAIL: corrupt bytes found, the stream resyncs
+//     on the next packet header
+static int32_t index_lhdcv5_stream(lhdcv5BT_dec_ctx_t *ctx)
+{
+  lhdcv5_stream_t *st = &ctx->stream;
+  lhdcv5_stream_frame_t *f;
+  lhdc_frame_Info_t lhdc_frame_Info;
+  uint32_t avail;
+  uint32_t frame_num;
+  uint32_t conceal;
+  int32_t func_ret;
+  int32_t index_ret = LHDCV5BT_DEC_API_SUCCEED;
+
+  while (st->q_num < LHDCV5BT_DEC_STREAM_FRAMES)
+  {
+    avail = st->wr - st->idx;
+
+    if (st->resync) {
+      if (avail < (LHDCV5BT_DEC_HDR_BYTES + LHDCV5BT_DEC_FRAME_INFO_BYTES)) {
+        break;
+      }
+
+      frame_num = (st->acc[st->idx] & A2DP_LHDC_HDR_FRAME_NO_MASK) >> 2;
+      func_ret = lhdcv5_util_dec_fetch_frame_info(st->acc + st->idx + LHDCV5BT_DEC_HDR_BYTES,
+          avail - LHDCV5BT_DEC_HDR_BYTES, &lhdc_frame_Info);
+      if ((frame_num == 0) || (func_ret != LHDCV5_UTIL_DEC_SUCCESS) ||
+          (lhdc_frame_Info.frame_len == 0) ||
+          (lhdc_frame_Info.frame_len > LHDCV5BT_DEC_BOUNCE_BYTES)) {
+        skip_lhdcv5_stream(st, 1);
+        continue;
+      }
+
+      st->resync = false;
+    }
+
+    if (st->frames_left == 0) {
+      if (avail < LHDCV5BT_DEC_HDR_BYTES) {
+        break;
+      }
+
+      frame_num = (st->acc[st->idx] & A2DP_LHDC_HDR_FRAME_NO_MASK) >> 2;
+      LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_PACKET,
+          st->acc[st->idx + 1] | (frame_num << 8), avail);
+      if (frame_num == 0) {
+        LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_DEBUG, LHDC_DEC_TRACE_EVT_NO_FRAME,
+            st->acc[st->idx], avail);
+      } else {
+        st->pend_conceal += count_lhdcv5_lost_frames(ctx, st->acc[st->idx + 1], frame_num,
+            LHDCBT_DEC_UPD_SEQ_NO);
+      }
+
+      st->frames_left = frame_num;
+      skip_lhdcv5_stream(st, LHDCV5BT_DEC_HDR_BYTES);
+      continue;
+    }
+
+    if (avail == 0) {
+      break;
+    }
+
+    func_ret = lhdcv5_util_dec_fetch_frame_info(st->acc + st->idx, avail, &lhdc_frame_Info);
+    if ((func_ret == LHDCV5_UTIL_DEC_SUCCESS) && (lhdc_frame_Info.frame_len > avail) &&
+        (lhdc_frame_Info.frame_len <= LHDCV5BT_DEC_BOUNCE_BYTES)) {
+      // frame not complete yet
+      break;
     }
+    if ((func_ret != LHDCV5_UTIL_DEC_SUCCESS) && (avail < LHDCV5BT_DEC_FRAME_INFO_BYTES)) {
+      // may be a frame header cut short
+      break;
+    }
+    if ((func_ret != LHDCV5_UTIL_DEC_SUCCESS) || (lhdc_frame_Info.frame_len == 0) ||
+        (lhdc_frame_Info.frame_len > LHDCV5BT_DEC_BOUNCE_BYTES)) {
+      LHDC_DEC_TRACE(&ctx->trace, LHDC_DEC_TRACE_LVL_ERROR, LHDC_DEC_TRACE_EVT_FRAME_INFO_FAIL,
+          func_ret, st->idx);
+      st->frames_left = 0;
+      st->resync = true;
+      skip_lhdcv5_stream(st, 1);
+      index_ret = LHDCV5BT_DEC_API_FRAME_INFO_FAIL;
+      continue;
+    }
+
+    // concealment is produced once a good frame is decoded, by the frame
+    // queued ahead of this one when none is decoded yet
+    conceal = (ctx->plc_valid || (st->q_num > 0)) ? st->pend_conceal : 0;
+
+    f = &st->q[(st->q_head + st->q_num) & (LHDCV5BT_DEC_STREAM_FRAMES - 1)];
+    f->skip = (uint16_t)st->pend_skip;
+    f->len = (uint16_t)lhdc_frame_Info.frame_len;
+    f->conceal = conceal;
+    st->q_num++;
+    st->avail_bytes += (conceal + 1) * ctx->out_frame_bytes;
+
+    st->pend_skip = 0;
+    st->pend_conceal = 0;
+    st->idx += lhdc_frame_Info.frame_len;
+    st->frames_left--;
   }
-   */
 
-  func_ret = assemble_lhdcv5_packet(&frame_num, frameDataStart, frameBytes, &in_buf, &in_len,
-      LHDCBT_DEC_UPD_SEQ_NO);
-  if (func_ret < 0 || in_buf == NULL) {
-    ALOGE("%s: failed setup input buffer", __func__);
-    return LHDCV5BT_DEC_API_FAIL;
+  return index_ret;
+}
+
+
+// description
+//   append bytes of an LHDC packet stream; packets may be split anywhere.
+//   Complete frames are indexed at once, incomplete ones stay buffered until
+//   the rest arrives. Do not mix with the packet decode APIs on one handle.
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   data: pointer to stream bytes
+//   len: number of bytes at data
+//   consumed: return number of bytes taken, less than len when the buffer is
+//     full; pull pcm and push the rest again
+// return:
+//   == 0: succeed
+//   LHDCV5BT_DEC_API_FRAME_INFO_FAIL: corrupt bytes skipped, the bytes are
+//     taken and the stream resyncs on the next packet header
+//   < 0: error
+int32_t lhdcv5BT_dec_push_bytes(HANDLE_LHDCV5_BT handle, const uint8_t *data, uint32_t len,
+    uint32_t *consumed)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  lhdcv5_stream_t *st;
+  uint32_t n;
+
+  if ((ctx == NULL) || ((data == NULL) && (len > 0)) || (consumed == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
   }
 
-  if (frame_num == 0) {
-    return LHDCV5BT_DEC_API_SUCCEED;
+  st = &ctx->stream;
+
+  if ((st->rd > 0) && ((st->wr + len) > LHDCV5BT_DEC_STREAM_BYTES)) {
+    memmove(st->acc, st->acc + st->rd, st->wr - st->rd);
+    st->idx -= st->rd;
+    st->wr -= st->rd;
+    st->rd = 0;
   }
 
-  func_ret = lhdcv5_util_dec_get_sample_size(&frame_samples);
-  if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
-    ALOGD("%s: fetch frame samples failed (%d)", __func__, func_ret);
-    return LHDCV5BT_DEC_API_FRAME_INFO_FAIL;
+  n = LHDCV5BT_DEC_STREAM_BYTES - st->wr;
+  if (n > len) {
+    n = len;
   }
-  ALOGV("%s: output frame samples %d", __func__, (int)frame_samples);
+  memcpy(st->acc + st->wr, data, n);
+  st->wr += n;
+  *consumed = n;
 
-  if (bits_depth == LHDCV5BT_BIT_DEPTH_16) {
-    frame_bytes = frame_samples * 2 * 2;
-  } else {
-    // 24 or 32
-    frame_bytes = frame_samples * 4 * 2;
+  return index_lhdcv5_stream(ctx);
+}
+
+
+// description
+//   number of pcm bytes lhdcv5BT_dec_pull_pcm can produce from the bytes
+//   pushed so far, concealment included
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   pcmBytes: return pcm bytes available
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_pcm_available(HANDLE_LHDCV5_BT handle, uint32_t *pcmBytes)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+
+  if ((ctx == NULL) || (pcmBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
   }
 
-  ptr_offset = 0;
-  dec_sum = 0;
+  *pcmBytes = ctx->stream.avail_bytes;
 
-  while ((frame_num > 0) && (ptr_offset < in_len))
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   decode indexed frames of the byte stream straight into the output buffer,
+//   as many whole frames as fit. Each frame is decoded once.
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   pcmData: pointer to output buffer
+//   pcmBytes: [in] size of output buffer, [out] pcm bytes written
+// return:
+//   == 0: succeed
+//   < 0: error, the failing frame is dropped and pcm before it is returned
+int32_t lhdcv5BT_dec_pull_pcm(HANDLE_LHDCV5_BT handle, uint8_t *pcmData, uint32_t *pcmBytes)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  lhdcv5_stream_t *st;
+  lhdcv5_stream_frame_t *f;
+  uint32_t pcmSpaceBytes;
+  uint32_t dec_sum = 0;
+  uint32_t lhdc_out_len = 0;
+  uint32_t num;
+  int32_t func_ret = LHDCV5BT_DEC_API_SUCCEED;
+
+  if ((ctx == NULL) || (pcmData == NULL) || (pcmBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  st = &ctx->stream;
+  pcmSpaceBytes = *pcmBytes;
+
+  while (st->q_num > 0)
   {
-    func_ret = lhdcv5_util_dec_fetch_frame_info(in_buf + ptr_offset, in_len, &lhdc_frame_Info);
-    if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
-      ALOGD("%s: fetch frame info fail (%d)", __func__, func_ret);
-      return LHDCV5BT_DEC_API_FRAME_INFO_FAIL;
-    }
+    f = &st->q[st->q_head];
 
-    if ((ptr_offset + lhdc_frame_Info.frame_len) > in_len) {
-      return LHDCV5BT_DEC_API_INPUT_NOT_ENOUGH;
+    if ((f->conceal > 0) && (conceal_lhdcv5_frame_num(ctx, f->conceal) == 0)) {
+      // the frame ahead failed to decode, there is nothing to repeat
+      st->avail_bytes -= f->conceal * ctx->out_frame_bytes;
+      f->conceal = 0;
     }
 
-    if ((dec_sum + frame_bytes) > pcmSpaceBytes) {
-      return LHDCV5BT_DEC_API_OUTPUT_NOT_ENOUGH;
+    if (f->conceal > 0) {
+      num = (pcmSpaceBytes - dec_sum) / ctx->slot_bytes;
+      if (num == 0) {
+        break;
+      }
+      if (num > f->conceal) {
+        num = f->conceal;
+      }
+      conceal_lhdcv5_frames(ctx, num, pcmData + dec_sum, pcmSpaceBytes - dec_sum, &lhdc_out_len);
+      dec_sum += lhdc_out_len;
+      f->conceal -= num;
+      st->avail_bytes -= num * ctx->out_frame_bytes;
+      continue;
     }
 
-    //ALOGD("%s: get ptr_offset=%d, dec_sum=%d", __func__, ptr_offset, dec_sum);
-    func_ret = lhdcv5_util_dec_process(
-        ((uint8_t *)pcmData) + dec_sum,
-        in_buf + ptr_offset,
-        lhdc_frame_Info.frame_len,
-        &lhdc_out_len);
-    if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
-      ALOGD("%s: decode fail (%d)", __func__, func_ret);
-      return LHDCV5BT_DEC_API_DECODE_FAIL;
+    if ((pcmSpaceBytes - dec_sum) < ctx->slot_bytes) {
+      break;
     }
 
-    ALOGD("%s: frame_num[%d]: input_frame_len %d output_len %d", __func__,
-        (int)frame_num, (int)lhdc_frame_Info.frame_len, (int)lhdc_out_len);
+    st->rd += f->skip;
+    func_ret = decode_lhdcv5_one_frame(ctx, st->acc + st->rd, f->len,
+        pcmData + dec_sum, pcmSpaceBytes - dec_sum, &lhdc_out_len);
+    st->rd += f->len;
+    st->q_head = (st->q_head + 1) & (LHDCV5BT_DEC_STREAM_FRAMES - 1);
+    st->q_num--;
+    st->avail_bytes -= ctx->out_frame_bytes;
+
+    if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+      break;
+    }
 
-    ptr_offset += lhdc_frame_Info.frame_len;
     dec_sum += lhdc_out_len;
+  }
 
-    frame_num--;
+  if (st->rd == st->wr) {
+    st->rd = 0;
+    st->idx = 0;
+    st->wr = 0;
+  }
+
+  *pcmBytes = dec_sum;
+
+  if (func_ret != LHDCV5BT_DEC_API_SUCCEED) {
+    return func_ret;
+  }
+
+  // frames held back by a full index may fit now
+  return index_lhdcv5_stream(ctx);
+}
+
+
+// description
+//   decode all frames in one packet on the live decoder instance (legacy API)
+// Parameter
+//   frameData: pointer to input buffer from bt stack
+//   frameBytes: length (bytes) of input buffer pointed by frameData
+//   pcmData: pointer to output buffer to bt stack
+//   pcmBytes: length (bytes) of pcm samples in output buffer
+//   bits_depth: bit per sample (unused, taken from the decoder configuration)
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_decode(const uint8_t *frameData, uint32_t frameBytes,
+    uint8_t *pcmData, uint32_t *pcmBytes, uint32_t bits_depth)
+{
+  int32_t func_ret;
+
+  (void)bits_depth;
+
+  func_ret = lhdcv5BT_dec_decode_r((HANDLE_LHDCV5_BT)lock_lhdcv5_owner(), frameData, frameBytes,
+      pcmData, pcmBytes);
+  unlock_lhdcv5_owner();
+
+  return func_ret;
+}
+
+
+// description
+//   drain trace records collected by one decoder instance
+// Parameter
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
+//   recs: output records, NULL to print all pending records to the log instead
+//   maxNum: capacity of recs
+//   recNum: return number of records drained
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_dec_dump_trace(HANDLE_LHDCV5_BT handle, lhdc_dec_trace_rec_t *recs,
+    uint32_t maxNum, uint32_t *recNum)
+{
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
+  uint32_t num;
+
+  if (ctx == NULL) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  if (recs == NULL) {
+    num = lhdc_dec_trace_dump_log(&ctx->trace, LOG_TAG);
+  } else {
+    num = lhdc_dec_trace_drain(&ctx->trace, recs, maxNum);
   }
 
-  *pcmBytes = (uint32_t) dec_sum;
+  if (recNum != NULL) {
+    *recNum = num;
+  }
 
   return LHDCV5BT_DEC_API_SUCCEED;
 }
@@ -387,29 +1946,41 @@ int32_t lhdcv5BT_dec_decode(const uint8_t *frameData, uint32_t frameBytes,
 // description
 //   de-initialize (free) all resources allocated by LHDC V5 decoder
 // Parameter
-//   none
+//   handle: decoder instance from lhdcv5BT_dec_init_decoder
 // return:
 //   == 0: success
 int32_t lhdcv5BT_dec_deinit_decoder(HANDLE_LHDCV5_BT handle)
 {
+  lhdcv5BT_dec_ctx_t *ctx = (lhdcv5BT_dec_ctx_t *)handle;
   int32_t func_ret = 0;
 
-  if(handle == NULL) {
+  if(ctx == NULL) {
     ALOGD("%s: empty handle", __func__);
     return LHDCV5BT_DEC_API_SUCCEED;
   }
 
-  func_ret = lhdcv5_util_dec_destroy();
-  if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
-    ALOGD("%s: deinit decoder error (%d)", __func__, func_ret);
-    return LHDCV5BT_DEC_API_FAIL;
+  // under owner_lock: a legacy call still running on this instance finishes
+  // before the util decoder and the instance go away
+  pthread_mutex_lock(&owner_lock);
+  if (ctx->util_ready) {
+    func_ret = lhdcv5_util_dec_destroy();
+    if (func_ret != LHDCV5_UTIL_DEC_SUCCESS) {
+      pthread_mutex_unlock(&owner_lock);
+      ALOGD("%s: deinit decoder error (%d)", __func__, func_ret);
+      return LHDCV5BT_DEC_API_FAIL;
+    }
+    ctx->util_ready = false;
+  }
+
+  if (owner_ctx == ctx) {
+    owner_ctx = NULL;
   }
+  pthread_mutex_unlock(&owner_lock);
 
-  if(handle) {
+  if (ctx->mem_owned) {
     ALOGD ("%s: free handle %p!", __func__, handle);
-    free(handle);
+    free(ctx);
   }
 
   return LHDCV5BT_DEC_API_SUCCEED;
 }
-
@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "lhdcv5BT_dec_jb.h"
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "lhdcv5BT_dec_jb"
+#include <cutils/log.h>
+
+// packets over which the lowest transit delay is tracked, bounds clock drift
+#define LHDCV5_JB_BASE_WINDOW       (512)
+// playout delay kept per unit of smoothed jitter
+#define LHDCV5_JB_JITTER_MULT       (4)
+// the playout delay closes 1/2^n of its excess per packet when shrinking
+#define LHDCV5_JB_SHRINK_SHIFT      (7)
+
+typedef struct
+{
+  bool used;
+  bool busy;            // handed to the decoder by lhdcv5BT_jb_get
+  uint8_t seqno;
+  uint32_t len;
+  int64_t send_us;      // sender time, from the extended RTP timestamp
+  uint8_t *data;
+} lhdcv5_jb_slot_t;
+
+typedef struct _lhdcv5_jb
+{
+  tLHDCV5_JB_CONFIG config;
+  pthread_mutex_t lock;
+  uint32_t mask;
+  bool started;         // first packet received
+  bool playing;         // first packet handed to the decoder
+  uint8_t next_seq;     // next sequence number to play
+  uint32_t last_ts;     // newest RTP timestamp seen
+  int64_t ext_ts;       // last_ts extended past 32 bits
+  int64_t prev_transit;
+  int64_t base_transit; // lowest arrival - send time in use (us)
+  int64_t win_min_transit;
+  uint32_t win_count;
+  uint32_t jitter_q4;   // smoothed jitter (us), Q4
+  uint32_t target_us;   // playout delay on top of base_transit
+  tLHDCV5_JB_STATS stats;
+  lhdcv5_jb_slot_t slot[LHDCV5BT_JB_MAX_PACKETS];
+} lhdcv5_jb_t;
+
+#define LHDCV5_JB_CTX_BYTES \
+  ((sizeof(lhdcv5_jb_t) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1))
+
+
+// description
+//   clear buffered packets and clock recovery state, lock held
+static void reset_lhdcv5_jb(lhdcv5_jb_t *jb)
+{
+  uint32_t i;
+
+  for (i = 0; i <= jb->mask; i++) {
+    jb->slot[i].used = false;
+    jb->slot[i].busy = false;
+  }
+
+  jb->started = false;
+  jb->playing = false;
+  jb->next_seq = 0;
+  jb->last_ts = 0;
+  jb->ext_ts = 0;
+  jb->prev_transit = 0;
+  jb->base_transit = 0;
+  jb->win_min_transit = INT64_MAX;
+  jb->win_count = 0;
+  jb->jitter_q4 = 0;
+  jb->target_us = jb->config.min_depth_us;
+  memset(&jb->stats, 0, sizeof(jb->stats));
+}
+
+
+// description
+//   create a jitter buffer
+// Parameter
+//   jb: return jitter buffer handle
+//   config: configuration, zero fields take the defaults
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5BT_jb_create(HANDLE_LHDCV5_JB *jb, const tLHDCV5_JB_CONFIG *config)
+{
+  tLHDCV5_JB_CONFIG cfg;
+  lhdcv5_jb_t *ctx;
+  uint8_t *data;
+  uint32_t i;
+
+  if ((jb == NULL) || (config == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  cfg = *config;
+  if (cfg.min_depth_us == 0) {
+    cfg.min_depth_us = LHDCV5BT_JB_DEF_MIN_DEPTH_US;
+  }
+  if (cfg.max_depth_us == 0) {
+    cfg.max_depth_us = LHDCV5BT_JB_DEF_MAX_DEPTH_US;
+  }
+  if (cfg.capacity == 0) {
+    cfg.capacity = LHDCV5BT_JB_DEF_PACKETS;
+  }
+  if (cfg.max_packet_bytes == 0) {
+    cfg.max_packet_bytes = LHDCV5BT_JB_DEF_PACKET_BYTES;
+  }
+
+  if ((cfg.clock_rate == 0) ||
+      (cfg.min_depth_us > cfg.max_depth_us) ||
+      (cfg.capacity > LHDCV5BT_JB_MAX_PACKETS) ||
+      ((cfg.capacity & (cfg.capacity - 1)) != 0)) {
+    ALOGD("%s: invalid config rate %u depth %u..%u capacity %u", __func__,
+        cfg.clock_rate, cfg.min_depth_us, cfg.max_depth_us, cfg.capacity);
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  ctx = (lhdcv5_jb_t *)malloc(LHDCV5_JB_CTX_BYTES + cfg.capacity * cfg.max_packet_bytes);
+  if (ctx == NULL) {
+    ALOGW ("%s: Fail to allocate memory!", __func__);
+    return LHDCV5BT_DEC_API_ALLOC_MEM_FAIL;
+  }
+
+  memset(ctx, 0, sizeof(lhdcv5_jb_t));
+  ctx->config = cfg;
+  ctx->mask = cfg.capacity - 1;
+
+  data = (uint8_t *)ctx + LHDCV5_JB_CTX_BYTES;
+  for (i = 0; i < cfg.capacity; i++) {
+    ctx->slot[i].data = data + i * cfg.max_packet_bytes;
+  }
+
+  if (pthread_mutex_init(&ctx->lock, NULL) != 0) {
+    free(ctx);
+    return LHDCV5BT_DEC_API_FAIL;
+  }
+
+  reset_lhdcv5_jb(ctx);
+
+  *jb = (HANDLE_LHDCV5_JB)ctx;
+
+  ALOGD("%s: rate %u depth %u..%u us, %u x %u bytes", __func__, cfg.clock_rate,
+      cfg.min_depth_us, cfg.max_depth_us, cfg.capacity, cfg.max_packet_bytes);
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+int32_t lhdcv5BT_jb_destroy(HANDLE_LHDCV5_JB jb)
+{
+  lhdcv5_jb_t *ctx = (lhdcv5_jb_t *)jb;
+
+  if (ctx == NULL) {
+    return LHDCV5BT_DEC_API_SUCCEED;
+  }
+
+  pthread_mutex_destroy(&ctx->lock);
+  free(ctx);
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   drop all buffered packets and restart clock recovery, e.g. on stream
+//   restart. Must not run concurrently with lhdcv5BT_jb_get.
+int32_t lhdcv5BT_jb_reset(HANDLE_LHDCV5_JB jb)
+{
+  lhdcv5_jb_t *ctx = (lhdcv5_jb_t *)jb;
+
+  if (ctx == NULL) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+  reset_lhdcv5_jb(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   update jitter and playout delay estimates from one arrival, lock held
+// Parameter
+//   jb: jitter buffer
+//   transit: arrival time - sender time (us) of the packet
+static void update_lhdcv5_jb_delay(lhdcv5_jb_t *jb, int64_t transit)
+{
+  int64_t d = transit - jb->prev_transit;
+  uint64_t want, late;
+
+  jb->prev_transit = transit;
+
+  // RFC 3550 interarrival jitter, J += (|D| - J) / 16
+  if (d < 0) {
+    d = -d;
+  }
+  if (d > (int64_t)jb->config.max_depth_us) {
+    d = jb->config.max_depth_us;
+  }
+  jb->jitter_q4 = jb->jitter_q4 + (uint32_t)d - (jb->jitter_q4 >> 4);
+
+  // the lowest transit is the reference for "on time"; restart the minimum
+  // every window so sender/receiver clock drift is followed
+  if (transit < jb->base_transit) {
+    jb->base_transit = transit;
+  }
+  if (transit < jb->win_min_transit) {
+    jb->win_min_transit = transit;
+  }
+  if (++jb->win_count >= LHDCV5_JB_BASE_WINDOW) {
+    jb->base_transit = jb->win_min_transit;
+    jb->win_min_transit = INT64_MAX;
+    jb->win_count = 0;
+  }
+
+  want = (uint64_t)(jb->jitter_q4 >> 4) * LHDCV5_JB_JITTER_MULT;
+  late = (uint64_t)(transit - jb->base_transit);
+  if (late > want) {
+    // this packet would have been late with a shorter delay
+    want = late;
+  }
+  if (want < jb->config.min_depth_us) {
+    want = jb->config.min_depth_us;
+  }
+  if (want > jb->config.max_depth_us) {
+    want = jb->config.max_depth_us;
+  }
+
+  if (want > jb->target_us) {
+    jb->target_us = (uint32_t)want;
+  } else {
+    jb->target_us -= (jb->target_us - (uint32_t)want) >> LHDCV5_JB_SHRINK_SHIFT;
+  }
+}
+
+
+// description
+//   queue one packet
+// Parameter
+//   jb: jitter buffer from lhdcv5BT_jb_create
+//   data: packet starting at the LHDC header
+//   len: length (bytes) of the packet
+//   rtp_timestamp: RTP timestamp of the media packet
+//   arrival_us: local arrival time (us, monotonic)
+// return:
+//   == 0: succeed
+//   LHDCV5BT_DEC_API_INVALID_SEQ_NO: late (behind the played sequence number with
+//     an older RTP timestamp) or duplicate packet, dropped
+//   < 0: error
+int32_t lhdcv5BT_jb_put(HANDLE_LHDCV5_JB jb, const uint8_t *data, uint32_t len,
+    uint32_t rtp_timestamp, uint64_t arrival_us)
+{
+  lhdcv5_jb_t *ctx = (lhdcv5_jb_t *)jb;
+  lhdcv5_jb_slot_t *s;
+  uint8_t seqno;
+  int32_t dts;
+  int64_t ext_ts, send_us, transit;
+  int32_t dseq;
+  uint32_t i;
+
+  if ((ctx == NULL) || (data == NULL) || (len < LHDCV5BT_DEC_HDR_BYTES)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  if (len > ctx->config.max_packet_bytes) {
+    ALOGD("%s: packet %u bytes exceeds %u", __func__, len, ctx->config.max_packet_bytes);
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  seqno = data[1];
+
+  pthread_mutex_lock(&ctx->lock);
+
+  if (!ctx->started) {
+    ctx->started = true;
+    ctx->next_seq = seqno;
+    ctx->last_ts = rtp_timestamp;
+    ctx->ext_ts = 0;
+    ctx->base_transit = (int64_t)arrival_us;
+    ctx->prev_transit = (int64_t)arrival_us;
+  }
+
+  dts = (int32_t)(rtp_timestamp - ctx->last_ts);
+  ext_ts = ctx->ext_ts + dts;
+  if (dts > 0) {
+    ctx->last_ts = rtp_timestamp;
+    ctx->ext_ts = ext_ts;
+  }
+  send_us = ext_ts * 1000000 / (int64_t)ctx->config.clock_rate;
+  transit = (int64_t)arrival_us - send_us;
+
+  update_lhdcv5_jb_delay(ctx, transit);
+
+  dseq = (int8_t)(uint8_t)(seqno - ctx->next_seq);
+  if ((dseq < 0) && ctx->playing && (dts > 0)) {
+    // newer than every packet seen, so it is 128 or more packets ahead
+    // (outage, sender restart), not late: drop what is held and play on
+    // from this packet
+    for (i = 0; i <= ctx->mask; i++) {
+      s = &ctx->slot[i];
+      if (s->used && !s->busy) {
+        s->used = false;
+        ctx->stats.held--;
+        ctx->stats.overflow++;
+      }
+    }
+    ALOGD("%s: resync seqno %u -> %u", __func__, ctx->next_seq, seqno);
+    ctx->next_seq = seqno;
+    dseq = 0;
+  }
+  if (dseq < 0) {
+    if (ctx->playing) {
+      ctx->stats.late++;
+      pthread_mutex_unlock(&ctx->lock);
+      return LHDCV5BT_DEC_API_INVALID_SEQ_NO;
+    }
+    // nothing played yet, an earlier packet moves the start back
+    ctx->next_seq = seqno;
+    dseq = 0;
+  }
+
+  // keep the window [next_seq, next_seq + capacity) free of older packets
+  while (dseq > (int32_t)ctx->mask) {
+    s = &ctx->slot[ctx->next_seq & ctx->mask];
+    if (s->used && !s->busy && (s->seqno == ctx->next_seq)) {
+      s->used = false;
+      ctx->stats.held--;
+      ctx->stats.overflow++;
+    }
+    ctx->next_seq++;
+    dseq--;
+  }
+
+  s = &ctx->slot[seqno & ctx->mask];
+  if (s->used) {
+    if (s->seqno == seqno) {
+      ctx->stats.duplicate++;
+      pthread_mutex_unlock(&ctx->lock);
+      return LHDCV5BT_DEC_API_INVALID_SEQ_NO;
+    }
+    // slot still being decoded, or left behind by a start moved back
+    if (s->busy) {
+      ctx->stats.overflow++;
+      pthread_mutex_unlock(&ctx->lock);
+      return LHDCV5BT_DEC_API_FAIL;
+    }
+    ctx->stats.held--;
+    ctx->stats.overflow++;
+  }
+
+  memcpy(s->data, data, len);
+  s->len = len;
+  s->seqno = seqno;
+  s->send_us = send_us;
+  s->used = true;
+  ctx->stats.received++;
+  ctx->stats.held++;
+
+  pthread_mutex_unlock(&ctx->lock);
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
+
+
+// description
+//   decode the next packet in sequence order once its playout time is
+//   reached; missing packets before it are skipped for the decoder to conceal
+// Parameter
+//   jb: jitter buffer from lhdcv5BT_jb_create
+//   dec: decoder instance from lhdcv5BT_dec_init_decoder
+//   now_us: current time (us), same clock as arrival_us
+//   pcmData: pointer to output buffer
+//   pcmBytes: [in] size of output buffer, [out] pcm bytes written, 0 when no
+//     packet is due
+// return:
+//   == 0: succeed
+//   < 0: error from the decoder
+int32_t lhdcv5BT_jb_get(HANDLE_LHDCV5_JB jb, HANDLE_LHDCV5_BT dec, uint64_t now_us,
+    uint8_t *pcmData, uint32_t *pcmBytes)
+{
+  lhdcv5_jb_t *ctx = (lhdcv5_jb_t *)jb;
+  lhdcv5_jb_slot_t *s = NULL;
+  uint8_t seq;
+  uint32_t k;
+  int32_t func_ret;
+
+  if ((ctx == NULL) || (dec == NULL) || (pcmData == NULL) || (pcmBytes == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+
+  for (k = 0; ctx->started && (k <= ctx->mask); k++) {
+    seq = (uint8_t)(ctx->next_seq + k);
+    s = &ctx->slot[seq & ctx->mask];
+    if (s->used && !s->busy && (s->seqno == seq)) {
+      break;
+    }
+    s = NULL;
+  }
+
+  if ((s == NULL) ||
+      ((int64_t)now_us < s->send_us + ctx->base_transit + (int64_t)ctx->target_us)) {
+    pthread_mutex_unlock(&ctx->lock);
+    *pcmBytes = 0;
+    return LHDCV5BT_DEC_API_SUCCEED;
+  }
+
+  ctx->stats.skipped += k;
+  ctx->stats.played++;
+  ctx->stats.held--;
+  ctx->next_seq = s->seqno + 1;
+  ctx->playing = true;
+  s->busy = true;
+
+  pthread_mutex_unlock(&ctx->lock);
+
+  func_ret = lhdcv5BT_dec_decode_r(dec, s->data, s->len, pcmData, pcmBytes);
+
+  pthread_mutex_lock(&ctx->lock);
+  s->busy = false;
+  s->used = false;
+  pthread_mutex_unlock(&ctx->lock);
+
+  return func_ret;
+}
+
+
+int32_t lhdcv5BT_jb_get_stats(HANDLE_LHDCV5_JB jb, tLHDCV5_JB_STATS *stats)
+{
+  lhdcv5_jb_t *ctx = (lhdcv5_jb_t *)jb;
+
+  if ((ctx == NULL) || (stats == NULL)) {
+    return LHDCV5BT_DEC_API_INVALID_INPUT;
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+  *stats = ctx->stats;
+  stats->jitter_us = ctx->jitter_q4 >> 4;
+  stats->target_depth_us = ctx->target_us;
+  pthread_mutex_unlock(&ctx->lock);
+
+  return LHDCV5BT_DEC_API_SUCCEED;
+}
@@ -0,0 +1,980 @@
+/*
+ * lhdcv5BT_dec_pcm.c
+ *
+ * Output format conversion of decoded LHDC V5 pcm. Every conversion is split
+ * into a load stage (decoder layout -> intermediate) and a store stage
+ * (intermediate -> output layout), run on chunks of LHDCV5_PCM_CHUNK_SAMPLES
+ * while the frame is still in cache. Integer conversions at unity gain use a
+ * q31 intermediate and are bit exact; gain and float output use float32.
+ *
+ * SSE2, AVX2 and NEON versions exist for the common stages, packed 24 bit and
+ * dithered stores are scalar only.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "lhdcv5BT_dec_pcm.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LHDCV5_PCM_HAVE_AVX2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define LHDCV5_PCM_GAIN_MB_MIN    (-9600)
+#define LHDCV5_PCM_GAIN_MB_MAX    (2400)
+
+// largest float below 2^31, anything above overflows int32 conversion
+#define LHDCV5_PCM_S32_MAX_F      (2147483520.0f)
+
+typedef struct
+{
+  lhdcv5_pcm_load_fn load_q31_s16;
+  lhdcv5_pcm_load_fn load_q31_s32;        // shift by conv->in_shift
+  lhdcv5_pcm_store_fn store_q31_s16;      // rounding, saturating
+  lhdcv5_pcm_store_fn store_q31_s32;      // rounding shift by conv->out_shift, saturating
+  lhdcv5_pcm_load_fn load_f_s16;
+  lhdcv5_pcm_load_fn load_f_s32;
+  lhdcv5_pcm_store_fn store_f_s16;
+  lhdcv5_pcm_store_fn store_f_s32;        // clamp to conv->out_min/out_max
+  const char *name;
+} lhdcv5_pcm_ops_t;
+
+
+/*******************************************************************************
+ * scalar kernels
+ ******************************************************************************/
+static uint32_t pcm_rand(lhdcv5_pcm_conv_t *conv)
+{
+  // xorshift32
+  uint32_t x = conv->rng;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  conv->rng = x;
+
+  return x;
+}
+
+static void load_q31_s16_c(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int16_t *src = (const int16_t *)in;
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i;
+
+  (void)conv;
+  for (i = 0; i < n; i++) {
+    q[i] = (int32_t)((uint32_t)src[i] << 16);
+  }
+}
+
+static void load_q31_s32_c(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *src = (const int32_t *)in;
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    q[i] = (int32_t)((uint32_t)src[i] << conv->in_shift);
+  }
+}
+
+static void store_q31_s16_c(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  int16_t *dst = (int16_t *)out;
+  int32_t v;
+  uint32_t i;
+
+  (void)conv;
+  for (i = 0; i < n; i++) {
+    v = (q[i] >> 16) + ((q[i] >> 15) & 1);
+    dst[i] = (int16_t)((v > INT16_MAX) ? INT16_MAX : v);
+  }
+}
+
+static void store_q31_s16_dither_c(const void *tmp, uint8_t *out, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  int16_t *dst = (int16_t *)out;
+  int64_t v;
+  uint32_t r;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    // triangular noise of +-1 lsb of the 16 bit output
+    r = pcm_rand(conv);
+    v = (int64_t)q[i] + (int64_t)(r & 0xffff) + (int64_t)(r >> 16) - 0xffff;
+    v = (v + 0x8000) >> 16;
+    if (v > INT16_MAX) {
+      v = INT16_MAX;
+    } else if (v < INT16_MIN) {
+      v = INT16_MIN;
+    }
+    dst[i] = (int16_t)v;
+  }
+}
+
+static void store_q31_s32_c(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  int32_t *dst = (int32_t *)out;
+  uint32_t shift = conv->out_shift;
+  int32_t max = (int32_t)(INT32_MAX >> shift);
+  int32_t v;
+  uint32_t i;
+
+  if (shift == 0) {
+    memmove(dst, q, n * sizeof(int32_t));
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    v = (q[i] >> shift) + ((q[i] >> (shift - 1)) & 1);
+    dst[i] = (v > max) ? max : v;
+  }
+}
+
+static void store_q31_s24p_c(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  int32_t v;
+  uint32_t i;
+
+  (void)conv;
+  for (i = 0; i < n; i++) {
+    v = (q[i] >> 8) + ((q[i] >> 7) & 1);
+    if (v > 0x7fffff) {
+      v = 0x7fffff;
+    }
+    out[3 * i + 0] = (uint8_t)v;
+    out[3 * i + 1] = (uint8_t)(v >> 8);
+    out[3 * i + 2] = (uint8_t)(v >> 16);
+  }
+}
+
+static void load_f_s16_c(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int16_t *src = (const int16_t *)in;
+  float *f = (float *)tmp;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    f[i] = (float)src[i] * conv->in_scale;
+  }
+}
+
+static void load_f_s32_c(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *src = (const int32_t *)in;
+  float *f = (float *)tmp;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    f[i] = (float)src[i] * conv->in_scale;
+  }
+}
+
+static inline float pcm_clampf(float v, float lo, float hi)
+{
+  return (v < lo) ? lo : ((v > hi) ? hi : v);
+}
+
+static void store_f_s16_c(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  int16_t *dst = (int16_t *)out;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    dst[i] = (int16_t)lrintf(pcm_clampf(f[i] * conv->out_scale, conv->out_min, conv->out_max));
+  }
+}
+
+static void store_f_s16_dither_c(const void *tmp, uint8_t *out, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  int16_t *dst = (int16_t *)out;
+  uint32_t r;
+  float noise;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    r = pcm_rand(conv);
+    noise = ((float)(r & 0xffff) + (float)(r >> 16)) * (1.0f / 65536.0f) - 1.0f;
+    dst[i] = (int16_t)lrintf(pcm_clampf(f[i] * conv->out_scale + noise,
+        conv->out_min, conv->out_max));
+  }
+}
+
+static void store_f_s32_c(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  int32_t *dst = (int32_t *)out;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    dst[i] = (int32_t)lrintf(pcm_clampf(f[i] * conv->out_scale, conv->out_min, conv->out_max));
+  }
+}
+
+static void store_f_s24p_c(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  int32_t v;
+  uint32_t i;
+
+  for (i = 0; i < n; i++) {
+    v = (int32_t)lrintf(pcm_clampf(f[i] * conv->out_scale, conv->out_min, conv->out_max));
+    out[3 * i + 0] = (uint8_t)v;
+    out[3 * i + 1] = (uint8_t)(v >> 8);
+    out[3 * i + 2] = (uint8_t)(v >> 16);
+  }
+}
+
+static void store_f_f_c(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  (void)conv;
+  memmove(out, tmp, n * sizeof(float));
+}
+
+static const lhdcv5_pcm_ops_t pcm_ops_c = {
+  load_q31_s16_c,
+  load_q31_s32_c,
+  store_q31_s16_c,
+  store_q31_s32_c,
+  load_f_s16_c,
+  load_f_s32_c,
+  store_f_s16_c,
+  store_f_s32_c,
+  "c",
+};
+
+
+/*******************************************************************************
+ * SSE2 kernels
+ ******************************************************************************/
+#if defined(__SSE2__)
+static void load_q31_s16_sse2(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  __m128i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+    // interleaving zeros below each sample is a shift left by 16
+    _mm_storeu_si128((__m128i *)(q + i), _mm_unpacklo_epi16(zero, v));
+    _mm_storeu_si128((__m128i *)(q + i + 4), _mm_unpackhi_epi16(zero, v));
+  }
+  load_q31_s16_c(in + 2 * i, q + i, n - i, conv);
+}
+
+static void load_q31_s32_sse2(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const __m128i shift = _mm_cvtsi32_si128((int)conv->in_shift);
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  __m128i v;
+
+  for (; i + 4 <= n; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(in + 4 * i));
+    _mm_storeu_si128((__m128i *)(q + i), _mm_sll_epi32(v, shift));
+  }
+  load_q31_s32_c(in + 4 * i, q + i, n - i, conv);
+}
+
+static inline __m128i pcm_round_shr_sse2(__m128i v, int shift)
+{
+  const __m128i one = _mm_set1_epi32(1);
+  __m128i s = _mm_cvtsi32_si128(shift);
+  __m128i s1 = _mm_cvtsi32_si128(shift - 1);
+
+  return _mm_add_epi32(_mm_sra_epi32(v, s), _mm_and_si128(_mm_sra_epi32(v, s1), one));
+}
+
+static void store_q31_s16_sse2(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  uint32_t i = 0;
+  __m128i lo, hi;
+
+  for (; i + 8 <= n; i += 8) {
+    lo = pcm_round_shr_sse2(_mm_loadu_si128((const __m128i *)(q + i)), 16);
+    hi = pcm_round_shr_sse2(_mm_loadu_si128((const __m128i *)(q + i + 4)), 16);
+    _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_packs_epi32(lo, hi));
+  }
+  store_q31_s16_c(q + i, out + 2 * i, n - i, conv);
+}
+
+static void store_q31_s32_sse2(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  __m128i max, v, gt;
+  uint32_t i = 0;
+
+  if (conv->out_shift == 0) {
+    store_q31_s32_c(tmp, out, n, conv);
+    return;
+  }
+
+  max = _mm_set1_epi32((int32_t)(INT32_MAX >> conv->out_shift));
+  for (; i + 4 <= n; i += 4) {
+    v = pcm_round_shr_sse2(_mm_loadu_si128((const __m128i *)(q + i)), (int)conv->out_shift);
+    gt = _mm_cmpgt_epi32(v, max);
+    v = _mm_or_si128(_mm_andnot_si128(gt, v), _mm_and_si128(gt, max));
+    _mm_storeu_si128((__m128i *)(out + 4 * i), v);
+  }
+  store_q31_s32_c(q + i, out + 4 * i, n - i, conv);
+}
+
+static void load_f_s16_sse2(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const __m128 scale = _mm_set1_ps(conv->in_scale);
+  float *f = (float *)tmp;
+  uint32_t i = 0;
+  __m128i v, lo, hi;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+    lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(f + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(f + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  load_f_s16_c(in + 2 * i, f + i, n - i, conv);
+}
+
+static void load_f_s32_sse2(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const __m128 scale = _mm_set1_ps(conv->in_scale);
+  float *f = (float *)tmp;
+  uint32_t i = 0;
+  __m128i v;
+
+  for (; i + 4 <= n; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(in + 4 * i));
+    _mm_storeu_ps(f + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  }
+  load_f_s32_c(in + 4 * i, f + i, n - i, conv);
+}
+
+static inline __m128i pcm_cvt_f_sse2(const float *f, __m128 scale, __m128 lo, __m128 hi)
+{
+  __m128 v = _mm_mul_ps(_mm_loadu_ps(f), scale);
+
+  return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, lo), hi));
+}
+
+static void store_f_s16_sse2(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const __m128 scale = _mm_set1_ps(conv->out_scale);
+  const __m128 lo = _mm_set1_ps(conv->out_min);
+  const __m128 hi = _mm_set1_ps(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128((__m128i *)(out + 2 * i),
+        _mm_packs_epi32(pcm_cvt_f_sse2(f + i, scale, lo, hi),
+                        pcm_cvt_f_sse2(f + i + 4, scale, lo, hi)));
+  }
+  store_f_s16_c(f + i, out + 2 * i, n - i, conv);
+}
+
+static void store_f_s32_sse2(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const __m128 scale = _mm_set1_ps(conv->out_scale);
+  const __m128 lo = _mm_set1_ps(conv->out_min);
+  const __m128 hi = _mm_set1_ps(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_si128((__m128i *)(out + 4 * i), pcm_cvt_f_sse2(f + i, scale, lo, hi));
+  }
+  store_f_s32_c(f + i, out + 4 * i, n - i, conv);
+}
+
+static const lhdcv5_pcm_ops_t pcm_ops_sse2 = {
+  load_q31_s16_sse2,
+  load_q31_s32_sse2,
+  store_q31_s16_sse2,
+  store_q31_s32_sse2,
+  load_f_s16_sse2,
+  load_f_s32_sse2,
+  store_f_s16_sse2,
+  store_f_s32_sse2,
+  "sse2",
+};
+#endif /* __SSE2__ */
+
+
+/*******************************************************************************
+ * AVX2 kernels, selected at run time
+ ******************************************************************************/
+#if defined(LHDCV5_PCM_HAVE_AVX2)
+#define PCM_AVX2 __attribute__((target("avx2")))
+
+PCM_AVX2 static void load_q31_s16_avx2(const uint8_t *in, void *tmp, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + 2 * i)));
+    _mm256_storeu_si256((__m256i *)(q + i), _mm256_slli_epi32(v, 16));
+  }
+  load_q31_s16_c(in + 2 * i, q + i, n - i, conv);
+}
+
+PCM_AVX2 static void load_q31_s32_avx2(const uint8_t *in, void *tmp, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const __m128i shift = _mm_cvtsi32_si128((int)conv->in_shift);
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm256_loadu_si256((const __m256i *)(in + 4 * i));
+    _mm256_storeu_si256((__m256i *)(q + i), _mm256_sll_epi32(v, shift));
+  }
+  load_q31_s32_c(in + 4 * i, q + i, n - i, conv);
+}
+
+PCM_AVX2 static inline __m256i pcm_round_shr_avx2(__m256i v, int shift)
+{
+  const __m256i one = _mm256_set1_epi32(1);
+  __m128i s = _mm_cvtsi32_si128(shift);
+  __m128i s1 = _mm_cvtsi32_si128(shift - 1);
+
+  return _mm256_add_epi32(_mm256_sra_epi32(v, s), _mm256_and_si256(_mm256_sra_epi32(v, s1), one));
+}
+
+PCM_AVX2 static void store_q31_s16_avx2(const void *tmp, uint8_t *out, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = pcm_round_shr_avx2(_mm256_loadu_si256((const __m256i *)(q + i)), 16);
+    _mm_storeu_si128((__m128i *)(out + 2 * i),
+        _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+  }
+  store_q31_s16_c(q + i, out + 2 * i, n - i, conv);
+}
+
+PCM_AVX2 static void store_q31_s32_avx2(const void *tmp, uint8_t *out, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  __m256i max, v;
+  uint32_t i = 0;
+
+  if (conv->out_shift == 0) {
+    store_q31_s32_c(tmp, out, n, conv);
+    return;
+  }
+
+  max = _mm256_set1_epi32((int32_t)(INT32_MAX >> conv->out_shift));
+  for (; i + 8 <= n; i += 8) {
+    v = pcm_round_shr_avx2(_mm256_loadu_si256((const __m256i *)(q + i)), (int)conv->out_shift);
+    _mm256_storeu_si256((__m256i *)(out + 4 * i), _mm256_min_epi32(v, max));
+  }
+  store_q31_s32_c(q + i, out + 4 * i, n - i, conv);
+}
+
+PCM_AVX2 static void load_f_s16_avx2(const uint8_t *in, void *tmp, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const __m256 scale = _mm256_set1_ps(conv->in_scale);
+  float *f = (float *)tmp;
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + 2 * i)));
+    _mm256_storeu_ps(f + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  load_f_s16_c(in + 2 * i, f + i, n - i, conv);
+}
+
+PCM_AVX2 static void load_f_s32_avx2(const uint8_t *in, void *tmp, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const __m256 scale = _mm256_set1_ps(conv->in_scale);
+  float *f = (float *)tmp;
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = _mm256_loadu_si256((const __m256i *)(in + 4 * i));
+    _mm256_storeu_ps(f + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  load_f_s32_c(in + 4 * i, f + i, n - i, conv);
+}
+
+PCM_AVX2 static inline __m256i pcm_cvt_f_avx2(const float *f, __m256 scale, __m256 lo, __m256 hi)
+{
+  __m256 v = _mm256_mul_ps(_mm256_loadu_ps(f), scale);
+
+  return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(v, lo), hi));
+}
+
+PCM_AVX2 static void store_f_s16_avx2(const void *tmp, uint8_t *out, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const __m256 scale = _mm256_set1_ps(conv->out_scale);
+  const __m256 lo = _mm256_set1_ps(conv->out_min);
+  const __m256 hi = _mm256_set1_ps(conv->out_max);
+  uint32_t i = 0;
+  __m256i v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = pcm_cvt_f_avx2(f + i, scale, lo, hi);
+    _mm_storeu_si128((__m128i *)(out + 2 * i),
+        _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+  }
+  store_f_s16_c(f + i, out + 2 * i, n - i, conv);
+}
+
+PCM_AVX2 static void store_f_s32_avx2(const void *tmp, uint8_t *out, uint32_t n,
+    lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const __m256 scale = _mm256_set1_ps(conv->out_scale);
+  const __m256 lo = _mm256_set1_ps(conv->out_min);
+  const __m256 hi = _mm256_set1_ps(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_si256((__m256i *)(out + 4 * i), pcm_cvt_f_avx2(f + i, scale, lo, hi));
+  }
+  store_f_s32_c(f + i, out + 4 * i, n - i, conv);
+}
+
+static const lhdcv5_pcm_ops_t pcm_ops_avx2 = {
+  load_q31_s16_avx2,
+  load_q31_s32_avx2,
+  store_q31_s16_avx2,
+  store_q31_s32_avx2,
+  load_f_s16_avx2,
+  load_f_s32_avx2,
+  store_f_s16_avx2,
+  store_f_s32_avx2,
+  "avx2",
+};
+#endif /* LHDCV5_PCM_HAVE_AVX2 */
+
+
+/*******************************************************************************
+ * NEON kernels
+ ******************************************************************************/
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+static void load_q31_s16_neon(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+  int16x8_t v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = vld1q_s16((const int16_t *)(in + 2 * i));
+    vst1q_s32(q + i, vshll_n_s16(vget_low_s16(v), 16));
+    vst1q_s32(q + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+  }
+  load_q31_s16_c(in + 2 * i, q + i, n - i, conv);
+}
+
+static void load_q31_s32_neon(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32x4_t shift = vdupq_n_s32((int32_t)conv->in_shift);
+  int32_t *q = (int32_t *)tmp;
+  uint32_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    vst1q_s32(q + i, vshlq_s32(vld1q_s32((const int32_t *)(in + 4 * i)), shift));
+  }
+  load_q31_s32_c(in + 4 * i, q + i, n - i, conv);
+}
+
+static void store_q31_s16_neon(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  uint32_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    vst1q_s16((int16_t *)(out + 2 * i),
+        vcombine_s16(vqrshrn_n_s32(vld1q_s32(q + i), 16),
+                     vqrshrn_n_s32(vld1q_s32(q + i + 4), 16)));
+  }
+  store_q31_s16_c(q + i, out + 2 * i, n - i, conv);
+}
+
+static void store_q31_s32_neon(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const int32_t *q = (const int32_t *)tmp;
+  int32x4_t shift, max;
+  uint32_t i = 0;
+
+  if (conv->out_shift == 0) {
+    store_q31_s32_c(tmp, out, n, conv);
+    return;
+  }
+
+  shift = vdupq_n_s32(-(int32_t)conv->out_shift);
+  max = vdupq_n_s32((int32_t)(INT32_MAX >> conv->out_shift));
+  for (; i + 4 <= n; i += 4) {
+    vst1q_s32((int32_t *)(out + 4 * i), vminq_s32(vrshlq_s32(vld1q_s32(q + i), shift), max));
+  }
+  store_q31_s32_c(q + i, out + 4 * i, n - i, conv);
+}
+
+static void load_f_s16_neon(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  float *f = (float *)tmp;
+  uint32_t i = 0;
+  int16x8_t v;
+
+  for (; i + 8 <= n; i += 8) {
+    v = vld1q_s16((const int16_t *)(in + 2 * i));
+    vst1q_f32(f + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), conv->in_scale));
+    vst1q_f32(f + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), conv->in_scale));
+  }
+  load_f_s16_c(in + 2 * i, f + i, n - i, conv);
+}
+
+static void load_f_s32_neon(const uint8_t *in, void *tmp, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  float *f = (float *)tmp;
+  uint32_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32(f + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32((const int32_t *)(in + 4 * i))),
+        conv->in_scale));
+  }
+  load_f_s32_c(in + 4 * i, f + i, n - i, conv);
+}
+
+static inline int32x4_t pcm_cvt_f_neon(const float *f, float scale, float32x4_t lo, float32x4_t hi)
+{
+  float32x4_t v = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(f), scale), lo), hi);
+
+#if defined(__aarch64__)
+  return vcvtnq_s32_f32(v);
+#else
+  // armv7 converts toward zero, round half away from zero instead
+  uint32x4_t neg = vcltq_f32(v, vdupq_n_f32(0.0f));
+  float32x4_t half = vbslq_f32(neg, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+  return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+
+static void store_f_s16_neon(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const float32x4_t lo = vdupq_n_f32(conv->out_min);
+  const float32x4_t hi = vdupq_n_f32(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    vst1q_s16((int16_t *)(out + 2 * i),
+        vcombine_s16(vqmovn_s32(pcm_cvt_f_neon(f + i, conv->out_scale, lo, hi)),
+                     vqmovn_s32(pcm_cvt_f_neon(f + i + 4, conv->out_scale, lo, hi))));
+  }
+  store_f_s16_c(f + i, out + 2 * i, n - i, conv);
+}
+
+static void store_f_s32_neon(const void *tmp, uint8_t *out, uint32_t n, lhdcv5_pcm_conv_t *conv)
+{
+  const float *f = (const float *)tmp;
+  const float32x4_t lo = vdupq_n_f32(conv->out_min);
+  const float32x4_t hi = vdupq_n_f32(conv->out_max);
+  uint32_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    vst1q_s32((int32_t *)(out + 4 * i), pcm_cvt_f_neon(f + i, conv->out_scale, lo, hi));
+  }
+  store_f_s32_c(f + i, out + 4 * i, n - i, conv);
+}
+
+static const lhdcv5_pcm_ops_t pcm_ops_neon = {
+  load_q31_s16_neon,
+  load_q31_s32_neon,
+  store_q31_s16_neon,
+  store_q31_s32_neon,
+  load_f_s16_neon,
+  load_f_s32_neon,
+  store_f_s16_neon,
+  store_f_s32_neon,
+  "neon",
+};
+#endif /* __ARM_NEON */
+
+
+/*******************************************************************************
+ * converter setup
+ ******************************************************************************/
+// kernel sets usable on this cpu, the scalar reference first and the
+// preferred one last
+static uint32_t pcm_list_ops(const lhdcv5_pcm_ops_t *list[LHDCV5_PCM_MAX_ISA])
+{
+  uint32_t num = 0;
+
+  list[num++] = &pcm_ops_c;
+#if defined(__SSE2__)
+  list[num++] = &pcm_ops_sse2;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  list[num++] = &pcm_ops_neon;
+#endif
+#if defined(LHDCV5_PCM_HAVE_AVX2)
+  if (__builtin_cpu_supports("avx2")) {
+    list[num++] = &pcm_ops_avx2;
+  }
+#endif
+
+  return num;
+}
+
+uint32_t lhdcv5_pcm_isa_num(void)
+{
+  const lhdcv5_pcm_ops_t *list[LHDCV5_PCM_MAX_ISA];
+
+  return pcm_list_ops(list);
+}
+
+const char *lhdcv5_pcm_isa_name(uint32_t isa)
+{
+  const lhdcv5_pcm_ops_t *list[LHDCV5_PCM_MAX_ISA];
+
+  if (isa >= pcm_list_ops(list)) {
+    return NULL;
+  }
+
+  return list[isa]->name;
+}
+
+uint32_t lhdcv5_pcm_layout_bytes(lhdcv5_pcm_layout_t layout)
+{
+  switch (layout) {
+    case LHDCV5_PCM_S16:
+      return 2;
+    case LHDCV5_PCM_S24_PACKED:
+      return 3;
+    case LHDCV5_PCM_S24_IN32:
+    case LHDCV5_PCM_S32:
+    case LHDCV5_PCM_FLOAT:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// full scale of an integer layout as float
+static float pcm_full_scale(lhdcv5_pcm_layout_t layout)
+{
+  switch (layout) {
+    case LHDCV5_PCM_S16:
+      return 32768.0f;
+    case LHDCV5_PCM_S24_IN32:
+    case LHDCV5_PCM_S24_PACKED:
+      return 8388608.0f;
+    case LHDCV5_PCM_S32:
+      return 2147483648.0f;
+    default:
+      return 1.0f;
+  }
+}
+
+
+// description
+//   set up conversion from decoder output layout to requested output layout
+//   with a given kernel set
+// Parameter
+//   conv: converter to set up
+//   in_layout: layout written by the decoder (S16, S24_IN32 or S32)
+//   out_layout: requested output layout
+//   gain_mb: output gain in millibel, 0 for unity
+//   dither: add TPDF dither when reducing a 24/32 bit stream to 16 bit
+//   isa: kernel set, below lhdcv5_pcm_isa_num
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5_pcm_conv_init_isa(lhdcv5_pcm_conv_t *conv, lhdcv5_pcm_layout_t in_layout,
+    lhdcv5_pcm_layout_t out_layout, int32_t gain_mb, bool dither, uint32_t isa)
+{
+  const lhdcv5_pcm_ops_t *list[LHDCV5_PCM_MAX_ISA];
+  const lhdcv5_pcm_ops_t *ops;
+  bool use_float;
+  float gain;
+
+  if ((conv == NULL) || (isa >= pcm_list_ops(list))) {
+    return -1;
+  }
+  ops = list[isa];
+
+  if ((in_layout != LHDCV5_PCM_S16) &&
+      (in_layout != LHDCV5_PCM_S24_IN32) &&
+      (in_layout != LHDCV5_PCM_S32)) {
+    return -1;
+  }
+
+  if ((lhdcv5_pcm_layout_bytes(out_layout) == 0) ||
+      (gain_mb < LHDCV5_PCM_GAIN_MB_MIN) || (gain_mb > LHDCV5_PCM_GAIN_MB_MAX)) {
+    return -1;
+  }
+
+  memset(conv, 0, sizeof(lhdcv5_pcm_conv_t));
+  conv->in_layout = in_layout;
+  conv->out_layout = out_layout;
+  conv->in_bytes = lhdcv5_pcm_layout_bytes(in_layout);
+  conv->out_bytes = lhdcv5_pcm_layout_bytes(out_layout);
+  conv->dither = dither && (out_layout == LHDCV5_PCM_S16) && (in_layout != LHDCV5_PCM_S16);
+  conv->rng = 0x12345678;
+  conv->isa = ops->name;
+
+  if ((in_layout == out_layout) && (gain_mb == 0)) {
+    conv->active = false;
+    return 0;
+  }
+
+  conv->active = true;
+  use_float = (gain_mb != 0) || (out_layout == LHDCV5_PCM_FLOAT);
+
+  if (!use_float) {
+    // bit exact integer path through a q31 intermediate
+    conv->in_shift = (in_layout == LHDCV5_PCM_S24_IN32) ? 8 : 0;
+    conv->load = (in_layout == LHDCV5_PCM_S16) ? ops->load_q31_s16 : ops->load_q31_s32;
+
+    switch (out_layout) {
+      case LHDCV5_PCM_S16:
+        conv->store = conv->dither ? store_q31_s16_dither_c : ops->store_q31_s16;
+        break;
+      case LHDCV5_PCM_S24_IN32:
+        conv->out_shift = 8;
+        conv->store = ops->store_q31_s32;
+        break;
+      case LHDCV5_PCM_S32:
+        conv->out_shift = 0;
+        conv->store = ops->store_q31_s32;
+        break;
+      case LHDCV5_PCM_S24_PACKED:
+      default:
+        conv->store = store_q31_s24p_c;
+        break;
+    }
+    return 0;
+  }
+
+  gain = powf(10.0f, (float)gain_mb / 2000.0f);
+  conv->in_scale = gain / pcm_full_scale(in_layout);
+  conv->load = (in_layout == LHDCV5_PCM_S16) ? ops->load_f_s16 : ops->load_f_s32;
+
+  conv->out_scale = pcm_full_scale(out_layout);
+  conv->out_min = -conv->out_scale;
+  conv->out_max = (out_layout == LHDCV5_PCM_S32) ? LHDCV5_PCM_S32_MAX_F : (conv->out_scale - 1.0f);
+
+  switch (out_layout) {
+    case LHDCV5_PCM_S16:
+      conv->store = conv->dither ? store_f_s16_dither_c : ops->store_f_s16;
+      break;
+    case LHDCV5_PCM_S24_IN32:
+    case LHDCV5_PCM_S32:
+      conv->store = ops->store_f_s32;
+      break;
+    case LHDCV5_PCM_S24_PACKED:
+      conv->store = store_f_s24p_c;
+      break;
+    case LHDCV5_PCM_FLOAT:
+    default:
+      conv->out_scale = 1.0f;
+      conv->store = store_f_f_c;
+      break;
+  }
+
+  return 0;
+}
+
+
+// description
+//   set up conversion from decoder output layout to requested output layout
+//   with the best kernel set of this cpu
+// Parameter
+//   conv: converter to set up
+//   in_layout: layout written by the decoder (S16, S24_IN32 or S32)
+//   out_layout: requested output layout
+//   gain_mb: output gain in millibel, 0 for unity
+//   dither: add TPDF dither when reducing a 24/32 bit stream to 16 bit
+// return:
+//   == 0: succeed
+//   < 0: error
+int32_t lhdcv5_pcm_conv_init(lhdcv5_pcm_conv_t *conv, lhdcv5_pcm_layout_t in_layout,
+    lhdcv5_pcm_layout_t out_layout, int32_t gain_mb, bool dither)
+{
+  return lhdcv5_pcm_conv_init_isa(conv, in_layout, out_layout, gain_mb, dither,
+      lhdcv5_pcm_isa_num() - 1);
+}
+
+
+// description
+//   convert samples in place. When the output layout is wider than the input
+//   one the buffer is walked backwards, so it must be large enough to hold
+//   samples * conv->out_bytes.
+// Parameter
+//   conv: converter from lhdcv5_pcm_conv_init
+//   buf: decoder output, replaced by converted samples
+//   samples: number of samples (all channels)
+void lhdcv5_pcm_convert(lhdcv5_pcm_conv_t *conv, uint8_t *buf, uint32_t samples)
+{
+  union {
+    int32_t q[LHDCV5_PCM_CHUNK_SAMPLES];
+    float f[LHDCV5_PCM_CHUNK_SAMPLES];
+  } tmp;
+  uint32_t start, n;
+
+  if ((conv == NULL) || !conv->active || (samples == 0)) {
+    return;
+  }
+
+  if (conv->out_bytes > conv->in_bytes) {
+    start = ((samples - 1) / LHDCV5_PCM_CHUNK_SAMPLES) * LHDCV5_PCM_CHUNK_SAMPLES;
+    for (;;) {
+      n = samples - start;
+      if (n > LHDCV5_PCM_CHUNK_SAMPLES) {
+        n = LHDCV5_PCM_CHUNK_SAMPLES;
+      }
+      conv->load(buf + start * conv->in_bytes, &tmp, n, conv);
+      conv->store(&tmp, buf + start * conv->out_bytes, n, conv);
+      if (start == 0) {
+        break;
+      }
+      start -= LHDCV5_PCM_CHUNK_SAMPLES;
+    }
+  } else {
+    for (start = 0; start < samples; start += n) {
+      n = samples - start;
+      if (n > LHDCV5_PCM_CHUNK_SAMPLES) {
+        n = LHDCV5_PCM_CHUNK_SAMPLES;
+      }
+      conv->load(buf + start * conv->in_bytes, &tmp, n, conv);
+      conv->store(&tmp, buf + start * conv->out_bytes, n, conv);
+    }
+  }
+}
@@ -0,0 +1,76 @@
+/*
+ * lhdcv5BT_dec_pcm.h
+ *
+ * In-place pcm output format conversion applied to every decoded frame.
+ */
+
+#ifndef LHDCV5BT_DEC_PCM_H
+#define LHDCV5BT_DEC_PCM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// samples converted per pass through the intermediate buffer
+#define LHDCV5_PCM_CHUNK_SAMPLES    64
+
+// kernel sets a build can carry: scalar, sse2 or neon, avx2
+#define LHDCV5_PCM_MAX_ISA          3
+
+// sample layouts handled by the converter
+typedef enum {
+  LHDCV5_PCM_S16 = 0,       // int16
+  LHDCV5_PCM_S24_IN32,      // 24 bit, sign extended in int32 (decoder output for 24 bit depth)
+  LHDCV5_PCM_S32,           // int32, full scale (also s24/s32 left-justified)
+  LHDCV5_PCM_S24_PACKED,    // 3 bytes little endian
+  LHDCV5_PCM_FLOAT,         // float32, full scale 1.0
+} lhdcv5_pcm_layout_t;
+
+struct _lhdcv5_pcm_conv;
+
+// first stage: in -> intermediate (q31 int32 or float32) of n samples
+typedef void (*lhdcv5_pcm_load_fn)(const uint8_t *in, void *tmp, uint32_t n,
+    struct _lhdcv5_pcm_conv *conv);
+// second stage: intermediate -> out of n samples
+typedef void (*lhdcv5_pcm_store_fn)(const void *tmp, uint8_t *out, uint32_t n,
+    struct _lhdcv5_pcm_conv *conv);
+
+typedef struct _lhdcv5_pcm_conv
+{
+  lhdcv5_pcm_layout_t in_layout;
+  lhdcv5_pcm_layout_t out_layout;
+  uint32_t in_bytes;        // bytes per input sample
+  uint32_t out_bytes;       // bytes per output sample
+  bool active;              // false: output is the decoder output as is
+  bool dither;              // TPDF dither when reducing to 16 bit
+  uint32_t in_shift;        // q31 path: left shift of input samples
+  uint32_t out_shift;       // q31 path: right shift of output samples
+  float in_scale;           // float path: gain / input full scale
+  float out_scale;          // float path: output full scale
+  float out_min;            // float path: output clamp range
+  float out_max;
+  uint32_t rng;             // dither noise state
+  lhdcv5_pcm_load_fn load;
+  lhdcv5_pcm_store_fn store;
+  const char *isa;          // kernel set picked at init, for logging
+} lhdcv5_pcm_conv_t;
+
+int32_t lhdcv5_pcm_conv_init(lhdcv5_pcm_conv_t *conv, lhdcv5_pcm_layout_t in_layout,
+    lhdcv5_pcm_layout_t out_layout, int32_t gain_mb, bool dither);
+
+// kernel sets usable on this cpu: 0 is the scalar reference, the last one is
+// what lhdcv5_pcm_conv_init picks; for benchmarks and reference checks
+uint32_t lhdcv5_pcm_isa_num(void);
+const char *lhdcv5_pcm_isa_name(uint32_t isa);
+int32_t lhdcv5_pcm_conv_init_isa(lhdcv5_pcm_conv_t *conv, lhdcv5_pcm_layout_t in_layout,
+    lhdcv5_pcm_layout_t out_layout, int32_t gain_mb, bool dither, uint32_t isa);
+uint32_t lhdcv5_pcm_layout_bytes(lhdcv5_pcm_layout_t layout);
+void lhdcv5_pcm_convert(lhdcv5_pcm_conv_t *conv, uint8_t *buf, uint32_t samples);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* End of LHDCV5BT_DEC_PCM_H */